@@ -0,0 +1,180 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "allocationcounter.h"
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QStringList>
+
+#include <cstdlib>
+#include <new>
+
+#if defined(Q_OS_WIN)
+    #include <windows.h>
+    #include <psapi.h>
+#elif defined(Q_OS_UNIX)
+    #include <sys/resource.h>
+#endif
+
+#include "debug.h"
+
+
+/// The number of allocations (zero-initialized before any allocation takes place)
+static QAtomicInt allocationCount;
+
+
+#if defined(__GLIBC__)
+
+// glibc allows replacing the allocation functions, the real implementation stays available via __libc_*
+extern "C" {
+    void* __libc_malloc( size_t size );
+    void* __libc_calloc( size_t count, size_t size );
+    void* __libc_realloc( void* ptr, size_t size );
+
+    void* malloc( size_t size )
+    {
+        allocationCount.ref();
+        return __libc_malloc( size );
+    }
+
+    void* calloc( size_t count, size_t size )
+    {
+        allocationCount.ref();
+        return __libc_calloc( count, size );
+    }
+
+    void* realloc( void* ptr, size_t size )
+    {
+        allocationCount.ref();
+        return __libc_realloc( ptr, size );
+    }
+}
+
+#else
+
+// only the C++ allocations can be counted portably
+void* operator new( size_t size )
+{
+    allocationCount.ref();
+    void* ptr = std::malloc( size ? size : 1 );
+    if( !ptr ) { throw std::bad_alloc(); }
+    return ptr;
+}
+
+void* operator new[]( size_t size )
+{
+    allocationCount.ref();
+    void* ptr = std::malloc( size ? size : 1 );
+    if( !ptr ) { throw std::bad_alloc(); }
+    return ptr;
+}
+
+void* operator new( size_t size, const std::nothrow_t& ) throw()
+{
+    allocationCount.ref();
+    return std::malloc( size ? size : 1 );
+}
+
+void* operator new[]( size_t size, const std::nothrow_t& ) throw()
+{
+    allocationCount.ref();
+    return std::malloc( size ? size : 1 );
+}
+
+void operator delete( void* ptr ) throw()
+{
+    std::free( ptr );
+}
+
+void operator delete[]( void* ptr ) throw()
+{
+    std::free( ptr );
+}
+
+void operator delete( void* ptr, const std::nothrow_t& ) throw()
+{
+    std::free( ptr );
+}
+
+void operator delete[]( void* ptr, const std::nothrow_t& ) throw()
+{
+    std::free( ptr );
+}
+
+#endif
+
+
+namespace edbee {
+
+
+/// Returns the number of allocations since the start of the process. (The counter wraps, use differences)
+unsigned int AllocationCounter::count()
+{
+    return static_cast<unsigned int>( allocationCount.fetchAndAddOrdered(0) );
+}
+
+
+/// Returns a description of the counted allocations
+QString AllocationCounter::method()
+{
+#if defined(__GLIBC__)
+    return "malloc";
+#else
+    return "operator new";
+#endif
+}
+
+
+/// Resets the peak memory usage of the process to the current memory usage.
+/// This is only supported on linux (via /proc/self/clear_refs)
+/// @return true if the peak is reset
+bool AllocationCounter::resetPeakMemory()
+{
+#if defined(Q_OS_LINUX)
+    QFile file( "/proc/self/clear_refs" );
+    if( !file.open( QIODevice::WriteOnly ) ) { return false; }
+    return file.write( "5" ) == 1;
+#else
+    return false;
+#endif
+}
+
+
+/// Returns the peak memory usage (resident set size) of the process in KB. Returns -1 if this isn't available
+qint64 AllocationCounter::peakMemoryKb()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) ) {
+        return counters.PeakWorkingSetSize / 1024;
+    }
+    return -1;
+#elif defined(Q_OS_MAC)
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) == 0 ) { return usage.ru_maxrss / 1024; }   // bytes on mac
+    return -1;
+#elif defined(Q_OS_UNIX)
+  #if defined(Q_OS_LINUX)
+    // the VmHWM line is the peak since the last resetPeakMemory, ru_maxrss can't be reset
+    QFile file( "/proc/self/status" );
+    if( file.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+        foreach( QByteArray line, file.readAll().split('\n') ) {
+            if( line.startsWith("VmHWM:") ) {
+                return line.mid(6).trimmed().split(' ').first().toLongLong();      // "VmHWM:   1234 kB"
+            }
+        }
+    }
+  #endif
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) == 0 ) { return usage.ru_maxrss; }          // KB on linux
+    return -1;
+#else
+    return -1;
+#endif
+}
+
+
+} // edbee
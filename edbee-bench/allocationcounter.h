@@ -0,0 +1,27 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QString>
+
+namespace edbee {
+
+
+/// Counts the heap allocations of the benchmark process.
+///
+/// With glibc every malloc, calloc and realloc call is counted (this includes the data of the Qt containers).
+/// On other platforms only the C++ operator new calls are counted.
+class AllocationCounter
+{
+public:
+    static unsigned int count();
+    static QString method();
+    static bool resetPeakMemory();
+    static qint64 peakMemoryKb();
+};
+
+
+} // edbee
@@ -0,0 +1,48 @@
+
+QT  += core gui
+QT  -= sql
+QT  += widgets
+
+TARGET = edbee-bench
+TEMPLATE = app
+CONFIG += console
+
+
+# This seems to be required for Windows
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+DEFINES += QT_NODLL
+
+
+# The benchmark sources
+SOURCES += \
+	allocationcounter.cpp \
+	lexerbenchmark.cpp \
+	main.cpp
+
+HEADERS += \
+	allocationcounter.h \
+	lexerbenchmark.h
+
+# The peak memory usage on windows
+win32: LIBS += -lpsapi
+
+
+## Extra dependencies
+##====================
+include(../vendor/qslog/QsLog.pri)
+
+
+## edbee-lib dependency
+##=======================
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../edbee-lib/release/ -ledbee
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../edbee-lib/debug/ -ledbee
+else:unix:!symbian: LIBS += -L$$OUT_PWD/../edbee-lib/ -ledbee
+
+INCLUDEPATH += $$PWD/../edbee-lib
+DEPENDPATH += $$PWD/../edbee-lib
+
+win32:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../edbee-lib/release/edbee.lib
+else:win32:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../edbee-lib/debug/edbee.lib
+else:unix:!symbian: PRE_TARGETDEPS += $$OUT_PWD/../edbee-lib/libedbee.a
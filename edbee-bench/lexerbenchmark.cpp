@@ -0,0 +1,723 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "lexerbenchmark.h"
+
+#include <limits>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QStringList>
+#include <QTextStream>
+
+#include "edbee/io/baseplistparser.h"
+#include "edbee/io/jsonparser.h"
+#include "edbee/io/tmlanguageparser.h"
+#include "edbee/lexers/grammarlexerstatistics.h"
+#include "edbee/lexers/grammartextlexer.h"
+#include "edbee/models/chardocument/chartextdocument.h"
+#include "edbee/models/textdocumentscopes.h"
+#include "edbee/models/textgrammar.h"
+#include "edbee/util/regexp.h"
+#include "edbee/edbee.h"
+#include "allocationcounter.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Reads a plist into a variant tree. (The way the grammar parser worked before it was streaming)
+class PListVariantReader : public BasePListParser
+{
+public:
+    QVariant read( QIODevice* device )
+    {
+        QVariant result;
+        if( beginParsing(device) ) { result = readNextPlistType(); }
+        endParsing();
+        return result;
+    }
+};
+
+
+/// The format version of a baseline file
+static const int BaselineVersion = 2;
+
+
+/// A small deterministic random generator, so the generated corpora are the same on every platform
+class CorpusRandom
+{
+public:
+    /// Constructs the generator with the given seed
+    CorpusRandom( quint32 seed ) : state_( seed ) {}
+
+    /// Returns a number in the range [0,max)
+    int next( int max )
+    {
+        state_ = state_ * 1664525u + 1013904223u;
+        return static_cast<int>( ( state_ >> 8 ) % static_cast<quint32>( max ) );
+    }
+
+    /// Returns one of the given words
+    QString pick( const QStringList& words )
+    {
+        return words.at( next( words.size() ) );
+    }
+
+private:
+    quint32 state_;     ///< The state of the linear congruential generator
+};
+
+
+/// Constructs an empty result
+LexerBenchmarkResult::LexerBenchmarkResult()
+    : lineCount(0)
+    , charCount(0)
+    , nsecs(0)
+    , linesPerSecond(0)
+    , searchesPerLine(0)
+    , allocationsPerLine(0)
+    , peakMemoryKb(-1)
+    , parallelLexing(-1)
+{
+}
+
+
+//=================================================
+
+
+/// Constructs the benchmark
+LexerBenchmark::LexerBenchmark()
+    : iterations_(3)
+    , parallelLexingSet_(false)
+    , parallelLexingEnabled_(false)
+{
+}
+
+
+/// Sets the number of times every corpus is lexed. The fastest time is reported
+void LexerBenchmark::setIterations( int iterations )
+{
+    iterations_ = qMax( 1, iterations );
+}
+
+
+/// Enables or disables parallel lexing. Without this call the default mode of the lexer is used
+void LexerBenchmark::setParallelLexingEnabled( bool enabled )
+{
+    parallelLexingSet_ = true;
+    parallelLexingEnabled_ = enabled;
+}
+
+
+/// Adds the generated corpora: C++, JSON, HTML, minified javascript and a large log file
+/// @param scale a multiplier for the number of lines of the corpora
+void LexerBenchmark::addGeneratedCorpora( int scale )
+{
+    scale = qMax( 1, scale );
+    addCorpus( "cpp", "bench.cpp", generateCppCorpus( 20000 * scale ) );
+    addCorpus( "json", "bench.json", generateJsonCorpus( 20000 * scale ) );
+    addCorpus( "html", "bench.html", generateHtmlCorpus( 10000 * scale ) );
+    addCorpus( "minified-js", "bench.min.js", generateMinifiedJsCorpus( 100 * scale, 10000 ) );
+    addCorpus( "log", "bench.log", generateLogCorpus( 100000 * scale ) );
+}
+
+
+/// Adds the given file as corpus. The grammar is detected with the filename
+/// @param fileName the file to add
+/// @return false if the file couldn't be read
+bool LexerBenchmark::addCorpusFile( const QString& fileName )
+{
+    QFile file( fileName );
+    if( !file.open( QIODevice::ReadOnly ) ) { return false; }
+    QTextStream stream( &file );
+    stream.setCodec( "UTF-8" );
+    QFileInfo fileInfo( fileName );
+    addCorpus( fileInfo.fileName(), fileInfo.fileName(), stream.readAll() );
+    file.close();
+    return true;
+}
+
+
+/// Adds a text to lex
+/// @param name the name of the corpus
+/// @param fileName the filename that's used to detect the grammar
+/// @param text the text to lex
+void LexerBenchmark::addCorpus( const QString& name, const QString& fileName, const QString& text )
+{
+    LexerBenchmarkCorpus corpus;
+    corpus.name = name;
+    corpus.fileName = fileName;
+    corpus.text = text;
+    corpusList_.append( corpus );
+}
+
+
+/// Lexes all corpora
+void LexerBenchmark::run()
+{
+    resultList_.clear();
+    foreach( const LexerBenchmarkCorpus& corpus, corpusList_ ) {
+        resultList_.append( runCorpus( corpus ) );
+    }
+}
+
+
+/// Returns the results of the last run
+QList<LexerBenchmarkResult> LexerBenchmark::results() const
+{
+    return resultList_;
+}
+
+
+/// Returns a readable table with the results
+QString LexerBenchmark::resultsAsString() const
+{
+    QString result = QString("%1 %2 %3 %4 %5 %6 %7 %8  %9\n")
+        .arg("corpus",-14).arg("mode",8).arg("lines",8).arg("ms",9).arg("lines/s",11).arg("search/ln",9).arg("alloc/ln",9).arg("peak(MB)",9).arg("grammar");
+    foreach( const LexerBenchmarkResult& res, resultList_ ) {
+        result.append( QString("%1 %2 %3 %4 %5 %6 %7 %8  %9\n")
+            .arg(res.name,-14)
+            .arg(res.parallelLexing > 0 ? QString("parallel") : QString("serial"), 8)
+            .arg(res.lineCount,8)
+            .arg(res.nsecs / 1000000.0, 9, 'f', 1 )
+            .arg(res.linesPerSecond, 11, 'f', 0 )
+            .arg(res.searchesPerLine, 9, 'f', 2 )
+            .arg(res.allocationsPerLine, 9, 'f', 2 )
+            .arg(res.peakMemoryKb < 0 ? QString("-") : QString::number( res.peakMemoryKb / 1024.0, 'f', 1 ), 9 )
+            .arg(res.grammarName) );
+    }
+    result.append( QString("(allocations counted via %1, the peak memory is the peak resident size while lexing the corpus)\n").arg( AllocationCounter::method() ) );
+    return result;
+}
+
+
+/// Writes the results as json baseline file
+/// @param fileName the baseline file to write
+/// @return true on success
+bool LexerBenchmark::writeBaseline( const QString& fileName ) const
+{
+    QVariantMap corpora;
+    foreach( const LexerBenchmarkResult& res, resultList_ ) {
+        QVariantMap values;
+        values.insert( "linesPerSecond", qRound64( res.linesPerSecond ) );
+        values.insert( "searchesPerLine", res.searchesPerLine );
+        values.insert( "allocationsPerLine", res.allocationsPerLine );
+        if( res.peakMemoryKb >= 0 ) { values.insert( "peakMemoryKb", res.peakMemoryKb ); }
+        values.insert( "parallelLexing", res.parallelLexing > 0 );
+        corpora.insert( res.name, values );
+    }
+    QVariantMap baseline;
+    baseline.insert( "version", BaselineVersion );
+    baseline.insert( "corpora", corpora );
+
+    QFile file( fileName );
+    if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) { return false; }
+    file.write( QJsonDocument::fromVariant( baseline ).toJson() );
+    file.close();
+    return file.error() == QFile::NoError;
+}
+
+
+/// Compares the results with the given baseline.
+/// A corpus regresses when it's throughput is lower, or when it uses more searches, allocations per line or memory than the baseline (plus the tolerance).
+/// The values that are missing in the baseline aren't compared. A corpus that's lexed in another mode (serial/parallel)
+/// than the baseline isn't compared, and a corpus without baseline values is reported as such (it never passes as ok)
+/// @param fileName the baseline file
+/// @param tolerance the allowed difference (0.1 is 10%)
+/// @param report (out) the comparison report
+/// @return the number of regressions or -1 if the baseline couldn't be read
+int LexerBenchmark::compareWithBaseline( const QString& fileName, double tolerance, QString& report ) const
+{
+    bool ok = false;
+    QMap<QString,LexerBenchmarkResult> baseline = readBaseline( fileName, ok );
+    if( !ok ) {
+        report = QString("Error reading baseline %1\n").arg(fileName);
+        return -1;
+    }
+
+    int regressionCount = 0;
+    report = QString("%1 %2 %3 %4 %5\n").arg("corpus",-14).arg("lines/s",18).arg("search/ln",18).arg("alloc/ln",18).arg("peak",18);
+    foreach( const LexerBenchmarkResult& res, resultList_ ) {
+        if( !baseline.contains( res.name ) ) {
+            report.append( QString("%1 (not in baseline)\n").arg(res.name,-14) );
+            continue;
+        }
+        const LexerBenchmarkResult& base = baseline[res.name];
+        if( base.parallelLexing >= 0 && base.parallelLexing != res.parallelLexing ) {
+            report.append( QString("%1 (lexed %2, the baseline is %3)\n").arg(res.name,-14)
+                .arg(res.parallelLexing > 0 ? QString("parallel") : QString("serial"))
+                .arg(base.parallelLexing > 0 ? QString("parallel") : QString("serial")) );
+            continue;
+        }
+        if( base.linesPerSecond < 0 && base.searchesPerLine < 0 && base.allocationsPerLine < 0 && base.peakMemoryKb < 0 ) {
+            report.append( QString("%1 (no values in baseline)\n").arg(res.name,-14) );
+            continue;
+        }
+        QStringList problems;
+        if( base.linesPerSecond >= 0 && res.linesPerSecond < base.linesPerSecond * ( 1.0 - tolerance ) ) { problems.append("throughput"); }
+        if( base.searchesPerLine >= 0 && res.searchesPerLine > base.searchesPerLine * ( 1.0 + tolerance ) ) { problems.append("searches"); }
+        if( base.allocationsPerLine >= 0 && res.allocationsPerLine > base.allocationsPerLine * ( 1.0 + tolerance ) ) { problems.append("allocations"); }
+        if( base.peakMemoryKb >= 0 && res.peakMemoryKb > base.peakMemoryKb * ( 1.0 + tolerance ) ) { problems.append("memory"); }
+
+        QString delta1 = base.linesPerSecond > 0 ? QString("%1%").arg( 100.0 * ( res.linesPerSecond / base.linesPerSecond - 1.0 ), 0, 'f', 1 ) : QString("-");
+        QString delta2 = base.searchesPerLine > 0 ? QString("%1%").arg( 100.0 * ( res.searchesPerLine / base.searchesPerLine - 1.0 ), 0, 'f', 1 ) : QString("-");
+        QString delta3 = base.allocationsPerLine > 0 ? QString("%1%").arg( 100.0 * ( res.allocationsPerLine / base.allocationsPerLine - 1.0 ), 0, 'f', 1 ) : QString("-");
+        QString delta4 = base.peakMemoryKb > 0 && res.peakMemoryKb >= 0 ? QString("%1%").arg( 100.0 * ( double( res.peakMemoryKb ) / base.peakMemoryKb - 1.0 ), 0, 'f', 1 ) : QString("-");
+        report.append( QString("%1 %2 %3 %4 %5  %6\n")
+            .arg(res.name,-14)
+            .arg(delta1,18)
+            .arg(delta2,18)
+            .arg(delta3,18)
+            .arg(delta4,18)
+            .arg(problems.isEmpty() ? QString("ok") : QString("REGRESSION: %1").arg(problems.join(", ")) ) );
+        if( !problems.isEmpty() ) { ++regressionCount; }
+    }
+    return regressionCount;
+}
+
+
+/// Lexes a text with a mix of languages with every loaded grammar, with the individual searches of the grammar rules
+/// and with the multi-pattern scan. Reports the (fastest) durations of both scan methods.
+/// @param report (out) the report with the durations per grammar
+/// @return the number of grammars where the scan methods give different scopes
+int LexerBenchmark::compareScanModes( QString& report ) const
+{
+    QString text = generateMixedCorpus( 1000 );
+    int differenceCount = 0;
+    qint64 totalNsecs[2] = { 0, 0 };
+    report = QString("%1 %2 %3\n").arg("grammar",-30).arg("individual(ms)",15).arg("combined(ms)",15);
+    foreach( TextGrammar* grammar, Edbee::instance()->grammarManager()->grammars() ) {
+        grammar->mainRule();    // (loads a lazy grammar, this isn't part of the measurements)
+        CharTextDocument doc;
+        doc.setLanguageGrammar( grammar );
+        doc.setText( text );
+        GrammarTextLexer* lexer = dynamic_cast<GrammarTextLexer*>( doc.textLexer() );
+        Q_ASSERT(lexer);
+
+        qint64 nsecs[2];
+        QStringList scopes[2];
+        for( int mode=0; mode < 2; ++mode ) {
+            lexer->setMultiPatternScanEnabled( mode == 1 );
+            nsecs[mode] = std::numeric_limits<qint64>::max();
+            for( int i=0; i<iterations_; ++i ) {
+                doc.scopes()->removeScopesAfterOffset(0);
+                QElapsedTimer timer;
+                timer.start();
+                lexer->lexRange( 0, doc.length() );
+                nsecs[mode] = qMin( nsecs[mode], timer.nsecsElapsed() );
+            }
+            scopes[mode] = doc.scopes()->scopesAsStringList();
+            totalNsecs[mode] += nsecs[mode];
+        }
+
+        bool equal = scopes[0] == scopes[1];
+        if( !equal ) { ++differenceCount; }
+        report.append( QString("%1 %2 %3  %4\n")
+            .arg(grammar->name(),-30)
+            .arg(nsecs[0] / 1000000.0, 15, 'f', 2 )
+            .arg(nsecs[1] / 1000000.0, 15, 'f', 2 )
+            .arg(equal ? QString("") : QString("DIFFERENT SCOPES")) );
+    }
+    report.append( QString("%1 %2 %3\n")
+        .arg("total",-30)
+        .arg(totalNsecs[0] / 1000000.0, 15, 'f', 2 )
+        .arg(totalNsecs[1] / 1000000.0, 15, 'f', 2 ) );
+    return differenceCount;
+}
+
+
+/// Compiles the match and begin patterns of a plist variant tree, like the old parser did when it built the grammar
+/// from the variant tree. (The streaming parser compiles the same patterns while it builds the rules)
+/// @param value the variant tree (or a part of it)
+/// @return false if a pattern isn't a valid regexp
+static bool compileVariantRegExps( const QVariant& value )
+{
+    bool ok = true;
+    if( value.type() == QVariant::Map ) {
+        QVariantMap map = value.toMap();
+        for( QVariantMap::const_iterator itr = map.constBegin(); itr != map.constEnd(); ++itr ) {
+            if( ( itr.key() == "match" || itr.key() == "begin" ) && itr.value().type() == QVariant::String ) {
+                RegExp* regExp = TextGrammarRule::createRegExp( itr.value().toString() );
+                ok = regExp->isValid() && ok;
+                delete regExp;
+            } else {
+                ok = compileVariantRegExps( itr.value() ) && ok;
+            }
+        }
+    } else if( value.type() == QVariant::List ) {
+        foreach( const QVariant& item, value.toList() ) { ok = compileVariantRegExps( item ) && ok; }
+    }
+    return ok;
+}
+
+
+/// The costs of parsing a single grammar file
+struct GrammarParseCost {
+    GrammarParseCost() : nsecs( std::numeric_limits<qint64>::max() ), allocations(0), peakMemoryKb(-1) {}
+    qint64 nsecs;               ///< The fastest duration
+    unsigned int allocations;   ///< The number of allocations of a single parse
+    qint64 peakMemoryKb;        ///< The growth of the peak memory usage while parsing (-1 if unknown)
+};
+
+
+/// Parses the file of every lazy grammar with the streaming grammar parser and with the old method: building the
+/// variant tree of the file and compiling the regexps of the tree. (Both paths compile the same regexps, so the
+/// durations are comparable). Reports the fastest durations, the allocations and the peak memory growth of both.
+/// @param report (out) the report with the costs per grammar
+/// @return the number of grammar files that couldn't be parsed
+int LexerBenchmark::compareGrammarParsing( QString& report ) const
+{
+    int errorCount = 0;
+    qint64 totalNsecs[2] = { 0, 0 };
+    quint64 totalAllocations[2] = { 0, 0 };
+    report = QString("%1 %2 %3 %4 %5 %6 %7\n").arg("grammar",-30)
+        .arg("streaming(ms)",14).arg("allocs",9).arg("peak(KB)",9)
+        .arg("variant(ms)",12).arg("allocs",9).arg("peak(KB)",9);
+    foreach( TextGrammar* grammar, Edbee::instance()->grammarManager()->grammars() ) {
+        if( grammar->fileName().isEmpty() ) { continue; }
+
+        GrammarParseCost cost[2];
+        bool ok = true;
+        for( int i=0; i<iterations_; ++i ) {
+            for( int path=0; path<2; ++path ) {
+
+                // the peak memory and allocations are measured in the first iteration, the fastest run counts
+                bool peakReset = i == 0 && AllocationCounter::resetPeakMemory();
+                qint64 peakStart = AllocationCounter::peakMemoryKb();
+                unsigned int allocationStart = AllocationCounter::count();
+                QElapsedTimer timer;
+                timer.start();
+                if( path == 0 ) {
+                    TmLanguageParser parser;
+                    TextGrammar* parsedGrammar = parser.parse( grammar->fileName() );
+                    ok = ok && parsedGrammar;
+                    delete parsedGrammar;
+                } else {
+                    QFile file( grammar->fileName() );
+                    PListVariantReader reader;
+                    QVariant tree = file.open( QIODevice::ReadOnly ) ? reader.read( &file ) : QVariant();
+                    ok = ok && tree.isValid() && compileVariantRegExps( tree );
+                }
+                cost[path].nsecs = qMin( cost[path].nsecs, timer.nsecsElapsed() );
+                if( i == 0 ) {
+                    cost[path].allocations = AllocationCounter::count() - allocationStart;
+                    if( peakReset ) { cost[path].peakMemoryKb = AllocationCounter::peakMemoryKb() - peakStart; }
+                }
+            }
+        }
+        if( !ok ) { ++errorCount; }
+        QString line = QString("%1").arg(grammar->name(),-30);
+        for( int path=0; path<2; ++path ) {
+            totalNsecs[path] += cost[path].nsecs;
+            totalAllocations[path] += cost[path].allocations;
+            line.append( QString(" %1 %2 %3")
+                .arg(cost[path].nsecs / 1000000.0, path == 0 ? 14 : 12, 'f', 2 )
+                .arg(cost[path].allocations, 9 )
+                .arg(cost[path].peakMemoryKb < 0 ? QString("-") : QString::number( cost[path].peakMemoryKb ), 9 ) );
+        }
+        report.append( line ).append( ok ? QString("\n") : QString("  PARSE ERROR\n") );
+    }
+    report.append( QString("%1 %2 %3 %4 %5 %6\n")
+        .arg("total",-30)
+        .arg(totalNsecs[0] / 1000000.0, 14, 'f', 2 )
+        .arg(totalAllocations[0], 9 )
+        .arg("",9)
+        .arg(totalNsecs[1] / 1000000.0, 12, 'f', 2 )
+        .arg(totalAllocations[1], 9 ) );
+    report.append( QString("(allocations counted via %1, the peak is the growth of the peak resident size while parsing)\n").arg( AllocationCounter::method() ) );
+    return errorCount;
+}
+
+
+/// Generates C++ code with classes, templates, comments, strings, numbers and preprocessor lines
+/// @param lineCount the (minimal) number of lines
+QString LexerBenchmark::generateCppCorpus( int lineCount )
+{
+    CorpusRandom random(1);
+    QStringList types = QStringList() << "int" << "double" << "QString" << "std::string" << "unsigned long";
+    QString result;
+    int lines = 0;
+    for( int i=0; lines < lineCount; ++i ) {
+        QString type = random.pick( types );
+        result.append( QString(
+            "// ----- module %1 -----\n"
+            "#include <vector>\n"
+            "#include \"module%1.h\"\n"
+            "\n"
+            "namespace bench {\n"
+            "\n"
+            "/// A generated class %1\n"
+            "template<typename T>\n"
+            "class Widget%1 : public Base\n"
+            "{\n"
+            "public:\n"
+            "    Widget%1( %2 value ) : value_( value ), name_( \"widget %1\\n\" ) {}\n"
+            "    virtual ~Widget%1() {}\n"
+            "\n"
+            "    int compute( const std::vector<T>& items ) const\n"
+            "    {\n"
+            "        int result = 0x%3;  /* start value */\n"
+            "        for( size_t i=0; i<items.size(); ++i ) {\n"
+            "            if( items[i] > %4.5f && value_ != 'x' ) { result += static_cast<int>( items[i] ) * %5; }\n"
+            "        }\n"
+            "        return result;\n"
+            "    }\n"
+            "\n"
+            "private:\n"
+            "    %2 value_;      // the value\n"
+            "    const char* name_;\n"
+            "};\n"
+            "\n"
+            "#define WIDGET_%1_SIZE (%5 * sizeof(Widget%1<int>))\n"
+            "\n"
+            "} // bench\n"
+            "\n" )
+            .arg(i)
+            .arg(type)
+            .arg(random.next(0xffff),0,16)
+            .arg(random.next(1000))
+            .arg(random.next(100)) );
+        lines += 32;
+    }
+    return result;
+}
+
+
+/// Generates a JSON document with an array of nested objects
+/// @param lineCount the (minimal) number of lines
+QString LexerBenchmark::generateJsonCorpus( int lineCount )
+{
+    CorpusRandom random(2);
+    QStringList words = QStringList() << "alpha" << "beta" << "gamma" << "delta" << "epsilon";
+    QString result("[\n");
+    int lines = 1;
+    for( int i=0; lines < lineCount; ++i ) {
+        if( i ) { result.append(",\n"); }
+        result.append( QString(
+            "  {\n"
+            "    \"id\": %1,\n"
+            "    \"name\": \"item \\\"%2\\\"\",\n"
+            "    \"active\": %3,\n"
+            "    \"score\": %4.%5e3,\n"
+            "    \"tags\": [\"%6\", \"%7\", null],\n"
+            "    \"nested\": { \"x\": -%8, \"path\": \"c:\\\\temp\\\\%1\" }\n"
+            "  }" )
+            .arg(i)
+            .arg(random.pick(words))
+            .arg(random.next(2) ? "true" : "false")
+            .arg(random.next(100))
+            .arg(random.next(10))
+            .arg(random.pick(words))
+            .arg(random.pick(words))
+            .arg(random.next(1000)) );
+        lines += 8;
+    }
+    result.append("\n]\n");
+    return result;
+}
+
+
+/// Generates a HTML document with attributes, entities, comments and embedded css and javascript
+/// @param lineCount the (minimal) number of lines
+QString LexerBenchmark::generateHtmlCorpus( int lineCount )
+{
+    CorpusRandom random(3);
+    QString result(
+        "<!DOCTYPE html>\n"
+        "<html>\n"
+        "<head>\n"
+        "<title>Benchmark</title>\n"
+        "<style type=\"text/css\">\n"
+        "  body { font-family: \"Helvetica\", sans-serif; margin: 0 4px; }\n"
+        "  .item:hover { color: #a0b0c0; }\n"
+        "</style>\n"
+        "</head>\n"
+        "<body>\n" );
+    int lines = 10;
+    for( int i=0; lines < lineCount; ++i ) {
+        int value = random.next(100);
+        result.append( QString(
+            "<!-- section %1 -->\n"
+            "<div class=\"item item-%1\" id=\"d%1\" data-value='%2'>\n"
+            "  <p>Paragraph %1 with <b>bold</b> &amp; <a href=\"http://example.com/%1?a=1&amp;b=2\">a link</a></p>\n"
+            "  <input type=\"text\" name=\"field%1\" value=\"v%2\" disabled>\n"
+            "  <script type=\"text/javascript\">\n"
+            "    document.getElementById(\"d%1\").onclick = function() { return %2 > 10 ? \"yes\" : 'no'; };\n"
+            "  </script>\n"
+            "</div>\n" )
+            .arg(i)
+            .arg(value) );
+        lines += 8;
+    }
+    result.append( "</body>\n</html>\n" );
+    return result;
+}
+
+
+/// Generates minified javascript: very long lines with functions, strings and regular expressions
+/// @param lineCount the number of lines
+/// @param lineLength the (minimal) length of a line
+QString LexerBenchmark::generateMinifiedJsCorpus( int lineCount, int lineLength )
+{
+    CorpusRandom random(4);
+    QString result;
+    for( int line=0; line < lineCount; ++line ) {
+        int start = result.length();
+        for( int i=0; result.length() - start < lineLength; ++i ) {
+            result.append( QString( "function a%1(b,c){var d=\"s%1\\n\",e=/ab+c[0-9]{%2}/g;if(b>c&&!d){return d.replace(e,'x')}return c+%3*b.length};" )
+                .arg(line * 1000 + i)
+                .arg(random.next(9) + 1)
+                .arg(random.next(1000)) );
+        }
+        result.append("\n");
+    }
+    return result;
+}
+
+
+/// Generates a log file with timestamps, levels, quoted strings and numbers
+/// @param lineCount the number of lines
+QString LexerBenchmark::generateLogCorpus( int lineCount )
+{
+    CorpusRandom random(5);
+    QStringList levels = QStringList() << "INFO " << "INFO " << "INFO " << "DEBUG" << "WARN " << "ERROR";
+    QString result;
+    for( int i=0; i < lineCount; ++i ) {
+        QString level = random.pick( levels );
+        result.append( QString( "2013-05-12 10:%1:%2.%3 [%4] [worker-%5] Request GET \"/api/items/%6\" from 192.168.%7.%8 completed in %9 ms" )
+            .arg( (i/60000)%60, 2, 10, QChar('0') )
+            .arg( (i/1000)%60, 2, 10, QChar('0') )
+            .arg( i%1000, 3, 10, QChar('0') )
+            .arg( level )
+            .arg( random.next(16) )
+            .arg( random.next(100000) )
+            .arg( random.next(256) )
+            .arg( random.next(256) )
+            .arg( random.next(2000) ) );
+        result.append( QString(" (status=%1)\n").arg( level == "ERROR" ? 500 : 200 ) );
+        if( level == "ERROR" ) {
+            result.append( "java.lang.IllegalStateException: Invalid state 'closed'\n" );
+            result.append( QString( "    at net.edbee.Service.handle(Service.java:%1)\n" ).arg( random.next(500) ) );
+            i += 2;
+        }
+    }
+    return result;
+}
+
+
+/// Generates a text with fragments of several languages (C, HTML, javascript, python, yaml). Every grammar finds
+/// something to match in this text
+/// @param lineCount the (minimal) number of lines
+QString LexerBenchmark::generateMixedCorpus( int lineCount )
+{
+    QString result;
+    for( int i=0; i < lineCount; i += 8 ) {
+        result.append( "#include <stdio.h>\n<!-- html --><div class=\"x\">text</div>\n" );
+        result.append( "function test( a, b ) { return a + 12.5 * b; } // comment\n" );
+        result.append( "/* block\n comment */ if( x == 'str' ) { print(\"hello\\n\"); }\n" );
+        result.append( "def method(arg): # python/ruby\n  key: value\n  - item\n" );
+    }
+    return result;
+}
+
+
+/// Lexes a single corpus
+/// @param corpus the corpus to lex
+/// @return the measurements
+LexerBenchmarkResult LexerBenchmark::runCorpus( const LexerBenchmarkCorpus& corpus )
+{
+    LexerBenchmarkResult result;
+    result.name = corpus.name;
+
+    TextGrammar* grammar = Edbee::instance()->grammarManager()->detectGrammarWithFilename( corpus.fileName );
+    result.grammarName = grammar->name();
+
+    CharTextDocument doc;
+    doc.setLanguageGrammar( grammar );
+    doc.setText( corpus.text );
+    result.lineCount = doc.lineCount();
+    result.charCount = doc.length();
+
+    GrammarTextLexer* lexer = dynamic_cast<GrammarTextLexer*>( doc.textLexer() );
+    Q_ASSERT(lexer);
+
+    // the default mode of the lexer is measured, unless the mode is set. Both modes lex the complete corpus
+    // synchronously: lexLinesParallel waits for the threads, lexRange doesn't start the background lexing
+    bool parallel = parallelLexingSet_ ? parallelLexingEnabled_ : lexer->isParallelLexingEnabled();
+    lexer->setParallelLexingEnabled( false );
+    result.parallelLexing = parallel ? 1 : 0;
+
+    // the peak memory is sampled per corpus. When the peak of the process can't be reset, it's only known if this corpus raises it
+    bool peakReset = AllocationCounter::resetPeakMemory();
+    qint64 peakStart = AllocationCounter::peakMemoryKb();
+
+    // the fastest run counts
+    result.nsecs = std::numeric_limits<qint64>::max();
+    unsigned int allocationCount = std::numeric_limits<unsigned int>::max();
+    for( int i=0; i<iterations_; ++i ) {
+        doc.scopes()->removeScopesAfterOffset(0);
+        unsigned int allocationStart = AllocationCounter::count();
+        QElapsedTimer timer;
+        timer.start();
+        if( parallel ) {
+            lexer->lexLinesParallel( 0, doc.lineCount() );
+        } else {
+            lexer->lexRange( 0, doc.length() );
+        }
+        result.nsecs = qMin( result.nsecs, timer.nsecsElapsed() );
+        allocationCount = qMin( allocationCount, AllocationCounter::count() - allocationStart );
+    }
+    qint64 peakEnd = AllocationCounter::peakMemoryKb();
+    result.peakMemoryKb = ( peakReset || peakEnd > peakStart ) ? peakEnd : -1;
+
+    // count the searches in a separate run, the instrumentation makes lexing slower
+    lexer->setStatisticsEnabled( true );
+    doc.scopes()->removeScopesAfterOffset(0);
+    lexer->lexRange( 0, doc.length() );
+    int searchCount = lexer->statistics()->searchCount();
+    lexer->setStatisticsEnabled( false );
+
+    int lineCount = qMax( 1, result.lineCount );
+    result.linesPerSecond = result.nsecs > 0 ? result.lineCount * 1000000000.0 / result.nsecs : 0;
+    result.searchesPerLine = double( searchCount ) / lineCount;
+    result.allocationsPerLine = double( allocationCount ) / lineCount;
+    return result;
+}
+
+
+/// Reads a json baseline file. A value that's missing in the baseline is set to -1
+/// @param fileName the file to read
+/// @param ok (out) is set to false when the file couldn't be read
+/// @return the results from the baseline by corpus name
+QMap<QString,LexerBenchmarkResult> LexerBenchmark::readBaseline( const QString& fileName, bool& ok )
+{
+    QMap<QString,LexerBenchmarkResult> result;
+    ok = false;
+    JsonParser parser;
+    if( !parser.parse( fileName ) ) { return result; }
+
+    QVariantMap baseline = parser.result().toMap();
+    if( baseline.value("version").toInt() != BaselineVersion ) { return result; }
+    QVariantMap corpora = baseline.value("corpora").toMap();
+    foreach( QString name, corpora.keys() ) {
+        QVariantMap values = corpora.value(name).toMap();
+        LexerBenchmarkResult res;
+        res.name = name;
+        res.linesPerSecond = values.value( "linesPerSecond", -1 ).toDouble();
+        res.searchesPerLine = values.value( "searchesPerLine", -1 ).toDouble();
+        res.allocationsPerLine = values.value( "allocationsPerLine", -1 ).toDouble();
+        res.peakMemoryKb = values.value( "peakMemoryKb", -1 ).toLongLong();
+        if( values.contains( "parallelLexing" ) ) { res.parallelLexing = values.value( "parallelLexing" ).toBool() ? 1 : 0; }
+        result.insert( res.name, res );
+    }
+    ok = true;
+    return result;
+}
+
+
+} // edbee
@@ -0,0 +1,95 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QList>
+#include <QMap>
+#include <QString>
+
+namespace edbee {
+
+class TextGrammar;
+
+
+/// A text that is lexed by the benchmark
+class LexerBenchmarkCorpus
+{
+public:
+    QString name;               ///< The name of the corpus (used in the report and the baseline)
+    QString fileName;           ///< The filename, used for detecting the grammar
+    QString text;               ///< The text to lex
+};
+
+
+/// The measurements of a single corpus
+class LexerBenchmarkResult
+{
+public:
+    LexerBenchmarkResult();
+
+    QString name;               ///< The name of the corpus
+    QString grammarName;        ///< The name of the grammar that was used
+    int lineCount;              ///< The number of lines of the corpus
+    int charCount;              ///< The number of characters of the corpus
+    qint64 nsecs;               ///< The fastest lexing time of all iterations
+    double linesPerSecond;      ///< The number of lines lexed per second
+    double searchesPerLine;     ///< The average number of regexp searches per line
+    double allocationsPerLine;  ///< The average number of heap allocations per line
+    qint64 peakMemoryKb;        ///< The peak resident memory of the process while lexing this corpus (-1 if unknown)
+    int parallelLexing;         ///< Was the corpus lexed with multiple threads? (1 parallel, 0 serial, -1 unknown)
+};
+
+
+/// Measures the lexing throughput of the grammar lexer for a set of texts.
+///
+/// Every corpus is lexed a number of times; the fastest run is reported. The regexp searches are counted in
+/// an extra run with the lexer statistics enabled, so the instrumentation doesn't influence the timing.
+///
+/// The results can be saved as a baseline. A later run can be compared with this baseline to detect regressions.
+/// The corpora are lexed with the default lexing mode of the library (serial or parallel), unless the mode is set.
+class LexerBenchmark
+{
+public:
+    LexerBenchmark();
+
+    void setIterations( int iterations );
+    void setParallelLexingEnabled( bool enabled );
+
+    void addGeneratedCorpora( int scale=1 );
+    bool addCorpusFile( const QString& fileName );
+    void addCorpus( const QString& name, const QString& fileName, const QString& text );
+
+    void run();
+    QList<LexerBenchmarkResult> results() const;
+    QString resultsAsString() const;
+
+    bool writeBaseline( const QString& fileName ) const;
+    int compareWithBaseline( const QString& fileName, double tolerance, QString& report ) const;
+
+    int compareScanModes( QString& report ) const;
+    int compareGrammarParsing( QString& report ) const;
+
+    static QString generateCppCorpus( int lineCount );
+    static QString generateJsonCorpus( int lineCount );
+    static QString generateHtmlCorpus( int lineCount );
+    static QString generateMinifiedJsCorpus( int lineCount, int lineLength );
+    static QString generateLogCorpus( int lineCount );
+    static QString generateMixedCorpus( int lineCount );
+
+private:
+    LexerBenchmarkResult runCorpus( const LexerBenchmarkCorpus& corpus );
+    static QMap<QString,LexerBenchmarkResult> readBaseline( const QString& fileName, bool& ok );
+
+private:
+    int iterations_;                            ///< The number of times every corpus is lexed
+    bool parallelLexingSet_;                    ///< Is the lexing mode set? (else the default of the lexer is used)
+    bool parallelLexingEnabled_;                ///< Lex with multiple threads? (only used when the mode is set)
+    QList<LexerBenchmarkCorpus> corpusList_;    ///< The texts to lex
+    QList<LexerBenchmarkResult> resultList_;    ///< The results of the last run
+};
+
+
+} // edbee
@@ -0,0 +1,168 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include <QApplication>
+#include <QStringList>
+#include <QTextStream>
+
+#include <QsLog.h>
+#include <QsLogDest.h>
+
+#include "edbee/edbee.h"
+#include "lexerbenchmark.h"
+
+#include "debug.h"
+
+
+/// Prints the command line options
+static void printUsage( QTextStream& out )
+{
+    out << "Usage: edbee-bench [options] [corpus-files...]\n"
+        << "\n"
+        << "Lexes generated corpora (C++, JSON, HTML, minified javascript and a log file) and the given files\n"
+        << "with the tmLanguage grammars and reports the lexing throughput.\n"
+        << "\n"
+        << "  --grammars <path>       the path with the tmLanguage files (default: <app>/data/syntaxfiles)\n"
+        << "  --iterations <n>        the number of runs per corpus, the fastest run counts (default: 3)\n"
+        << "  --scale <n>             a multiplier for the size of the generated corpora (default: 1)\n"
+        << "  --no-generated          only lex the given files\n"
+        << "  --serial                lex with a single thread (default: the default mode of the lexer)\n"
+        << "  --parallel              lex with multiple threads\n"
+        << "  --scan-modes            compare the individual searches with the multi-pattern scan for all grammars\n"
+        << "  --parse-grammars        compare the streaming grammar parser with the plist variant tree (time, allocations, memory)\n"
+        << "  --baseline <file>       compare the results with this json baseline (created with --save-baseline)\n"
+        << "  --save-baseline <file>  save the results as json baseline\n"
+        << "  --tolerance <percent>   the allowed difference with the baseline (default: 10)\n";
+}
+
+
+/// The main entry method of the benchmark
+/// @return 0 on success, 1 on an error and 2 when a regression is found
+int main(int argc, char* argv[])
+{
+    QApplication app( argc, argv );
+    QTextStream out( stdout );
+
+    // only show warnings of the library
+    QsLogging::Logger& logger = QsLogging::Logger::instance();
+    static QsLogging::DestinationPtr debugDestination( QsLogging::DestinationFactory::MakeDebugOutputDestination() );
+    logger.addDestination(debugDestination.get());
+    logger.setLoggingLevel(QsLogging::WarnLevel);
+
+    // the default paths
+    QString appDataPath;
+    #ifdef Q_OS_MAC
+        appDataPath = app.applicationDirPath() + "/../Resources/";
+    #else
+        appDataPath= app.applicationDirPath() + "/data/";
+    #endif
+    QString grammarPath = QString("%1%2").arg(appDataPath).arg("syntaxfiles");
+
+    // parse the arguments
+    edbee::LexerBenchmark benchmark;
+    QString baselineFile;
+    QString saveBaselineFile;
+    double tolerance = 0.1;
+    int scale = 1;
+    bool generated = true;
+    bool scanModes = false;
+    bool parseGrammars = false;
+    QStringList corpusFiles;
+
+    QStringList args = app.arguments();
+    for( int i=1; i<args.size(); ++i ) {
+        QString arg = args.at(i);
+        bool hasValue = i+1 < args.size();
+        if( arg == "--grammars" && hasValue ) {
+            grammarPath = args.at(++i);
+        } else if( arg == "--iterations" && hasValue ) {
+            benchmark.setIterations( args.at(++i).toInt() );
+        } else if( arg == "--scale" && hasValue ) {
+            scale = args.at(++i).toInt();
+        } else if( arg == "--no-generated" ) {
+            generated = false;
+        } else if( arg == "--serial" ) {
+            benchmark.setParallelLexingEnabled( false );
+        } else if( arg == "--parallel" ) {
+            benchmark.setParallelLexingEnabled( true );
+        } else if( arg == "--scan-modes" ) {
+            scanModes = true;
+        } else if( arg == "--parse-grammars" ) {
+            parseGrammars = true;
+        } else if( arg == "--baseline" && hasValue ) {
+            baselineFile = args.at(++i);
+        } else if( arg == "--save-baseline" && hasValue ) {
+            saveBaselineFile = args.at(++i);
+        } else if( arg == "--tolerance" && hasValue ) {
+            tolerance = args.at(++i).toDouble() / 100.0;
+        } else if( arg.startsWith("--") ) {
+            printUsage( out );
+            return arg == "--help" ? 0 : 1;
+        } else {
+            corpusFiles.append( arg );
+        }
+    }
+
+    // initialize edbee. (A lazy grammar is loaded when the corpus is prepared, this isn't part of the measurements)
+    edbee::Edbee* tm = edbee::Edbee::instance();
+    tm->setGrammarPath( grammarPath );
+    tm->init();
+
+    if( generated ) { benchmark.addGeneratedCorpora( scale ); }
+    foreach( QString fileName, corpusFiles ) {
+        if( !benchmark.addCorpusFile( fileName ) ) {
+            out << "Error reading corpus " << fileName << "\n";
+            tm->shutdown();
+            return 1;
+        }
+    }
+
+    out << "Lexing with the grammars in " << grammarPath << "\n\n";
+    out.flush();
+    benchmark.run();
+    out << benchmark.resultsAsString();
+
+    int result = 0;
+    if( scanModes ) {
+        QString report;
+        int differenceCount = benchmark.compareScanModes( report );
+        out << "\nIndividual searches compared with the multi-pattern scan:\n" << report;
+        if( differenceCount > 0 ) {
+            out << differenceCount << " grammar(s) with different scopes\n";
+            result = 1;
+        }
+    }
+    if( parseGrammars ) {
+        QString report;
+        int errorCount = benchmark.compareGrammarParsing( report );
+        out << "\nStreaming grammar parser compared with the plist variant tree:\n" << report;
+        if( errorCount > 0 ) {
+            out << errorCount << " grammar file(s) with parse errors\n";
+            result = 1;
+        }
+    }
+    if( !saveBaselineFile.isEmpty() ) {
+        if( benchmark.writeBaseline( saveBaselineFile ) ) {
+            out << "\nBaseline saved to " << saveBaselineFile << "\n";
+        } else {
+            out << "\nError writing baseline " << saveBaselineFile << "\n";
+            result = 1;
+        }
+    }
+    if( !baselineFile.isEmpty() ) {
+        QString report;
+        int regressionCount = benchmark.compareWithBaseline( baselineFile, tolerance, report );
+        out << "\nCompared with baseline " << baselineFile << ":\n" << report;
+        if( regressionCount < 0 ) {
+            result = 1;
+        } else if( regressionCount > 0 ) {
+            out << regressionCount << " regression(s) found\n";
+            result = 2;
+        }
+    }
+
+    tm->shutdown();
+    return result;
+}
@@ -6,8 +6,12 @@ src_lib.subdir = edbee-lib
 src_lib_test.subdir = edbee-test
 src_lib_test.depends = src_lib
 
+src_lib_bench.subdir = edbee-bench
+src_lib_bench.depends = src_lib
+
 
 SUBDIRS = \
 	src_lib \
-	src_lib_test
+	src_lib_test \
+	src_lib_bench
 
@@ -15,14 +15,20 @@ SOURCES += \
 	$$PWD/edbee/models/texteditorkeymap.cpp \
 	$$PWD/edbee/models/textundostack.cpp \
 	$$PWD/edbee/views/textcaretcache.cpp \
+	$$PWD/edbee/views/textlinewidthindex.cpp \
 	$$PWD/edbee/models/textlexer.cpp \
 	$$PWD/edbee/models/textrange.cpp \
 	$$PWD/edbee/views/textselection.cpp \
 	$$PWD/edbee/models/textdocumentscopes.cpp \
 	$$PWD/edbee/lexers/grammartextlexer.cpp \
+	$$PWD/edbee/lexers/grammarrulescanner.cpp \
+	$$PWD/edbee/lexers/grammarlexerstatistics.cpp \
+	$$PWD/edbee/lexers/grammarlexjob.cpp \
 	$$PWD/edbee/util/gapvector.h \
 	$$PWD/edbee/util/lineoffsetvector.cpp \
 	$$PWD/edbee/models/textlinedata.cpp \
+	$$PWD/edbee/models/textdiffmodel.cpp \
+	$$PWD/edbee/models/textlinediffindex.cpp \
 	$$PWD/edbee/models/textbuffer.cpp \
 	$$PWD/edbee/models/chardocument/chartextbuffer.cpp \
 	$$PWD/edbee/texteditorcontroller.cpp \
@@ -41,12 +47,14 @@ SOURCES += \
 	$$PWD/edbee/commands/debugcommand.cpp \
 	$$PWD/edbee/util/regexp.cpp \
 	$$PWD/edbee/io/tmthemeparser.cpp \
+	$$PWD/edbee/io/tmbinarycache.cpp \
 	$$PWD/edbee/io/baseplistparser.cpp \
 	$$PWD/edbee/io/jsonparser.cpp \
 	$$PWD/edbee/models/textgrammar.cpp \
 	$$PWD/edbee/models/texteditorcommandmap.cpp \
 	$$PWD/edbee/views/components/texteditorcomponent.cpp \
 	$$PWD/edbee/views/components/texteditorrenderer.cpp \
+	$$PWD/edbee/views/components/texteditortilecache.cpp \
 	$$PWD/edbee/views/components/textmargincomponent.cpp \
 	$$PWD/edbee/views/texttheme.cpp \
 	$$PWD/edbee/views/texteditorscrollarea.cpp \
@@ -92,13 +100,19 @@ HEADERS += \
 	$$PWD/edbee/models/textundostack.h \
 	$$PWD/edbee/texteditorcontroller.h \
 	$$PWD/edbee/views/textcaretcache.h \
+	$$PWD/edbee/views/textlinewidthindex.h \
 	$$PWD/edbee/models/textlexer.h \
 	$$PWD/edbee/models/textrange.h \
 	$$PWD/edbee/views/textselection.h \
 	$$PWD/edbee/models/textdocumentscopes.h \
 	$$PWD/edbee/lexers/grammartextlexer.h \
+	$$PWD/edbee/lexers/grammarrulescanner.h \
+	$$PWD/edbee/lexers/grammarlexerstatistics.h \
+	$$PWD/edbee/lexers/grammarlexjob.h \
 	$$PWD/edbee/util/lineoffsetvector.h \
 	$$PWD/edbee/models/textlinedata.h \
+	$$PWD/edbee/models/textdiffmodel.h \
+	$$PWD/edbee/models/textlinediffindex.h \
 	$$PWD/edbee/models/textbuffer.h \
 	$$PWD/edbee/models/chardocument/chartextbuffer.h \
 	$$PWD/edbee/texteditorcommand.h \
@@ -118,12 +132,14 @@ HEADERS += \
 	$$PWD/edbee/commands/debugcommand.h \
 	$$PWD/edbee/util/regexp.h \
 	$$PWD/edbee/io/tmthemeparser.h \
+	$$PWD/edbee/io/tmbinarycache.h \
 	$$PWD/edbee/io/baseplistparser.h \
 	$$PWD/edbee/io/jsonparser.h \
 	$$PWD/edbee/models/textgrammar.h \
 	$$PWD/edbee/models/texteditorcommandmap.h \
 	$$PWD/edbee/views/components/texteditorcomponent.h \
 	$$PWD/edbee/views/components/texteditorrenderer.h \
+	$$PWD/edbee/views/components/texteditortilecache.h \
 	$$PWD/edbee/views/components/textmargincomponent.h \
 	$$PWD/edbee/views/texttheme.h \
 	$$PWD/edbee/views/texteditorscrollarea.h \
@@ -5,6 +5,8 @@
 
 #include "debugcommand.h"
 
+#include "edbee/lexers/grammarlexerstatistics.h"
+#include "edbee/lexers/grammartextlexer.h"
 #include "edbee/models/textdocument.h"
 #include "edbee/models/textdocumentscopes.h"
 #include "edbee/models/textlexer.h"
@@ -26,6 +28,8 @@ void DebugCommand::execute(TextEditorController* controller)
         case DumpScopes: dumpScopes( controller ); break;
         case RebuildScopes: rebuildScopes( controller ); break;
         case DumpUndoStack: dumpUndoStack( controller ); break;
+        case DumpScopeMemoryStats: dumpScopeMemoryStats( controller ); break;
+        case DumpLexerStatistics: dumpLexerStatistics( controller ); break;
     }
 
 }
@@ -69,4 +73,26 @@ void DebugCommand::dumpUndoStack(TextEditorController* controller)
     qlog_info() << controller->textDocument()->textUndoStack()->dumpStack();
 }
 
+/// dumps the memory usage of the scopes
+void DebugCommand::dumpScopeMemoryStats(TextEditorController* controller)
+{
+    qlog_info() << controller->textDocument()->scopes()->memoryStatsString();
+}
+
+/// dumps the search statistics of the grammar rules.
+/// The first time the statistics are enabled and the complete document is lexed again
+void DebugCommand::dumpLexerStatistics(TextEditorController* controller)
+{
+    GrammarTextLexer* lexer = dynamic_cast<GrammarTextLexer*>( controller->textDocument()->textLexer() );
+    if( !lexer ) {
+        qlog_info() << "The document doesn't have a grammar lexer";
+        return;
+    }
+    if( !lexer->isStatisticsEnabled() ) {
+        lexer->setStatisticsEnabled( true );
+        rebuildScopes( controller );
+    }
+    qlog_info() << lexer->statistics()->toString();
+}
+
 } // edbee
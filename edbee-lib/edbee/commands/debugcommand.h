@@ -18,7 +18,9 @@ public:
     enum DebugCommandType {
         DumpScopes,
         RebuildScopes,
-        DumpUndoStack
+        DumpUndoStack,
+        DumpScopeMemoryStats,
+        DumpLexerStatistics
     };
 
     DebugCommand( DebugCommandType command );
@@ -32,6 +34,8 @@ protected:
     void rebuildScopes( TextEditorController* controller );
 
     void dumpUndoStack( TextEditorController* controller );
+    void dumpScopeMemoryStats( TextEditorController* controller );
+    void dumpLexerStatistics( TextEditorController* controller );
 
 private:
 
@@ -109,6 +109,8 @@ void FactoryKeyMap::fill( TextEditorKeyMap* km )
     add( "debug_dump_scopes", "Ctrl+Shift+X,S" );
     add( "debug_rebuild_scopes", "Ctrl+Shift+X,R" );
     add( "debug_dump_undo_stack", "Ctrl+Shift+X,U" );
+    add( "debug_dump_scope_memory", "Ctrl+Shift+X,M" );
+    add( "debug_dump_lexer_stats", "Ctrl+Shift+X,L" );
 
     // find commands
     add( "find_use_sel", "Ctrl+E" );
@@ -13,6 +13,7 @@
 #include "edbee/models/texteditorkeymap.h"
 #include "edbee/models/textdocumentscopes.h"
 #include "edbee/models/textgrammar.h"
+#include "edbee/util/regexp.h"
 #include "edbee/util/textcodec.h"
 #include "edbee/views/texttheme.h"
 
@@ -24,6 +25,12 @@ namespace edbee {
 /// The edbee instance singleton
 static Edbee* theInstance=0;
 
+/// The maximum number of backtrack entries of a single regexp search (protects against catastrophic grammar rules)
+static const unsigned int DefaultRegExpMatchStackLimit = 1000000;
+
+/// The maximum number of backtracks of a single regexp search (a catastrophic search is stopped after ~100ms)
+static const unsigned long DefaultRegExpRetryLimit = 5000000;
+
 
 /// The constructor
 Edbee::Edbee()
@@ -84,6 +91,15 @@ void Edbee::setThemePath( const QString& themePath )
 }
 
 
+/// Sets the path of the binary cache for parsed grammars and themes.
+/// Without a cache path (the default) every start parses the grammar and theme files
+/// @param cachePath the cache directory (it's created when it doesn't exist)
+void Edbee::setCachePath( const QString& cachePath )
+{
+    cachePath_ = cachePath;
+}
+
+
 /// This method automaticly initializes the edbee library it this hasn't already been done
 void Edbee::autoInit()
 {
@@ -174,18 +190,33 @@ void Edbee::init()
 
     qRegisterMetaType<edbee::TextBufferChange>("edbee::TextBufferChange");
 
+    // grammars are compiled in worker threads, the regexp engine must be initialized first
+    RegExp::initEngine();
+
+    // a pathological regexp should fail instead of consuming all memory or time
+    RegExp::setDefaultMatchStackLimit( DefaultRegExpMatchStackLimit );
+    RegExp::setDefaultRetryLimit( DefaultRegExpRetryLimit );
+
     // factory fill the default command map
     defaultCommandMap_->loadFactoryCommandMap();
 
 
-    // load all grammar definitions
+    // parsed grammars and themes are cached in a binary format
+    grammarManager_->setCachePath( cachePath_ );
+    themeManager_->setCachePath( cachePath_ );
+
+    // load all grammar definitions (lazy grammars only read the header, the rules are parsed on first use)
     if( !grammarPath_.isEmpty() ) {
         grammarManager_->readAllGrammarFilesInPath( grammarPath_ );
+
+        // parse the lazy grammars in the background, so opening a document seldom waits for the parser
+        grammarManager_->prewarmGrammars();
     }
 
-    // load all themes
+    // load all themes (the theme files are read concurrently)
     if( !themePath_.isEmpty() ) {
        themeManager_->listAllThemes( themePath_ );
+       themeManager_->loadAllThemes();
     }
 
     // load the keymaps or fallback to the factory keymap
@@ -34,6 +34,7 @@ public:
     void setKeyMapPath( const QString& keyMapPath );
     void setGrammarPath( const QString& grammarPath );
     void setThemePath( const QString& themePath );
+    void setCachePath( const QString& cachePath );
 
     void autoInit();
 
@@ -61,6 +62,7 @@ protected:
     QString grammarPath_;                       ///< The path were to load all grammars from
     QString themePath_;                         ///< The path to load all themes from
     QString keyMapPath_;                        ///< The path to load all keymaps
+    QString cachePath_;                         ///< The path of the binary grammar and theme cache
 
     TextEditorCommandMap* defaultCommandMap_;   ///< The default command map
 
@@ -176,6 +176,62 @@ QString BasePListParser::readElementText()
 }
 
 
+/// Skips the current element (and all its children) without converting it to a variant
+void BasePListParser::skipElement()
+{
+    xml_->skipCurrentElement();
+    if( !elementStack_.isEmpty() ) { elementStack_.pop(); }
+}
+
+
+/// Reads the next value and checks if it is of the given type.
+/// A value of another type is skipped. After a succesful call the caller should read the contents of the value
+/// @param type the expected element name (dict, array, string)
+/// @return true if the next value is of the given type
+bool BasePListParser::readNextValue(const QString& type)
+{
+    if( !readNextElement("") ) { return false; }
+    if( xml_->name().compare( type, Qt::CaseInsensitive ) == 0 ) { return true; }
+    skipElement();
+    return false;
+}
+
+
+/// Reads the next value as a string
+/// @return the string or an empty string if the value isn't a string
+QString BasePListParser::readStringValue()
+{
+    if( readNextValue("string") ) { return readElementText(); }
+    return QString();
+}
+
+
+/// Reads the next value as an array of strings (all other array items are ignored)
+/// @return the list of strings
+QStringList BasePListParser::readStringListValue()
+{
+    QStringList result;
+    if( readNextValue("array") ) {
+        int level = currentStackLevel();
+        while( readNextElement("",level) ) {
+            if( xml_->name().compare( "string", Qt::CaseInsensitive ) == 0 ) {
+                result.append( readElementText() );
+            } else {
+                skipElement();
+            }
+        }
+    }
+    return result;
+}
+
+
+/// Skips the next value
+void BasePListParser::skipNextValue()
+{
+    if( readNextElement("") ) { skipElement(); }
+}
+
+
 /// returns the current stack-level
 int BasePListParser::currentStackLevel()
 {
@@ -183,5 +239,12 @@ int BasePListParser::currentStackLevel()
 }
 
 
+/// returns the name of the current (last started) element
+QString BasePListParser::currentElementName() const
+{
+    return elementStack_.isEmpty() ? QString() : elementStack_.top();
+}
+
+
 
 } // edbee
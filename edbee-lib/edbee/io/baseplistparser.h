@@ -8,6 +8,7 @@
 #include <QHash>
 #include <QStack>
 #include <QString>
+#include <QStringList>
 #include <QVariant>
 
 class QIODevice;
@@ -39,8 +40,16 @@ protected:
 
     bool readNextElement( const QString& name, int level=-1 );
     QString readElementText();
+    void skipElement();
+
+  // streaming plist parsing (without building variants)
+    bool readNextValue( const QString& type );
+    QString readStringValue();
+    QStringList readStringListValue();
+    void skipNextValue();
 
     int currentStackLevel();
+    QString currentElementName() const;
 
 private:
 
@@ -0,0 +1,653 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "tmbinarycache.h"
+
+#include <QColor>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QStringList>
+#include <QThread>
+#include <QVector>
+
+#include "edbee/models/textdocumentscopes.h"
+#include "edbee/models/textgrammar.h"
+#include "edbee/views/texttheme.h"
+#include "edbee/util/regexp.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+static const quint32 CacheMagic = 0x45444243;       // 'EDBC'
+static const quint32 CacheVersion = 1;              // increase this number when the format changes
+static const int GrammarCacheKind = 1;
+static const int ThemeCacheKind = 2;
+static const int ThemeColorCount = 12;              // the number of theme setting colors
+static const int CacheStreamVersion = QDataStream::Qt_4_8;
+static const int MaxRuleTreeDepth = 256;            // deeper rule trees in a cache file are rejected (the rules are created recursively)
+
+
+/// A pool with unique strings. The cache tables refer to the strings by index
+class TmCacheStringPool
+{
+public:
+    /// Adds the string to the pool
+    /// @return the index of the string
+    qint32 add( const QString& str )
+    {
+        QHash<QString,qint32>::const_iterator itr = indexMap_.find(str);
+        if( itr != indexMap_.end() ) { return itr.value(); }
+        qint32 index = strings_.size();
+        strings_.append(str);
+        indexMap_.insert(str,index);
+        return index;
+    }
+
+    const QStringList& strings() const { return strings_; }
+
+private:
+    QStringList strings_;                   ///< All strings in the pool
+    QHash<QString,qint32> indexMap_;        ///< The index of every string
+};
+
+
+/// A single grammar rule in the flat rule table. The rules are stored in pre-order,
+/// the children of a rule directly follow the rule
+struct TmCacheGrammarRule
+{
+    quint8 instruction;                     ///< The TextGrammarRule::Instruction
+    qint32 scopeName;                       ///< The string index of the scope name
+    qint32 contentScopeName;                ///< The string index of the content scope name (or include name)
+    qint32 matchRegExp;                     ///< The string index of the match regexp (-1 if there's no regexp)
+    qint32 endRegExp;                       ///< The string index of the end regexp
+    qint32 childCount;                      ///< The number of direct children
+    QMap<int,qint32> matchCaptures;         ///< The capture names (string indices)
+    QMap<int,qint32> endCaptures;           ///< The end capture names (string indices)
+};
+
+
+/// Returns the sha1 hash of the given file
+static QByteArray hashOfFile( const QString& fileName )
+{
+    QFile file(fileName);
+    if( !file.open( QIODevice::ReadOnly ) ) { return QByteArray(); }
+    return QCryptographicHash::hash( file.readAll(), QCryptographicHash::Sha1 );
+}
+
+
+/// Writes the captures to the stream
+static void writeCaptures( QDataStream& stream, const QMap<int,qint32>& captures )
+{
+    stream << qint32( captures.size() );
+    QMapIterator<int,qint32> itr(captures);
+    while( itr.hasNext() ) {
+        itr.next();
+        stream << qint32( itr.key() ) << itr.value();
+    }
+}
+
+
+/// Reads the captures from the stream
+static bool readCaptures( QDataStream& stream, QMap<int,qint32>& captures )
+{
+    qint32 count = 0;
+    stream >> count;
+    if( count < 0 ) { return false; }
+    for( qint32 i=0; i<count && stream.status() == QDataStream::Ok; ++i ) {
+        qint32 key = 0, value = 0;
+        stream >> key >> value;
+        captures.insert( key, value );
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+
+/// Appends the rule and all its children to the rule table (pre-order)
+static void appendRuleToTable( QVector<TmCacheGrammarRule>& table, TmCacheStringPool& pool, TextGrammarRule* rule )
+{
+    TmCacheGrammarRule entry;
+    entry.instruction = rule->instruction();
+    entry.scopeName = pool.add( rule->scopeName() );
+    entry.contentScopeName = pool.add( rule->contentScopeName() );
+    entry.matchRegExp = rule->matchRegExp() ? pool.add( rule->matchRegExp()->pattern() ) : -1;
+    entry.endRegExp = pool.add( rule->endRegExpString() );
+    entry.childCount = rule->ruleCount();
+
+    QMapIterator<int,QString> itr( rule->matchCaptures() );
+    while( itr.hasNext() ) { itr.next(); entry.matchCaptures.insert( itr.key(), pool.add( itr.value() ) ); }
+    QMapIterator<int,QString> endItr( rule->endCaptures() );
+    while( endItr.hasNext() ) { endItr.next(); entry.endCaptures.insert( endItr.key(), pool.add( endItr.value() ) ); }
+    table.append( entry );
+
+    for( int i=0, cnt=rule->ruleCount(); i<cnt; ++i ) {
+        appendRuleToTable( table, pool, rule->rule(i) );
+    }
+}
+
+
+/// Checks the rule tree at the given index (without creating rules).
+/// The tree is walked with an explicit stack, trees deeper than MaxRuleTreeDepth are rejected
+/// @param index (in/out) the index of the rule, after the call the index of the next tree
+/// @return false if the table is inconsistent
+static bool isValidRuleTree( const QVector<TmCacheGrammarRule>& table, int stringCount, int& index )
+{
+    QVector<qint32> remainingChildren;      // the number of unchecked children of every rule on the current path
+    remainingChildren.append(1);            // the root of the tree
+    while( !remainingChildren.isEmpty() ) {
+        if( remainingChildren.last() == 0 ) {
+            remainingChildren.removeLast();
+            continue;
+        }
+        --remainingChildren.last();
+
+        if( index >= table.size() ) { return false; }
+        const TmCacheGrammarRule& entry = table.at(index++);
+        if( entry.instruction > TextGrammarRule::Parser ) { return false; }
+        if( entry.scopeName < 0 || entry.scopeName >= stringCount ) { return false; }
+        if( entry.contentScopeName < 0 || entry.contentScopeName >= stringCount ) { return false; }
+        if( entry.matchRegExp < -1 || entry.matchRegExp >= stringCount ) { return false; }
+        if( entry.matchRegExp < 0 && ( entry.instruction == TextGrammarRule::SingleLineRegExp || entry.instruction == TextGrammarRule::MultiLineRegExp ) ) { return false; }
+        if( entry.endRegExp < 0 || entry.endRegExp >= stringCount ) { return false; }
+        foreach( qint32 value, entry.matchCaptures ) { if( value < 0 || value >= stringCount ) { return false; } }
+        foreach( qint32 value, entry.endCaptures ) { if( value < 0 || value >= stringCount ) { return false; } }
+        if( entry.childCount < 0 ) { return false; }
+        if( entry.childCount > 0 ) {
+            if( remainingChildren.size() >= MaxRuleTreeDepth ) { return false; }
+            remainingChildren.append( entry.childCount );
+        }
+    }
+    return true;
+}
+
+
+/// Creates the rule tree at the given index. The table must be validated with isValidRuleTree
+/// @param index (in/out) the index of the rule, after the call the index of the next tree
+static TextGrammarRule* createRuleTree( const QVector<TmCacheGrammarRule>& table, const QStringList& strings, TextGrammar* grammar, int& index )
+{
+    const TmCacheGrammarRule& entry = table.at(index++);
+    TextGrammarRule* rule = 0;
+    switch( entry.instruction ) {
+        case TextGrammarRule::MainRule:
+            rule = TextGrammarRule::createMainRule( grammar, strings.at(entry.scopeName) );
+            break;
+        case TextGrammarRule::SingleLineRegExp:
+            rule = TextGrammarRule::createSingleLineRegExp( grammar, strings.at(entry.scopeName), strings.at(entry.matchRegExp) );
+            break;
+        case TextGrammarRule::MultiLineRegExp:
+            rule = TextGrammarRule::createMultiLineRegExp( grammar, strings.at(entry.scopeName), strings.at(entry.contentScopeName), strings.at(entry.matchRegExp), strings.at(entry.endRegExp) );
+            break;
+        case TextGrammarRule::IncludeCall:
+            rule = TextGrammarRule::createIncludeRule( grammar, strings.at(entry.contentScopeName) );
+            break;
+        default:
+            rule = new TextGrammarRule( grammar, TextGrammarRule::Instruction( entry.instruction ) );
+            rule->setScopeName( strings.at(entry.scopeName) );
+            rule->setContentScopeName( strings.at(entry.contentScopeName) );
+            break;
+    }
+
+    QMapIterator<int,qint32> itr( entry.matchCaptures );
+    while( itr.hasNext() ) { itr.next(); rule->setCapture( itr.key(), strings.at( itr.value() ) ); }
+    QMapIterator<int,qint32> endItr( entry.endCaptures );
+    while( endItr.hasNext() ) { endItr.next(); rule->setEndCapture( endItr.key(), strings.at( endItr.value() ) ); }
+
+    for( int i=0; i<entry.childCount; ++i ) {
+        rule->giveRule( createRuleTree( table, strings, grammar, index ) );
+    }
+    return rule;
+}
+
+
+//==========================
+
+
+/// Constructs the binary cache
+/// @param cachePath the directory with the cache files
+TmBinaryCache::TmBinaryCache(const QString& cachePath)
+    : cachePath_( cachePath )
+{
+}
+
+
+/// Reads the header (name, displayName and file extensions) of a cached grammar.
+/// @param sourceFile the tmLanguage file
+/// @return a lazy grammar, the rules are read from the cache on first use. 0 if the cache entry isn't valid
+///         The grammar remembers the hash of the source file
+TextGrammar* TmBinaryCache::readGrammarHeader(const QString& sourceFile)
+{
+    QByteArray payload = readCacheFile( sourceFile, GrammarCacheKind );
+    if( payload.isEmpty() ) { return 0; }
+
+    QDataStream stream( payload );
+    stream.setVersion( CacheStreamVersion );
+    QString name, displayName;
+    QStringList fileTypes;
+    stream >> name >> displayName >> fileTypes;
+    if( stream.status() != QDataStream::Ok || name.isEmpty() ) {
+        lastErrorMessage_ = QObject::tr("Corrupt cache file for %1").arg(sourceFile);
+        return 0;
+    }
+
+    TextGrammar* grammar = new TextGrammar( name, displayName );
+    foreach( QString fileType, fileTypes ) {
+        grammar->addFileExtension( fileType );
+    }
+    grammar->setLazyFileName( sourceFile );
+    grammar->setSourceHash( sourceHash_ );     // (reading the rules doesn't need to hash the file again)
+    return grammar;
+}
+
+
+/// Reads the complete grammar from the cache
+/// @param sourceFile the tmLanguage file
+/// @return the grammar or 0 if the cache entry isn't valid
+TextGrammar* TmBinaryCache::readGrammar(const QString& sourceFile)
+{
+    QByteArray payload = readCacheFile( sourceFile, GrammarCacheKind );
+    if( payload.isEmpty() ) { return 0; }
+
+    QDataStream stream( payload );
+    stream.setVersion( CacheStreamVersion );
+    QString name, displayName;
+    QStringList fileTypes;
+    stream >> name >> displayName >> fileTypes;
+    if( stream.status() != QDataStream::Ok || name.isEmpty() ) {
+        lastErrorMessage_ = QObject::tr("Corrupt cache file for %1").arg(sourceFile);
+        return 0;
+    }
+
+    TextGrammar* grammar = new TextGrammar( name, displayName );
+    if( !readGrammarRulesFromStream( stream, grammar ) ) {
+        delete grammar;
+        return 0;
+    }
+    foreach( QString fileType, fileTypes ) {
+        grammar->addFileExtension( fileType );
+    }
+    return grammar;
+}
+
+
+/// Reads the rules of a (lazy) grammar from the cache.
+/// @param sourceFile the tmLanguage file
+/// @param grammar the grammar to add the main rule and the repository to
+/// @return true on success. On failure the grammar isn't changed
+bool TmBinaryCache::readGrammarRules(const QString& sourceFile, TextGrammar* grammar)
+{
+    QByteArray payload = readCacheFile( sourceFile, GrammarCacheKind );
+    if( payload.isEmpty() ) { return false; }
+
+    QDataStream stream( payload );
+    stream.setVersion( CacheStreamVersion );
+    QString name, displayName;
+    QStringList fileTypes;
+    stream >> name >> displayName >> fileTypes;
+    if( stream.status() != QDataStream::Ok || name != grammar->name() ) {
+        lastErrorMessage_ = QObject::tr("Corrupt cache file for %1").arg(sourceFile);
+        return false;
+    }
+    return readGrammarRulesFromStream( stream, grammar );
+}
+
+
+/// Writes the given grammar to the cache
+/// @param sourceFile the tmLanguage file the grammar has been parsed from
+/// @param grammar the parsed grammar
+/// @return true on success
+bool TmBinaryCache::writeGrammar(const QString& sourceFile, TextGrammar* grammar)
+{
+    TmCacheStringPool pool;
+    QVector<TmCacheGrammarRule> table;
+    QList<qint32> reposNames;
+
+    // the main rule is the first tree, the repository rules follow in order
+    appendRuleToTable( table, pool, grammar->mainRule() );
+    QMapIterator<QString,TextGrammarRule*> itr( grammar->repository() );
+    while( itr.hasNext() ) {
+        itr.next();
+        reposNames.append( pool.add( itr.key() ) );
+        appendRuleToTable( table, pool, itr.value() );
+    }
+
+    QByteArray payload;
+    QDataStream stream( &payload, QIODevice::WriteOnly );
+    stream.setVersion( CacheStreamVersion );
+    stream << grammar->name() << grammar->displayName() << grammar->fileExtensions();
+    stream << pool.strings();
+    stream << qint32( table.size() );
+    foreach( const TmCacheGrammarRule& entry, table ) {
+        stream << entry.instruction << entry.scopeName << entry.contentScopeName << entry.matchRegExp << entry.endRegExp << entry.childCount;
+        writeCaptures( stream, entry.matchCaptures );
+        writeCaptures( stream, entry.endCaptures );
+    }
+    stream << qint32( reposNames.size() );
+    foreach( qint32 reposName, reposNames ) { stream << reposName; }
+
+    return writeCacheFile( sourceFile, GrammarCacheKind, payload );
+}
+
+
+/// Reads a theme from the cache
+/// @param sourceFile the tmTheme file
+/// @return the theme or 0 if the cache entry isn't valid
+TextTheme* TmBinaryCache::readTheme(const QString& sourceFile)
+{
+    QByteArray payload = readCacheFile( sourceFile, ThemeCacheKind );
+    if( payload.isEmpty() ) { return 0; }
+
+    QDataStream stream( payload );
+    stream.setVersion( CacheStreamVersion );
+    QStringList strings;
+    qint32 name = -1, uuid = -1, bracketOptions = -1, bracketContentsOptions = -1, tagsOptions = -1;
+    QColor colors[ThemeColorCount];
+    stream >> strings >> name >> uuid;
+    for( int i=0; i<ThemeColorCount; ++i ) { stream >> colors[i]; }
+    stream >> bracketOptions >> bracketContentsOptions >> tagsOptions;
+
+    qint32 ruleCount = 0;
+    stream >> ruleCount;
+    if( stream.status() != QDataStream::Ok || ruleCount < 0 ) {
+        lastErrorMessage_ = QObject::tr("Corrupt cache file for %1").arg(sourceFile);
+        return 0;
+    }
+
+    // read and validate the rule table
+    int stringCount = strings.size();
+    QList<qint32> ruleStrings;
+    QList<QColor> ruleColors;
+    QList<quint8> ruleFlags;
+    for( qint32 i=0; i<ruleCount && stream.status() == QDataStream::Ok; ++i ) {
+        qint32 ruleName = -1, ruleSelector = -1;
+        QColor foreground, background;
+        quint8 flags = 0;
+        stream >> ruleName >> ruleSelector >> foreground >> background >> flags;
+        ruleStrings << ruleName << ruleSelector;
+        ruleColors << foreground << background;
+        ruleFlags << flags;
+    }
+    bool valid = stream.status() == QDataStream::Ok;
+    foreach( qint32 idx, QList<qint32>() << ruleStrings << name << uuid << bracketOptions << bracketContentsOptions << tagsOptions ) {
+        if( idx < 0 || idx >= stringCount ) { valid = false; }
+    }
+    if( !valid ) {
+        lastErrorMessage_ = QObject::tr("Corrupt cache file for %1").arg(sourceFile);
+        return 0;
+    }
+
+    TextTheme* theme = new TextTheme();
+    theme->setName( strings.at(name) );
+    theme->setUuid( strings.at(uuid) );
+    theme->setBackgroundColor( colors[0] );
+    theme->setForegroundColor( colors[1] );
+    theme->setCaretColor( colors[2] );
+    theme->setInvisiblesColor( colors[3] );
+    theme->setLineHighlightColor( colors[4] );
+    theme->setSelectionColor( colors[5] );
+    theme->setFindHighlightForegroundColor( colors[6] );
+    theme->setFindHighlightBackgroundColor( colors[7] );
+    theme->setSelectionBorderColor( colors[8] );
+    theme->setActiveGuideColor( colors[9] );
+    theme->setBracketForegroundColor( colors[10] );
+    theme->setBracketContentsForegroundColor( colors[11] );
+    theme->setBracketOptions( strings.at(bracketOptions) );
+    theme->setBracketContentsOptions( strings.at(bracketContentsOptions) );
+    theme->setTagsOptions( strings.at(tagsOptions) );
+    for( int i=0; i<ruleCount; ++i ) {
+        quint8 flags = ruleFlags.at(i);
+        theme->giveThemeRule( new TextThemeRule( strings.at( ruleStrings.at(i*2) ), strings.at( ruleStrings.at(i*2+1) ),
+            ruleColors.at(i*2), ruleColors.at(i*2+1), (flags & 1) != 0, (flags & 2) != 0, (flags & 4) != 0 ) );
+    }
+    return theme;
+}
+
+
+/// Writes the given theme to the cache
+/// @param sourceFile the tmTheme file the theme has been parsed from
+/// @param theme the parsed theme
+/// @return true on success
+bool TmBinaryCache::writeTheme(const QString& sourceFile, TextTheme* theme)
+{
+    TmCacheStringPool pool;
+    qint32 name = pool.add( theme->name() );
+    qint32 uuid = pool.add( theme->uuid() );
+    qint32 bracketOptions = pool.add( theme->bracketOptions() );
+    qint32 bracketContentsOptions = pool.add( theme->bracketContentsOptions() );
+    qint32 tagsOptions = pool.add( theme->tagsOptions() );
+
+    QByteArray rules;
+    QDataStream ruleStream( &rules, QIODevice::WriteOnly );
+    ruleStream.setVersion( CacheStreamVersion );
+    foreach( TextThemeRule* rule, theme->rules() ) {
+        quint8 flags = ( rule->bold() ? 1 : 0 ) | ( rule->italic() ? 2 : 0 ) | ( rule->underline() ? 4 : 0 );
+        ruleStream << pool.add( rule->name() ) << pool.add( rule->scopeSelector()->toString() );
+        ruleStream << rule->foregroundColor() << rule->backgroundColor() << flags;
+    }
+
+    QByteArray payload;
+    QDataStream stream( &payload, QIODevice::WriteOnly );
+    stream.setVersion( CacheStreamVersion );
+    stream << pool.strings() << name << uuid;
+    stream << theme->backgroundColor() << theme->foregroundColor() << theme->caretColor() << theme->invisiblesColor();
+    stream << theme->lineHighlightColor() << theme->selectionColor() << theme->findHighlightForegroundColor() << theme->findHighlightBackgroundColor();
+    stream << theme->selectionBorderColor() << theme->activeGuideColor() << theme->bracketForegroundColor() << theme->bracketContentsForegroundColor();
+    stream << bracketOptions << bracketContentsOptions << tagsOptions;
+    stream << qint32( theme->rules().size() );
+    stream.writeRawData( rules.constData(), rules.size() );
+
+    return writeCacheFile( sourceFile, ThemeCacheKind, payload );
+}
+
+
+/// Sets the known sha1 hash of the given source file, so reading a cache entry doesn't need to hash the file again
+/// @param sourceFile the source file
+/// @param hash the sha1 hash of the source file (an empty hash is ignored)
+void TmBinaryCache::setSourceHash(const QString& sourceFile, const QByteArray& hash)
+{
+    if( hash.isEmpty() ) { return; }
+    sourceHashFile_ = sourceFile;
+    sourceHash_ = hash;
+}
+
+
+/// Returns the sha1 hash of the given source file if it's known. (It has been computed when reading a cache entry)
+/// @param sourceFile the source file
+/// @return the hash or an empty array if it hasn't been computed
+QByteArray TmBinaryCache::sourceHash(const QString& sourceFile) const
+{
+    return sourceHashFile_ == sourceFile ? sourceHash_ : QByteArray();
+}
+
+
+/// Returns the cache directory
+QString TmBinaryCache::cachePath() const
+{
+    return cachePath_;
+}
+
+
+/// Returns the name of the cache file for the given source file.
+/// The name is the sha1 of the absolute path, so files with the same name in different directories don't collide
+QString TmBinaryCache::cacheFileName(const QString& sourceFile) const
+{
+    QByteArray pathHash = QCryptographicHash::hash( QFileInfo(sourceFile).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1 );
+    return QString("%1/%2.edbeecache").arg(cachePath_).arg( QString::fromLatin1( pathHash.toHex() ) );
+}
+
+
+/// Returns the reason the last read or write failed
+QString TmBinaryCache::lastErrorMessage() const
+{
+    return lastErrorMessage_;
+}
+
+
+/// Reads the cache file of the given source and validates the header.
+/// @param sourceFile the source file
+/// @param kind the expected kind of cache file
+/// @return the payload of the cache file. An empty array when the file is missing, stale or corrupt
+QByteArray TmBinaryCache::readCacheFile(const QString& sourceFile, int kind)
+{
+    lastErrorMessage_.clear();
+
+    QFile file( cacheFileName(sourceFile) );
+    if( !file.open( QIODevice::ReadOnly ) ) {
+        lastErrorMessage_ = QObject::tr("No cache file for %1").arg(sourceFile);
+        return QByteArray();
+    }
+
+    QDataStream stream( &file );
+    stream.setVersion( CacheStreamVersion );
+    quint32 magic = 0, version = 0;
+    quint8 fileKind = 0;
+    QString path;
+    qint64 modified = 0, size = 0;
+    QByteArray hash, payload;
+    stream >> magic >> version >> fileKind;
+    if( magic != CacheMagic || version != CacheVersion || fileKind != kind ) {
+        lastErrorMessage_ = QObject::tr("Invalid cache file for %1").arg(sourceFile);
+        return QByteArray();
+    }
+    stream >> path >> modified >> size >> hash >> payload;
+    if( stream.status() != QDataStream::Ok ) {
+        lastErrorMessage_ = QObject::tr("Corrupt cache file for %1").arg(sourceFile);
+        return QByteArray();
+    }
+
+    // the cache is only valid for the exact same source file (the file is only hashed once)
+    QFileInfo fileInfo( sourceFile );
+    if( path != fileInfo.absoluteFilePath() || modified != fileInfo.lastModified().toMSecsSinceEpoch() || size != fileInfo.size() ) {
+        lastErrorMessage_ = QObject::tr("Stale cache file for %1").arg(sourceFile);
+        return QByteArray();
+    }
+    if( sourceHashFile_ != sourceFile ) {
+        sourceHashFile_ = sourceFile;
+        sourceHash_ = hashOfFile( sourceFile );
+    }
+    if( hash != sourceHash_ ) {
+        lastErrorMessage_ = QObject::tr("Stale cache file for %1").arg(sourceFile);
+        return QByteArray();
+    }
+    return payload;
+}
+
+
+/// Writes the cache file for the given source file.
+/// The file is written to a temporary file first, so a reader never sees a partially written cache file
+/// @param sourceFile the source file
+/// @param kind the kind of cache file
+/// @param payload the data to store
+/// @return true on success
+bool TmBinaryCache::writeCacheFile(const QString& sourceFile, int kind, const QByteArray& payload)
+{
+    lastErrorMessage_.clear();
+
+    // the written hash is always computed from the current file
+    QFileInfo fileInfo( sourceFile );
+    QByteArray hash = hashOfFile( sourceFile );
+    if( hash.isEmpty() ) {
+        lastErrorMessage_ = QObject::tr("Unable to read %1").arg(sourceFile);
+        return false;
+    }
+    sourceHashFile_ = sourceFile;
+    sourceHash_ = hash;
+
+    if( !QDir().mkpath( cachePath_ ) ) {
+        lastErrorMessage_ = QObject::tr("Unable to create cache path %1").arg(cachePath_);
+        return false;
+    }
+
+    QString fileName = cacheFileName( sourceFile );
+    // (cache files are written by the grammar loaders and the prewarm thread, the temp file is unique per thread)
+    QString tempFileName = QString("%1.%2.%3.tmp").arg(fileName).arg( QDateTime::currentMSecsSinceEpoch() ).arg( quintptr( QThread::currentThreadId() ) );
+    QFile file( tempFileName );
+    if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+        lastErrorMessage_ = file.errorString();
+        return false;
+    }
+
+    QDataStream stream( &file );
+    stream.setVersion( CacheStreamVersion );
+    stream << CacheMagic << CacheVersion << quint8( kind );
+    stream << fileInfo.absoluteFilePath() << qint64( fileInfo.lastModified().toMSecsSinceEpoch() ) << qint64( fileInfo.size() ) << hash;
+    stream << payload;
+    file.close();
+
+    if( stream.status() != QDataStream::Ok || file.error() != QFile::NoError ) {
+        lastErrorMessage_ = QObject::tr("Error writing cache file %1").arg(fileName);
+        QFile::remove( tempFileName );
+        return false;
+    }
+
+    QFile::remove( fileName );
+    if( !QFile::rename( tempFileName, fileName ) ) {
+        lastErrorMessage_ = QObject::tr("Error writing cache file %1").arg(fileName);
+        QFile::remove( tempFileName );
+        return false;
+    }
+    return true;
+}
+
+
+/// Reads the rule tables and adds the rules to the grammar.
+/// The complete table is validated before the first rule is created
+/// @return true on success
+bool TmBinaryCache::readGrammarRulesFromStream(QDataStream& stream, TextGrammar* grammar)
+{
+    QStringList strings;
+    qint32 ruleCount = 0;
+    stream >> strings >> ruleCount;
+    if( stream.status() != QDataStream::Ok || ruleCount <= 0 ) {
+        lastErrorMessage_ = QObject::tr("Corrupt grammar cache for %1").arg(grammar->name());
+        return false;
+    }
+
+    QVector<TmCacheGrammarRule> table;
+    for( qint32 i=0; i<ruleCount && stream.status() == QDataStream::Ok; ++i ) {
+        TmCacheGrammarRule entry;
+        stream >> entry.instruction >> entry.scopeName >> entry.contentScopeName >> entry.matchRegExp >> entry.endRegExp >> entry.childCount;
+        if( !readCaptures( stream, entry.matchCaptures ) || !readCaptures( stream, entry.endCaptures ) ) { break; }
+        table.append( entry );
+    }
+
+    QList<qint32> reposNames;
+    qint32 reposCount = 0;
+    stream >> reposCount;
+    for( qint32 i=0; i<reposCount && stream.status() == QDataStream::Ok; ++i ) {
+        qint32 reposName = -1;
+        stream >> reposName;
+        reposNames.append( reposName );
+    }
+
+    // validate the complete table: the main rule tree, followed by a tree for every repository item
+    bool valid = stream.status() == QDataStream::Ok && table.size() == ruleCount && reposCount >= 0;
+    int index = 0;
+    if( valid ) { valid = isValidRuleTree( table, strings.size(), index ) && table.at(0).instruction == TextGrammarRule::MainRule; }
+    foreach( qint32 reposName, reposNames ) {
+        if( !valid ) { break; }
+        valid = reposName >= 0 && reposName < strings.size() && isValidRuleTree( table, strings.size(), index );
+    }
+    if( !valid || index != table.size() ) {
+        lastErrorMessage_ = QObject::tr("Corrupt grammar cache for %1").arg(grammar->name());
+        return false;
+    }
+
+    // create the rules
+    index = 0;
+    grammar->giveMainRule( createRuleTree( table, strings, grammar, index ) );
+    foreach( qint32 reposName, reposNames ) {
+        grammar->giveToRepos( strings.at(reposName), createRuleTree( table, strings, grammar, index ) );
+    }
+    return true;
+}
+
+
+} // edbee
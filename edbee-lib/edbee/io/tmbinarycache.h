@@ -0,0 +1,64 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+class QDataStream;
+
+namespace edbee {
+
+class TextGrammar;
+class TextTheme;
+
+
+/// A versioned binary cache of parsed grammars (tmLanguage) and themes (tmTheme).
+///
+/// Every source file has its own cache file in the cache path. A cache file starts with a header that identifies
+/// the source: the absolute path, the modification time, the size and the sha1 hash of the contents.
+/// An entry is only used when all of these match the current source file. The hash of a source file is only computed
+/// once per cache object, a known hash can be given with setSourceHash. (A lazy grammar stores the hash of its header read)
+///
+/// The payload is stored as flat tables: a string pool with all unique strings and a table with all grammar rules
+/// (or theme rules) that refer to the strings by index. Reading a cache file never touches the xml parser.
+///
+/// When a cache file is missing, stale or corrupt the read methods return 0 (or false) and the caller
+/// falls back to parsing the plist file.
+class TmBinaryCache
+{
+public:
+    TmBinaryCache( const QString& cachePath );
+
+    TextGrammar* readGrammarHeader( const QString& sourceFile );
+    TextGrammar* readGrammar( const QString& sourceFile );
+    bool readGrammarRules( const QString& sourceFile, TextGrammar* grammar );
+    bool writeGrammar( const QString& sourceFile, TextGrammar* grammar );
+
+    TextTheme* readTheme( const QString& sourceFile );
+    bool writeTheme( const QString& sourceFile, TextTheme* theme );
+
+    void setSourceHash( const QString& sourceFile, const QByteArray& hash );
+    QByteArray sourceHash( const QString& sourceFile ) const;
+
+    QString cachePath() const;
+    QString cacheFileName( const QString& sourceFile ) const;
+    QString lastErrorMessage() const;
+
+private:
+    QByteArray readCacheFile( const QString& sourceFile, int kind );
+    bool writeCacheFile( const QString& sourceFile, int kind, const QByteArray& payload );
+    bool readGrammarRulesFromStream( QDataStream& stream, TextGrammar* grammar );
+
+private:
+    QString cachePath_;                 ///< The directory with the cache files
+    QString lastErrorMessage_;          ///< The reason the last read or write failed
+    QString sourceHashFile_;            ///< The source file of the known hash
+    QByteArray sourceHash_;             ///< The known sha1 hash of the source file (computed once per source file)
+};
+
+
+} // edbee
@@ -7,9 +7,7 @@
 
 #include <QDir>
 #include <QList>
-#include <QHash>
-#include <QVariant>
-#include <QXmlStreamReader>
+#include <QMap>
 
 #include "edbee/models/textgrammar.h"
 #include "edbee/edbee.h"
@@ -31,9 +29,12 @@ TextGrammar* TmLanguageParser::parse(QIODevice* device)
 {
     TextGrammar* result=0;
 
-    if( beginParsing(device) ) {
-        QVariant plist = readNextPlistType( );
-        result = createLanguage( plist );
+    if( beginParsing(device) && readNextValue("dict") ) {
+        result = new TextGrammar( QString(), QString() );
+        readLanguage( result, true );
+        if( result->name().isEmpty() || result->displayName().isEmpty() ) {
+            raiseError("Name or scope is empty. Cannot parse language!");
+        }
     }
 
     if( !endParsing() ) {
@@ -63,90 +64,232 @@ TextGrammar* TmLanguageParser::parse(const QString& fileName)
 }
 
 
-/// sets the captures
-void TmLanguageParser::addCapturesToGrammarRule(TextGrammarRule* rule, QHash<QString, QVariant> captures, bool endCapture)
+/// Parses only the header of the given grammar file. The header is the name, scopeName and the fileTypes.
+/// All other values are skipped without converting them, no grammar rules are constructed.
+/// The rules of the returned (lazy) grammar are parsed by parseRules on first use
+/// @param fileName the grammar file to read
+/// @return the lazy language grammar or 0 on error
+TextGrammar* TmLanguageParser::parseHeader(const QString& fileName)
 {
-    if( captures.isEmpty() ){ return; }
-    QHashIterator<QString,QVariant> itr(captures);
-    while( itr.hasNext() ) {
-        itr.next();
-        QHash<QString,QVariant> fields = itr.value().toHash();
-        int keyIndex = itr.key().toInt();
-        QString name = fields.value("name").toString();
-        if( endCapture ) {
-            rule->setEndCapture(keyIndex,name);
+    QFile file(fileName);
+    if( !file.open( QIODevice::ReadOnly ) ) {
+        setLastErrorMessage( file.errorString()  );
+        return 0;
+    }
+
+    QString name;
+    QString scopeName;
+    QStringList fileTypes;
+    if( beginParsing(&file) && readNextValue("dict") ) {
+        int level = currentStackLevel();
+        while( readNextElement("key",level) ) {
+            QString key = readElementText();
+            if( key == "name" ) {
+                name = readStringValue();
+            } else if( key == "scopeName" ) {
+                scopeName = readStringValue();
+            } else if( key == "fileTypes" ) {
+                fileTypes = readStringListValue();
+            } else {
+                skipNextValue();
+            }
+        }
+    }
+
+    bool parsed = endParsing();
+    file.close();
+    if( !parsed ) { return 0; }
+
+    TextGrammar* result = 0;
+    if( name.isEmpty() || scopeName.isEmpty() ) {
+        setLastErrorMessage("Name or scope is empty. Cannot parse language!");
+    } else {
+        result = new TextGrammar( scopeName, name );
+        foreach( QString fileType, fileTypes ) {
+            result->addFileExtension( fileType );
+        }
+        result->setLazyFileName( fileName );
+    }
+    return result;
+}
+
+
+/// Parses the rules of the given grammar file and adds them to the given (lazy) grammar.
+/// The header of the grammar (name and file types) isn't changed.
+/// @param fileName the grammar file to read
+/// @param grammar the grammar to add the main rule and repository to
+/// @return true on success. On a parse error the grammar can contain the rules that were read before the error
+bool TmLanguageParser::parseRules(const QString& fileName, TextGrammar* grammar)
+{
+    QFile file(fileName);
+    if( !file.open( QIODevice::ReadOnly ) ) {
+        setLastErrorMessage( file.errorString()  );
+        return false;
+    }
+
+    if( beginParsing(&file) && readNextValue("dict") ) {
+        readLanguage( grammar, false );
+    }
+    bool result = endParsing();
+    file.close();
+    return result;
+}
+
+
+/// Reads the language dictionary. The rules are constructed directly while reading the xml (no variant tree is built)
+/// @param grammar the grammar to fill
+/// @param readHeader should the header (name, scopeName and fileTypes) be stored in the grammar
+void TmLanguageParser::readLanguage(TextGrammar* grammar, bool readHeader)
+{
+    TextGrammarRule* mainRule = TextGrammarRule::createMainRule( grammar, grammar->name() );
+    grammar->giveMainRule(mainRule);
+
+    int level = currentStackLevel();
+    while( readNextElement("key",level) ) {
+        QString key = readElementText();
+        if( key == "patterns" ) {
+            QList<TextGrammarRule*> patterns;
+            readPatterns( grammar, patterns );
+            foreach( TextGrammarRule* rule, patterns ) { mainRule->giveRule( rule ); }
+
+        } else if( key == "repository" ) {
+            readRepository( grammar );
+
+        } else if( key == "name" && readHeader ) {
+            grammar->setDisplayName( readStringValue() );
+
+        } else if( key == "scopeName" && readHeader ) {
+            grammar->setName( readStringValue() );
+
+        } else if( key == "fileTypes" && readHeader ) {
+            foreach( QString fileType, readStringListValue() ) {
+                grammar->addFileExtension( fileType );
+            }
+
         } else {
-            rule->setCapture(keyIndex,name);
+            skipNextValue();
         }
     }
+
+    // the scopeName can be defined after the patterns
+    mainRule->setScopeName( grammar->name() );
 }
 
 
-/// Adds all patterns to the grammar rules
-void TmLanguageParser::addPatternsToGrammarRule(TextGrammarRule* rule, QList<QVariant> patterns)
+/// Reads the repository dictionary and adds all named rules to the grammar
+void TmLanguageParser::readRepository(TextGrammar* grammar)
 {
-    foreach( QVariant pattern, patterns ) {
-        TextGrammarRule* childRule = createGrammarRule( rule->grammar(), pattern );
-        if( childRule ) { rule->giveRule( childRule ); }
+    if( !readNextValue("dict") ) { return; }
+    int level = currentStackLevel();
+    while( readNextElement("key",level) ) {
+        QString name = readElementText();
+        if( readNextValue("dict") ) {
+            grammar->giveToRepos( name, readRule( grammar ) );
+        } else {
+            qlog_warn() << "Error create grammar rule!";
+        }
     }
 }
 
 
-/// creates a grammar rue
-TextGrammarRule* TmLanguageParser::createGrammarRule( TextGrammar* grammar, const QVariant& data)
+/// Reads an array of rules
+/// @param grammar the grammar the rules belong to
+/// @param rules (out) the list the created rules are appended to
+void TmLanguageParser::readPatterns(TextGrammar* grammar, QList<TextGrammarRule*>& rules)
 {
-    QHash<QString,QVariant> map = data.toHash();
-    QString match = map.value("match").toString();
-    QString include = map.value("include").toString();
-    QString begin = map.value("begin").toString();
-    QString name = map.value("name").toString();
+    if( !readNextValue("array") ) { return; }
+    int level = currentStackLevel();
+    while( readNextElement("",level) ) {
+        if( currentElementName().compare( "dict", Qt::CaseInsensitive ) == 0 ) {
+            rules.append( readRule( grammar ) );
+        } else {
+            skipElement();
+        }
+    }
+}
+
+
+/// Reads a captures dictionary: { "1" => { "name" => "scope" } }
+/// @param captures (out) the map to add the capture names to
+void TmLanguageParser::readCaptures(QMap<int,QString>& captures)
+{
+    if( !readNextValue("dict") ) { return; }
+    int level = currentStackLevel();
+    while( readNextElement("key",level) ) {
+        int keyIndex = readElementText().toInt();
+        QString name;
+        if( readNextValue("dict") ) {
+            int captureLevel = currentStackLevel();
+            while( readNextElement("key",captureLevel) ) {
+                if( readElementText() == "name" ) {
+                    name = readStringValue();
+                } else {
+                    skipNextValue();
+                }
+            }
+        }
+        captures.insert( keyIndex, name );
+    }
+}
+
+
+/// Reads a single grammar rule. The <dict> element of the rule must be read already.
+/// The keys of a rule can be in any order, so the values are collected before the rule is created
+/// @param grammar the grammar this rule belongs to
+/// @return the created grammar rule
+TextGrammarRule* TmLanguageParser::readRule(TextGrammar* grammar)
+{
+    QString match, include, begin, end, name;
+    QMap<int,QString> captures, beginCaptures, endCaptures;
+    QList<TextGrammarRule*> patterns;
+
+    int level = currentStackLevel();
+    while( readNextElement("key",level) ) {
+        QString key = readElementText();
+        if( key == "match" ) { match = readStringValue(); }
+        else if( key == "include" ) { include = readStringValue(); }
+        else if( key == "begin" ) { begin = readStringValue(); }
+        else if( key == "end" ) { end = readStringValue(); }
+        else if( key == "name" ) { name = readStringValue(); }
+        else if( key == "captures" ) { readCaptures( captures ); }
+        else if( key == "beginCaptures" ) { readCaptures( beginCaptures ); }
+        else if( key == "endCaptures" ) { readCaptures( endCaptures ); }
+        else if( key == "patterns" ) { readPatterns( grammar, patterns ); }
+        else { skipNextValue(); }
+    }
+
+    TextGrammarRule* rule = 0;
 
     // match filled?
     if( !match.isEmpty() ) {
-        TextGrammarRule* rule = TextGrammarRule::createSingleLineRegExp( grammar, name, match );
-        QHash<QString,QVariant> captures = map.value("captures").toHash();
-        addCapturesToGrammarRule( rule, captures );
-        return rule;
+        rule = TextGrammarRule::createSingleLineRegExp( grammar, name, match );
+        addCaptures( rule, captures, false );
 
     } else if( !include.isEmpty() ) {
-        return TextGrammarRule::createIncludeRule( grammar, include );
+        rule = TextGrammarRule::createIncludeRule( grammar, include );
 
     } else if( !begin.isEmpty() ) {
-        QString end = map.value("end").toString();
-
         // TODO: contentScopeName
         QString contentScope = name;
-        TextGrammarRule* rule = TextGrammarRule::createMultiLineRegExp( grammar, name, contentScope, begin, end  );
-
-        // add the patterns
-        QList<QVariant> patterns = map.value("patterns").toList();
-        addPatternsToGrammarRule( rule, patterns );
-
-        if( map.contains("captures")) {
-            QHash<QString,QVariant> captures = map.value("captures").toHash();
-            addCapturesToGrammarRule( rule, captures );
-            addCapturesToGrammarRule( rule, captures, true );
-        }
-        if( map.contains("beginCaptures")) {
-            QHash<QString,QVariant> captures = map.value("beginCaptures").toHash();
-            addCapturesToGrammarRule( rule, captures );
-        }
-        if( map.contains("endCaptures")) {
-            QHash<QString,QVariant> endCaptures = map.value("endCaptures").toHash();
-            addCapturesToGrammarRule( rule, endCaptures, true );
-        }
-        return rule;
+        rule = TextGrammarRule::createMultiLineRegExp( grammar, name, contentScope, begin, end  );
 
+        // the captures apply to begin and end. beginCaptures and endCaptures overrule them
+        addCaptures( rule, captures, false );
+        addCaptures( rule, captures, true );
+        addCaptures( rule, beginCaptures, false );
+        addCaptures( rule, endCaptures, true );
 
     } else {
-        TextGrammarRule* rule = TextGrammarRule::createRuleList(grammar);
-
-        // add the patterns
-        QList<QVariant> patterns = map.value("patterns").toList();
-        addPatternsToGrammarRule( rule, patterns );
+        rule = TextGrammarRule::createRuleList(grammar);
+    }
 
-        return rule;
+    // only rule-lists and multi-line rules have sub-patterns
+    if( rule->isRuleList() || rule->isMultiLineRegExp() ) {
+        foreach( TextGrammarRule* child, patterns ) { rule->giveRule( child ); }
+    } else {
+        qDeleteAll( patterns );
     }
+    return rule;
 
 
 //    <key>angle_brackets</key>
@@ -172,52 +315,21 @@ TextGrammarRule* TmLanguageParser::createGrammarRule( TextGrammar* grammar, cons
 }
 
 
-// parses the given language
-TextGrammar* TmLanguageParser::createLanguage(QVariant& data)
+/// Adds the captures to the grammar rule
+/// @param rule the rule to add the captures to
+/// @param captures the capture names
+/// @param endCapture should the captures be added as end-captures
+void TmLanguageParser::addCaptures(TextGrammarRule* rule, const QMap<int,QString>& captures, bool endCapture)
 {
-    QHash<QString,QVariant> hashMap = data.toHash();
-    QString name      = hashMap.value("name").toString();
-    QString scopeName = hashMap.value("scopeName").toString();
-    QString uuid      = hashMap.value("uuid").toString();
-
-    if( name.isEmpty() || scopeName.isEmpty() ) {
-        raiseError("Name or scope is empty. Cannot parse language!");
-        return 0;
-    }
-
-    // construct the grammar
-    TextGrammar* grammar = new TextGrammar( scopeName, name );
-
-    // and get the main patterns
-    // construct the main rule
-    TextGrammarRule* mainRule = TextGrammarRule::createMainRule( grammar, scopeName );
-    grammar->giveMainRule(mainRule);
-
-    QList<QVariant> patterns = hashMap.value("patterns").toList();
-    addPatternsToGrammarRule( mainRule, patterns );
-
-
-    // get the repos
-    QHash<QString,QVariant> repos  = hashMap.value("repository").toHash();
-    QHashIterator<QString,QVariant> itr(repos);
+    QMapIterator<int,QString> itr(captures);
     while( itr.hasNext() ) {
         itr.next();
-        TextGrammarRule* rule = createGrammarRule( grammar, itr.value() );
-        if( rule ) {
-            grammar->giveToRepos( itr.key(), rule  );
+        if( endCapture ) {
+            rule->setEndCapture( itr.key(), itr.value() );
         } else {
-            qlog_warn() << "Error create grammar rule!";
+            rule->setCapture( itr.key(), itr.value() );
         }
     }
-
-    // add the file types
-    QStringList fileTypes = hashMap.value("fileTypes").toStringList();
-    foreach( QString fileType, fileTypes ) {
-        grammar->addFileExtension( fileType );
-    }
-
-
-    return grammar;
 }
 
 
@@ -7,8 +7,7 @@
 
 #include <QList>
 #include <QMap>
-#include <QStack>
-#include <QVariant>
+#include <QString>
 
 #include "baseplistparser.h"
 
@@ -23,6 +22,7 @@ class TextGrammarManager;
 class TextGrammarRule;
 
 /// For parsing a Textmate Language
+/// The grammar rules are constructed directly from the xml stream, no intermediate variant tree is built
 class TmLanguageParser : public BasePListParser
 {
 public:
@@ -31,14 +31,17 @@ public:
     TextGrammar* parse(const QFile& file );
     TextGrammar* parse( const QString& fileName );
 
-protected:
-
-    void addCapturesToGrammarRule( TextGrammarRule* rule, QHash<QString,QVariant> captures, bool endCapture=false );
-    void addPatternsToGrammarRule( TextGrammarRule* rule, QList<QVariant> patterns );
+    TextGrammar* parseHeader( const QString& fileName );
+    bool parseRules( const QString& fileName, TextGrammar* grammar );
 
-    TextGrammarRule* createGrammarRule(TextGrammar *grammar, const QVariant &data );
-    TextGrammar* createLanguage(QVariant& data );
+protected:
 
+    void readLanguage( TextGrammar* grammar, bool readHeader );
+    void readRepository( TextGrammar* grammar );
+    void readPatterns( TextGrammar* grammar, QList<TextGrammarRule*>& rules );
+    void readCaptures( QMap<int,QString>& captures );
+    TextGrammarRule* readRule( TextGrammar* grammar );
+    void addCaptures( TextGrammarRule* rule, const QMap<int,QString>& captures, bool endCapture );
 
 };
 
@@ -0,0 +1,280 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "grammarlexerstatistics.h"
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include "edbee/models/textgrammar.h"
+#include "edbee/util/regexp.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Constructs empty rule statistics
+GrammarRuleStatistics::GrammarRuleStatistics()
+    : searchCount(0)
+    , skippedCount(0)
+    , matchCount(0)
+    , winCount(0)
+    , nsecs(0)
+{
+}
+
+
+/// Sorts the rule statistics on the search time (most expensive first)
+static bool lessThanRuleStatistics( const GrammarRuleStatistics& stats1, const GrammarRuleStatistics& stats2 )
+{
+    if( stats1.nsecs != stats2.nsecs ) { return stats1.nsecs > stats2.nsecs; }
+    return stats1.searchCount > stats2.searchCount;
+}
+
+
+//=================================================
+
+
+/// Constructs the (empty) lexer statistics
+GrammarLexerStatistics::GrammarLexerStatistics()
+    : lineCount_(0)
+    , lineNsecs_(0)
+{
+}
+
+
+/// The destructor
+GrammarLexerStatistics::~GrammarLexerStatistics()
+{
+}
+
+
+/// Clears all statistics
+void GrammarLexerStatistics::clear()
+{
+    for( int i=0; i<SearchKindCount; ++i ) {
+        ruleStatisticsMap_[i].clear();
+    }
+    lineCount_ = 0;
+    lineNsecs_ = 0;
+}
+
+
+/// Adds the given statistics to this statistics
+/// (For example the statistics of the lexers of the chunks that are lexed in parallel)
+/// @param other the statistics to add
+void GrammarLexerStatistics::merge( const GrammarLexerStatistics& other )
+{
+    for( int i=0; i<SearchKindCount; ++i ) {
+        QHashIterator<TextGrammarRule*,GrammarRuleStatistics> itr( other.ruleStatisticsMap_[i] );
+        while( itr.hasNext() ) {
+            itr.next();
+            const GrammarRuleStatistics& otherStats = itr.value();
+            GrammarRuleStatistics& stats = statisticsForRule( itr.key(), static_cast<SearchKind>(i) );
+            if( stats.pattern.isEmpty() ) { stats.pattern = otherStats.pattern; }
+            stats.searchCount += otherStats.searchCount;
+            stats.skippedCount += otherStats.skippedCount;
+            stats.matchCount += otherStats.matchCount;
+            stats.winCount += otherStats.winCount;
+            stats.nsecs += otherStats.nsecs;
+        }
+    }
+    lineCount_ += other.lineCount_;
+    lineNsecs_ += other.lineNsecs_;
+}
+
+
+/// Searches the given regexp and records the search (and the match)
+/// @param regExp the regexp to search
+/// @param line the line to search
+/// @param offset the offset in the line to start searching
+/// @param rule the rule the search is recorded on
+/// @param kind the kind of search
+/// @return the result of RegExp::indexIn
+int GrammarLexerStatistics::indexIn( RegExp* regExp, const QString& line, int offset, TextGrammarRule* rule, SearchKind kind )
+{
+    int skippedCount = regExp->skippedSearchCount();
+    QElapsedTimer timer;
+    timer.start();
+    int pos = regExp->indexIn( line, offset );
+    recordSearch( rule, kind, regExp->pattern(), timer.nsecsElapsed(), regExp->skippedSearchCount() != skippedCount );
+    if( pos >= 0 ) { recordMatch( rule, kind ); }
+    return pos;
+}
+
+
+/// Records a regexp search
+/// @param rule the searched rule (the context rule for a combined search)
+/// @param kind the kind of search
+/// @param pattern the searched pattern
+/// @param nsecs the search time in nano-seconds
+/// @param skipped was the search rejected by the required literal prefilter?
+void GrammarLexerStatistics::recordSearch( TextGrammarRule* rule, SearchKind kind, const QString& pattern, qint64 nsecs, bool skipped )
+{
+    GrammarRuleStatistics& stats = statisticsForRule( rule, kind );
+    if( stats.pattern.isEmpty() ) { stats.pattern = pattern; }
+    ++stats.searchCount;
+    if( skipped ) { ++stats.skippedCount; }
+    stats.nsecs += nsecs;
+}
+
+
+/// Records a search of the given rule that found a match
+void GrammarLexerStatistics::recordMatch( TextGrammarRule* rule, SearchKind kind )
+{
+    ++statisticsForRule( rule, kind ).matchCount;
+}
+
+
+/// Records a match of the given rule that has been applied
+void GrammarLexerStatistics::recordWin( TextGrammarRule* rule, SearchKind kind )
+{
+    ++statisticsForRule( rule, kind ).winCount;
+}
+
+
+/// Records a lexed line
+/// @param nsecs the time it took to lex the line
+void GrammarLexerStatistics::recordLine( qint64 nsecs )
+{
+    ++lineCount_;
+    lineNsecs_ += nsecs;
+}
+
+
+/// Returns the statistics of the given rule
+/// @return the statistics or 0 if the rule hasn't been searched
+const GrammarRuleStatistics* GrammarLexerStatistics::ruleStatistics( TextGrammarRule* rule, SearchKind kind ) const
+{
+    QHash<TextGrammarRule*,GrammarRuleStatistics>::const_iterator itr = ruleStatisticsMap_[kind].constFind( rule );
+    if( itr == ruleStatisticsMap_[kind].constEnd() ) { return 0; }
+    return &itr.value();
+}
+
+
+/// Returns the statistics of all rules for the given kind of search, the most expensive rules first
+QList<GrammarRuleStatistics> GrammarLexerStatistics::allRuleStatistics( SearchKind kind ) const
+{
+    QList<GrammarRuleStatistics> result = ruleStatisticsMap_[kind].values();
+    qSort( result.begin(), result.end(), lessThanRuleStatistics );
+    return result;
+}
+
+
+/// Returns the number of lexed lines (lines that reused interned scopes aren't counted)
+int GrammarLexerStatistics::lineCount() const
+{
+    return lineCount_;
+}
+
+
+/// Returns the total time of the lexed lines in nano-seconds
+qint64 GrammarLexerStatistics::lineNsecs() const
+{
+    return lineNsecs_;
+}
+
+
+/// Returns the total number of regexp searches
+int GrammarLexerStatistics::searchCount() const
+{
+    int result = 0;
+    for( int i=0; i<SearchKindCount; ++i ) {
+        foreach( const GrammarRuleStatistics& stats, ruleStatisticsMap_[i] ) {
+            result += stats.searchCount;
+        }
+    }
+    return result;
+}
+
+
+/// Returns a readable table with the statistics, the most expensive rules first
+QString GrammarLexerStatistics::toString() const
+{
+    int totalSearches = searchCount();
+    QString result = QString("Lexer statistics: %1 lines, %2 ms, %3 searches (%4 per line)\n")
+        .arg(lineCount_)
+        .arg(lineNsecs_ / 1000000.0, 0, 'f', 2 )
+        .arg(totalSearches)
+        .arg(lineCount_ ? double(totalSearches) / lineCount_ : 0.0, 0, 'f', 1 );
+
+    for( int i=0; i<SearchKindCount; ++i ) {
+        QList<GrammarRuleStatistics> list = allRuleStatistics( static_cast<SearchKind>(i) );
+        if( list.isEmpty() ) { continue; }
+        result.append( QString("\n%1:\n").arg( kindName( static_cast<SearchKind>(i) ) ) );
+        result.append( QString("%1 %2 %3 %4 %5 %6  %7\n")
+            .arg("time(ms)",10).arg("searches",9).arg("skipped",8).arg("wins",8).arg("wasted",8).arg("us/search",9).arg("scope / pattern") );
+        foreach( const GrammarRuleStatistics& stats, list ) {
+            result.append( QString("%1 %2 %3 %4 %5 %6  %7 %8\n")
+                .arg(stats.nsecs / 1000000.0, 10, 'f', 3 )
+                .arg(stats.searchCount,9)
+                .arg(stats.skippedCount,8)
+                .arg(stats.winCount,8)
+                .arg(stats.wastedCount(),8)
+                .arg(stats.searchCount ? stats.nsecs / 1000.0 / stats.searchCount : 0.0, 9, 'f', 2 )
+                .arg(stats.scopeName.isEmpty() ? QString("-") : stats.scopeName, stats.pattern ) );
+        }
+    }
+    return result;
+}
+
+
+/// Exports the statistics as a json document
+QString GrammarLexerStatistics::toJson() const
+{
+    QJsonObject result;
+    result.insert( "lines", lineCount_ );
+    result.insert( "nsecs", static_cast<double>( lineNsecs_ ) );
+    result.insert( "searches", searchCount() );
+    for( int i=0; i<SearchKindCount; ++i ) {
+        QJsonArray rules;
+        foreach( const GrammarRuleStatistics& stats, allRuleStatistics( static_cast<SearchKind>(i) ) ) {
+            QJsonObject rule;
+            rule.insert( "scope", stats.scopeName );
+            rule.insert( "pattern", stats.pattern );
+            rule.insert( "searches", stats.searchCount );
+            rule.insert( "skipped", stats.skippedCount );
+            rule.insert( "matches", stats.matchCount );
+            rule.insert( "wins", stats.winCount );
+            rule.insert( "wasted", stats.wastedCount() );
+            rule.insert( "nsecs", static_cast<double>( stats.nsecs ) );
+            rules.append( rule );
+        }
+        result.insert( kindName( static_cast<SearchKind>(i) ), rules );
+    }
+    return QString::fromUtf8( QJsonDocument( result ).toJson() );
+}
+
+
+/// Returns the name of the given kind of search
+QString GrammarLexerStatistics::kindName( SearchKind kind )
+{
+    switch( kind ) {
+        case MatchSearch: return "match";
+        case EndSearch: return "end";
+        case CombinedSearch: return "combined";
+        default: return "unknown";
+    }
+}
+
+
+/// Returns the (modifiable) statistics of the given rule. The statistics are created when they don't exist
+GrammarRuleStatistics& GrammarLexerStatistics::statisticsForRule( TextGrammarRule* rule, SearchKind kind )
+{
+    QHash<TextGrammarRule*,GrammarRuleStatistics>& map = ruleStatisticsMap_[kind];
+    QHash<TextGrammarRule*,GrammarRuleStatistics>::iterator itr = map.find( rule );
+    if( itr == map.end() ) {
+        itr = map.insert( rule, GrammarRuleStatistics() );
+        itr.value().scopeName = rule->scopeName();
+    }
+    return itr.value();
+}
+
+
+} // edbee
@@ -0,0 +1,91 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+
+namespace edbee {
+
+class RegExp;
+class TextGrammarRule;
+
+
+/// The search statistics of a single grammar rule
+class GrammarRuleStatistics
+{
+public:
+    GrammarRuleStatistics();
+
+    QString scopeName;          ///< The scope name of the rule
+    QString pattern;            ///< The searched pattern
+    int searchCount;            ///< The number of searches
+    int skippedCount;           ///< The number of searches that were rejected by the required literal prefilter
+    int matchCount;             ///< The number of searches that found a match
+    int winCount;               ///< The number of matches that were applied (the leftmost match)
+    qint64 nsecs;               ///< The cumulative search time in nano-seconds
+
+    int wastedCount() const { return matchCount - winCount; }
+};
+
+
+/// The lexing statistics of a grammar text lexer. It records the regexp searches per grammar rule.
+///
+/// There are three kinds of searches:
+/// - MatchSearch: the search of the match (or begin) pattern of a rule
+/// - EndSearch: the search of the end-pattern of an active multi-line rule
+/// - CombinedSearch: the search of the combined regexp of a context (multi-pattern scan). A search with a match is recorded
+///   on the matched rule, a search without a match on the context rule
+///
+/// A match that isn't applied because another rule matched earlier in the line (or at the same position, but before it
+/// in the rule order) is wasted. The wins are recorded by the lexer, after the match is compared with the end-pattern
+/// of the active rule.
+class GrammarLexerStatistics
+{
+public:
+    enum SearchKind {
+        MatchSearch,
+        EndSearch,
+        CombinedSearch,
+        SearchKindCount
+    };
+
+    GrammarLexerStatistics();
+    virtual ~GrammarLexerStatistics();
+
+    void clear();
+    void merge( const GrammarLexerStatistics& other );
+
+    int indexIn( RegExp* regExp, const QString& line, int offset, TextGrammarRule* rule, SearchKind kind );
+
+    void recordSearch( TextGrammarRule* rule, SearchKind kind, const QString& pattern, qint64 nsecs, bool skipped );
+    void recordMatch( TextGrammarRule* rule, SearchKind kind );
+    void recordWin( TextGrammarRule* rule, SearchKind kind );
+    void recordLine( qint64 nsecs );
+
+    const GrammarRuleStatistics* ruleStatistics( TextGrammarRule* rule, SearchKind kind ) const;
+    QList<GrammarRuleStatistics> allRuleStatistics( SearchKind kind ) const;
+    int lineCount() const;
+    qint64 lineNsecs() const;
+    int searchCount() const;
+
+    QString toString() const;
+    QString toJson() const;
+
+    static QString kindName( SearchKind kind );
+
+private:
+    GrammarRuleStatistics& statisticsForRule( TextGrammarRule* rule, SearchKind kind );
+
+private:
+    QHash<TextGrammarRule*,GrammarRuleStatistics> ruleStatisticsMap_[SearchKindCount];  ///< The statistics per rule, for every kind of search
+    int lineCount_;                 ///< The number of lexed lines
+    qint64 lineNsecs_;              ///< The total lexing time of the lines
+};
+
+
+} // edbee
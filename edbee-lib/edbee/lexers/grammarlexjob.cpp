@@ -0,0 +1,301 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "grammarlexjob.h"
+
+#include "edbee/lexers/grammartextlexer.h"
+#include "edbee/models/textdocument.h"
+#include "edbee/models/textgrammar.h"
+#include "edbee/edbee.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+/// The number of lines a chunk lexes before checking if the job is canceled
+static const int ChunkBatchLineCount = 100;
+
+
+/// Releases a reference to a line scoped range list. The list is deleted when it isn't used anymore
+/// @param list the list to release (may be 0)
+static void releaseLineScopedRangeList( ScopedTextRangeList* list )
+{
+    if( list && !list->deref() ) { delete list; }
+}
+
+
+/// Creates a chunk (the chunk is lexed in the worker thread)
+/// @param job the job this chunk belongs to
+/// @param lineStart the first line of the chunk in the original document
+/// @param lineCount the number of lines of the chunk
+/// @param text the text of the chunk
+GrammarLexChunk::GrammarLexChunk( GrammarLexJob* job, int lineStart, int lineCount, const QString& text )
+    : jobRef_( job )
+    , lineStart_( lineStart )
+    , lineCount_( lineCount )
+    , text_( text )
+    , lexer_( 0 )
+    , startRange_( 0, text.length(), Edbee::instance()->scopeManager()->refTextScope( job->grammar()->mainRule()->scopeName() ) )
+{
+    setAutoDelete( false );
+    startRange_.setGrammarRule( job->grammar()->mainRule() );
+}
+
+
+/// The destructor deletes all (not taken) speculative scopes
+GrammarLexChunk::~GrammarLexChunk()
+{
+    delete lexer_;
+    foreach( ScopedTextRangeList* list, lineRangeLists_ ) { releaseLineScopedRangeList( list ); }
+    foreach( ScopedTextRangeList* list, internedLineRangeListMap_ ) { releaseLineScopedRangeList( list ); }
+    qDeleteAll( multiLineRanges_ );
+}
+
+
+/// Lexes all lines of the chunk (in the worker thread). The lexing stops early when the job is canceled.
+void GrammarLexChunk::run()
+{
+    lineOffsets_.reserve( lineCount_ + 1 );
+    lineOffsets_.append( 0 );
+    for( int offset = text_.indexOf( QChar('\n') ); offset >= 0 && lineOffsets_.size() < lineCount_; offset = text_.indexOf( QChar('\n'), offset + 1 ) ) {
+        lineOffsets_.append( offset + 1 );
+    }
+    while( lineOffsets_.size() <= lineCount_ ) { lineOffsets_.append( text_.length() ); }
+    lineRangeLists_.fill( 0, lineCount_ );
+
+    GrammarTextLexer* chunkLexer = new GrammarTextLexer( this, jobRef_->grammar() );
+    chunkLexer->maxLineLength_ = jobRef_->maxLineLength();
+    chunkLexer->lineTimeBudget_ = jobRef_->lineTimeBudget();
+    chunkLexer->lineEndStatesRef_ = &lineEndStates_;
+    chunkLexer->setStatisticsEnabled( jobRef_->isStatisticsEnabled() );
+    chunkLexer->activeMultiLineRangesRefList_.append( &startRange_ );
+
+    int offset = 0;
+    for( int line=0; line < lineCount_; ++line ) {
+        if( line % ChunkBatchLineCount == 0 && jobRef_->isCanceled() ) { break; }
+        chunkLexer->lexLine( line, offset );
+    }
+    lexer_ = chunkLexer;
+
+    QMetaObject::invokeMethod( jobRef_, "chunkFinished", Qt::QueuedConnection );
+}
+
+
+/// Returns the text of the given line of the chunk (inclusive the trailing newline)
+/// @param line the line in the chunk
+QString GrammarLexChunk::line( int line ) const
+{
+    int offset = offsetFromLine( line );
+    return text_.mid( offset, offsetFromLine( line + 1 ) - offset );
+}
+
+
+/// Returns the offset of the given line in the text of the chunk
+/// @param line the line in the chunk (lineCount() returns the length of the chunk)
+int GrammarLexChunk::offsetFromLine( int line ) const
+{
+    return lineOffsets_.at( line );
+}
+
+
+/// Sets the scopes of the given line
+/// @param line the line in the chunk
+/// @param list the scopes of the line, the chunk takes over the reference of the caller
+void GrammarLexChunk::giveLineScopedRangeList( int line, ScopedTextRangeList* list )
+{
+    releaseLineScopedRangeList( lineRangeLists_.at( line ) );
+    lineRangeLists_[line] = list;
+}
+
+
+/// Takes the scopes of the given line
+/// @param line the line in the chunk
+/// @return the scopes (or 0), the caller owns the reference of the line
+ScopedTextRangeList* GrammarLexChunk::takeLineScopedRangeList( int line )
+{
+    ScopedTextRangeList* result = lineRangeLists_.at( line );
+    lineRangeLists_[line] = 0;
+    return result;
+}
+
+
+/// Adds a multi-line range that is started in this chunk
+/// @param range the range, the chunk becomes the owner
+void GrammarLexChunk::giveMultiLineScopedTextRange( MultiLineScopedTextRange* range )
+{
+    multiLineRanges_.append( range );
+}
+
+
+/// Takes all multi-line ranges that are started in this chunk (the start range isn't included)
+/// @return the list of ranges, the caller is the owner
+QList<MultiLineScopedTextRange*> GrammarLexChunk::takeAllMultiLineScopedTextRanges()
+{
+    QList<MultiLineScopedTextRange*> result = multiLineRanges_;
+    multiLineRanges_.clear();
+    return result;
+}
+
+
+/// Finds the interned scopes of an identical line of this chunk
+/// @param key the intern key of the line
+/// @return the list with an extra reference for the caller, or 0 if not found
+ScopedTextRangeList* GrammarLexChunk::findInternedLineScopedRangeList( const QString& key )
+{
+    ScopedTextRangeList* list = internedLineRangeListMap_.value( key, 0 );
+    if( list ) { list->ref(); }
+    return list;
+}
+
+
+/// Interns an independent line scope list, so identical lines of this chunk can share this list.
+/// (The size of the table is limited by the text of the chunk)
+/// @param key the intern key of the line
+/// @param list the list to intern. The table adds its own reference
+void GrammarLexChunk::internLineScopedRangeList( const QString& key, ScopedTextRangeList* list )
+{
+    list->ref();
+    releaseLineScopedRangeList( internedLineRangeListMap_.value( key, 0 ) );
+    internedLineRangeListMap_.insert( key, list );
+}
+
+
+//==========================
+
+
+/// Creates the job and the chunks. The text of the chunks is copied from the document of the lexer
+/// @param lexer the lexer that receives the results
+/// @param lineStart the first line to lex
+/// @param lineCount the number of lines to lex
+/// @param chunkLineCount the number of lines per chunk
+GrammarLexJob::GrammarLexJob( GrammarTextLexer* lexer, int lineStart, int lineCount, int chunkLineCount )
+    : lexerRef_( lexer )
+    , grammarRef_( lexer->grammar() )
+    , lineStart_( lineStart )
+    , lineCount_( lineCount )
+    , maxLineLength_( lexer->maxLineLength() )
+    , lineTimeBudget_( lexer->lineTimeBudget() )
+    , statisticsEnabled_( lexer->isStatisticsEnabled() )
+    , finishedChunkCount_( 0 )
+    , canceled_( 0 )
+{
+    Q_ASSERT( chunkLineCount > 0 );
+    TextDocument* doc = lexer->textDocument();
+    for( int line=lineStart, endLine=lineStart+lineCount; line < endLine; line += chunkLineCount ) {
+        int count = qMin( chunkLineCount, endLine - line );
+        int offset = doc->offsetFromLine( line );
+        chunks_.append( new GrammarLexChunk( this, line, count, doc->textPart( offset, doc->offsetFromLine( line + count ) - offset ) ) );
+    }
+}
+
+
+/// The destructor cancels the job and waits for the running chunks
+GrammarLexJob::~GrammarLexJob()
+{
+    cancel();
+    pool_.waitForDone();
+    qDeleteAll( chunks_ );
+}
+
+
+/// Starts lexing the chunks in the thread pool
+void GrammarLexJob::start()
+{
+    foreach( GrammarLexChunk* chunk, chunks_ ) {
+        pool_.start( chunk );
+    }
+}
+
+
+/// Cancels the job. The running chunks stop after the current batch of lines
+void GrammarLexJob::cancel()
+{
+    canceled_.storeRelease( 1 );
+}
+
+
+/// Waits until all chunks are lexed. The queued results are ignored after this call, the caller should apply them
+void GrammarLexJob::waitForDone()
+{
+    pool_.waitForDone();
+}
+
+
+/// Detaches the job from the lexer, the results aren't reported anymore
+void GrammarLexJob::detach()
+{
+    lexerRef_ = 0;
+}
+
+
+/// Returns true if the job is canceled
+bool GrammarLexJob::isCanceled() const
+{
+    return canceled_.loadAcquire() != 0;
+}
+
+
+/// Returns the first line of the job
+int GrammarLexJob::lineStart() const
+{
+    return lineStart_;
+}
+
+
+/// Returns the number of lines of the job
+int GrammarLexJob::lineCount() const
+{
+    return lineCount_;
+}
+
+
+/// Returns the grammar that's used for lexing
+TextGrammar* GrammarLexJob::grammar() const
+{
+    return grammarRef_;
+}
+
+
+/// Returns the maximum line length the chunks use
+int GrammarLexJob::maxLineLength() const
+{
+    return maxLineLength_;
+}
+
+
+/// Returns the line time budget the chunks use
+int GrammarLexJob::lineTimeBudget() const
+{
+    return lineTimeBudget_;
+}
+
+
+/// Returns true if the chunks record statistics
+bool GrammarLexJob::isStatisticsEnabled() const
+{
+    return statisticsEnabled_;
+}
+
+
+/// Returns the chunks of the job in document order
+QList<GrammarLexChunk*>& GrammarLexJob::chunks()
+{
+    return chunks_;
+}
+
+
+/// A chunk is lexed (queued from the worker thread). When all chunks are lexed the results are applied by the lexer,
+/// and the job is deleted
+void GrammarLexJob::chunkFinished()
+{
+    ++finishedChunkCount_;
+    if( finishedChunkCount_ == chunks_.size() && lexerRef_ ) {
+        lexerRef_->applyLexJob();
+        deleteLater();
+    }
+}
+
+
+} // edbee
@@ -0,0 +1,117 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+#include "edbee/models/textdocumentscopes.h"
+
+namespace edbee {
+
+class GrammarLexJob;
+class GrammarTextLexer;
+class TextGrammar;
+
+
+/// A chunk of a document that is lexed speculatively in a worker thread.
+/// The chunk only holds plain data (the text and the resulting scopes), there's no document or other QObject involved.
+/// The lexer of the chunk writes its scopes directly to the chunk. The lexing starts with the main rule of the grammar,
+/// which is a guess of the real lexer state at the start of the chunk.
+class GrammarLexChunk : public QRunnable
+{
+public:
+    GrammarLexChunk( GrammarLexJob* job, int lineStart, int lineCount, const QString& text );
+    virtual ~GrammarLexChunk();
+
+    virtual void run();
+
+    int lineStart() const { return lineStart_; }
+    int lineCount() const { return lineCount_; }
+    int length() const { return text_.length(); }
+    QString line( int line ) const;
+    int offsetFromLine( int line ) const;
+    GrammarTextLexer* lexer() const { return lexer_; }
+    QVector< QVector<MultiLineScopedTextRange*> >& lineEndStates() { return lineEndStates_; }
+    MultiLineScopedTextRange& startRange() { return startRange_; }
+
+    ScopedTextRangePool* scopedRangePool() { return &scopedRangePool_; }
+    void giveLineScopedRangeList( int line, ScopedTextRangeList* list );
+    ScopedTextRangeList* takeLineScopedRangeList( int line );
+    void giveMultiLineScopedTextRange( MultiLineScopedTextRange* range );
+    QList<MultiLineScopedTextRange*> takeAllMultiLineScopedTextRanges();
+    ScopedTextRangeList* findInternedLineScopedRangeList( const QString& key );
+    void internLineScopedRangeList( const QString& key, ScopedTextRangeList* list );
+
+private:
+    GrammarLexJob* jobRef_;                                         ///< The job this chunk belongs to
+    int lineStart_;                                                 ///< The first line of the chunk in the original document
+    int lineCount_;                                                 ///< The number of lines in this chunk
+    QString text_;                                                  ///< The text of this chunk
+    QVector<int> lineOffsets_;                                      ///< The offsets of the lines in the text (filled in the worker thread)
+    GrammarTextLexer* lexer_;                                       ///< The lexer of this chunk (0 until the chunk is lexed)
+
+    ScopedTextRangePool scopedRangePool_;                           ///< The pool for the ranges of the line scopes
+    MultiLineScopedTextRange startRange_;                           ///< The (guessed) range of the grammar at the start of the chunk
+    QVector<ScopedTextRangeList*> lineRangeLists_;                  ///< The scopes of every line (holds a reference)
+    QList<MultiLineScopedTextRange*> multiLineRanges_;              ///< The multi-line ranges that are started in this chunk
+    QHash<QString,ScopedTextRangeList*> internedLineRangeListMap_;  ///< The shared independent line scopes of this chunk (holds a reference)
+    QVector< QVector<MultiLineScopedTextRange*> > lineEndStates_;   ///< The active multi-line ranges at the end of every line
+};
+
+
+/// Lexes a range of lines of a document speculatively in a thread pool. The lines are split in chunks, every chunk is
+/// lexed in a worker thread. When all chunks are lexed the results are handed to the lexer with a queued call in the
+/// thread of the job, so the thread of the document never waits for the worker threads.
+class GrammarLexJob : public QObject
+{
+    Q_OBJECT
+
+public:
+    GrammarLexJob( GrammarTextLexer* lexer, int lineStart, int lineCount, int chunkLineCount );
+    virtual ~GrammarLexJob();
+
+    void start();
+    void cancel();
+    void waitForDone();
+    void detach();
+
+    bool isCanceled() const;
+    int lineStart() const;
+    int lineCount() const;
+    TextGrammar* grammar() const;
+    int maxLineLength() const;
+    int lineTimeBudget() const;
+    bool isStatisticsEnabled() const;
+    QList<GrammarLexChunk*>& chunks();
+
+private slots:
+
+    void chunkFinished();
+
+private:
+    GrammarTextLexer* lexerRef_;            ///< The lexer that receives the results (0 when detached)
+    TextGrammar* grammarRef_;               ///< The grammar used for lexing
+    int lineStart_;                         ///< The first line of the job
+    int lineCount_;                         ///< The number of lines of the job
+    int maxLineLength_;                     ///< The maximum line length of the lexer
+    int lineTimeBudget_;                    ///< The line time budget of the lexer
+    bool statisticsEnabled_;                ///< Should the chunks record statistics?
+
+    QList<GrammarLexChunk*> chunks_;        ///< The chunks in document order
+    int finishedChunkCount_;                ///< The number of chunks that have reported their results
+    QAtomicInt canceled_;                   ///< Is the job canceled? (the chunks stop lexing)
+    QThreadPool pool_;                      ///< The thread pool that lexes the chunks
+};
+
+
+} // edbee
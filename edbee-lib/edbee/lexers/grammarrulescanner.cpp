@@ -0,0 +1,257 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "grammarrulescanner.h"
+
+#include <QElapsedTimer>
+
+#include "edbee/lexers/grammarlexerstatistics.h"
+#include "edbee/models/textgrammar.h"
+#include "edbee/util/regexp.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Constructs the scanner for the given rules
+/// @param ruleRefList the single- and multi-line regexp rules of the context, in the order they should be matched
+/// @param privateRegExps when true, the scanner uses its own copies of the match regexps (required for lexing in another thread)
+GrammarRuleScanner::GrammarRuleScanner( const QVector<TextGrammarRule*>& ruleRefList, bool privateRegExps )
+    : ruleRefList_( ruleRefList )
+    , ownsRegExps_( privateRegExps )
+    , groupIndexList_( ruleRefList.size(), -1 )
+    , combinedRegExp_(0)
+    , combinedRuleCount_(0)
+{
+    regExpList_.reserve( ruleRefList.size() );
+    foreach( TextGrammarRule* rule, ruleRefList ) {
+        RegExp* regExp = rule->matchRegExp();
+        if( privateRegExps && regExp ) { regExp = regExp->clone(); }
+        regExpList_.append( regExp );
+    }
+    buildCombinedRegExp();
+}
+
+
+/// The destructor
+GrammarRuleScanner::~GrammarRuleScanner()
+{
+    delete combinedRegExp_;
+    if( ownsRegExps_ ) { qDeleteAll( regExpList_ ); }
+}
+
+
+/// Finds the grammar rule with the lowest match position. For rules matching at the same position the first rule wins.
+/// The found variables are only changed if a rule is found at a position lower then the given foundPosition.
+///
+/// @param line the line to search
+/// @param offsetInLine the offset to start searching
+/// @param foundRule (in/out) the found grammar rule
+/// @param foundRegExp (in/out) the regexp of the found rule. After a match this regexp contains the match captures
+/// @param foundPosition (in/out) the position of the match
+/// @param foundCombined (in/out) set to true if the found rule is matched by the combined regexp
+/// @param statistics the statistics to record the searches in (0 if disabled)
+/// @param contextRule the context rule of this scanner (a combined search without a match is recorded on this rule)
+/// @return false if a search failed (for example when the match stack limit is exceeded). The found rule isn't reliable then
+bool GrammarRuleScanner::findNextGrammarRule( const QString& line, int offsetInLine, TextGrammarRule*& foundRule, RegExp*& foundRegExp, int& foundPosition,
+                                              bool& foundCombined, GrammarLexerStatistics* statistics, TextGrammarRule* contextRule )
+{
+    // a single search for all combined rules
+    int combinedPos = -1;
+    int combinedIdx = -1;
+    qint64 combinedNsecs = 0;
+    bool combinedSkipped = false;
+    if( combinedRegExp_ ) {
+        int skippedCount = combinedRegExp_->skippedSearchCount();
+        QElapsedTimer timer;
+        if( statistics ) { timer.start(); }
+        combinedPos = combinedRegExp_->indexIn( line, offsetInLine );
+        if( statistics ) { combinedNsecs = timer.nsecsElapsed(); }
+        combinedSkipped = combinedRegExp_->skippedSearchCount() != skippedCount;
+        if( combinedPos < -1 ) {
+            if( statistics ) { statistics->recordSearch( contextRule, GrammarLexerStatistics::CombinedSearch, combinedRegExp_->pattern(), combinedNsecs, combinedSkipped ); }
+            return false;
+        }
+        if( combinedPos >= 0 ) {
+            for( int i=0, cnt=groupIndexList_.size(); i<cnt; ++i ) {
+                int groupIndex = groupIndexList_.at(i);
+                if( groupIndex > 0 && combinedRegExp_->pos(groupIndex) >= 0 ) {
+                    combinedIdx = i;
+                    break;
+                }
+            }
+        }
+    }
+
+    // merge the combined result with the individually searched rules (keeping the rule order)
+    bool combinedFound = false;
+    for( int i=0, cnt=ruleRefList_.size(); i<cnt; ++i ) {
+        int pos = -1;
+        if( groupIndexList_.at(i) > 0 ) {
+            if( i != combinedIdx ) { continue; }
+            pos = combinedPos;
+        } else {
+            if( statistics ) {
+                pos = statistics->indexIn( regExpList_.at(i), line, offsetInLine, ruleRefList_.at(i), GrammarLexerStatistics::MatchSearch );
+            } else {
+                pos = regExpList_.at(i)->indexIn( line, offsetInLine );
+            }
+            if( pos < -1 ) { return false; }
+        }
+
+        if( pos >= 0 && pos < foundPosition ) {
+            foundRule     = ruleRefList_.at(i);
+            foundRegExp   = regExpList_.at(i);
+            foundPosition = pos;
+            combinedFound = ( i == combinedIdx );
+            foundCombined = combinedFound;
+        }
+    }
+
+    // the combined regexp only tells which rule matched. The captures are read from the rule's own regexp
+    // (This search succeeds immediately at the found position)
+    if( combinedFound ) {
+        QElapsedTimer timer;
+        if( statistics ) { timer.start(); }
+        foundRegExp->indexIn( line, foundPosition );
+        if( statistics ) { combinedNsecs += timer.nsecsElapsed(); }
+    }
+
+    // a combined search that matches is recorded on the matched rule (the win is recorded by the lexer)
+    if( statistics && combinedRegExp_ ) {
+        if( combinedIdx >= 0 ) {
+            TextGrammarRule* matchedRule = ruleRefList_.at(combinedIdx);
+            statistics->recordSearch( matchedRule, GrammarLexerStatistics::CombinedSearch, regExpList_.at(combinedIdx)->pattern(), combinedNsecs, combinedSkipped );
+            statistics->recordMatch( matchedRule, GrammarLexerStatistics::CombinedSearch );
+        } else {
+            statistics->recordSearch( contextRule, GrammarLexerStatistics::CombinedSearch, combinedRegExp_->pattern(), combinedNsecs, combinedSkipped );
+        }
+    }
+    return true;
+}
+
+
+/// Returns the number of regexp rules in this context
+int GrammarRuleScanner::ruleCount() const
+{
+    return ruleRefList_.size();
+}
+
+
+/// Returns the number of rules that are matched via the combined regexp
+int GrammarRuleScanner::combinedRuleCount() const
+{
+    return combinedRuleCount_;
+}
+
+
+/// Returns the combined regular expression (or 0 if there isn't one)
+RegExp* GrammarRuleScanner::combinedRegExp() const
+{
+    return combinedRegExp_;
+}
+
+
+/// Checks if the given pattern can be added to a combined regexp. The check is conservative,
+/// when in doubt the pattern is searched individually.
+///
+/// @param pattern the regular expression pattern
+/// @param extended (out) this variable is set to true when the complete pattern is in extended (?x) mode
+/// @return true if the pattern can be combined
+bool GrammarRuleScanner::isCombinablePattern( const QString& pattern, bool& extended )
+{
+    extended = false;
+    for( int i=0, len=pattern.length(); i<len; ++i ) {
+        QChar c = pattern.at(i);
+
+        // escaped characters: \G depends on the search start, back-references and subexp-calls on the group numbering
+        if( c == '\\' ) {
+            if( i+1 >= len ) { return false; }
+            QChar next = pattern.at(i+1);
+            if( next == 'G' || next == 'k' || next == 'g' || ( next >= '1' && next <= '9' ) ) { return false; }
+            ++i;
+            continue;
+        }
+
+        // special groups
+        if( c == '(' && i+2 < len && pattern.at(i+1) == '?' ) {
+            QChar type = pattern.at(i+2);
+
+            // look-behinds are fine, named groups change the group numbering
+            if( type == '<' ) {
+                QChar next = i+3 < len ? pattern.at(i+3) : QChar();
+                if( next != '=' && next != '!' ) { return false; }
+                continue;
+            }
+            if( type == '\'' || type == 'P' || type == '(' ) { return false; }
+
+            // option groups: (?imx-imx) or (?imx-imx:subexp)
+            bool enable = true;
+            bool extendedOn = false;
+            bool extendedOff = false;
+            int j = i+2;
+            for( ; j<len; ++j ) {
+                QChar option = pattern.at(j);
+                if( option == '-' ) {
+                    enable = false;
+                } else if( option == 'x' ) {
+                    if( enable ) { extendedOn = true; } else { extendedOff = true; }
+                } else if( option != 'i' && option != 'm' ) {
+                    break;
+                }
+            }
+
+            // only a leading (?x) that is active until the end of the pattern is supported.
+            // (In extended mode a trailing comment would swallow the closing bracket of the alternative)
+            if( extendedOn || extendedOff ) {
+                if( i != 0 || extendedOff || j >= len || pattern.at(j) != ')' ) { return false; }
+                extended = true;
+            }
+        }
+    }
+    return true;
+}
+
+
+/// Builds the combined regular expression of all combinable rules
+void GrammarRuleScanner::buildCombinedRegExp()
+{
+    QString pattern;
+    int groupIndex = 1;
+    for( int i=0, cnt=ruleRefList_.size(); i<cnt; ++i ) {
+        RegExp* regExp = regExpList_.at(i);
+        bool extended = false;
+        if( !regExp || !regExp->isValid() || !isCombinablePattern( regExp->pattern(), extended ) ) { continue; }
+        if( regExp->engine() != RegExp::EngineOniguruma || regExp->syntax() != RegExp::SyntaxDefault || !regExp->isCaseSensitive() ) { continue; }   // (the options of the combined regexp)
+
+        if( !pattern.isEmpty() ) { pattern.append("|"); }
+        pattern.append("(").append( regExp->pattern() ).append( extended ? "\n)" : ")" );
+
+        groupIndexList_[i] = groupIndex;
+        groupIndex += regExp->captureCount() + 1;
+        ++combinedRuleCount_;
+    }
+
+    // a single rule doesn't need a combined regexp
+    if( combinedRuleCount_ < 2 ) {
+        groupIndexList_.fill(-1);
+        combinedRuleCount_ = 0;
+        return;
+    }
+
+    // when the combination fails, fallback to searching every rule individually
+    combinedRegExp_ = new RegExp( pattern );
+    if( !combinedRegExp_->isValid() || combinedRegExp_->captureCount() != groupIndex-1 ) {
+        qlog_warn() << "Unable to combine the grammar rules, using individual searches:" << combinedRegExp_->errorString();
+        delete combinedRegExp_;
+        combinedRegExp_ = 0;
+        groupIndexList_.fill(-1);
+        combinedRuleCount_ = 0;
+    }
+}
+
+
+} // edbee
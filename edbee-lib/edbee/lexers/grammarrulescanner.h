@@ -0,0 +1,59 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QString>
+#include <QVector>
+
+namespace edbee {
+
+class GrammarLexerStatistics;
+class RegExp;
+class TextGrammarRule;
+
+
+/// The grammar rule scanner searches all regexp rules of a single grammar context at once.
+/// A grammar context is the (flattened) list of rules that can match inside a main-rule, rule-list or
+/// multi-line rule. All includes are resolved by the lexer before the scanner is constructed.
+///
+/// The match-patterns of the rules are combined into a single alternation: (p1)|(p2)|(p3)
+/// Oniguruma returns the leftmost match, and for matches at the same position the first alternative.
+/// This is exactly the rule the 'search every rule' loop of the lexer selects.
+///
+/// With private regexps the scanner uses its own copies of the match-regexps. (A regexp contains the state of the last match,
+/// scanners that are used in different threads cannot share the regexps of the grammar rules)
+///
+/// Patterns that depend on their own group numbering (back-references, subexp-calls), on the search start (\\G)
+/// or on extended-mode trickery are excluded from the combined regexp. These rules are searched individually.
+class GrammarRuleScanner
+{
+public:
+    GrammarRuleScanner( const QVector<TextGrammarRule*>& ruleRefList, bool privateRegExps=false );
+    virtual ~GrammarRuleScanner();
+
+    bool findNextGrammarRule( const QString& line, int offsetInLine, TextGrammarRule*& foundRule, RegExp*& foundRegExp, int& foundPosition,
+                              bool& foundCombined, GrammarLexerStatistics* statistics=0, TextGrammarRule* contextRule=0 );
+
+    int ruleCount() const;
+    int combinedRuleCount() const;
+    RegExp* combinedRegExp() const;
+
+    static bool isCombinablePattern( const QString& pattern, bool& extended );
+
+private:
+    void buildCombinedRegExp();
+
+private:
+    QVector<TextGrammarRule*> ruleRefList_;     ///< All regexp rules of this context (in match order)
+    QVector<RegExp*> regExpList_;               ///< The match regexps of the rules (the rule's own regexps or private copies)
+    bool ownsRegExps_;                          ///< Are the regexps private copies (owned by this scanner)?
+    QVector<int> groupIndexList_;               ///< The group number of the rule in the combined regexp (-1 if searched individually)
+    RegExp* combinedRegExp_;                    ///< The combined regular expression (0 when there's nothing to combine)
+    int combinedRuleCount_;                     ///< The number of rules in the combined regexp
+};
+
+
+} // edbee
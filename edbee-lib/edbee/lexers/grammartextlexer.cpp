@@ -6,71 +6,183 @@
 #include "grammartextlexer.h"
 
 #include <limits>
+#include <QElapsedTimer>
 #include <QStack>
+#include <QThread>
 
+#include "edbee/lexers/grammarlexerstatistics.h"
+#include "edbee/lexers/grammarlexjob.h"
+#include "edbee/lexers/grammarrulescanner.h"
 #include "edbee/models/textgrammar.h"
 #include "edbee/models/textdocument.h"
 #include "edbee/models/textdocumentscopes.h"
 #include "edbee/util/regexp.h"
 #include "edbee/edbee.h"
+#include "util/simpleprofiler.h"
 
 #include "debug.h"
 
 namespace edbee {
 
+/// The default number of compiled end-regexps that are cached
+static const int DefaultEndRegExpCacheSize = 256;
+
+/// Lines longer then this aren't lexed. They only get the enclosing scopes
+static const int DefaultMaxLineLength = 20000;
+
+/// The maximum lexing time of a single line (in ms). The remainder of a line isn't lexed when this budget is exceeded
+static const int DefaultLineTimeBudget = 250;
+
+/// The minimal number of lines of a chunk when lexing in parallel
+static const int MinimumParallelChunkLineCount = 1000;
+
+
+/// Compares two lexer states. The states are equal if the active rules and end-patterns are the same
+/// @param state1 the active multi-line ranges of the first state
+/// @param state2 the active multi-line ranges of the second state
+/// @return true if the states are equal
+static bool isEqualLexerState( const QVector<MultiLineScopedTextRange*>& state1, const QVector<MultiLineScopedTextRange*>& state2 )
+{
+    if( state1.size() != state2.size() ) { return false; }
+    for( int i=0, cnt=state1.size(); i<cnt; ++i ) {
+        MultiLineScopedTextRange* range1 = state1.at(i);
+        MultiLineScopedTextRange* range2 = state2.at(i);
+        if( range1->grammarRule() != range2->grammarRule() ) { return false; }
+
+        RegExp* endRegExp1 = range1->endRegExp();
+        RegExp* endRegExp2 = range2->endRegExp();
+        if( !endRegExp1 || !endRegExp2 ) {
+            if( endRegExp1 != endRegExp2 ) { return false; }
+        } else if( endRegExp1->pattern() != endRegExp2->pattern() ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
 /// Constructs the grammar textlexer
 /// @param scopes a reference to the scopes model
 GrammarTextLexer::GrammarTextLexer(TextDocumentScopes* scopes)
     : TextLexer( scopes )
     , lineRangeList_( 0 )
+    , multiPatternScanEnabled_( true )
+    , scannerGrammarRef_( 0 )
+    , endRegExpCache_( DefaultEndRegExpCacheSize )
+    , endRegExpCompileCount_( 0 )
+    , maxLineLength_( DefaultMaxLineLength )
+    , lineTimeBudget_( DefaultLineTimeBudget )
+    , flagIncompleteLines_( true )
+    , lineLimitReached_( false )
+    , nextIncompleteLine_( 0 )
+    , parallelLexingEnabled_( false )
+    , lexJob_( 0 )
+    , lineInterningEnabled_( true )
+    , internedLineHitCount_( 0 )
+    , privateRegExps_( false )
+    , chunkRef_( 0 )
+    , lineEndStatesRef_( 0 )
+    , statistics_( 0 )
 {
     setGrammar( Edbee::instance()->grammarManager()->defaultGrammar() );
 }
 
 
+/// Constructs the lexer of a chunk of the parallel lexer. This lexer doesn't have a document, the lines are read from
+/// the chunk and the scopes are written to the chunk. (Only the plain data of the chunk is used in the worker thread)
+/// @param chunk the chunk to lex
+/// @param grammar the grammar to use
+GrammarTextLexer::GrammarTextLexer( GrammarLexChunk* chunk, TextGrammar* grammar )
+    : TextLexer( 0 )
+    , lineRangeList_( 0 )
+    , multiPatternScanEnabled_( true )
+    , scannerGrammarRef_( 0 )
+    , endRegExpCache_( DefaultEndRegExpCacheSize )
+    , endRegExpCompileCount_( 0 )
+    , maxLineLength_( DefaultMaxLineLength )
+    , lineTimeBudget_( DefaultLineTimeBudget )
+    , flagIncompleteLines_( true )
+    , lineLimitReached_( false )
+    , nextIncompleteLine_( 0 )
+    , parallelLexingEnabled_( false )
+    , lexJob_( 0 )
+    , lineInterningEnabled_( true )
+    , internedLineHitCount_( 0 )
+    , privateRegExps_( true )
+    , chunkRef_( chunk )
+    , lineEndStatesRef_( 0 )
+    , statistics_( 0 )
+{
+    setGrammar( grammar );
+}
+
+
 /// The destructor
 GrammarTextLexer::~GrammarTextLexer()
 {
+    delete lexJob_;
     delete lineRangeList_;  // just in case
+    delete statistics_;
+    clearScanners();
 }
 
 
-/// This method builds the end-regexp for the given multi-line-regexp
+/// This method returns the end-regexp for the given multi-line-regexp
+/// The back-references (\\1) in the end-regexp string are replaced by the captures of the start regexp.
+/// The resulting pattern identifies the rule and captured values, the compiled regexp is shared (LRU cache)
+/// between all ranges with the same end-pattern. (for example every string with a " delimiter)
 /// @param startRegExp the start regexp
 /// @param endRegExStringIn the end regexp string
-RegExp* GrammarTextLexer::createEndRegExp( RegExp* startRegExp, const QString& endRegExpStringIn)
+QSharedPointer<RegExp> GrammarTextLexer::createEndRegExp( RegExp* startRegExp, const QString& endRegExpStringIn)
 {
     // build the end-regexp string
     QString endRegExpString;
-    RegExp matcher("\\\\(\\d+)");  // \(d+)
-    int lastPos = 0;
-    while( matcher.indexIn(endRegExpStringIn,lastPos) >= 0 ) {
-        int len = matcher.len();
-        int pos = matcher.pos();
-
-        // append the previous string
-        if( pos-lastPos > 0 ) {
-            endRegExpString.append( endRegExpStringIn.mid(lastPos,pos-lastPos) );
-        }
+    for( int i=0, len=endRegExpStringIn.length(); i<len; ++i ) {
+        QChar c = endRegExpStringIn.at(i);
+        if( c == '\\' && i+1 < len ) {
+            QChar next = endRegExpStringIn.at(i+1);
+
+            // append the 'match'
+            if( next.isDigit() ) {
+                int digitEnd = i+1;
+                while( digitEnd < len && endRegExpStringIn.at(digitEnd).isDigit() ) { ++digitEnd; }
+                endRegExpString.append( startRegExp->cap( endRegExpStringIn.mid( i+1, digitEnd-i-1 ).toInt() ) );
+                i = digitEnd-1;
+                continue;
+            }
 
-        // append the 'match'
-        int nr = matcher.cap(1).toInt();
-        if( nr >= 0 ) {
-            endRegExpString.append( startRegExp->cap(nr) );
+            // other escape sequences are copied as-is (this prevents \\1 from being seen as a back-reference)
+            endRegExpString.append(c).append(next);
+            ++i;
+            continue;
         }
-        lastPos = pos + len + 1;
+        endRegExpString.append(c);
     }
-    endRegExpString.append( endRegExpStringIn.mid(lastPos));
-    return new RegExp(endRegExpString);
+
+    // reuse the compiled regexp
+    QSharedPointer<RegExp>* cachedRegExp = endRegExpCache_.object( endRegExpString );
+    if( cachedRegExp ) { return *cachedRegExp; }
+
+    PROF_COUNT("end-regexp compilations")
+    ++endRegExpCompileCount_;
+    QSharedPointer<RegExp> regExp( new RegExp(endRegExpString) );
+    endRegExpCache_.insert( endRegExpString, new QSharedPointer<RegExp>(regExp) );
+    return regExp;
 }
 
 
 /// Search the next grammar rule
 /// @param (out) foundRegExp the found regexp
 /// @param (out) foundPosition the found position
-/// @return the grammarRule found
-void GrammarTextLexer::findNextGrammarRule( const QString& line, int offsetInLine, TextGrammarRule* activeRule, TextGrammarRule*& foundRule, RegExp*& foundRegExp, int& foundPosition )
+/// @param (out) foundCombined set to true if the found rule is matched by the combined regexp of the multi-pattern scan
+/// @return false if a regexp search failed (for example when the match stack limit was exceeded)
+bool GrammarTextLexer::findNextGrammarRule( const QString& line, int offsetInLine, TextGrammarRule* activeRule, TextGrammarRule*& foundRule, RegExp*& foundRegExp, int& foundPosition, bool& foundCombined )
 {
+    // search all rules of the context with the (cached) combined scanner
+    if( multiPatternScanEnabled_ ) {
+        return scannerForRule( activeRule )->findNextGrammarRule( line, offsetInLine, foundRule, foundRegExp, foundPosition, foundCombined, statistics_, activeRule );
+    }
+
     // next iterate over all rules and find the rule with the lowest offset
     QStack<TextGrammarRule::Iterator*> ruleIterators;
     ruleIterators.push( activeRule->createIterator() );
@@ -88,7 +200,16 @@ void GrammarTextLexer::findNextGrammarRule( const QString& line, int offsetInLin
                     case TextGrammarRule::MultiLineRegExp:
                     {
                         // only use this match if the offset < foundPosition
-                        int pos = rule->matchRegExp()->indexIn( line, offsetInLine );
+                        int pos = -1;
+                        if( statistics_ ) {
+                            pos = statistics_->indexIn( rule->matchRegExp(), line, offsetInLine, rule, GrammarLexerStatistics::MatchSearch );
+                        } else {
+                            pos = rule->matchRegExp()->indexIn( line, offsetInLine );
+                        }
+                        if( pos < -1 ) {
+                            qDeleteAll( ruleIterators );
+                            return false;
+                        }
                         if( pos >= 0 ) {
 
                             if( pos < foundPosition ) {
@@ -135,6 +256,7 @@ void GrammarTextLexer::findNextGrammarRule( const QString& line, int offsetInLin
         delete ruleIterators.pop();
 
     }// while ruleIterators
+    return true;
 }
 
 
@@ -158,7 +280,7 @@ void GrammarTextLexer::processCaptures( RegExp* foundRegExp, const QMap<int, QSt
                 int end    = capturePos+capLen;
 
 //                textScopes()->addScopedRange( currentDocOffset+capturePos, currentDocOffset+capturePos+capLen, scope, foundRule );
-                lineRangeList_->giveRange( new ScopedTextRange( start, end, Edbee::instance()->scopeManager()->refTextScope(scope) ));
+                lineRangeList_->addRange( start, end, Edbee::instance()->scopeManager()->refTextScope(scope) );
 
             }
         }
@@ -184,19 +306,32 @@ TextGrammarRule* GrammarTextLexer::findAndApplyNextGrammarRule( int currentDocOf
     TextGrammarRule* foundRule = 0;
     RegExp* foundRegExp    = 0;
     int foundPosition      = std::numeric_limits<int>::max();
+    bool foundCombined     = false;
 
 
     // first try to close the active rule
     if( activeMultiRange->endRegExp() ) {
-        if( activeMultiRange->endRegExp()->indexIn( line, offsetInLine ) >= 0 ) {
+        int endPos = -1;
+        if( statistics_ ) {
+            endPos = statistics_->indexIn( activeMultiRange->endRegExp(), line, offsetInLine, activeRule, GrammarLexerStatistics::EndSearch );
+        } else {
+            endPos = activeMultiRange->endRegExp()->indexIn( line, offsetInLine );
+        }
+        if( endPos >= 0 ) {
             foundRule      = activeRule;
             foundRegExp    = activeMultiRange->endRegExp();
             foundPosition  = foundRegExp->pos();
+        } else if( endPos < -1 ) {
+            lineLimitReached_ = true;
+            return 0;
         }
     }
 
-    // find the grammar rule
-    findNextGrammarRule( line, offsetInLine, activeRule, foundRule, foundRegExp, foundPosition );
+    // find the grammar rule. A failed search makes the result unreliable, the remainder of the line isn't lexed then
+    if( !findNextGrammarRule( line, offsetInLine, activeRule, foundRule, foundRegExp, foundPosition, foundCombined ) ) {
+        lineLimitReached_ = true;
+        return 0;
+    }
 
     // next we have found the rule that matched a certain scope
     if( foundRule ) {
@@ -205,6 +340,17 @@ TextGrammarRule* GrammarTextLexer::findAndApplyNextGrammarRule( int currentDocOf
 
         int startPos = foundPosition;
         int endPos   = startPos + matchedLength;
+
+        // the found rule won from the end-pattern and all other rules of the context
+        if( statistics_ ) {
+            GrammarLexerStatistics::SearchKind kind = GrammarLexerStatistics::MatchSearch;
+            if( activeMultiRange->endRegExp() == foundRegExp ) {
+                kind = GrammarLexerStatistics::EndSearch;
+            } else if( foundCombined ) {
+                kind = GrammarLexerStatistics::CombinedSearch;
+            }
+            statistics_->recordWin( foundRule, kind );
+        }
 //qlog_info() << " foundRule: " << foundRule->toString(false) << ", foundPosition:" << foundPosition <<" : " << startPos << "t/m" << endPos;
 //qlog_info() << " foundRegExp: " << foundRegExp->pattern();
 
@@ -212,7 +358,7 @@ TextGrammarRule* GrammarTextLexer::findAndApplyNextGrammarRule( int currentDocOf
 
         // Did we found the endrule? Then  we need to 'close' the current activeRule
         if( activeMultiRange->endRegExp() == foundRegExp ) {
-            activeMultiRange->maxVar() = currentDocOffset + endPos;         // mark the end (DOC)
+            setMultiLineScopedTextRangeMax( *activeMultiRange, currentDocOffset + endPos );   // mark the end (DOC)
             activeScopedTextRange()->maxVar() = endPos;                     // mark the end (TextScope)
 
             processCaptures( foundRegExp, &activeRule->endCaptures() );
@@ -226,19 +372,19 @@ TextGrammarRule* GrammarTextLexer::findAndApplyNextGrammarRule( int currentDocOf
             // did we find a multiline regexp. add the start of this scope
             if( foundRule->isMultiLineRegExp() ) {
 
-                ScopedTextRange* range = new ScopedTextRange(startPos, line.length(), scopeRef );
-                lineRangeList_->giveRange( range );
+                int rangeIndex = lineRangeList_->size();
+                lineRangeList_->addRange( startPos, line.length(), scopeRef );
 
-                MultiLineScopedTextRange* multiRange = new MultiLineScopedTextRange( currentDocOffset+startPos, textScopes()->textDocument()->length(), scopeRef );
+                MultiLineScopedTextRange* multiRange = new MultiLineScopedTextRange( currentDocOffset+startPos, textLength(), scopeRef );
                 multiRange->setGrammarRule( foundRule );
-                multiRange->giveEndRegExp( createEndRegExp( foundRegExp, foundRule->endRegExpString() ) );
+                multiRange->setEndRegExp( createEndRegExp( foundRegExp, foundRule->endRegExpString() ) );
 
-                pushActiveRange( range, multiRange );
+                pushActiveRange( rangeIndex, multiRange );
 
             // a single rule
             } else {
                 // add the found regexp
-                lineRangeList_->giveRange( new ScopedTextRange(startPos, endPos, scopeRef ));
+                lineRangeList_->addRange( startPos, endPos, scopeRef );
                 //textScopes()->addScopedRange( startPos, endPos, foundRule->scopeName(), foundRule );
             }           
 
@@ -271,8 +417,8 @@ MultiLineScopedTextRange* GrammarTextLexer::activeMultiLineRange()
 /// Returns the active scoped text range
 ScopedTextRange* GrammarTextLexer::activeScopedTextRange()
 {
-    Q_ASSERT( !activeScopedRangesRefList_.isEmpty() );
-    return activeScopedRangesRefList_.last();
+    Q_ASSERT( !activeScopedRangeIndexList_.isEmpty() );
+    return lineRangeList_->at( activeScopedRangeIndexList_.last() );
 }
 
 
@@ -282,7 +428,7 @@ ScopedTextRange* GrammarTextLexer::activeScopedTextRange()
 void GrammarTextLexer::popActiveRange()
 {
     Q_ASSERT( activeMultiLineRangesRefList_.size() > 1 ); // there should be at least 2 items. The first one is the grammar rule!
-    Q_ASSERT( activeScopedRangesRefList_.size() == activeMultiLineRangesRefList_.size() );
+    Q_ASSERT( activeScopedRangeIndexList_.size() == activeMultiLineRangesRefList_.size() );
     //
     if( currentMultiLineRangeList_.isEmpty() ) {
         closedMultiRangesRangesRefList_.append( activeMultiLineRangesRefList_.last() );
@@ -294,18 +440,19 @@ void GrammarTextLexer::popActiveRange()
     }
 
     activeMultiLineRangesRefList_.pop_back();
-    activeScopedRangesRefList_.pop_back();
+    activeScopedRangeIndexList_.pop_back();
 }
 
 
 /// Adds the given range to the multiscoped textranges
 /// And to the list of current line ranges
-/// @param range the range top push
-void GrammarTextLexer::pushActiveRange(ScopedTextRange* range, MultiLineScopedTextRange* multiRange )
+/// @param rangeIndex the index of the line range in the line range list
+/// @param multiRange the multi-line range to push
+void GrammarTextLexer::pushActiveRange( int rangeIndex, MultiLineScopedTextRange* multiRange )
 {
     activeMultiLineRangesRefList_.push_back( multiRange );
     currentMultiLineRangeList_.push_back( multiRange );
-    activeScopedRangesRefList_.push_back( range );
+    activeScopedRangeIndexList_.push_back( rangeIndex );
 //qlog_info() << "[push]";
 //    activeRangesRefList_.push_back( range );
 //    currentLineRangesList_.push_back(range);
@@ -335,6 +482,79 @@ TextGrammarRule* GrammarTextLexer::findIncludeGrammarRule(TextGrammarRule* base)
 }
 
 
+/// Returns the rule scanner for the context of the given rule. The scanner is constructed on first use.
+/// @param rule the active (context) rule
+/// @return the scanner of the given rule
+GrammarRuleScanner* GrammarTextLexer::scannerForRule(TextGrammarRule* rule)
+{
+    // $base and $self includes are resolved with the active grammar, a new grammar requires new scanners
+    if( scannerGrammarRef_ != grammar() ) {
+        clearScanners();
+        scannerGrammarRef_ = grammar();
+    }
+
+    GrammarRuleScanner* scanner = scannerMap_.value( rule, 0 );
+    if( !scanner ) {
+        QVector<TextGrammarRule*> ruleRefList;
+        QSet<TextGrammarRule*> visitedRuleRefSet;
+        visitedRuleRefSet.insert( rule );
+        collectGrammarRules( rule, ruleRefList, visitedRuleRefSet );
+
+        scanner = new GrammarRuleScanner( ruleRefList, privateRegExps_ );
+        scannerMap_.insert( rule, scanner );
+    }
+    return scanner;
+}
+
+
+/// Collects all regexp rules of the given rule, with all includes resolved.
+/// The order is the same as the (depth first) order findNextGrammarRule uses.
+/// Rules that are encountered a second time are skipped, they can never win from the first occurence.
+///
+/// @param parentRule the rule to collect the child-rules from
+/// @param ruleRefList (out) the list with all single and multi-line regexp rules
+/// @param visitedRuleRefSet the set of rules that already have been processed
+void GrammarTextLexer::collectGrammarRules(TextGrammarRule* parentRule, QVector<TextGrammarRule*>& ruleRefList, QSet<TextGrammarRule*>& visitedRuleRefSet )
+{
+    for( int i=0, cnt=parentRule->ruleCount(); i<cnt; ++i ) {
+        TextGrammarRule* rule = parentRule->rule(i);
+
+        // resolve the include calls
+        while( rule && rule->isIncludeCall() && !visitedRuleRefSet.contains(rule) ) {
+            visitedRuleRefSet.insert(rule);
+            TextGrammarRule* includedRule = findIncludeGrammarRule( rule );
+            if( !includedRule ) {
+                qlog_warn() << "ERROR, include rule" << rule->includeName() << "not found!" ;
+            }
+            rule = includedRule;
+        }
+        if( !rule || visitedRuleRefSet.contains(rule) ) { continue; }
+        visitedRuleRefSet.insert(rule);
+
+        switch( rule->instruction() ) {
+            case TextGrammarRule::SingleLineRegExp:
+            case TextGrammarRule::MultiLineRegExp:
+                ruleRefList.append( rule );
+                break;
+            case TextGrammarRule::MainRule:
+            case TextGrammarRule::RuleList:
+                collectGrammarRules( rule, ruleRefList, visitedRuleRefSet );
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+
+/// Deletes all cached rule scanners
+void GrammarTextLexer::clearScanners()
+{
+    qDeleteAll( scannerMap_ );
+    scannerMap_.clear();
+}
+
+
 
 /// This method is called to notify the lexer some data has been changed
 //void GrammarTextLexer::textReplaced( int offset, int length, int newLength )
@@ -344,6 +564,13 @@ void GrammarTextLexer::textChanged( const TextBufferChange& change )
     TextDocument* doc = textDocument();
     TextDocumentScopes* docScopes = textScopes();
 
+    // the speculative results are based on the old text
+    delete lexJob_;
+    lexJob_ = 0;
+
+    // the incomplete lines after the change have been moved
+    nextIncompleteLine_ = qMin( nextIncompleteLine_, change.line() );
+
     // first check the first dependent line
     bool dependent = false;
     for( int idx=0; idx<change.lineCount(); ++idx) {
@@ -388,37 +615,51 @@ void GrammarTextLexer::textChanged( const TextBufferChange& change )
 /// WARNING lexline CANNOT be called indepdently of lexLines (beacuse lex-lines set the activeScopes!
 bool GrammarTextLexer::lexLine( int lineIdx, int& currentDocOffset )
 {
-    TextDocument* doc = textDocument();
-    TextDocumentScopes* docScopes = textScopes();
-
-    QString line        = doc->line(lineIdx); //+ "\n";
+    QString line        = lineText(lineIdx); //+ "\n";
 
     //    int lineStartOffset = doc->offsetFromLine(lineIdx);
 
+    // an identical independent line with the same lexer state has exactly the same scopes
+    // (lines that are too long to lex aren't interned)
+    QString internKey;
+    bool internLine = lineInterningEnabled_ && ( maxLineLength_ <= 0 || line.length() <= maxLineLength_ );
+    if( internLine ) {
+        internKey = lineInternKey( line );
+        ScopedTextRangeList* internedList = findInternedLine( internKey );
+        if( internedList ) {
+            if( lineEndStatesRef_ ) { lineEndStatesRef_->append( activeMultiLineRangesRefList_ ); }
+            giveLineScopedRangeList( lineIdx, internedList );
+            currentDocOffset += line.size();
+            return true;
+        }
+    }
+
     Q_ASSERT( currentMultiLineRangeList_.isEmpty() );
     Q_ASSERT( closedMultiRangesRangesRefList_.isEmpty() );
-    Q_ASSERT( activeScopedRangesRefList_.isEmpty() );
+    Q_ASSERT( activeScopedRangeIndexList_.isEmpty() );
 
-    lineRangeList_ = new ScopedTextRangeList();
+    lineRangeList_ = new ScopedTextRangeList( scopedRangePool() );
 
     // append the active ranges
     for( int i=0,cnt=activeMultiLineRangesRefList_.size(); i<cnt; ++i ) {
-        MultiLineScopedTextRangeReference* range = new MultiLineScopedTextRangeReference( *activeMultiLineRangesRefList_.at(i) );
-        range->setAnchor(0);
-        range->setCaret(line.length());
-        lineRangeList_->giveRange( range );
-        activeScopedRangesRefList_.append(range);
+        lineRangeList_->addRange( 0, line.length(), *activeMultiLineRangesRefList_.at(i) );
+        activeScopedRangeIndexList_.append(i);
     }
 
 // qlog_info() << "";
 // qlog_info() << "////////////////////////////////////////////////////////////////";
 // qlog_info() << " * " << lineIdx << ":" << line;
 
+    // very long lines (minified files) aren't lexed, they only get the enclosing scopes
+    lineLimitReached_ = maxLineLength_ > 0 && line.length() > maxLineLength_;
+    QElapsedTimer lineTimer;
+    lineTimer.start();
+
     // find the first 'matching' rule
     int offsetInLine = 0;
     int lastOffsetInLine = 0;
     TextGrammarRule* lastFoundRule = 0;
-    while( true ) {
+    while( !lineLimitReached_ ) {
 //QString debug;
 //debug.append( QString(" =[%1,%2,%3]= ").arg(lineIdx).arg(offsetInLine).arg(currentDocOffset) );
         TextGrammarRule* foundRule = findAndApplyNextGrammarRule( currentDocOffset, line, offsetInLine  );
@@ -460,21 +701,35 @@ bool GrammarTextLexer::lexLine( int lineIdx, int& currentDocOffset )
         lastFoundRule = foundRule;
 
         lastOffsetInLine = offsetInLine;
+
+        // stop lexing when the time budget of this line is exceeded
+        if( lineTimeBudget_ > 0 && lineTimer.elapsed() > lineTimeBudget_ ) {
+            lineLimitReached_ = true;
+        }
     }
 
     // when there are no-multi-line spanning rules, set the independent flag
-    lineRangeList_->setIndependent( currentMultiLineRangeList_.isEmpty() && closedMultiRangesRangesRefList_.isEmpty());
+    // an aborted line is never independent, the remainder of the line may change the scopes of the following lines
+    lineRangeList_->setIndependent( currentMultiLineRangeList_.isEmpty() && closedMultiRangesRangesRefList_.isEmpty() && !lineLimitReached_ );
+    lineRangeList_->setIncomplete( lineLimitReached_ && flagIncompleteLines_ );
+    if( lineRangeList_->isIncomplete() ) { nextIncompleteLine_ = qMin( nextIncompleteLine_, lineIdx ); }
+    lineLimitReached_ = false;
+    if( statistics_ ) { statistics_->recordLine( lineTimer.nsecsElapsed() ); }
     lineRangeList_->squeeze();  // free unused memory
     bool result = lineRangeList_->isIndependent();
+    if( result && internLine ) { internLineScopedRangeList( internKey, lineRangeList_ ); }
+
+    // remember the state at the end of the line
+    if( lineEndStatesRef_ ) { lineEndStatesRef_->append( activeMultiLineRangesRefList_ ); }
 
     // give the line to the document scopes
-    docScopes->giveLineScopedRangeList( lineIdx, lineRangeList_ );
+    giveLineScopedRangeList( lineIdx, lineRangeList_ );
     lineRangeList_ = 0;
 
     foreach( MultiLineScopedTextRange* scopedRange, currentMultiLineRangeList_ ) {
-        docScopes->giveMultiLineScopedTextRange(scopedRange);
+        giveMultiLineScopedTextRange(scopedRange);
     }
-    activeScopedRangesRefList_.clear();
+    activeScopedRangeIndexList_.clear();
     currentMultiLineRangeList_.clear();
     closedMultiRangesRangesRefList_.clear();
 
@@ -563,7 +818,570 @@ void GrammarTextLexer::lexRange( int beginOffset, int endOffset )
     int lineStart   = doc->lineFromOffset(offset);
     int lineEnd     = doc->lineFromOffset(endOffset) + 1;
 
+    // the requested lines are (partially) lexed by the speculative job. Waiting for the job is faster then lexing
+    // the lines again. (This only happens when the requested lines are far below the last lexed line)
+    if( lexJob_ && lineEnd > lexJob_->lineStart() ) {
+        GrammarLexJob* job = lexJob_;
+        job->waitForDone();
+        applyLexJob();
+        delete job;
+
+        if( endOffset <= docScopes->lastScopedOffset()) { return; }
+        lineStart = doc->lineFromOffset( docScopes->lastScopedOffset() );
+    }
     lexLines(lineStart, lineEnd-lineStart);
+
+    // the remainder of a large document is lexed in the background
+    if( parallelLexingEnabled_ && !lexJob_ ) {
+        startLexJob( lineEnd );
+    }
+}
+
+
+/// Starts lexing the lines from the given line to the end of the document speculatively in worker threads.
+/// The results are applied with a queued call when all chunks are lexed. (see applyLexJob)
+/// Nothing is started when the number of remaining lines is too small to be worth the effort
+/// @param lineStart the first line to lex
+void GrammarTextLexer::startLexJob( int lineStart )
+{
+    int lineCount = textDocument()->lineCount() - lineStart;
+    if( lineCount < 2 * MinimumParallelChunkLineCount ) { return; }
+
+    int chunkLineCount = qMax( MinimumParallelChunkLineCount, lineCount / qMax( 1, QThread::idealThreadCount() ) + 1 );
+    lexJob_ = new GrammarLexJob( this, lineStart, lineCount, chunkLineCount );
+    lexJob_->start();
+}
+
+
+/// Lexes the given lines with multiple threads and waits for the result. This is meant for lexing a (large) document
+/// at once. (benchmarks, tests). The editor uses the speculative background lexing of lexRange.
+///
+/// The lines are split in chunks. Every chunk is lexed speculatively in a threadpool, starting with the
+/// main rule of the grammar. Next the chunks are reconciled in document order: the lines of a chunk are lexed
+/// again until the real lexer state is equal to the speculative state. The remaining speculative results are
+/// correct and are moved to the document scopes. (Usually the states converge after a few lines)
+///
+/// @param lineStart the first line to lex
+/// @param lineCount the number of lines to lex
+/// @param chunkLineCount the number of lines per chunk (0 divides the lines over the available cores)
+void GrammarTextLexer::lexLinesParallel( int lineStart, int lineCount, int chunkLineCount )
+{
+    TextDocument* doc = textDocument();
+    TextDocumentScopes* docScopes = textScopes();
+
+    if( chunkLineCount <= 0 ) {
+        chunkLineCount = qMax( MinimumParallelChunkLineCount, lineCount / qMax( 1, QThread::idealThreadCount() ) + 1 );
+    }
+
+    // a single chunk is simply lexed in this thread
+    if( lineCount <= chunkLineCount ) {
+        lexLines( lineStart, lineCount );
+        return;
+    }
+
+    delete lexJob_;
+    docScopes->removeScopesAfterOffset( doc->offsetFromLine( lineStart ) );
+
+    GrammarLexJob* job = new GrammarLexJob( this, lineStart, lineCount, chunkLineCount );
+    lexJob_ = job;
+    job->start();
+    job->waitForDone();
+    applyLexJob();
+    delete job;
+}
+
+
+/// Applies the results of the speculative lex job. This is called when all chunks of the job are lexed.
+/// The lines between the last lexed line and the start of the job are lexed first. Next the chunks are reconciled
+/// in document order, starting at the last lexed line.
+/// The job is detached from this lexer, the caller deletes the job.
+void GrammarTextLexer::applyLexJob()
+{
+    GrammarLexJob* job = lexJob_;
+    Q_ASSERT(job);
+    lexJob_ = 0;
+    job->detach();
+    if( job->isCanceled() || job->grammar() != grammar() ) { return; }
+
+    TextDocument* doc = textDocument();
+    TextDocumentScopes* docScopes = textScopes();
+
+    // the speculative lexing is part of the work
+    if( statistics_ ) {
+        foreach( GrammarLexChunk* chunk, job->chunks() ) {
+            if( chunk->lexer()->statistics() ) { statistics_->merge( *chunk->lexer()->statistics() ); }
+        }
+    }
+
+    // lex the lines before the job
+    int firstLine = doc->lineFromOffset( docScopes->lastScopedOffset() );
+    if( firstLine < job->lineStart() ) {
+        lexLines( firstLine, job->lineStart() - firstLine );
+        firstLine = doc->lineFromOffset( docScopes->lastScopedOffset() );
+    }
+    if( firstLine >= job->lineStart() + job->lineCount() ) { return; }
+    firstLine = qMax( firstLine, job->lineStart() );
+
+    int currentDocOffset = doc->offsetFromLine( firstLine );
+    docScopes->removeScopesAfterOffset( currentDocOffset );
+
+    // reconcile the chunks in document order
+    foreach( GrammarLexChunk* chunk, job->chunks() ) {
+        int chunkLineEnd = chunk->lineStart() + chunk->lineCount();
+        if( chunkLineEnd <= firstLine ) { continue; }
+        reconcileChunk( chunk, qMax( 0, firstLine - chunk->lineStart() ), currentDocOffset );
+    }
+
+    docScopes->setLastScopedOffset( currentDocOffset );
+    docScopes->removeScopesAfterOffset( currentDocOffset );
+}
+
+
+/// Reconciles a speculatively lexed chunk with the real lexer state. The lines of the chunk are lexed until the
+/// real state equals the speculative state at the same line. From that line the speculative scopes are used.
+/// @param chunk the chunk to reconcile
+/// @param firstLine the first line of the chunk to reconcile (the lines before are already lexed)
+/// @param currentDocOffset (in/out) the document offset of the first line to reconcile
+void GrammarTextLexer::reconcileChunk( GrammarLexChunk* chunk, int firstLine, int& currentDocOffset )
+{
+    TextDocumentScopes* docScopes = textScopes();
+
+    // the speculative state at the start of the chunk only contains the grammar
+    QVector<MultiLineScopedTextRange*> chunkStartState;
+    chunkStartState.append( &chunk->startRange() );
+
+    // lex the lines until the real state converges with the speculative state
+    activeMultiLineRangesRefList_ = docScopes->multiLineScopedRangesBetweenOffsets( currentDocOffset, currentDocOffset );
+    int line = firstLine;
+    for( ; line < chunk->lineCount(); ++line ) {
+        if( isEqualLexerState( activeMultiLineRangesRefList_, line == 0 ? chunkStartState : chunk->lineEndStates().at(line-1) ) ) { break; }
+        lexLine( chunk->lineStart() + line, currentDocOffset );
+    }
+    if( line == chunk->lineCount() ) { return; }
+
+    // the speculative ranges that are active at the convergence point are the real active ranges
+    const QVector<MultiLineScopedTextRange*>& convergedState = line == 0 ? chunkStartState : chunk->lineEndStates().at(line-1);
+    QHash<MultiLineScopedTextRange*,MultiLineScopedTextRange*> rangeMap;
+    for( int i=0, cnt=convergedState.size(); i<cnt; ++i ) {
+        rangeMap.insert( convergedState.at(i), activeMultiLineRangesRefList_.at(i) );
+    }
+    QSet<MultiLineScopedTextRange*> openRangeSet;
+    foreach( MultiLineScopedTextRange* range, chunk->lineEndStates().last() ) { openRangeSet.insert( range ); }
+
+    // move the multi-line ranges to the document
+    int chunkOffset = chunk->offsetFromLine( line );
+    int delta = currentDocOffset - chunkOffset;
+    int docLength = textDocument()->length();
+    foreach( MultiLineScopedTextRange* range, chunk->takeAllMultiLineScopedTextRanges() ) {
+        MultiLineScopedTextRange* realRange = rangeMap.value( range, 0 );
+        if( realRange ) {
+            if( !openRangeSet.contains( range ) ) { docScopes->setMultiLineScopedTextRangeMax( *realRange, range->max() + delta ); }  // closed in this chunk
+            delete range;
+        } else if( range->min() >= chunkOffset ) {
+            range->set( range->min() + delta, openRangeSet.contains( range ) ? docLength : range->max() + delta );
+            docScopes->giveMultiLineScopedTextRange( range );
+        } else {
+            delete range;   // (started and ended before the convergence point)
+        }
+    }
+
+    // move the line scopes to the document
+    for( int i=line, cnt=chunk->lineCount(); i<cnt; ++i ) {
+        ScopedTextRangeList* list = chunk->takeLineScopedRangeList( i );
+        if( list ) {
+            if( list->isIncomplete() ) { nextIncompleteLine_ = qMin( nextIncompleteLine_, chunk->lineStart() + i ); }
+            list->moveToPool( docScopes->scopedRangePool() );
+            for( int j=0, rangeCount = list->size(); j<rangeCount; ++j ) {
+                MultiLineScopedTextRange* realRange = rangeMap.value( list->at(j)->multiLineScopedTextRange(), 0 );
+                if( realRange ) { list->at(j)->setMultiLineScopedTextRange( realRange ); }
+            }
+        }
+        docScopes->giveLineScopedRangeList( chunk->lineStart() + i, list );
+    }
+    currentDocOffset += chunk->length() - chunkOffset;
+}
+
+
+/// Returns the key for interning the scopes of the given line. The key consists of the rules and end-patterns
+/// of the lexer state at the start of the line and the text of the line.
+/// (The complete text is part of the key, the hash of the key only selects the bucket. Two different lines never
+/// share their scopes, the size of the interned table is limited by the total length of the keys)
+/// @param line the text of the line
+/// @return the intern key
+QString GrammarTextLexer::lineInternKey( const QString& line ) const
+{
+    QString key;
+    foreach( MultiLineScopedTextRange* range, activeMultiLineRangesRefList_ ) {
+        key.append( QString::number( reinterpret_cast<quintptr>( range->grammarRule() ), 36 ) );
+        if( range->endRegExp() ) { key.append( range->endRegExp()->pattern() ); }
+        key.append( QChar(0) );
+    }
+    key.append( QChar(0) );
+    key.append( line );
+    return key;
+}
+
+
+/// Finds the interned scopes of an identical line. When the interned scopes reference other multi-line ranges
+/// than the currently active ranges (an identical line in another comment block for example), a copy with the
+/// active ranges is made. (The leading ranges of an independent line are the references to the active ranges)
+/// @param key the intern key of the line
+/// @return the scopes for the line (the caller owns a reference) or 0 if not found
+ScopedTextRangeList* GrammarTextLexer::findInternedLine( const QString& key )
+{
+    ScopedTextRangeList* list = findInternedLineScopedRangeList( key );
+    if( !list ) { return 0; }
+    ++internedLineHitCount_;
+
+    int activeCount = activeMultiLineRangesRefList_.size();
+    Q_ASSERT( list->size() >= activeCount );
+    for( int i=0; i < activeCount; ++i ) {
+        if( list->at(i)->multiLineScopedTextRange() != activeMultiLineRangesRefList_.at(i) ) {
+
+            // create a copy that references the active ranges
+            ScopedTextRangeList* copy = new ScopedTextRangeList( scopedRangePool() );
+            for( int j=0, cnt=list->size(); j < cnt; ++j ) {
+                copy->addRange( *list->at(j) );
+                if( j < activeCount ) { copy->at(j)->setMultiLineScopedTextRange( activeMultiLineRangesRefList_.at(j) ); }
+            }
+            copy->squeeze();
+            copy->setIndependent( true );
+            list->deref();  // (the interned table still holds a reference)
+            internLineScopedRangeList( key, copy );
+            return copy;
+        }
+    }
+    return list;
+}
+
+
+/// Returns the text of the given line (inclusive the newline). The line is read from the chunk or the document
+/// @param line the line to retrieve
+QString GrammarTextLexer::lineText( int line )
+{
+    return chunkRef_ ? chunkRef_->line( line ) : textDocument()->line( line );
+}
+
+
+/// Returns the length of the lexed text (the chunk or the document)
+int GrammarTextLexer::textLength()
+{
+    return chunkRef_ ? chunkRef_->length() : textDocument()->length();
+}
+
+
+/// Returns the pool for allocating the ranges of the line scopes
+ScopedTextRangePool* GrammarTextLexer::scopedRangePool()
+{
+    return chunkRef_ ? chunkRef_->scopedRangePool() : textScopes()->scopedRangePool();
+}
+
+
+/// Gives the scopes of a lexed line to the chunk or the document scopes
+/// @param line the lexed line
+/// @param list the scopes of the line (the reference of the caller is taken over)
+void GrammarTextLexer::giveLineScopedRangeList( int line, ScopedTextRangeList* list )
+{
+    if( chunkRef_ ) {
+        chunkRef_->giveLineScopedRangeList( line, list );
+    } else {
+        textScopes()->giveLineScopedRangeList( line, list );
+    }
+}
+
+
+/// Gives a multi-line range that's started in a lexed line to the chunk or the document scopes
+/// @param range the multi-line range (the ownership is transfered)
+void GrammarTextLexer::giveMultiLineScopedTextRange( MultiLineScopedTextRange* range )
+{
+    if( chunkRef_ ) {
+        chunkRef_->giveMultiLineScopedTextRange( range );
+    } else {
+        textScopes()->giveMultiLineScopedTextRange( range );
+    }
+}
+
+
+/// Changes the end of a multi-line range. (The ranges of a chunk don't have an index)
+/// @param range the range to change
+/// @param max the new end offset
+void GrammarTextLexer::setMultiLineScopedTextRangeMax( MultiLineScopedTextRange& range, int max )
+{
+    if( chunkRef_ ) {
+        range.maxVar() = max;
+    } else {
+        textScopes()->setMultiLineScopedTextRangeMax( range, max );
+    }
+}
+
+
+/// Finds the interned scopes of a line in the chunk or the document scopes
+/// @param key the intern key of the line
+/// @return the list with an extra reference for the caller, or 0 if not found
+ScopedTextRangeList* GrammarTextLexer::findInternedLineScopedRangeList( const QString& key )
+{
+    return chunkRef_ ? chunkRef_->findInternedLineScopedRangeList( key ) : textScopes()->findInternedLineScopedRangeList( key );
+}
+
+
+/// Interns the scopes of an independent line in the chunk or the document scopes
+/// @param key the intern key of the line
+/// @param list the list to intern
+void GrammarTextLexer::internLineScopedRangeList( const QString& key, ScopedTextRangeList* list )
+{
+    if( chunkRef_ ) {
+        chunkRef_->internLineScopedRangeList( key, list );
+    } else {
+        textScopes()->internLineScopedRangeList( key, list );
+    }
+}
+
+
+/// Enables or disables the multi-pattern scan. With the multi-pattern scan all rules of the active context
+/// are searched with a single (combined) regular expression. When disabled every rule is searched individually.
+/// (The results are identical, the option exists to be able to compare/benchmark both methods)
+/// @param enabled the new state of the multi-pattern scan
+void GrammarTextLexer::setMultiPatternScanEnabled(bool enabled)
+{
+    multiPatternScanEnabled_ = enabled;
+}
+
+
+/// Returns true if the multi-pattern scan is enabled
+bool GrammarTextLexer::isMultiPatternScanEnabled() const
+{
+    return multiPatternScanEnabled_;
+}
+
+
+/// Enables or disables parallel lexing. When enabled, lexRange lexes the requested lines and starts lexing the
+/// remainder of a large document speculatively in worker threads.
+/// It's disabled by default: the results are applied with a queued call (this requires an event loop in the thread
+/// of the document) and the speculative chunks cost extra cpu time when the lexer states don't converge quickly.
+/// @param enabled the new state of parallel lexing
+void GrammarTextLexer::setParallelLexingEnabled( bool enabled )
+{
+    parallelLexingEnabled_ = enabled;
+    if( !enabled ) {
+        delete lexJob_;
+        lexJob_ = 0;
+    }
+}
+
+
+/// Returns true if parallel lexing is enabled
+bool GrammarTextLexer::isParallelLexingEnabled() const
+{
+    return parallelLexingEnabled_;
+}
+
+
+/// Enables or disables line interning. With line interning identical independent lines (same text and same lexer state)
+/// share a single scope list, and the regular expressions only run for the first of these lines.
+/// @param enabled the new state of line interning
+void GrammarTextLexer::setLineInterningEnabled( bool enabled )
+{
+    lineInterningEnabled_ = enabled;
+}
+
+
+/// Returns true if line interning is enabled
+bool GrammarTextLexer::isLineInterningEnabled() const
+{
+    return lineInterningEnabled_;
+}
+
+
+/// Returns the number of lines that reused the scopes of an interned line
+int GrammarTextLexer::internedLineHitCount() const
+{
+    return internedLineHitCount_;
+}
+
+
+/// Sets the maximum number of compiled end-regexps that are cached
+/// @param size the number of end-regexps to cache
+void GrammarTextLexer::setEndRegExpCacheSize( int size )
+{
+    endRegExpCache_.setMaxCost( size );
+}
+
+
+/// Returns the maximum number of compiled end-regexps that are cached
+int GrammarTextLexer::endRegExpCacheSize() const
+{
+    return endRegExpCache_.maxCost();
+}
+
+
+/// Returns the number of end-regexps that have been compiled by this lexer
+int GrammarTextLexer::endRegExpCompileCount() const
+{
+    return endRegExpCompileCount_;
+}
+
+
+/// Enables or disables the lexer statistics. With the statistics enabled, every regexp search is timed and
+/// recorded per grammar rule. (This makes lexing slower, it's meant for tuning grammars)
+/// Disabling the statistics discards the recorded statistics
+/// @param enabled the new state of the statistics
+void GrammarTextLexer::setStatisticsEnabled( bool enabled )
+{
+    if( enabled && !statistics_ ) {
+        statistics_ = new GrammarLexerStatistics();
+    } else if( !enabled ) {
+        delete statistics_;
+        statistics_ = 0;
+    }
+}
+
+
+/// Returns true if the lexer statistics are enabled
+bool GrammarTextLexer::isStatisticsEnabled() const
+{
+    return statistics_ != 0;
+}
+
+
+/// Returns the lexer statistics (0 if disabled)
+GrammarLexerStatistics* GrammarTextLexer::statistics() const
+{
+    return statistics_;
+}
+
+
+/// Sets the maximum length of a line that is lexed. Longer lines only get the enclosing scopes
+/// and are flagged as incomplete.
+/// @param length the maximum line length (0 is unlimited)
+void GrammarTextLexer::setMaxLineLength( int length )
+{
+    maxLineLength_ = length;
+}
+
+
+/// Returns the maximum length of a line that is lexed (0 is unlimited)
+int GrammarTextLexer::maxLineLength() const
+{
+    return maxLineLength_;
+}
+
+
+/// Sets the maximum time the lexing of a single line may take. When a line takes longer, the remainder
+/// of the line only gets the enclosing scopes and the line is flagged as incomplete.
+/// (The budget is checked after every matched rule, a single regexp search is limited by RegExp::setRetryLimit)
+/// @param msecs the time budget in milliseconds (0 is unlimited)
+void GrammarTextLexer::setLineTimeBudget( int msecs )
+{
+    lineTimeBudget_ = msecs;
+}
+
+
+/// Returns the time budget for lexing a single line (0 is unlimited)
+int GrammarTextLexer::lineTimeBudget() const
+{
+    return lineTimeBudget_;
+}
+
+
+/// Lexes the next line that has been flagged as incomplete again. This method is meant to be called
+/// in the background (for example from an idle timer), with a larger time budget. The maximum line length
+/// isn't applied. When the line still can't be lexed completely it isn't flagged again.
+///
+/// The search continues after the previous relexed line, so every call only checks the lines that have been
+/// lexed since. The scopes of the following lines are kept when the lexer state at the end of the line
+/// doesn't change (see relexLine)
+///
+/// @param lineTimeBudget the time budget (in ms) for lexing the line (0 is unlimited)
+/// @return the line that has been lexed or -1 if there are no incomplete lines
+int GrammarTextLexer::lexNextIncompleteLine( int lineTimeBudget )
+{
+    TextDocumentScopes* docScopes = textScopes();
+    for( int line=nextIncompleteLine_, cnt=docScopes->scopedLineCount(); line<cnt; ++line ) {
+        ScopedTextRangeList* list = docScopes->scopedRangesAtLine(line);
+        if( !list || !list->isIncomplete() ) { continue; }
+
+        int oldMaxLineLength = maxLineLength_;
+        int oldLineTimeBudget = lineTimeBudget_;
+        maxLineLength_ = 0;
+        lineTimeBudget_ = lineTimeBudget;
+        flagIncompleteLines_ = false;
+
+        relexLine( line );
+
+        maxLineLength_ = oldMaxLineLength;
+        lineTimeBudget_ = oldLineTimeBudget;
+        flagIncompleteLines_ = true;
+        nextIncompleteLine_ = line + 1;
+        return line;
+    }
+    nextIncompleteLine_ = docScopes->scopedLineCount();
+    return -1;
+}
+
+
+/// Lexes a single (already lexed) line again, without removing the scopes of the following lines.
+///
+/// The following lines refer to the multi-line ranges that are active at the end of the line. When the lexer
+/// state at the end of the line is the same as before, the ranges of the previous lexing are kept (the new copies
+/// are deleted) and the following lines stay valid. When the state is changed the scopes after the line are removed,
+/// they're lexed again when they're required.
+/// @param line the line to lex
+void GrammarTextLexer::relexLine( int line )
+{
+    TextDocument* doc = textDocument();
+    TextDocumentScopes* docScopes = textScopes();
+    int offset = doc->offsetFromLine( line );
+    int nextOffset = offset + doc->lineLength( line );
+
+    // the state at the end of the line. (All ranges that have been started on this line are part of this state,
+    // a range that's started and ended on the same line isn't added to the document)
+    QVector<MultiLineScopedTextRange*> oldEndState = multiLineRangesStartedBefore( nextOffset );
+
+    activeMultiLineRangesRefList_ = multiLineRangesStartedBefore( offset );
+    int currentDocOffset = offset;
+    lexLine( line, currentDocOffset );
+    const QVector<MultiLineScopedTextRange*>& newEndState = activeMultiLineRangesRefList_;
+
+    // the state is the same, when the ranges are equal or both started at the same position on this line
+    bool sameState = isEqualLexerState( oldEndState, newEndState );
+    for( int i=1, cnt=oldEndState.size(); sameState && i<cnt; ++i ) {
+        MultiLineScopedTextRange* oldRange = oldEndState.at(i);
+        MultiLineScopedTextRange* newRange = newEndState.at(i);
+        sameState = oldRange == newRange || ( oldRange->min() >= offset && newRange->min() == oldRange->min() );
+    }
+
+    // keep the ranges the following lines refer to
+    if( sameState ) {
+        for( int i=1, cnt=oldEndState.size(); i<cnt; ++i ) {
+            if( oldEndState.at(i) != newEndState.at(i) ) { docScopes->removeMultiLineScopedTextRange( newEndState.at(i) ); }
+        }
+
+    // remove the ranges of the previous lexing of this line and all scopes after it
+    } else {
+        for( int i=1, cnt=oldEndState.size(); i<cnt; ++i ) {
+            if( oldEndState.at(i)->min() >= offset ) { docScopes->removeMultiLineScopedTextRange( oldEndState.at(i) ); }
+        }
+        docScopes->removeScopesAfterOffset( nextOffset );
+        for( int i=1, cnt=newEndState.size(); i<cnt; ++i ) {
+            docScopes->setMultiLineScopedTextRangeMax( *newEndState.at(i), doc->length() );     // (closed by a following line before)
+        }
+    }
+    activeMultiLineRangesRefList_.clear();
+}
+
+
+/// Returns the multi-line ranges that are active at the given offset, excluding the ranges that start at this offset.
+/// (The scopes after the offset aren't removed, so these ranges could exist)
+/// @param offset the offset to retrieve the ranges for
+/// @return the active ranges, the first range is the default range of the grammar
+QVector<MultiLineScopedTextRange*> GrammarTextLexer::multiLineRangesStartedBefore( int offset )
+{
+    QVector<MultiLineScopedTextRange*> result;
+    QVector<MultiLineScopedTextRange*> ranges = textScopes()->multiLineScopedRangesBetweenOffsets( offset, offset );
+    for( int i=0, cnt=ranges.size(); i<cnt; ++i ) {
+        if( i == 0 || ranges.at(i)->min() < offset ) { result.append( ranges.at(i) ); }
+    }
+    return result;
 }
 
 
@@ -5,19 +5,28 @@
 
 #pragma once
 
+#include <QCache>
+#include <QHash>
 #include <QMap>
 #include <QList>
 #include <QRegExp>
+#include <QSet>
+#include <QSharedPointer>
 #include <QVector>
 
 #include "edbee/models/textlexer.h"
 
 namespace edbee {
 
+class GrammarLexChunk;
+class GrammarLexJob;
+class GrammarLexerStatistics;
+class GrammarRuleScanner;
 class MultiLineScopedTextRange;
 class RegExp;
 class ScopedTextRange;
 class ScopedTextRangeList;
+class ScopedTextRangePool;
 class TextDocumentScopes;
 class TextGrammar;
 class TextGrammarRule;
@@ -25,6 +34,9 @@ class TextGrammarRule;
 /// A simple lexer matches texts with simple regular expressions
 class GrammarTextLexer : public TextLexer
 {
+    friend class GrammarLexChunk;
+    friend class GrammarLexJob;
+
 public:
     GrammarTextLexer( TextDocumentScopes* scopes );
     virtual ~GrammarTextLexer();
@@ -32,17 +44,44 @@ public:
     virtual void textChanged( const TextBufferChange& change );
 
 private:
+    GrammarTextLexer( GrammarLexChunk* chunk, TextGrammar* grammar );
+
     virtual bool lexLine(int line, int& currentDocOffset );
 
 public:
     virtual void lexLines( int line, int lineCount );
     virtual void lexRange( int beginOffset, int endOffset );
+    void lexLinesParallel( int lineStart, int lineCount, int chunkLineCount=0 );
+
+    void setMultiPatternScanEnabled( bool enabled );
+    bool isMultiPatternScanEnabled() const;
+
+    void setParallelLexingEnabled( bool enabled );
+    bool isParallelLexingEnabled() const;
+
+    void setLineInterningEnabled( bool enabled );
+    bool isLineInterningEnabled() const;
+    int internedLineHitCount() const;
+
+    void setEndRegExpCacheSize( int size );
+    int endRegExpCacheSize() const;
+    int endRegExpCompileCount() const;
+
+    void setStatisticsEnabled( bool enabled );
+    bool isStatisticsEnabled() const;
+    GrammarLexerStatistics* statistics() const;
+
+    void setMaxLineLength( int length );
+    int maxLineLength() const;
+    void setLineTimeBudget( int msecs );
+    int lineTimeBudget() const;
+    virtual int lexNextIncompleteLine( int lineTimeBudget );
 
 private:
 
-    RegExp* createEndRegExp( RegExp* startRegExp, const QString &endRegExpStringIn);
+    QSharedPointer<RegExp> createEndRegExp( RegExp* startRegExp, const QString &endRegExpStringIn);
 
-    void findNextGrammarRule(const QString &line, int offsetInLine, TextGrammarRule *activeRule, TextGrammarRule *&foundRule, RegExp*& foundRegExp, int& foundPosition );
+    bool findNextGrammarRule(const QString &line, int offsetInLine, TextGrammarRule *activeRule, TextGrammarRule *&foundRule, RegExp*& foundRegExp, int& foundPosition, bool& foundCombined );
     void processCaptures( RegExp *foundRegExp, const QMap<int,QString>* foundCaptures );
 
     TextGrammarRule* findAndApplyNextGrammarRule(int currentDocOffset, const QString& line, int& offsetInLine  );
@@ -51,22 +90,66 @@ private:
     ScopedTextRange* activeScopedTextRange();
 
     void popActiveRange();
-    void pushActiveRange( ScopedTextRange* range, MultiLineScopedTextRange* multiRange );
+    void pushActiveRange( int rangeIndex, MultiLineScopedTextRange* multiRange );
 
     TextGrammarRule* findIncludeGrammarRule( TextGrammarRule* base );
 
+    GrammarRuleScanner* scannerForRule( TextGrammarRule* rule );
+    void collectGrammarRules( TextGrammarRule* parentRule, QVector<TextGrammarRule*>& ruleRefList, QSet<TextGrammarRule*>& visitedRuleRefSet );
+    void clearScanners();
+
+    void startLexJob( int lineStart );
+    void applyLexJob();
+    void reconcileChunk( GrammarLexChunk* chunk, int firstLine, int& currentDocOffset );
+    void relexLine( int line );
+    QVector<MultiLineScopedTextRange*> multiLineRangesStartedBefore( int offset );
+
+    QString lineInternKey( const QString& line ) const;
+    ScopedTextRangeList* findInternedLine( const QString& key );
+
+    QString lineText( int line );
+    int textLength();
+    ScopedTextRangePool* scopedRangePool();
+    void giveLineScopedRangeList( int line, ScopedTextRangeList* list );
+    void giveMultiLineScopedTextRange( MultiLineScopedTextRange* range );
+    void setMultiLineScopedTextRangeMax( MultiLineScopedTextRange& range, int max );
+    ScopedTextRangeList* findInternedLineScopedRangeList( const QString& key );
+    void internLineScopedRangeList( const QString& key, ScopedTextRangeList* list );
+
 private:
 
     QVector<MultiLineScopedTextRange*> activeMultiLineRangesRefList_;        ///< The current active scoped text ranges, DOC  (this is only valid during parsing)
     QVector<MultiLineScopedTextRange*> currentMultiLineRangeList_;           ///< The doc ranges currently created            (only valid during parsing
     QVector<MultiLineScopedTextRange*> closedMultiRangesRangesRefList_;      ///< A list of all ranges (from other lines) that have been closed. (only valid during parsing)
 
-    QVector<ScopedTextRange*> activeScopedRangesRefList_;                    ///< The current active scoped text ranges, LINE (this is only valid during parsing)
+    QVector<int> activeScopedRangeIndexList_;                                ///< The indices of the current active scoped text ranges in the line list, LINE (this is only valid during parsing)
 
 //    QVector<MultiLineScopedTextRange*> currentLineRangesList_;      ///< The current scope ranges (only valid during parsing)
 
     ScopedTextRangeList* lineRangeList_;                            ///< The scopes at current line (only valid during parsing)
 
+    bool multiPatternScanEnabled_;                                   ///< Search all rules of a context with a single combined regexp
+    QHash<TextGrammarRule*,GrammarRuleScanner*> scannerMap_;         ///< The rule scanners per context rule
+    TextGrammar* scannerGrammarRef_;                                 ///< The grammar used for resolving the includes of the scanners
+
+    QCache<QString,QSharedPointer<RegExp> > endRegExpCache_;         ///< The compiled end-regexps (LRU) by end-pattern with the substituted captures
+    int endRegExpCompileCount_;                                      ///< The number of compiled end-regexps
+
+    int maxLineLength_;                                              ///< Longer lines aren't lexed (0 is unlimited)
+    int lineTimeBudget_;                                             ///< The maximum lexing time of a single line in ms (0 is unlimited)
+    bool flagIncompleteLines_;                                       ///< Should aborted lines be flagged for relexing?
+    bool lineLimitReached_;                                          ///< A lexing limit was reached on the current line (only valid during parsing)
+    int nextIncompleteLine_;                                         ///< The first line that may be flagged as incomplete (lexNextIncompleteLine continues here)
+
+    bool parallelLexingEnabled_;                                     ///< Lex the remainder of large documents speculatively in worker threads
+    GrammarLexJob* lexJob_;                                          ///< The running speculative lex job (0 if there's no job)
+    bool lineInterningEnabled_;                                      ///< Share the scopes of identical independent lines
+    int internedLineHitCount_;                                       ///< The number of lines that reused interned scopes
+    bool privateRegExps_;                                            ///< Use private copies of the grammar regexps (required for lexing in a worker thread)
+    GrammarLexChunk* chunkRef_;                                      ///< The chunk that's lexed by this lexer, the scopes are written to the chunk (0 for a document lexer)
+    QVector< QVector<MultiLineScopedTextRange*> >* lineEndStatesRef_;  ///< When set, the active multi-line ranges at the end of every lexed line are recorded
+    GrammarLexerStatistics* statistics_;                             ///< The search statistics per grammar rule (0 when disabled)
+
 };
 
 } // edbee
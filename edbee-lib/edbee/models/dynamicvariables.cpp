@@ -85,6 +85,7 @@ DynamicVariables::~DynamicVariables()
 {
     qDeleteAll(variableMap_);
     qDeleteAll(scopedVariableMap_);
+    qDeleteAll(selectorMatcherMap_);
 }
 
 
@@ -97,6 +98,7 @@ void DynamicVariables::setAndGiveScopedSelector(const QString& name, const QVari
     /// Todo, perhaps we should detect identical scope selectors and replace the original
     variableNames_.insert(name);
     scopedVariableMap_.insertMulti( name, new ScopedDynamicVariable(value, new TextScopeSelector(selector) ) );
+    delete selectorMatcherMap_.take(name);
 }
 
 
@@ -132,20 +134,14 @@ int DynamicVariables::valueCount(const QString& name) const
 /// @param scopeList the scope list to find the variable for
 DynamicVariable* DynamicVariables::find(const QString& name, TextScopeList* scopelist)
 {
-//qlog_info() << "name: " << name << "," << scopelist->toString();
     // the initial result is no variable found
     DynamicVariable* result = variableMap_.value(name);
-    double resultScore = -0.01;
-    if( scopelist ) {
-        foreach( ScopedDynamicVariable* var, scopedVariableMap_.values(name) ) {
-            double score = var->score( scopelist );
-//qlog_info() << "-  " << var->value() << ": score: " << score << " > " << resultScore;
-
-            // the variable is only found if the score is better
-            if( score > resultScore ) {
-                resultScore = score;
-                result = var;
-            }
+    if( scopelist && scopedVariableMap_.contains(name) ) {
+
+        // the best scoring variable is found (when scores are equal the first variable wins)
+        int index = selectorMatcher(name)->findBestMatch( scopelist );
+        if( index >= 0 ) {
+            result = scopedVariableMap_.values(name).at(index);
         }
     }
     return result;
@@ -165,5 +161,22 @@ QVariant DynamicVariables::value(const QString& name, TextScopeList* scopelist )
 }
 
 
+/// Returns the compiled selectors of the scoped variables with the given name.
+/// The selector indices are the indices of scopedVariableMap_.values(name)
+/// @param name the name of the variable
+TextScopeSelectorMatcher* DynamicVariables::selectorMatcher( const QString& name )
+{
+    TextScopeSelectorMatcher* matcher = selectorMatcherMap_.value(name);
+    if( !matcher ) {
+        matcher = new TextScopeSelectorMatcher();
+        foreach( ScopedDynamicVariable* var, scopedVariableMap_.values(name) ) {
+            matcher->addSelector( var->selector() );
+        }
+        selectorMatcherMap_.insert( name, matcher );
+    }
+    return matcher;
+}
+
+
 
 } // edbee
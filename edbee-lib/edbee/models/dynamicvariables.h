@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <QHash>
 #include <QMultiMap>
 #include <QSet>
 #include <QString>
@@ -14,6 +15,7 @@ namespace edbee {
 
 class TextScopeList;
 class TextScopeSelector;
+class TextScopeSelectorMatcher;
 
 /// The abstract base class for a dynamic variable
 class DynamicVariable
@@ -77,10 +79,14 @@ public:
     DynamicVariable* find( const QString& name, TextScopeList* scopelist );
     QVariant value( const QString& name, TextScopeList* scopeList=0 );
 
+private:
+    TextScopeSelectorMatcher* selectorMatcher( const QString& name );
+
 private:
     QSet<QString> variableNames_;                                             ///< A set with all unique variable names
     QMap<QString, BasicDynamicVariable*> variableMap_;                        ///< The static variable map
     QMultiMap<QString, ScopedDynamicVariable *> scopedVariableMap_;           ///< A map with all scoped variables.
+    QHash<QString, TextScopeSelectorMatcher*> selectorMatcherMap_;            ///< The compiled selectors of the scoped variables per name (created when required)
 };
 
 
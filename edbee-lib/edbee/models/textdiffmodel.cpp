@@ -0,0 +1,499 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textdiffmodel.h"
+
+#include <QHash>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTimer>
+
+#include "edbee/models/textdocument.h"
+#include "edbee/models/textlinediffindex.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+static const int LineMaxCost = 1000;    ///< The maximum number of added plus removed lines of a hunk that are diffed
+static const int CharMaxCost = 256;     ///< The maximum number of added plus removed characters of a line that are diffed
+
+
+/// Compares two sequences with the Myers O(ND) algorithm and returns the longest common subsequence.
+/// @param a the first sequence
+/// @param n the length of the first sequence
+/// @param b the second sequence
+/// @param m the length of the second sequence
+/// @param maxCost the maximum number of added plus removed elements
+/// @param matches this vector receives for every element of b the index of the matching element of a (or -1)
+/// @return false if the sequences differ more then maxCost elements (only the common prefix and suffix are matched)
+template<typename T>
+static bool diffSequences( const T* a, int n, const T* b, int m, int maxCost, QVector<int>& matches )
+{
+    matches.fill( -1, m );
+
+    // the common prefix and suffix don't need to be searched
+    int prefix = 0;
+    while( prefix < n && prefix < m && a[prefix] == b[prefix] ) {
+        matches[prefix] = prefix;
+        ++prefix;
+    }
+    int suffix = 0;
+    while( suffix < n - prefix && suffix < m - prefix && a[n-1-suffix] == b[m-1-suffix] ) {
+        matches[m-1-suffix] = n-1-suffix;
+        ++suffix;
+    }
+    a += prefix;
+    b += prefix;
+    n -= prefix + suffix;
+    m -= prefix + suffix;
+    if( n == 0 || m == 0 ) { return true; }
+
+    // find the furthest reaching path per diagonal (k = x-y) for every cost
+    // the vector of every cost is remembered (for diagonals -d-1 till d+1), to trace the path back
+    int offset = maxCost + 1;
+    QVector<int> v( 2 * offset + 1, 0 );
+    QVector< QVector<int> > trace;
+    int cost = -1;
+    for( int d=0; d <= maxCost && cost < 0; ++d ) {
+        trace.append( v.mid( offset - d - 1, 2 * d + 3 ) );
+        for( int k=-d; k <= d; k += 2 ) {
+            int x = ( k == -d || ( k != d && v.at(offset+k-1) < v.at(offset+k+1) ) ) ? v.at(offset+k+1) : v.at(offset+k-1) + 1;
+            int y = x - k;
+            while( x < n && y < m && a[x] == b[y] ) { ++x; ++y; }
+            v[offset+k] = x;
+            if( x >= n && y >= m ) {
+                cost = d;
+                break;
+            }
+        }
+    }
+    if( cost < 0 ) { return false; }
+
+    // walk back and record the diagonal moves
+    int x = n;
+    int y = m;
+    for( int d=cost; d >= 0; --d ) {
+        const QVector<int>& vd = trace.at(d);
+        int k = x - y;
+        int prevK = ( k == -d || ( k != d && vd.at(k+d) < vd.at(k+d+2) ) ) ? k + 1 : k - 1;
+        int prevX = vd.at(prevK+d+1);
+        int prevY = prevX - prevK;
+        while( x > prevX && y > prevY ) {
+            --x;
+            --y;
+            matches[prefix+y] = prefix+x;
+        }
+        x = prevX;
+        y = prevY;
+    }
+    return true;
+}
+
+
+/// Compares a changed line with the base line it replaces
+/// @return the inserted parts of the line and the positions of the removed parts (with a length of 0)
+static QVector<TextLineDiffSpan> diffLine( const QString& baseLine, const QString& line )
+{
+    QVector<TextLineDiffSpan> spans;
+    QVector<int> matches;
+    if( !diffSequences( baseLine.constData(), baseLine.length(), line.constData(), line.length(), CharMaxCost, matches ) ) {
+        spans.append( TextLineDiffSpan( 0, line.length(), stringdiff::INSERT ) );
+        return spans;
+    }
+
+    int nextBaseColumn = 0;
+    int insertColumn = -1;
+    for( int column=0, length=line.length(); column <= length; ++column ) {
+        int match = column < length ? matches.at(column) : baseLine.length();
+        if( match < 0 ) {
+            if( insertColumn < 0 ) { insertColumn = column; }
+            continue;
+        }
+        if( insertColumn >= 0 ) {
+            spans.append( TextLineDiffSpan( insertColumn, column - insertColumn, stringdiff::INSERT ) );
+            insertColumn = -1;
+        }
+        if( match > nextBaseColumn ) {
+            spans.append( TextLineDiffSpan( column, 0, stringdiff::DELETE ) );
+        }
+        nextBaseColumn = match + 1;
+    }
+    return spans;
+}
+
+
+/// Returns the identifier of the given line. Equal lines have the same identifier
+static int lineId( QHash<QString,int>& idMap, const QString& line )
+{
+    QHash<QString,int>::const_iterator itr = idMap.constFind( line );
+    if( itr != idMap.constEnd() ) { return itr.value(); }
+    int id = idMap.size();
+    idMap.insert( line, id );
+    return id;
+}
+
+
+//=================================================
+
+
+/// Diffs a hunk of the document with the matching part of the base text.
+/// The job only works with copies of the lines, so it can run in a worker thread
+class TextDiffJob : public QRunnable
+{
+public:
+    /// Constructs the job
+    /// @param modelRef the model that's notified when the job is finished in a worker thread
+    /// @param id the unique id of the job, the model ignores the notification of a job that's thrown away
+    TextDiffJob( TextDiffModel* modelRef, int id, int revision, int line, int baseLine )
+        : id( id )
+        , revision( revision )
+        , line( line )
+        , baseLine( baseLine )
+        , removedAfter( false )
+        , modelRef_( modelRef )
+    {
+        setAutoDelete( false );
+    }
+
+    /// diffs the hunk (in the worker thread) and notifies the model
+    virtual void run()
+    {
+        compute();
+        QMetaObject::invokeMethod( modelRef_, "diffJobFinished", Qt::QueuedConnection, Q_ARG( int, id ) );
+    }
+
+    void compute();
+
+    int id;                                         ///< The unique id of the job
+    int revision;                                   ///< The revision of the model when the job was created
+    int line;                                       ///< The first line of the hunk
+    int baseLine;                                   ///< The first base line of the hunk
+    QStringList baseLineList;                       ///< The base lines of the hunk
+    QStringList lineList;                           ///< The lines of the hunk
+
+    QVector<int> lineRefList;                       ///< Result: the matching base line per line (relative to baseLine, -1 if it doesn't match)
+    QVector<int> lineStatusList;                    ///< Result: the TextLineDiffIndex::LineStatus per line
+    QVector< QVector<TextLineDiffSpan> > lineSpanList;  ///< Result: the changed parts per line
+    bool removedAfter;                              ///< Result: are base lines removed after the last line of the hunk?
+
+private:
+    TextDiffModel* modelRef_;                       ///< The model to notify
+};
+
+
+/// Diffs the lines and compares the changed lines per character
+void TextDiffJob::compute()
+{
+    int baseLineCount = baseLineList.size();
+    int lineCount = lineList.size();
+
+    // compare the lines by identifier
+    QHash<QString,int> idMap;
+    QVector<int> baseIdList( baseLineCount );
+    QVector<int> idList( lineCount );
+    for( int i=0; i<baseLineCount; ++i ) { baseIdList[i] = lineId( idMap, baseLineList.at(i) ); }
+    for( int i=0; i<lineCount; ++i ) { idList[i] = lineId( idMap, lineList.at(i) ); }
+    // (when the hunk differs too much, only the common prefix and suffix are matched)
+    diffSequences( baseIdList.constData(), baseLineCount, idList.constData(), lineCount, LineMaxCost, lineRefList );
+
+    lineStatusList.fill( TextLineDiffIndex::LineUnchanged, lineCount );
+    lineSpanList.fill( QVector<TextLineDiffSpan>(), lineCount );
+    removedAfter = false;
+
+    // every gap between the matching lines contains removed base lines and/or added lines
+    // the added lines are paired with the removed lines, these lines are changed
+    int nextBaseLine = 0;
+    for( int i=0; i <= lineCount; ++i ) {
+        int gapStart = i;
+        while( i < lineCount && lineRefList.at(i) < 0 ) { ++i; }
+        int gapBaseEnd = i < lineCount ? lineRefList.at(i) : baseLineCount;
+
+        int gapLineCount = i - gapStart;
+        int gapBaseLineCount = gapBaseEnd - nextBaseLine;
+        for( int j=0; j < gapLineCount; ++j ) {
+            if( j < gapBaseLineCount ) {
+                lineStatusList[gapStart+j] = TextLineDiffIndex::LineChanged;
+                lineSpanList[gapStart+j] = diffLine( baseLineList.at(nextBaseLine+j), lineList.at(gapStart+j) );
+            } else {
+                lineStatusList[gapStart+j] = TextLineDiffIndex::LineInserted;
+            }
+        }
+
+        // removed lines are marked at the next line
+        if( gapBaseLineCount > gapLineCount ) {
+            if( i < lineCount ) {
+                lineStatusList[i] = TextLineDiffIndex::LineDeleted;
+            } else {
+                removedAfter = true;
+            }
+        }
+        nextBaseLine = gapBaseEnd + 1;
+    }
+}
+
+
+//=================================================
+
+
+/// Constructs the diff model
+/// @param document the document to compare with the base text
+/// @param index the index that receives the line differences
+TextDiffModel::TextDiffModel( TextDocument* document, TextLineDiffIndex* index )
+    : QObject()
+    , documentRef_( document )
+    , indexRef_( index )
+    , hasBaseText_( false )
+    , dirtyFirstLine_( -1 )
+    , dirtyLastLine_( -1 )
+    , revision_( 0 )
+    , threadingEnabled_( true )
+    , updateScheduled_( false )
+    , pool_( 0 )
+    , job_( 0 )
+    , lastJobId_( 0 )
+{
+    connect( document, SIGNAL(textChanged(edbee::TextBufferChange)), this, SLOT(textChanged(edbee::TextBufferChange)), Qt::DirectConnection );
+}
+
+
+/// The destructor waits for the running job
+TextDiffModel::~TextDiffModel()
+{
+    if( pool_ ) { pool_->waitForDone(); }
+    delete pool_;
+    delete job_;
+}
+
+
+/// Sets the base text the document is compared with. All lines are diffed
+/// @param text the base text
+void TextDiffModel::setBaseText( const QString& text )
+{
+    int lineCount = documentRef_->lineCount();
+    ++revision_;
+    hasBaseText_ = true;
+    baseLineList_ = text.split('\n');
+    baseLineRefList_.fill( -1, lineCount );
+
+    indexRef_->clear();
+    indexRef_->setLineCount( lineCount );
+
+    dirtyFirstLine_ = -1;
+    markDirty( 0, lineCount - 1 );
+    scheduleUpdate();
+}
+
+
+/// Removes the base text. The differences in the index are left alone
+void TextDiffModel::clearBaseText()
+{
+    ++revision_;
+    hasBaseText_ = false;
+    baseLineList_.clear();
+    baseLineRefList_.clear();
+    dirtyFirstLine_ = -1;
+    dirtyLastLine_ = -1;
+}
+
+
+/// Is a base text set?
+bool TextDiffModel::hasBaseText() const
+{
+    return hasBaseText_;
+}
+
+
+/// Returns the base text
+QString TextDiffModel::baseText() const
+{
+    return baseLineList_.join("\n");
+}
+
+
+/// Returns the base line that matches the given line
+/// @return the base line or -1 if the line doesn't match (or hasn't been diffed yet)
+int TextDiffModel::baseLineForLine( int line ) const
+{
+    if( line < 0 || line >= baseLineRefList_.size() ) { return -1; }
+    return baseLineRefList_.at(line);
+}
+
+
+/// Enables or disables diffing on a worker thread. Without threading the changes are diffed immediately
+void TextDiffModel::setThreadingEnabled( bool enabled )
+{
+    if( !enabled && job_ ) {
+        pool_->waitForDone();
+        delete job_;
+        job_ = 0;
+    }
+    threadingEnabled_ = enabled;
+    if( !threadingEnabled_ ) { updateNow(); }
+}
+
+
+/// Is diffing on a worker thread enabled?
+bool TextDiffModel::isThreadingEnabled() const
+{
+    return threadingEnabled_;
+}
+
+
+/// Are there lines that still need to be diffed?
+bool TextDiffModel::isUpdating() const
+{
+    return dirtyFirstLine_ >= 0;
+}
+
+
+/// The text is changed. The lines are moved and the changed lines are diffed again
+/// @param change the text change
+void TextDiffModel::textChanged( TextBufferChange change )
+{
+    int line = change.line();
+    if( !indexRef_->isEmpty() ) {
+        indexRef_->replaceLines( line + 1, change.lineCount(), change.newLineCount() );
+
+        // the changed parts of the edited line don't match its new text
+        if( line < indexRef_->lineCount() ) { indexRef_->setLineDiff( line, indexRef_->lineStatus(line), QVector<TextLineDiffSpan>() ); }
+    }
+    if( !hasBaseText_ ) { return; }
+
+    // move the matching base lines, the changed lines don't match anymore
+    baseLineRefList_.remove( line + 1, change.lineCount() );
+    baseLineRefList_.insert( line + 1, change.newLineCount(), -1 );
+    baseLineRefList_[line] = -1;
+
+    // move the lines that still need to be diffed
+    if( dirtyFirstLine_ >= 0 ) {
+        int oldLastLine = line + change.lineCount();
+        int newLastLine = line + change.newLineCount();
+        int lineDelta = change.newLineCount() - change.lineCount();
+        if( dirtyFirstLine_ > oldLastLine ) { dirtyFirstLine_ += lineDelta; }
+        else if( dirtyFirstLine_ > newLastLine ) { dirtyFirstLine_ = newLastLine; }
+        if( dirtyLastLine_ > oldLastLine ) { dirtyLastLine_ += lineDelta; }
+        else if( dirtyLastLine_ > newLastLine ) { dirtyLastLine_ = newLastLine; }
+    }
+    markDirty( line, line + change.newLineCount() );
+    ++revision_;
+    scheduleUpdate();
+}
+
+
+/// Diffs the changed lines immediately (in the current thread)
+void TextDiffModel::updateNow()
+{
+    if( !hasBaseText_ || dirtyFirstLine_ < 0 ) { return; }
+    TextDiffJob* job = createJob();
+    job->compute();
+    applyJob( job );
+    delete job;
+}
+
+
+/// Starts a job that diffs the changed lines. When a job is running, a new job is started when it's finished
+void TextDiffModel::startUpdate()
+{
+    updateScheduled_ = false;
+    if( job_ || !hasBaseText_ || dirtyFirstLine_ < 0 ) { return; }
+
+    // the thread is only created when there's something to diff
+    if( !pool_ ) {
+        pool_ = new QThreadPool();
+        pool_->setMaxThreadCount( 1 );
+    }
+    job_ = createJob();
+    pool_->start( job_ );
+}
+
+
+/// A job is finished. The result is applied when the text hasn't been changed in the mean time
+/// @param jobId the id of the finished job
+void TextDiffModel::diffJobFinished( int jobId )
+{
+    if( !job_ || job_->id != jobId ) { return; }     // (the job is thrown away when threading is disabled, another job can be running)
+    if( hasBaseText_ && job_->revision == revision_ ) {
+        applyJob( job_ );
+    }
+    delete job_;
+    job_ = 0;
+    if( dirtyFirstLine_ >= 0 ) { scheduleUpdate(); }
+}
+
+
+/// Schedules diffing the changed lines. With threading the changes are combined until the event loop is processed
+void TextDiffModel::scheduleUpdate()
+{
+    if( !threadingEnabled_ ) {
+        updateNow();
+        return;
+    }
+    if( updateScheduled_ ) { return; }
+    updateScheduled_ = true;
+    QTimer::singleShot( 0, this, SLOT(startUpdate()) );
+}
+
+
+/// Adds the given lines to the lines that need to be diffed
+void TextDiffModel::markDirty( int firstLine, int lastLine )
+{
+    if( dirtyFirstLine_ < 0 ) {
+        dirtyFirstLine_ = firstLine;
+        dirtyLastLine_ = lastLine;
+    } else {
+        dirtyFirstLine_ = qMin( dirtyFirstLine_, firstLine );
+        dirtyLastLine_ = qMax( dirtyLastLine_, lastLine );
+    }
+}
+
+
+/// Creates a job for the hunk around the changed lines.
+/// The hunk is extended to the nearest matching lines, so the base lines of the hunk are known
+TextDiffJob* TextDiffModel::createJob()
+{
+    int lineCount = baseLineRefList_.size();
+    int startLine = qBound( 0, dirtyFirstLine_, lineCount );
+    while( startLine > 0 && baseLineRefList_.at(startLine-1) < 0 ) { --startLine; }
+    int endLine = qBound( startLine, dirtyLastLine_ + 1, lineCount );
+    while( endLine < lineCount && baseLineRefList_.at(endLine) < 0 ) { ++endLine; }
+
+    int startBaseLine = startLine > 0 ? baseLineRefList_.at(startLine-1) + 1 : 0;
+    int endBaseLine = endLine < lineCount ? baseLineRefList_.at(endLine) : baseLineList_.size();
+
+    TextDiffJob* job = new TextDiffJob( this, ++lastJobId_, revision_, startLine, startBaseLine );
+    job->baseLineList = baseLineList_.mid( startBaseLine, endBaseLine - startBaseLine );
+    for( int line=startLine; line < endLine; ++line ) {
+        job->lineList.append( documentRef_->lineWithoutNewline(line) );
+    }
+    return job;
+}
+
+
+/// Stores the result of the given job in the index
+void TextDiffModel::applyJob( TextDiffJob* job )
+{
+    int lineCount = job->lineList.size();
+    for( int i=0; i<lineCount; ++i ) {
+        int ref = job->lineRefList.at(i);
+        baseLineRefList_[job->line + i] = ref < 0 ? -1 : job->baseLine + ref;
+        indexRef_->setLineDiff( job->line + i, job->lineStatusList.at(i), job->lineSpanList.at(i) );
+    }
+
+    // the (matching) line after the hunk shows the removed lines before it
+    int length = lineCount;
+    if( job->line + lineCount < baseLineRefList_.size() ) {
+        int status = job->removedAfter ? TextLineDiffIndex::LineDeleted : TextLineDiffIndex::LineUnchanged;
+        indexRef_->setLineDiff( job->line + lineCount, status, QVector<TextLineDiffSpan>() );
+        ++length;
+    }
+
+    dirtyFirstLine_ = -1;
+    dirtyLastLine_ = -1;
+    emit lineDiffsChanged( job->line, length );
+}
+
+
+} // edbee
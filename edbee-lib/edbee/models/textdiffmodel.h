@@ -0,0 +1,93 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+#include "edbee/models/textbuffer.h"
+
+class QThreadPool;
+
+namespace edbee {
+
+class TextDiffJob;
+class TextDocument;
+class TextLineDiffIndex;
+
+
+/// Keeps the line differences of a document with a base text up-to-date while the document is edited.
+///
+/// For every line of the document the model remembers the base line it matches. On a text change the lines
+/// are moved immediately, so the differences of the other lines stay at the correct line. Only the hunk around
+/// the changed lines is diffed again: the lines between the nearest matching lines before and after the change.
+///
+/// A hunk is diffed by comparing the lines (Myers diff). The changed lines are paired with the removed base lines
+/// and compared per character. This happens on a worker thread; a result of a text that has been changed in the
+/// mean time is thrown away and the hunk is diffed again.
+///
+/// Without a base text the model only moves the lines of the index (for differences set with TextDocument::setDiffLookup)
+class TextDiffModel : public QObject
+{
+    Q_OBJECT
+
+public:
+    TextDiffModel( TextDocument* document, TextLineDiffIndex* index );
+    virtual ~TextDiffModel();
+
+    void setBaseText( const QString& text );
+    void clearBaseText();
+    bool hasBaseText() const;
+    QString baseText() const;
+    int baseLineForLine( int line ) const;
+
+    void setThreadingEnabled( bool enabled );
+    bool isThreadingEnabled() const;
+    bool isUpdating() const;
+
+signals:
+
+    /// This signal is emitted when the differences of the given lines are recomputed
+    void lineDiffsChanged( int line, int length );
+
+public slots:
+
+    void textChanged( edbee::TextBufferChange change );
+    void updateNow();
+
+private slots:
+
+    void startUpdate();
+    void diffJobFinished( int jobId );
+
+private:
+    void scheduleUpdate();
+    void markDirty( int firstLine, int lastLine );
+    TextDiffJob* createJob();
+    void applyJob( TextDiffJob* job );
+
+private:
+    TextDocument* documentRef_;             ///< The document that's compared
+    TextLineDiffIndex* indexRef_;           ///< The index that receives the differences
+
+    bool hasBaseText_;                      ///< Is a base text set?
+    QStringList baseLineList_;              ///< The lines of the base text
+    QVector<int> baseLineRefList_;          ///< For every line of the document the matching base line (-1 if it doesn't match)
+
+    int dirtyFirstLine_;                    ///< The first line that needs to be diffed (-1 if nothing needs to be diffed)
+    int dirtyLastLine_;                     ///< The last line that needs to be diffed
+    int revision_;                          ///< Incremented on every change, a job of an older revision is outdated
+
+    bool threadingEnabled_;                 ///< Diff on a worker thread?
+    bool updateScheduled_;                  ///< Is a start of the update scheduled?
+    QThreadPool* pool_;                     ///< The thread that diffs the hunks (created for the first job)
+    TextDiffJob* job_;                      ///< The running job (0 if there's no job running)
+    int lastJobId_;                         ///< The id of the last created job
+};
+
+
+} // edbee
@@ -13,6 +13,7 @@
 #include "edbee/models/changes/textchange.h"
 #include "edbee/models/changes/textchangewithcaret.h"
 
+#include "edbee/models/textdiffmodel.h"
 #include "edbee/models/textlinedata.h"
 #include "edbee/models/textdocumentfilter.h"
 #include "edbee/models/textrange.h"
@@ -28,15 +29,17 @@ namespace edbee {
 /// Constructs the textdocument
 TextDocument::TextDocument( QObject* obj )
     : QObject(obj)
+    , diffModel_(0)
     , documentFilter_(0)
     , documentFilterRef_(0)
-{   
+{
 }
 
 
 /// Destroys the textdocument
 TextDocument::~TextDocument()
 {
+    delete diffModel_;
     delete documentFilter_;
 }
 
@@ -305,12 +308,67 @@ void TextDocument::setText(const QString& text)
 {
     replace( 0, length(), text, 0 );
 }
-    
-void TextDocument::setDiffLookup(QVector<QVector<diff_match_patch<string>::Diff>> lookup)
+
+
+/// Sets the differences of the lines. The differences are converted to the changed parts per line,
+/// so they don't need to be processed while rendering.
+/// @param lookup the diff of every line
+void TextDocument::setDiffLookup( const QVector<QVector<stringdiff::Diff>>& lookup )
+{
+    diffModel()->clearBaseText();
+    lineDiffIndex_.clear();
+    lineDiffIndex_.setLineCount( lookup.size() );
+    for( int line=0, cnt=lookup.size(); line<cnt; ++line ) {
+        const QVector<stringdiff::Diff>& diffs = lookup.at(line);
+        bool inserted = false;
+        bool deleted = false;
+        QVector<TextLineDiffSpan> spans;
+        int offset = 0;
+        for( int i=0, diffCount=diffs.size(); i<diffCount; ++i ) {
+            const stringdiff::Diff& diff = diffs.at(i);
+            int length = static_cast<int>( diff.text.length() );
+            if( diff.operation == stringdiff::DELETE ) { deleted = true; }
+            if( diff.operation == stringdiff::INSERT ) { inserted = true; }
+
+            // only lines with multiple parts show their changed parts
+            if( diffCount > 1 && diff.operation != stringdiff::EQUAL ) {
+                spans.append( TextLineDiffSpan( offset, length, diff.operation ) );
+            }
+            offset += length;
+        }
+
+        int status = TextLineDiffIndex::LineUnchanged;
+        if( deleted && inserted ) { status = TextLineDiffIndex::LineChanged; }
+        else if( inserted ) { status = TextLineDiffIndex::LineInserted; }
+        else if( deleted ) { status = TextLineDiffIndex::LineDeleted; }
+        lineDiffIndex_.setLineDiff( line, status, spans );
+    }
+    emit diffLookupChanged();
+}
+
+
+/// Compares the document with the given base text. The differences are kept up-to-date while the document
+/// is changed (see TextDiffModel). The lines are diffed in the background, lineDiffsChanged is emitted for the results
+/// @param baseText the text to compare with
+void TextDocument::setDiffBase( const QString& baseText )
+{
+    diffModel()->setBaseText( baseText );
+    emit diffLookupChanged();
+}
+
+
+/// Returns the model that keeps the line differences in sync with the text.
+/// The model is created when it's used the first time, a document without differences doesn't need a model
+TextDiffModel* TextDocument::diffModel()
 {
-    diffLookup_ = lookup;
+    if( !diffModel_ ) {
+        diffModel_ = new TextDiffModel( this, &lineDiffIndex_ );
+        connect( diffModel_, SIGNAL(lineDiffsChanged(int,int)), this, SIGNAL(lineDiffsChanged(int,int)) );
+    }
+    return diffModel_;
 }
 
+
 /// begins the raw append modes. In raw append mode data is directly streamed
 /// to the textdocument-buffer. No undo-data is collected and no events are fired
 void TextDocument::rawAppendBegin()
@@ -351,39 +409,20 @@ int TextDocument::length()
 }
 
 
-QVector<stringdiff::Diff> TextDocument::getLineDiffs(int lineIndex)
+/// Returns the changed parts of the given line (an empty list if the line isn't changed)
+const QVector<TextLineDiffSpan>& TextDocument::lineDiffSpans( int line ) const
 {
-	return diffLookup_.at(lineIndex);
+    return lineDiffIndex_.lineSpans( line );
 }
-    
+
+
+/// Returns the TextLineDiffIndex::LineStatus of the given line
 int TextDocument::getLineStatus(int lineIndex)
 {
-    QVector<stringdiff::Diff> diffs = diffLookup_.at(lineIndex);
-    
-    // TODO: this would be cool
-    //if any_of(diffs.cbegin(), diffs.cend(), [](<diff_match_patch<string>::Diff* diff){ return })
-    bool inserted = false;
-    bool deleted = false;
-    for (int i = 0; i < diffs.count(); ++i) {
-        stringdiff::Diff diff = diffs.at(i);
-
-        //qDebug() << "line" << lineIndex << "diff" << i << "op" << diff.operation;// << "txt";// << diff->text;
-            
-        if (diff.operation == stringdiff::DELETE) {
-            deleted = true;
-        }
-        if (diff.operation == stringdiff::INSERT) {
-            inserted = true;
-        }
-        
-    }
-    //qDebug() << "line" << lineIndex << " deleted and inserted are" << deleted << inserted;
-    if (deleted && inserted) return 3;
-    if (inserted) return 2;
-    if (deleted) return 1;
-    return 0;
+    return lineDiffIndex_.lineStatus( lineIndex );
 }
 
+
 /// Returns the number of lines
 int TextDocument::lineCount()
 {
@@ -9,6 +9,7 @@
 #include <QList>
 
 #include "edbee/models/textbuffer.h"
+#include "edbee/models/textlinediffindex.h"
 #include "diff_match_patch.h"
 
 using namespace std;
@@ -22,6 +23,7 @@ class TextGrammar;
 class Change;
 class ChangeGroup;
 class TextCodec;
+class TextDiffModel;
 class TextDocumentFilter;
 class TextDocumentScopes;
 class TextEditorConfig;
@@ -115,9 +117,12 @@ public:
     void giveSelection( TextEditorController* controller,  TextRangeSet* rangeSet);
     void endChanges( int coalesceId );
 
-    int getLineStatus (int line);    
-	QVector<stringdiff::Diff> TextDocument::getLineDiffs(int lineIndex);
-    void setDiffLookup(QVector<QVector<diff_match_patch<string>::Diff>> lookup);
+    int getLineStatus (int line);
+    const QVector<TextLineDiffSpan>& lineDiffSpans( int line ) const;
+    const TextLineDiffIndex* lineDiffIndex() const { return &lineDiffIndex_; }
+    void setDiffLookup( const QVector<QVector<stringdiff::Diff>>& lookup );
+    void setDiffBase( const QString& baseText );
+    TextDiffModel* diffModel();
     
     void executeAndGiveChange(Change* change , int coalesceId );
 
@@ -167,10 +172,17 @@ signals:
     /// this signal is emitted if the scoped range has been changed
     void lastScopedOffsetChanged( int previousOffset, int lastScopedOffset );
 
+    /// This signal is emitted if the line differences have been changed
+    void diffLookupChanged();
+
+    /// This signal is emitted if the differences of the given lines have been recomputed
+    void lineDiffsChanged( int line, int length );
+
 
 private:
 
-    QVector<QVector<stringdiff::Diff>> diffLookup_;
+    TextLineDiffIndex lineDiffIndex_;               ///< The precomputed line differences (see setDiffLookup)
+    TextDiffModel* diffModel_;                      ///< Keeps the line differences in sync with the text (0 until differences are set)
 
     TextDocumentFilter* documentFilter_;             ///< The document filter if the filter is owned
     TextDocumentFilter* documentFilterRef_;          ///< The reference to the document filter.
@@ -6,6 +6,14 @@
 #include "textdocumentscopes.h"
 
 #include <math.h>
+#include <new>
+#include <stdlib.h>
+#include <QAtomicInteger>
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QSet>
+#include <QThread>
+#include <QVarLengthArray>
 
 #include "edbee/models/textbuffer.h"
 #include "edbee/models/textdocument.h"
@@ -16,6 +24,18 @@
 
 namespace edbee {
 
+/// The maximum total length (in characters) of the keys of the interned line scopes. The table is cleared when it grows larger
+static const int MaxInternedLineRangeListCost = 512 * 1024;
+
+
+/// Releases a reference to a line scoped range list. The list is deleted when it isn't used anymore
+/// @param list the list to release (may be 0)
+static void releaseLineScopedRangeList( ScopedTextRangeList* list )
+{
+    if( list && !list->deref() ) { delete list; }
+}
+
+
 /// A scoped text range
 /// @param anchor the start of the range
 /// @param caret the caret position of the range
@@ -23,6 +43,20 @@ namespace edbee {
 ScopedTextRange::ScopedTextRange(int anchor, int caret, TextScope* scope)
     : TextRange(anchor,caret)
     , scopeRef_(scope)
+    , multiScopeRef_(0)
+{
+    Q_ASSERT(scopeRef_);
+}
+
+
+/// A line range that references a multi-line range
+/// @param anchor the start of the range in the line
+/// @param caret the caret position of the range in the line
+/// @param range the referenced multi-line range
+ScopedTextRange::ScopedTextRange(int anchor, int caret, MultiLineScopedTextRange& range)
+    : TextRange(anchor,caret)
+    , scopeRef_(range.scope())
+    , multiScopeRef_(&range)
 {
     Q_ASSERT(scopeRef_);
 }
@@ -56,85 +90,243 @@ QString ScopedTextRange::toString() const
 }
 
 
+/// Returns the referenced multi-line scoped text range (or 0 if this isn't a reference)
+MultiLineScopedTextRange* ScopedTextRange::multiLineScopedTextRange() const
+{
+    return multiScopeRef_;
+}
+
+
+/// Changes the referenced multi-line scoped textrange
+/// @param range the new range (with the same scope)
+void ScopedTextRange::setMultiLineScopedTextRange( MultiLineScopedTextRange* range )
+{
+    multiScopeRef_ = range;
+}
+
+
 //===========================================
 
 
+/// Constructs an empty range pool
+ScopedTextRangePool::ScopedTextRangePool()
+    : blockPos_(0)
+    , blockRemaining_(0)
+    , allocatedBytes_(0)
+    , usedBytes_(0)
+{
+    for( int i=0; i <= MaxPooledCapacity; ++i ) { freeLists_[i] = 0; }
+}
 
-/// Creates a scoped text range based on a scope textrange
-MultiLineScopedTextRangeReference::MultiLineScopedTextRangeReference(MultiLineScopedTextRange& range)
-    : ScopedTextRange( range.anchor(), range.caret(), range.scope() )
-    , multiScopeRef_( &range )
+
+/// The destructor frees all blocks. All arrays allocated from this pool become invalid
+ScopedTextRangePool::~ScopedTextRangePool()
 {
+    foreach( char* block, blockList_ ) { free( block ); }
 }
 
 
-// the destructor
-MultiLineScopedTextRangeReference::~MultiLineScopedTextRangeReference()
+/// Allocates an (uninitialized) array of ranges
+/// @param capacity the number of ranges
+/// @return the array. It must be released to this pool with the same capacity
+ScopedTextRange* ScopedTextRangePool::allocate( int capacity )
 {
+    Q_ASSERT( capacity > 0 );
+    int bytes = capacity * sizeof(ScopedTextRange);
+    usedBytes_ += bytes;
+
+    // large arrays are allocated on the heap
+    if( capacity > MaxPooledCapacity ) {
+        allocatedBytes_ += bytes;
+        return static_cast<ScopedTextRange*>( malloc( bytes ) );
+    }
+
+    // reuse a released array
+    void* result = freeLists_[capacity];
+    if( result ) {
+        freeLists_[capacity] = *static_cast<void**>( result );
+        return static_cast<ScopedTextRange*>( result );
+    }
+
+    // carve it from the current block
+    if( blockRemaining_ < bytes ) {
+        blockPos_ = static_cast<char*>( malloc( BlockSize ) );
+        blockRemaining_ = BlockSize;
+        blockList_.append( blockPos_ );
+        allocatedBytes_ += BlockSize;
+    }
+    result = blockPos_;
+    blockPos_ += bytes;
+    blockRemaining_ -= bytes;
+    return static_cast<ScopedTextRange*>( result );
 }
 
 
-/// Returns the reference the multilinescoped textrange
-MultiLineScopedTextRange* MultiLineScopedTextRangeReference::multiLineScopedTextRange()
+/// Releases an array. The ranges in the array must already be destructed
+/// @param ranges the array to release
+/// @param capacity the capacity given when allocating the array
+void ScopedTextRangePool::release( ScopedTextRange* ranges, int capacity )
 {
-    return multiScopeRef_;
+    if( !ranges ) { return; }
+    int bytes = capacity * sizeof(ScopedTextRange);
+    usedBytes_ -= bytes;
+
+    if( capacity > MaxPooledCapacity ) {
+        allocatedBytes_ -= bytes;
+        free( ranges );
+        return;
+    }
+    *reinterpret_cast<void**>( ranges ) = freeLists_[capacity];
+    freeLists_[capacity] = ranges;
+}
+
+
+/// Returns the number of bytes allocated by this pool
+qint64 ScopedTextRangePool::allocatedBytes() const
+{
+    return allocatedBytes_;
+}
+
+
+/// Returns the number of bytes in use (allocated and not released)
+qint64 ScopedTextRangePool::usedBytes() const
+{
+    return usedBytes_;
 }
 
 
 //===========================================
 
 
+/// The last id given to a scoped range list (lists are created by lexers in several threads).
+/// The id is 64 bits, so it never wraps and an id of a destroyed list is never reused
+static QAtomicInteger<qint64> lastScopedTextRangeListId(0);
+
+
 /// A scoped textrange lsit
-ScopedTextRangeList::ScopedTextRangeList()
-    : ranges_()
+/// @param pool the pool to allocate the range array from
+ScopedTextRangeList::ScopedTextRangeList( ScopedTextRangePool* pool )
+    : id_( lastScopedTextRangeListId.fetchAndAddOrdered(1) + 1 )
+    , poolRef_(pool)
+    , ranges_(0)
+    , size_(0)
+    , capacity_(0)
+    , refCount_(1)
     , independent_(false)
+    , incomplete_(false)
 {
+    Q_ASSERT(poolRef_);
 }
 
 
 /// The default destructor
 ScopedTextRangeList::~ScopedTextRangeList()
 {
-    qDeleteAll(ranges_);
-    ranges_.clear();
+    for( int i=0; i < size_; ++i ) { ranges_[i].~ScopedTextRange(); }
+    poolRef_->release( ranges_, capacity_ );
+}
+
+
+/// Returns the unique id of this list
+qint64 ScopedTextRangeList::id() const
+{
+    return id_;
 }
 
 
 /// Retursn the number of scoped textranges in the list
 int ScopedTextRangeList::size() const
 {
-    return ranges_.size();
+    return size_;
 }
 
 
 /// Returns the scoped textrange at the given list
+/// The returned pointer is only valid until the list is changed
 ScopedTextRange* ScopedTextRangeList::at(int idx)
 {
-    Q_ASSERT(idx < ranges_.size() );
-    return ranges_.at(idx);
+    Q_ASSERT(idx < size_ );
+    return &ranges_[idx];
+}
+
+
+/// Appends a line scoped range
+/// @param anchor the start of the range in the line
+/// @param caret the end of the range in the line
+/// @param scope the scope of the range
+void ScopedTextRangeList::addRange( int anchor, int caret, TextScope* scope )
+{
+    if( size_ == capacity_ ) { reserve( qMax( 4, capacity_ * 2 ) ); }
+    new ( &ranges_[size_] ) ScopedTextRange( anchor, caret, scope );
+    ++size_;
+}
+
+
+/// Appends a range that references a multi-line range
+/// @param anchor the start of the range in the line
+/// @param caret the end of the range in the line
+/// @param range the multi-line range
+void ScopedTextRangeList::addRange( int anchor, int caret, MultiLineScopedTextRange& range )
+{
+    if( size_ == capacity_ ) { reserve( qMax( 4, capacity_ * 2 ) ); }
+    new ( &ranges_[size_] ) ScopedTextRange( anchor, caret, range );
+    ++size_;
+}
+
+
+/// Appends a copy of the given range
+/// @param range the range to copy
+void ScopedTextRangeList::addRange( const ScopedTextRange& range )
+{
+    if( size_ == capacity_ ) { reserve( qMax( 4, capacity_ * 2 ) ); }
+    new ( &ranges_[size_] ) ScopedTextRange( range );
+    ++size_;
+}
+
+
+/// Adds a reference to this list. (A new list has a single reference)
+void ScopedTextRangeList::ref()
+{
+    ++refCount_;
 }
 
 
-/// give a rnage to the range set
-/// @param range the scoped text range
-void ScopedTextRangeList::giveRange(ScopedTextRange* range)
+/// Releases a reference
+/// @return false if this was the last reference, the list should be deleted then
+bool ScopedTextRangeList::deref()
 {
-    ranges_.append(range);
+    return --refCount_ > 0;
 }
 
 
-/// Prepends a range
-/// @param range the range to prepend
-void ScopedTextRangeList::giveAndPrependRange(ScopedTextRange* range)
+/// Returns the number of references to this list
+int ScopedTextRangeList::refCount() const
 {
-    ranges_.prepend(range);
+    return refCount_;
 }
 
 
 /// Squeezes the ranges (reduces the memory usage)
 void ScopedTextRangeList::squeeze()
 {
-    ranges_.squeeze();
+    if( size_ < capacity_ ) { reserve( size_ ); }
+}
+
+
+/// Moves the range array to another pool. (Required when a list is moved to another document)
+/// @param pool the new pool
+void ScopedTextRangeList::moveToPool( ScopedTextRangePool* pool )
+{
+    if( pool == poolRef_ ) { return; }
+    ScopedTextRange* ranges = size_ ? pool->allocate( size_ ) : 0;
+    for( int i=0; i < size_; ++i ) {
+        new ( &ranges[i] ) ScopedTextRange( ranges_[i] );
+        ranges_[i].~ScopedTextRange();
+    }
+    poolRef_->release( ranges_, capacity_ );
+    poolRef_ = pool;
+    ranges_ = ranges;
+    capacity_ = size_;
 }
 
 
@@ -152,19 +344,49 @@ bool ScopedTextRangeList::isIndependent() const
 }
 
 
+/// Marks the line as incompletely lexed. The remainder of the line only has the enclosing scopes.
+void ScopedTextRangeList::setIncomplete(bool enable)
+{
+    incomplete_ = enable;
+}
+
+
+/// returns true if the lexing of this line was aborted
+bool ScopedTextRangeList::isIncomplete() const
+{
+    return incomplete_;
+}
+
+
 /// Converts the scoped textrange list to a strubg
 QString ScopedTextRangeList::toString()
 {
     QString result;
     result.append( independent_ ? "[-]" : "[M]");
-    foreach( ScopedTextRange* scope, ranges_ ) {
+    for( int i=0; i < size_; ++i ) {
         if( !result.isEmpty() ) { result.append("| "); }
-        result.append( scope->toString() );
+        result.append( ranges_[i].toString() );
     }
     return result;
 }
 
 
+/// Changes the capacity of the range array
+/// @param capacity the new capacity (this should be at least the size)
+void ScopedTextRangeList::reserve( int capacity )
+{
+    Q_ASSERT( capacity >= size_ );
+    ScopedTextRange* ranges = capacity ? poolRef_->allocate( capacity ) : 0;
+    for( int i=0; i < size_; ++i ) {
+        new ( &ranges[i] ) ScopedTextRange( ranges_[i] );
+        ranges_[i].~ScopedTextRange();
+    }
+    poolRef_->release( ranges_, capacity_ );
+    ranges_ = ranges;
+    capacity_ = capacity;
+}
+
+
 //===========================================
 
 
@@ -172,7 +394,8 @@ QString ScopedTextRangeList::toString()
 /// @param anchor
 MultiLineScopedTextRange::MultiLineScopedTextRange(int anchor, int caret, TextScope* scope )
     : ScopedTextRange(anchor,caret,scope)
-    , endRegExp_(0)
+    , endRegExp_()
+    , rangeSetIndex_(-1)
 //    , ruleRef_(0)
 {
 }
@@ -181,7 +404,6 @@ MultiLineScopedTextRange::MultiLineScopedTextRange(int anchor, int caret, TextSc
 /// The multi-line destructor
 MultiLineScopedTextRange::~MultiLineScopedTextRange()
 {
-    delete endRegExp_;
 }
 
 
@@ -201,6 +423,14 @@ TextGrammarRule* MultiLineScopedTextRange::grammarRule() const
 
 /// Gives the end regular expression
 void MultiLineScopedTextRange::giveEndRegExp( RegExp* regExp)
+{
+    endRegExp_ = QSharedPointer<RegExp>(regExp);
+}
+
+
+/// Sets a (shared) end regular expression
+/// @param regExp the end regular expression, which can be used by several ranges
+void MultiLineScopedTextRange::setEndRegExp( const QSharedPointer<RegExp>& regExp )
 {
     endRegExp_ = regExp;
 }
@@ -209,7 +439,7 @@ void MultiLineScopedTextRange::giveEndRegExp( RegExp* regExp)
 /// returns the end-regular expression
 RegExp*MultiLineScopedTextRange::endRegExp()
 {
-    return endRegExp_;
+    return endRegExp_.data();
 }
 
 
@@ -493,11 +723,228 @@ double TextScopeSelector::calculateMatchScoreForSelector(TextScopeList* selector
 
 
 
+//=============================================
+
+
+/// Constructs an empty selector matcher
+TextScopeSelectorMatcher::TextScopeSelectorMatcher()
+    : selectorCount_(0)
+{
+    clear();
+}
+
+
+/// The destructor
+TextScopeSelectorMatcher::~TextScopeSelectorMatcher()
+{
+}
+
+
+/// Removes all selectors
+void TextScopeSelectorMatcher::clear()
+{
+    nodeList_.clear();
+    lastPathMap_.clear();
+    wildcardLastPathList_.clear();
+    selectorCount_ = 0;
+
+    Node root;
+    root.path = 0;
+    root.weight = 0;
+    nodeList_.append(root);
+}
+
+
+/// Adds the given selector to the matcher
+/// @param selector the selector to add. (the matcher doesn't take the ownership)
+/// @return the index of the selector. This is the index that's used in the match results
+int TextScopeSelectorMatcher::addSelector( TextScopeSelector* selector )
+{
+    int selectorIndex = selectorCount_++;
+    foreach( TextScopeList* pathList, selector->selectorList() ) {
+        int nodeIndex = 0;
+        for( int i=pathList->size()-1; i>=0; --i ) {
+            nodeIndex = findOrCreateChildNode( nodeIndex, pathList->at(i) );
+        }
+        nodeList_[nodeIndex].selectorList.append( selectorIndex );
+    }
+    return selectorIndex;
+}
+
+
+/// Returns the number of added selectors
+int TextScopeSelectorMatcher::selectorCount() const
+{
+    return selectorCount_;
+}
+
+
+/// Calculates the match scores of all selectors for the given scope list
+/// @param scopeList the scope list to match
+/// @param scores this vector is filled with the score per selector index. (-1 means no match)
+void TextScopeSelectorMatcher::calculateMatchScores( const TextScopeList* scopeList, QVector<TextScopeMatchScore>& scores ) const
+{
+    scores.fill( -1, selectorCount_ );
+
+    // a selector without paths always matches
+    foreach( int selectorIndex, nodeList_.at(0).selectorList ) { scores[selectorIndex] = 0; }
+
+    // the number of atoms of each scope and all scopes after it. This is the 'power' of the score of a matched path
+    int scopeCount = scopeList->size();
+    QVarLengthArray<int,32> suffixAtomCounts( scopeCount );
+    int atomCount = 0;
+    for( int i=scopeCount-1; i>=0; --i ) {
+        atomCount += scopeList->at(i)->atomCount();
+        suffixAtomCounts[i] = atomCount;
+    }
+
+    // every last path is matched with the last scope that starts with it
+    QVarLengthArray<bool,256> matched( nodeList_.size() );
+    for( int i=0, cnt=nodeList_.size(); i<cnt; ++i ) { matched[i] = false; }
+
+    TextScopeAtomId wildcard = Edbee::instance()->scopeManager()->wildcardId();
+    for( int scopeIndex=scopeCount-1; scopeIndex>=0; --scopeIndex ) {
+        TextScope* scope = scopeList->at(scopeIndex);
+        for( int pass=0; pass<2; ++pass ) {
+            const QVector<int>* candidates = &wildcardLastPathList_;
+            if( pass == 1 ) {
+                if( scope->atomCount() == 0 ) { break; }
+                TextScopeAtomId atom = scope->atomAt(0);
+                if( atom == wildcard ) {
+                    candidates = &nodeList_.at(0).childList;    // a wildcard scope can match every path
+                } else {
+                    QHash<TextScopeAtomId, QVector<int> >::const_iterator itr = lastPathMap_.constFind( atom );
+                    if( itr == lastPathMap_.constEnd() ) { break; }
+                    candidates = &itr.value();
+                }
+            }
+            foreach( int nodeIndex, *candidates ) {
+                if( matched[nodeIndex] ) { continue; }
+                if( scope->startsWith( nodeList_.at(nodeIndex).path ) ) {
+                    matched[nodeIndex] = true;
+                    matchNode( nodeIndex, scopeIndex, 0, scopeList, suffixAtomCounts.constData(), scores.data() );
+                }
+            }
+        }
+    }
+}
+
+
+/// Finds the selector with the best score for the given scope list
+/// When several selectors have the best score, the first selector is returned
+/// @param scopeList the scope list to match
+/// @param score (optional) this variable is filled with the score of the best match
+/// @return the index of the best matching selector or -1 if no selector matches
+int TextScopeSelectorMatcher::findBestMatch( const TextScopeList* scopeList, TextScopeMatchScore* score ) const
+{
+    QVector<TextScopeMatchScore> scores;
+    calculateMatchScores( scopeList, scores );
+    int result = -1;
+    TextScopeMatchScore resultScore = -1;
+    for( int i=0; i<selectorCount_; ++i ) {
+        if( scores.at(i) > resultScore ) {
+            resultScore = scores.at(i);
+            result = i;
+        }
+    }
+    if( score ) { *score = resultScore; }
+    return result;
+}
+
+
+/// Finds all selectors that match the given scope list
+/// @param scopeList the scope list to match
+/// @param selectorIndices this vector is filled with the indices of the matching selectors (in added order)
+void TextScopeSelectorMatcher::findMatches( const TextScopeList* scopeList, QVector<int>& selectorIndices ) const
+{
+    QVector<TextScopeMatchScore> scores;
+    calculateMatchScores( scopeList, scores );
+    selectorIndices.clear();
+    for( int i=0; i<selectorCount_; ++i ) {
+        if( scores.at(i) >= 0 ) { selectorIndices.append(i); }
+    }
+}
+
+
+/// Converts the given match score to the (floating point) score of TextScopeSelector::calculateMatchScore
+double TextScopeSelectorMatcher::scoreToDouble( TextScopeMatchScore score )
+{
+    if( score < 0 ) { return -1.0; }
+    return ldexp( static_cast<double>(score), -ScoreFractionBits );
+}
+
+
+/// Returns the child node of the given node with the given path. The node is created if it doesn't exist
+/// @param parentIndex the index of the parent node
+/// @param path the path of the child
+/// @return the index of the child node
+int TextScopeSelectorMatcher::findOrCreateChildNode( int parentIndex, TextScope* path )
+{
+    // paths are shared scopes, identical paths have the same pointer
+    foreach( int childIndex, nodeList_.at(parentIndex).childList ) {
+        if( nodeList_.at(childIndex).path == path ) { return childIndex; }
+    }
+
+    // the weight of a path with n atoms is 2^-1 + ... + 2^-n (the atoms of the path are the first atoms of a scope)
+    Node node;
+    node.path = path;
+    node.weight = ( (Q_INT64_C(1) << path->atomCount()) - 1 ) << ( ScoreFractionBits - path->atomCount() );
+    int nodeIndex = nodeList_.size();
+    nodeList_.append( node );
+    nodeList_[parentIndex].childList.append( nodeIndex );
+
+    // the last paths are indexed on their first atom
+    if( parentIndex == 0 ) {
+        if( path->atomCount() == 0 || path->atomAt(0) == Edbee::instance()->scopeManager()->wildcardId() ) {
+            wildcardLastPathList_.append( nodeIndex );
+        } else {
+            lastPathMap_[path->atomAt(0)].append( nodeIndex );
+        }
+    }
+    return nodeIndex;
+}
+
+
+/// Handles a matched node and matches its children with the scopes before the matched scope
+/// @param nodeIndex the index of the matched node
+/// @param scopeIndex the index of the scope the node is matched with
+/// @param score the score of the matched parent nodes
+/// @param scopeList the scope list that's matched
+/// @param suffixAtomCounts the number of atoms of each scope and all scopes after it
+/// @param scores the scores per selector
+void TextScopeSelectorMatcher::matchNode( int nodeIndex, int scopeIndex, TextScopeMatchScore score, const TextScopeList* scopeList, const int* suffixAtomCounts, TextScopeMatchScore* scores ) const
+{
+    const Node& node = nodeList_.at(nodeIndex);
+
+    // the weight is shifted by the number of atoms of the scopes after the matched path
+    int shift = suffixAtomCounts[scopeIndex] - node.path->atomCount();
+    if( shift < ScoreFractionBits ) { score += node.weight >> shift; }
+
+    foreach( int selectorIndex, node.selectorList ) {
+        scores[selectorIndex] = qMax( scores[selectorIndex], score );
+    }
+
+    // the paths before this path are searched backwards from the scope before the matched scope
+    foreach( int childIndex, node.childList ) {
+        TextScope* path = nodeList_.at(childIndex).path;
+        for( int i=scopeIndex-1; i>=0; --i ) {
+            if( scopeList->at(i)->startsWith( path ) ) {
+                matchNode( childIndex, i, score, scopeList, suffixAtomCounts, scores );
+                break;
+            }
+        }
+    }
+}
+
+
+
 //=============================================
 
 
 /// The scopemanager constructor
 TextScopeManager::TextScopeManager()
+    : nextScopeStackId_(1)
+    , mutex_( QMutex::Recursive )
 {
     reset();
 }
@@ -528,6 +975,10 @@ void TextScopeManager::reset()
         atomNameList_.clear();
         atomNameMap_.clear();
     }
+    {
+        QMutexLocker lock(&mutex_);     // (the stacks are read without the lock in the GUI thread)
+        scopeStackMap_.clear();
+    }
 
     // insert some defaults
     wildCardId_ = findOrRegisterScopeAtom("*");     // register the 'start' wildcard
@@ -549,6 +1000,7 @@ TextScopeAtomId TextScopeManager::wildcardId()
 /// This method registers the scope element
 TextScopeAtomId TextScopeManager::findOrRegisterScopeAtom(const QString& atom)
 {
+    QMutexLocker lock(&mutex_);
 //    element = element.toLower().trimmed();
     TextScopeAtomId id = atomNameMap_.value(atom,-1);
     if( id >= 0 ) { return id; }
@@ -562,6 +1014,7 @@ TextScopeAtomId TextScopeManager::findOrRegisterScopeAtom(const QString& atom)
 /// This method finds or creates a full-scope
 TextScope* TextScopeManager::refTextScope(const QString& scopeString)
 {
+    QMutexLocker lock(&mutex_);
     TextScope* scope = textScopeRefMap_.value(scopeString,0);
     if( scope ) { return scope; }
     scope = new TextScope(scopeString);
@@ -592,13 +1045,47 @@ TextScopeList* TextScopeManager::createTextScopeList(const QString& scopeListStr
 
 
 /// Returns the name of the given atom id
-const QString& TextScopeManager::atomName(TextScopeAtomId id)
+/// (The name is returned by value, atoms can be registered in another thread)
+QString TextScopeManager::atomName(TextScopeAtomId id)
 {
+    QMutexLocker lock(&mutex_);
     Q_ASSERT(0 <= id && id < atomNameList_.length() );
     return atomNameList_.at(id);
 }
 
 
+/// Returns the id of the scope stack that consists of the given parent stack with the given scope on top.
+/// Identical stacks get the same id, so the id can be used as key for the things that only depend on
+/// the scopes of a stack (like the theme format)
+///
+/// This method is called for every scoped range of a line that's styled, so it may only be called from the GUI thread.
+/// The stacks are only registered in the GUI thread, so the lookup doesn't need the lock. Only a registration locks
+/// the map, for the readers in other threads (like scopeStackCount)
+/// @param parentStackId the id of the parent stack (0 is the empty stack)
+/// @param scope the scope on top of the stack
+/// @return the id of the stack (never 0)
+TextScopeStackId TextScopeManager::findOrRegisterScopeStack( TextScopeStackId parentStackId, TextScope* scope )
+{
+    Q_ASSERT_GUI_THREAD;
+    QPair<TextScopeStackId,TextScope*> key( parentStackId, scope );
+    QHash<QPair<TextScopeStackId,TextScope*>,TextScopeStackId>::const_iterator itr = scopeStackMap_.constFind( key );
+    if( itr != scopeStackMap_.constEnd() ) { return itr.value(); }
+
+    QMutexLocker lock(&mutex_);
+    TextScopeStackId id = nextScopeStackId_++;
+    scopeStackMap_.insert( key, id );
+    return id;
+}
+
+
+/// Returns the number of registered scope stacks
+int TextScopeManager::scopeStackCount()
+{
+    QMutexLocker lock(&mutex_);
+    return scopeStackMap_.size();
+}
+
+
 //===========================================
 
 
@@ -606,6 +1093,9 @@ const QString& TextScopeManager::atomName(TextScopeAtomId id)
 MultiLineScopedTextRangeSet::MultiLineScopedTextRangeSet(TextDocument *textDocument , TextDocumentScopes *textDocumentScopes)
     : TextRangeSetBase( textDocument )
     , textDocumentScopesRef_( textDocumentScopes )
+    , maxEndLeafCount_(0)
+    , sorted_(true)
+    , indexed_(true)
 {
 }
 
@@ -621,6 +1111,7 @@ void MultiLineScopedTextRangeSet::reset()
 {
     qDeleteAll( scopedRangeList_ );
     scopedRangeList_.clear();
+    rebuildIndex();
 }
 
 
@@ -650,7 +1141,7 @@ const TextRange& MultiLineScopedTextRangeSet::constRange(int idx) const
 /// This method adds a range with the default scope
 void MultiLineScopedTextRangeSet::addRange(int anchor, int caret)
 {
-    scopedRangeList_.append( new MultiLineScopedTextRange(anchor, caret,Edbee::instance()->scopeManager()->refEmptyScope() ) );
+    giveScopedTextRange( new MultiLineScopedTextRange(anchor, caret,Edbee::instance()->scopeManager()->refEmptyScope() ) );
 }
 
 
@@ -666,6 +1157,10 @@ void MultiLineScopedTextRangeSet::removeRange(int idx)
 {
     delete scopedRangeList_[idx];
     scopedRangeList_.removeAt(idx);
+
+    // removing the last range doesn't change the index, the tree is only queried for the existing ranges.
+    // Other removals move the ranges after it, the index is rebuilt once when it's needed again
+    if( idx < scopedRangeList_.size() ) { indexed_ = false; }
 }
 
 
@@ -674,6 +1169,7 @@ void MultiLineScopedTextRangeSet::clear()
 {
     qDeleteAll( scopedRangeList_ );
     scopedRangeList_.clear();
+    rebuildIndex();
 }
 
 
@@ -688,6 +1184,8 @@ void MultiLineScopedTextRangeSet::toSingleRange()
 void MultiLineScopedTextRangeSet::sortRanges()
 {
     qSort( scopedRangeList_.begin(), scopedRangeList_.end(), MultiLineScopedTextRange::lessThan );
+    sorted_ = true;
+    rebuildIndex();
 }
 
 
@@ -704,7 +1202,7 @@ MultiLineScopedTextRange& MultiLineScopedTextRangeSet::addRange(int anchor, int
 {
     MultiLineScopedTextRange* tr = new MultiLineScopedTextRange(anchor, caret, Edbee::instance()->scopeManager()->refTextScope(name) );
     tr->setGrammarRule( rule );
-    scopedRangeList_.append( tr  );
+    giveScopedTextRange( tr );
     return *tr;
 }
 
@@ -714,16 +1212,22 @@ MultiLineScopedTextRange& MultiLineScopedTextRangeSet::addRange(int anchor, int
 /// end after the offset are 'invalidated' which means the end offset is placed to the end of the document
 void MultiLineScopedTextRangeSet::removeAndInvalidateRangesAfterOffset(int offset)
 {
+    ensureSorted();
     int len = textDocument()->length();
     beginChanges();
-    for( int idx=rangeCount()-1; idx >= 0; idx-- ) {
-        TextRange& range = this->range(idx);
-        if( range.caret() >= offset && range.anchor() >= offset ) {
-            removeRange(idx);
-        } else if( range.min() < offset && range.max() >= offset ) {
-            range.maxVar() = len;   // move the marker to the end
-        }
 
+    // the ranges that start after the offset are at the end of the list
+    for( int idx=rangeCount()-1, firstIdx = firstRangeWithMinAfter( offset, true ); idx >= firstIdx; idx-- ) {
+        removeRange(idx);
+    }
+    ensureIndexed();
+
+    // the ranges that cover the offset are moved to the end of the document
+    QVector<MultiLineScopedTextRange*> coveringRanges;
+    appendRangesEndingAfter( 1, 0, maxEndLeafCount_, rangeCount(), offset-1, coveringRanges );
+    foreach( MultiLineScopedTextRange* range, coveringRanges ) {
+        range->maxVar() = len;   // move the marker to the end
+        updateIndex( range->rangeSetIndex_ );
     }
     endChangesWithoutProcessing();  // we only deleted the last range. Do the result is still sorted
 }
@@ -732,7 +1236,34 @@ void MultiLineScopedTextRangeSet::removeAndInvalidateRangesAfterOffset(int offse
 /// This method gives the scoped text range to this object
 void MultiLineScopedTextRangeSet::giveScopedTextRange(MultiLineScopedTextRange* textScope)
 {
+    if( !scopedRangeList_.isEmpty() && textScope->min() < scopedRangeList_.last()->min() ) { sorted_ = false; }
+    textScope->rangeSetIndex_ = scopedRangeList_.size();
     scopedRangeList_.append( textScope );
+    updateIndex( textScope->rangeSetIndex_ );
+}
+
+
+/// Removes the given range from this set and deletes it
+/// @param textScope the range to remove
+void MultiLineScopedTextRangeSet::removeScopedTextRange( MultiLineScopedTextRange* textScope )
+{
+    // without index the range numbers can be outdated. (A removal only moves ranges to a lower index)
+    int idx = textScope->rangeSetIndex_;
+    if( !indexed_ ) { idx = scopedRangeList_.lastIndexOf( textScope, qMin( idx, scopedRangeList_.size()-1 ) ); }
+    Q_ASSERT( idx >= 0 && scopedRangeList_.at( idx ) == textScope );
+    removeRange( idx );
+}
+
+
+/// Removes all ranges from this set without deleting them
+/// @return the list of ranges, the caller is the owner
+QList<MultiLineScopedTextRange*> MultiLineScopedTextRangeSet::takeAllScopedTextRanges()
+{
+    QList<MultiLineScopedTextRange*> result = scopedRangeList_;
+    foreach( MultiLineScopedTextRange* range, result ) { range->rangeSetIndex_ = -1; }
+    scopedRangeList_.clear();
+    rebuildIndex();
+    return result;
 }
 
 
@@ -749,6 +1280,47 @@ void MultiLineScopedTextRangeSet::processChangesIfRequired(bool joinBorders )
 }
 
 
+/// This method should be called when the end of a range in this set has been changed. It updates the range index
+/// @param range the changed range (ranges that aren't in this set are ignored)
+void MultiLineScopedTextRangeSet::rangeMaxChanged( MultiLineScopedTextRange& range )
+{
+    if( !indexed_ ) { return; }  // the max is read when the index is rebuilt
+    int idx = range.rangeSetIndex_;
+    if( 0 <= idx && idx < scopedRangeList_.size() && scopedRangeList_.at(idx) == &range ) {
+        updateIndex( idx );
+    }
+}
+
+
+/// Appends all ranges that start in the given range, or that start before and end after offsetBegin.
+/// The ranges are appended in sorted order.
+/// @param offsetBegin the begin offset
+/// @param offsetEnd the end offset
+/// @param result the list the ranges are appended to
+void MultiLineScopedTextRangeSet::appendRangesBetweenOffsets( int offsetBegin, int offsetEnd, QVector<MultiLineScopedTextRange*>& result )
+{
+    ensureSorted();
+    ensureIndexed();
+    int startsAtBeginIdx = firstRangeWithMinAfter( offsetBegin, true );
+    int startsAfterBeginIdx = firstRangeWithMinAfter( offsetBegin, false );
+    int startsAtEndIdx = firstRangeWithMinAfter( offsetEnd, true );
+
+    // the ranges that start before offsetBegin and end after it
+    appendRangesEndingAfter( 1, 0, maxEndLeafCount_, startsAtBeginIdx, offsetBegin, result );
+
+    // the ranges that start at offsetBegin
+    for( int idx=startsAtBeginIdx; idx < startsAfterBeginIdx; ++idx ) {
+        MultiLineScopedTextRange* range = scopedRangeList_.at(idx);
+        if( offsetBegin < offsetEnd || offsetBegin < range->max() ) { result.append( range ); }
+    }
+
+    // the ranges that start inside the range
+    for( int idx=startsAfterBeginIdx; idx < startsAtEndIdx; ++idx ) {
+        result.append( scopedRangeList_.at(idx) );
+    }
+}
+
+
 /// convert the found ranges to strings
 QString MultiLineScopedTextRangeSet::toString()
 {
@@ -762,6 +1334,98 @@ QString MultiLineScopedTextRangeSet::toString()
 }
 
 
+/// Sorts the ranges if ranges have been given out of order
+void MultiLineScopedTextRangeSet::ensureSorted()
+{
+    if( !sorted_ ) { sortRanges(); }
+}
+
+
+/// Returns the index of the first range that starts after the given offset (binary search)
+/// @param offset the offset to search
+/// @param inclusive when true the ranges that start at the offset are included
+/// @return the index of the first range (or rangeCount() if there's no such range)
+int MultiLineScopedTextRangeSet::firstRangeWithMinAfter( int offset, bool inclusive )
+{
+    int begin = 0;
+    int end = scopedRangeList_.size();
+    while( begin < end ) {
+        int mid = ( begin + end ) / 2;
+        int min = scopedRangeList_.at(mid)->min();
+        if( min < offset || ( !inclusive && min == offset ) ) {
+            begin = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return begin;
+}
+
+
+/// Rebuilds the max-end index if ranges have been removed since the last rebuild
+void MultiLineScopedTextRangeSet::ensureIndexed()
+{
+    if( !indexed_ ) { rebuildIndex(); }
+}
+
+
+/// Rebuilds the complete max-end index and renumbers the ranges
+void MultiLineScopedTextRangeSet::rebuildIndex()
+{
+    indexed_ = true;
+    int count = scopedRangeList_.size();
+    maxEndLeafCount_ = 1;
+    while( maxEndLeafCount_ < count ) { maxEndLeafCount_ *= 2; }
+
+    maxEndTree_.fill( -1, maxEndLeafCount_ * 2 );
+    for( int i=0; i < count; ++i ) {
+        MultiLineScopedTextRange* range = scopedRangeList_.at(i);
+        range->rangeSetIndex_ = i;
+        maxEndTree_[maxEndLeafCount_+i] = range->max();
+    }
+    for( int node = maxEndLeafCount_-1; node > 0; --node ) {
+        maxEndTree_[node] = qMax( maxEndTree_.at(node*2), maxEndTree_.at(node*2+1) );
+    }
+}
+
+
+/// Updates the max-end index for the given range
+/// @param idx the index of the changed or appended range
+void MultiLineScopedTextRangeSet::updateIndex( int idx )
+{
+    if( !indexed_ ) { return; }  // the complete index is rebuilt on the next query
+    if( idx >= maxEndLeafCount_ ) {
+        rebuildIndex();
+        return;
+    }
+    int node = maxEndLeafCount_ + idx;
+    maxEndTree_[node] = scopedRangeList_.at(idx)->max();
+    for( node /= 2; node > 0; node /= 2 ) {
+        maxEndTree_[node] = qMax( maxEndTree_.at(node*2), maxEndTree_.at(node*2+1) );
+    }
+}
+
+
+/// Appends the ranges with an index lower than limit, that end after the given offset (in sorted order)
+/// @param node the tree node to search
+/// @param nodeBegin the index of the first range below this node
+/// @param nodeEnd the index after the last range below this node
+/// @param limit only ranges with an index lower then the limit are appended
+/// @param offset only ranges with a max larger than this offset are appended
+/// @param result the list the ranges are appended to
+void MultiLineScopedTextRangeSet::appendRangesEndingAfter( int node, int nodeBegin, int nodeEnd, int limit, int offset, QVector<MultiLineScopedTextRange*>& result )
+{
+    if( nodeBegin >= limit || maxEndTree_.at(node) <= offset ) { return; }
+    if( nodeEnd - nodeBegin == 1 ) {
+        result.append( scopedRangeList_.at(nodeBegin) );
+        return;
+    }
+    int nodeMid = ( nodeBegin + nodeEnd ) / 2;
+    appendRangesEndingAfter( node*2, nodeBegin, nodeMid, limit, offset, result );
+    appendRangesEndingAfter( node*2+1, nodeMid, nodeEnd, limit, offset, result );
+}
+
+
 //===========================================
 
 
@@ -771,6 +1435,7 @@ TextDocumentScopes::TextDocumentScopes(TextDocument* textDocument)
     : textDocumentRef_( textDocument )
     , defaultScopedRange_(0,0,Edbee::instance()->scopeManager()->refTextScope("text.plain"))
     , scopedRanges_( textDocument, this )
+    , internedLineRangeListCost_(0)
     , lastScopedOffset_(0)
 {
     connect( textDocument, SIGNAL(languageGrammarChanged()), this, SLOT(grammarChanged()) );
@@ -781,9 +1446,10 @@ TextDocumentScopes::TextDocumentScopes(TextDocument* textDocument)
 TextDocumentScopes::~TextDocumentScopes()
 {
     for( int i=0,cnt=lineRangeList_.length(); i<cnt; ++i ) {
-        delete lineRangeList_.at(i);
+        releaseLineScopedRangeList( lineRangeList_.at(i) );
     }
     lineRangeList_.clear();
+    clearInternedLineScopedRangeLists();
 }
 
 
@@ -825,11 +1491,22 @@ void TextDocumentScopes::giveLineScopedRangeList(int line, ScopedTextRangeList*
     if( line >= len ) {
         lineRangeList_.fill(len,0,0,line-len+1);
     }
-    delete lineRangeList_.at(line); // delete a possible old value
+    releaseLineScopedRangeList( lineRangeList_.at(line) ); // release a possible old value
     lineRangeList_.set(line, list);
 }
 
 
+/// Takes the scoped range list of the given line. The line doesn't have a scoped range list after this call
+/// @param line the line to take the list from
+/// @return the scoped range list (or 0), the caller owns the reference of the line
+ScopedTextRangeList* TextDocumentScopes::takeLineScopedRangeList(int line)
+{
+    ScopedTextRangeList* result = scopedRangesAtLine(line);
+    if( result ) { lineRangeList_.set(line, 0); }
+    return result;
+}
+
+
 
 /// This method returns all scoped ranges on the given line
 /// @param line the line to retrieve the scoped ranges for
@@ -855,12 +1532,39 @@ void TextDocumentScopes::giveMultiLineScopedTextRange(MultiLineScopedTextRange *
 }
 
 
+/// Changes the end of a multi-line range and updates the range index
+/// @param range the range to change (this range doesn't need to be added to the document yet)
+/// @param max the new end offset
+void TextDocumentScopes::setMultiLineScopedTextRangeMax( MultiLineScopedTextRange& range, int max )
+{
+    range.maxVar() = max;
+    scopedRanges_.rangeMaxChanged( range );
+}
+
+
+/// Removes and deletes the given multi-line range
+/// @param range the range to remove (this range must have been given to the document scopes)
+void TextDocumentScopes::removeMultiLineScopedTextRange( MultiLineScopedTextRange* range )
+{
+    scopedRanges_.removeScopedTextRange( range );
+}
+
+
+/// Takes all multi-line ranges (except the default range)
+/// @return the list of multi-line ranges, the caller is the owner
+QList<MultiLineScopedTextRange*> TextDocumentScopes::takeAllMultiLineScopedTextRanges()
+{
+    return scopedRanges_.takeAllScopedTextRanges();
+}
+
+
 /// This method invalidates all scopes after the given offset
 /// @param offset the offset from which to remove the offset
 void TextDocumentScopes::removeScopesAfterOffset(int offset)
 {
     if( offset == 0 ) {
         scopedRanges_.clear();
+        clearInternedLineScopedRangeLists();
     } else {
         scopedRanges_.removeAndInvalidateRangesAfterOffset(offset);
     }
@@ -872,7 +1576,7 @@ void TextDocumentScopes::removeScopesAfterOffset(int offset)
     int line = this->textDocument()->lineFromOffset(offset);
     if( line < lineRangeList_.length() ) {
         for( int i=line,cnt=lineRangeList_.length(); i<cnt; ++i ) {
-            delete lineRangeList_.at(i);
+            releaseLineScopedRangeList( lineRangeList_.at(i) );
         }
 
         lineRangeList_.replace(line, lineRangeList_.length()-line, 0, 0 );
@@ -890,20 +1594,68 @@ MultiLineScopedTextRange& TextDocumentScopes::defaultScopedRange()
 }
 
 
+/// Returns the pool that's used for allocating the ranges of the line scopes
+ScopedTextRangePool* TextDocumentScopes::scopedRangePool()
+{
+    return &scopedRangePool_;
+}
+
+
+/// Finds an interned (shared) line scope list
+/// @param key the key of the line. (The lexer state and the line text)
+/// @return the list with an extra reference for the caller, or 0 if not found
+ScopedTextRangeList* TextDocumentScopes::findInternedLineScopedRangeList( const QString& key )
+{
+    ScopedTextRangeList* list = internedLineRangeListMap_.value( key, 0 );
+    if( list ) { list->ref(); }
+    return list;
+}
+
+
+/// Interns an independent line scope list, so identical lines can share this list.
+/// An interned list is immutable, it may not be changed anymore.
+/// @param key the key of the line. (The lexer state and the line text)
+/// @param list the list to intern. The table adds its own reference
+void TextDocumentScopes::internLineScopedRangeList( const QString& key, ScopedTextRangeList* list )
+{
+    if( internedLineRangeListCost_ + key.length() > MaxInternedLineRangeListCost ) {
+        clearInternedLineScopedRangeLists();
+    }
+    list->ref();
+    ScopedTextRangeList* oldList = internedLineRangeListMap_.value( key, 0 );
+    if( oldList ) {
+        releaseLineScopedRangeList( oldList );
+    } else {
+        internedLineRangeListCost_ += key.length();
+    }
+    internedLineRangeListMap_.insert( key, list );
+}
+
+
+/// Releases all interned line scope lists
+void TextDocumentScopes::clearInternedLineScopedRangeLists()
+{
+    foreach( ScopedTextRangeList* list, internedLineRangeListMap_ ) {
+        releaseLineScopedRangeList( list );
+    }
+    internedLineRangeListMap_.clear();
+    internedLineRangeListCost_ = 0;
+}
+
+
+/// Returns the number of interned line scope lists
+int TextDocumentScopes::internedLineScopedRangeListCount() const
+{
+    return internedLineRangeListMap_.size();
+}
+
+
 /// This method returns all scope-ranges at the given offset-ranges
 QVector<MultiLineScopedTextRange*> TextDocumentScopes::multiLineScopedRangesBetweenOffsets(int offsetBegin, int offsetEnd)
 {
     QVector<MultiLineScopedTextRange*> result;
     result.append( &defaultScopedRange_ );
-    int minOffset=0;
-    for( int i=0, cnt=scopedRanges_.rangeCount(); i<cnt && minOffset <= /** CHANGED 2013-01-22, was < */ offsetEnd; ++i ) {
-        MultiLineScopedTextRange& range = scopedRanges_.scopedRange(i);
-        minOffset = range.min();
-        int maxOffset = range.max();
-        if( (offsetBegin <= minOffset && minOffset < offsetEnd) || (minOffset <= offsetBegin && offsetBegin < maxOffset) ) {
-            result.append(&range);
-        }
-    }
+    scopedRanges_.appendRangesBetweenOffsets( offsetBegin, offsetEnd, result );
     return result;
 }
 
@@ -1021,6 +1773,57 @@ void TextDocumentScopes::dumpScopedLineAddresses(const QString& text)
 }
 
 
+/// Returns the total number of line scoped ranges
+int TextDocumentScopes::lineScopedRangeCount()
+{
+    int result = 0;
+    for( int i=0, cnt=lineRangeList_.length(); i<cnt; ++i ) {
+        ScopedTextRangeList* list = lineRangeList_.at(i);
+        if( list ) { result += list->size(); }
+    }
+    return result;
+}
+
+
+/// Returns the memory used by the line scopes in bytes (the range lists and the pool)
+/// Lists that are shared by several lines are only counted once.
+qint64 TextDocumentScopes::lineScopedRangeMemoryUsage()
+{
+    QSet<ScopedTextRangeList*> listSet;
+    for( int i=0, cnt=lineRangeList_.length(); i<cnt; ++i ) {
+        if( lineRangeList_.at(i) ) { listSet.insert( lineRangeList_.at(i) ); }
+    }
+    return scopedRangePool_.allocatedBytes() + listSet.size() * sizeof(ScopedTextRangeList);
+}
+
+
+/// Returns the estimated memory usage of the line scopes when every range would be a separate heap object.
+/// (A range object with a vtable pointer, the heap allocation overhead and the pointer in the list)
+qint64 TextDocumentScopes::estimatedObjectMemoryUsage()
+{
+    int listCount = 0;
+    for( int i=0, cnt=lineRangeList_.length(); i<cnt; ++i ) {
+        if( lineRangeList_.at(i) ) { ++listCount; }
+    }
+    qint64 rangeObjectSize = sizeof(ScopedTextRange) + sizeof(void*) + 2 * sizeof(void*);
+    return lineScopedRangeCount() * ( rangeObjectSize + sizeof(void*) ) + listCount * sizeof(ScopedTextRangeList);
+}
+
+
+/// Returns a description of the memory usage of the scopes
+QString TextDocumentScopes::memoryStatsString()
+{
+    qint64 usage = lineScopedRangeMemoryUsage();
+    qint64 objectUsage = estimatedObjectMemoryUsage();
+    QString result;
+    result.append( QString("lines: %1, line ranges: %2, multi-line ranges: %3\n").arg(scopedLineCount()).arg(lineScopedRangeCount()).arg(scopedRanges_.rangeCount()) );
+    result.append( QString("pool: %1 bytes allocated, %2 bytes in use\n").arg(scopedRangePool_.allocatedBytes()).arg(scopedRangePool_.usedBytes()) );
+    result.append( QString("interned line scopes: %1\n").arg(internedLineRangeListMap_.size()) );
+    result.append( QString("line scopes: %1 bytes (with a heap object per range: ~%2 bytes, saved: %3 bytes)").arg(usage).arg(objectUsage).arg(objectUsage-usage) );
+    return result;
+}
+
+
 /// returns the current textdocument scope
 TextDocument*TextDocumentScopes::textDocument()
 {
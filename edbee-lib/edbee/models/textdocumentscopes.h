@@ -6,7 +6,10 @@
 #pragma once
 
 #include <QHash>
+#include <QMutex>
 #include <QObject>
+#include <QPair>
+#include <QSharedPointer>
 #include <QStringList>
 #include <QVector>
 
@@ -26,6 +29,9 @@ class TextScope;
 /// This type defines a single scope atom
 typedef short TextScopeAtomId;
 
+/// This type identifies a stack of scopes (0 is the empty stack)
+typedef int TextScopeStackId;
+
 /*
     ScopeElement
     FullScope =   ScopeElement.ScopeElement.ScopeElement
@@ -119,6 +125,8 @@ public:
     double calculateMatchScore(const TextScopeList* scopeList );
     QString toString();
 
+    const QVector<TextScopeList*>& selectorList() const { return selectorList_; }
+
 private:
     double calculateMatchScoreForSelector( TextScopeList* selector, const TextScopeList* scopeList );
 
@@ -128,6 +136,67 @@ private:
 };
 
 
+//===========================================
+
+/// The match score of a compiled selector. This is the score of TextScopeSelector::calculateMatchScore
+/// as fixed point number (the score multiplied with 2^TextScopeSelectorMatcher::ScoreFractionBits)
+typedef qint64 TextScopeMatchScore;
+
+
+/// A set of scope selectors compiled into a single matcher.
+///
+/// Matching a scope selector is a backwards search of the paths of the selector in the scope list. All selectors
+/// of a set (for example all rules of a theme) are combined in a trie of these paths, starting with the last path.
+/// Selectors that end with the same paths share the search of these paths. The last paths are indexed on their first
+/// atom, so matching a scope list only visits the selectors that end with one of the scopes of the list.
+///
+/// The scores are identical to the scores of TextScopeSelector::calculateMatchScore, but they are calculated as
+/// integers. The score of a matched path only depends on its atom count and on the number of atoms of the matched
+/// scope and the scopes after it.
+///
+/// The matcher refers to the (shared) scopes of the selectors, the selectors themselves aren't used after they
+/// are added.
+class TextScopeSelectorMatcher
+{
+public:
+    enum {
+        ScoreFractionBits = 62      ///< The number of fraction bits of a score. Atoms deeper in the scope list don't count
+    };
+
+    TextScopeSelectorMatcher();
+    virtual ~TextScopeSelectorMatcher();
+
+    void clear();
+    int addSelector( TextScopeSelector* selector );
+    int selectorCount() const;
+
+    void calculateMatchScores( const TextScopeList* scopeList, QVector<TextScopeMatchScore>& scores ) const;
+    int findBestMatch( const TextScopeList* scopeList, TextScopeMatchScore* score=0 ) const;
+    void findMatches( const TextScopeList* scopeList, QVector<int>& selectorIndices ) const;
+
+    static double scoreToDouble( TextScopeMatchScore score );
+
+private:
+
+    /// A path of a selector in the trie. The children are the paths before this path
+    struct Node {
+        TextScope* path;                    ///< The scope path of this node
+        TextScopeMatchScore weight;         ///< The score of this path when it's matched with the last atom of the scope list
+        QVector<int> childList;             ///< The indices of the child nodes
+        QVector<int> selectorList;          ///< The indices of the selectors that start with this path
+    };
+
+    int findOrCreateChildNode( int parentIndex, TextScope* path );
+    void matchNode( int nodeIndex, int scopeIndex, TextScopeMatchScore score, const TextScopeList* scopeList, const int* suffixAtomCounts, TextScopeMatchScore* scores ) const;
+
+private:
+    QVector<Node> nodeList_;                                ///< All nodes, the first node is the root
+    QHash<TextScopeAtomId, QVector<int> > lastPathMap_;     ///< The children of the root, by first atom
+    QVector<int> wildcardLastPathList_;                     ///< The children of the root that start with a wildcard (or are empty)
+    int selectorCount_;                                     ///< The number of added selectors
+};
+
+
 //===========================================
 
 /// The scope manager is used to manage the scopes...
@@ -156,7 +225,10 @@ public:
 
     TextScopeList* createTextScopeList(const QString &scopeListString );
 
-    const QString& atomName( TextScopeAtomId id );
+    QString atomName( TextScopeAtomId id );
+
+    TextScopeStackId findOrRegisterScopeStack( TextScopeStackId parentStackId, TextScope* scope );
+    int scopeStackCount();
 
 private:
     TextScopeAtomId wildCardId_;                            ///< The atom id reserved for the wildcard '*'
@@ -168,6 +240,12 @@ private:
     // full scopes
     QList<TextScope*> textScopeList_;                       ///< The list of full-scope
     QHash<QString,TextScope*> textScopeRefMap_;             ///< The full-scope map
+
+    // scope stacks
+    QHash<QPair<TextScopeStackId,TextScope*>,TextScopeStackId> scopeStackMap_;  ///< The stack ids by parent stack id and top scope (only changed in the GUI thread)
+    TextScopeStackId nextScopeStackId_;                     ///< The next stack id (ids aren't reused after a reset, cached formats could refer to them)
+
+    QMutex mutex_;                                          ///< Scopes can be registered by lexers in other threads
 };
 
 
@@ -175,23 +253,26 @@ private:
 
 
 /// A base scoped text range
+/// The line ranges are stored by value in the range array of a ScopedTextRangeList.
+/// The destructor is virtual, because a MultiLineScopedTextRange is deleted via this base class.
+/// A line range that is part of a multi-line range (started or ended on another line) references this multi-line range.
 class ScopedTextRange : public TextRange
 {
 public:
     ScopedTextRange( int anchor, int caret, TextScope* scope );
-//    ScopedTextRange( const MultiLineScopedTextRange& range );
+    ScopedTextRange( int anchor, int caret, MultiLineScopedTextRange& range );
     virtual ~ScopedTextRange();
 
     void setScope( TextScope* scope );
     TextScope* scope() const;
     QString toString() const;
 
-    /// returns the multi-line scoped text range
-    virtual MultiLineScopedTextRange* multiLineScopedTextRange() { return 0; }
-
+    MultiLineScopedTextRange* multiLineScopedTextRange() const;
+    void setMultiLineScopedTextRange( MultiLineScopedTextRange* range );
 
 private:
-    TextScope* scopeRef_;      ///< The scope for this range
+    TextScope* scopeRef_;                           ///< The scope for this range
+    MultiLineScopedTextRange* multiScopeRef_;       ///< The referenced multi-line range (0 for a line range)
 
 };
 
@@ -199,54 +280,91 @@ private:
 //===========================================
 
 
-/// A line based ScopedText range, that referenes a multi-line text-reference
-class MultiLineScopedTextRangeReference : public ScopedTextRange
+/// A pool allocator for the range arrays of the scoped range lists of a document.
+/// Small arrays are carved out of large blocks and are recycled with a free-list per array size.
+/// This prevents millions of small heap allocations for large documents. The pool isn't thread-safe,
+/// every document has its own pool.
+class ScopedTextRangePool
 {
+    Q_DISABLE_COPY(ScopedTextRangePool)
 public:
-    MultiLineScopedTextRangeReference( MultiLineScopedTextRange& range );
-    virtual ~MultiLineScopedTextRangeReference();
+    ScopedTextRangePool();
+    virtual ~ScopedTextRangePool();
+
+    ScopedTextRange* allocate( int capacity );
+    void release( ScopedTextRange* ranges, int capacity );
 
-    /// returns the multi-line scoped text range
-    virtual MultiLineScopedTextRange* multiLineScopedTextRange();
+    qint64 allocatedBytes() const;
+    qint64 usedBytes() const;
 
 private:
-    MultiLineScopedTextRange* multiScopeRef_;       ///< the reference to the multi-scoped textrange that defined this scope
+    enum {
+        MaxPooledCapacity = 32,             ///< Larger arrays are allocated on the heap
+        BlockSize = 64 * 1024               ///< The size of a single pool block in bytes
+    };
+
+    QList<char*> blockList_;                        ///< All allocated blocks
+    char* blockPos_;                                ///< The next free position in the current block
+    int blockRemaining_;                            ///< The number of free bytes in the current block
+    void* freeLists_[MaxPooledCapacity+1];          ///< The released arrays per capacity (linked via the first pointer)
+
+    qint64 allocatedBytes_;                         ///< The total number of allocated bytes (blocks and heap arrays)
+    qint64 usedBytes_;                              ///< The number of bytes in use
 };
 
 
-
 //===========================================
 
 /// a list of textscopes
-/// This class is used for single-line scopes
-/// (Todo, this needs to be optimized)
+/// This class is used for single-line scopes. The ranges are stored in a single array, allocated from
+/// the range pool of the document.
+///
+/// A list is reference counted. Identical independent lines share a single (immutable) list, see
+/// TextDocumentScopes::internLineScopedRangeList.
+///
+/// Every list gets a unique id. A list isn't changed after it's given to the document (a lexed line gets a new list),
+/// so the id can be used as key for things that are derived from the ranges (like the format ranges of a line).
 class ScopedTextRangeList
 {
     Q_DISABLE_COPY(ScopedTextRangeList)
 public:
 
-    explicit ScopedTextRangeList();
+    explicit ScopedTextRangeList( ScopedTextRangePool* pool );
     virtual ~ScopedTextRangeList();
 
+    qint64 id() const;
     int size() const;
     ScopedTextRange* at( int idx );
-    void giveRange( ScopedTextRange* at );
-    void giveAndPrependRange(ScopedTextRange* range );
+    void addRange( int anchor, int caret, TextScope* scope );
+    void addRange( int anchor, int caret, MultiLineScopedTextRange& range );
+    void addRange( const ScopedTextRange& range );
+
+    void ref();
+    bool deref();
+    int refCount() const;
 
     void squeeze();
+    void moveToPool( ScopedTextRangePool* pool );
     void setIndependent(bool enable=true);
     bool isIndependent() const;
+    void setIncomplete(bool enable=true);
+    bool isIncomplete() const;
 
     QString toString();
 
+private:
+    void reserve( int capacity );
 
 private:
 
-    QVector<ScopedTextRange*> ranges_;  ///< the textranges
+    qint64 id_;                         ///< The unique id of this list
+    ScopedTextRangePool* poolRef_;      ///< The pool the range array is allocated from
+    ScopedTextRange* ranges_;           ///< the textranges
+    int size_;                          ///< The number of ranges
+    int capacity_;                      ///< The capacity of the range array
+    int refCount_;                      ///< The number of references to this list
     bool independent_;                  ///< this boolean tells if the line contains a multi-lined scope start or end
-
-//    int size_;                      /// The number of ranges
-//    ScopedTextRange* ranges_;       /// The list of ranges
+    bool incomplete_;                   ///< the lexing of this line has been aborted (a lexing limit was reached)
 };
 
 
@@ -264,13 +382,17 @@ public:
     TextGrammarRule* grammarRule() const;
 
     void giveEndRegExp( RegExp* regExp );
+    void setEndRegExp( const QSharedPointer<RegExp>& regExp );
     RegExp* endRegExp();
 
     static bool lessThan( MultiLineScopedTextRange* r1, MultiLineScopedTextRange* r2);
 
 private:
     TextGrammarRule* ruleRef_;     ///< The grammar rule that found this range
-    RegExp* endRegExp_;        ///< The end regexp
+    QSharedPointer<RegExp> endRegExp_;  ///< The end regexp (shared between ranges with the same end pattern)
+    int rangeSetIndex_;            ///< The index in the MultiLineScopedTextRangeSet (-1 if not in a set)
+
+    friend class MultiLineScopedTextRangeSet;
 };
 
 
@@ -279,6 +401,11 @@ private:
 
 /// This is a set of scoped textranges. This set is used
 /// to remember parsed language ranges
+///
+/// The ranges are sorted by their start offset. A max-end index (a segment tree with the maximum end offset of the ranges
+/// below every node) makes it possible to find the ranges that cover an offset in O(log n + k).
+/// Changes to the end of a range should be reported with rangeMaxChanged, so the index stays correct.
+/// Removing a range in the middle moves all ranges after it, the index is rebuilt once on the next query.
 class MultiLineScopedTextRangeSet : public TextRangeSetBase
 {
 public:
@@ -304,16 +431,34 @@ public:
 
   // adds a text scope
     void giveScopedTextRange( MultiLineScopedTextRange* textScope );
+    void removeScopedTextRange( MultiLineScopedTextRange* textScope );
+    QList<MultiLineScopedTextRange*> takeAllScopedTextRanges();
     void processChangesIfRequired( bool joinBorders );
 
+  // range index
+    void rangeMaxChanged( MultiLineScopedTextRange& range );
+    void appendRangesBetweenOffsets( int offsetBegin, int offsetEnd, QVector<MultiLineScopedTextRange*>& result );
+
     QString toString();
 
     TextDocumentScopes* textDocumentScopes();
 
+private:
+    void ensureSorted();
+    int firstRangeWithMinAfter( int offset, bool inclusive );
+    void ensureIndexed();
+    void rebuildIndex();
+    void updateIndex( int idx );
+    void appendRangesEndingAfter( int node, int nodeBegin, int nodeEnd, int limit, int offset, QVector<MultiLineScopedTextRange*>& result );
+
 private:
 
     TextDocumentScopes* textDocumentScopesRef_;     ///< A reference to the text document scopes
     QList<MultiLineScopedTextRange*> scopedRangeList_;       ///< A list of all scoped ranges
+    QVector<int> maxEndTree_;                       ///< The max-end segment tree (node 1 is the root, the leafs start at maxEndLeafCount_)
+    int maxEndLeafCount_;                           ///< The number of leafs in the max-end tree (a power of 2)
+    bool sorted_;                                   ///< Are the ranges sorted? (ranges given out of order are sorted on the next query)
+    bool indexed_;                                  ///< Is the max-end index up-to-date? (after removals it's rebuilt on the next query)
 };
 
 
@@ -338,12 +483,22 @@ public:
     void setDefaultScope(const QString& name, TextGrammarRule *rule);
 
     void giveLineScopedRangeList( int line, ScopedTextRangeList* list);
+    ScopedTextRangeList* takeLineScopedRangeList( int line );
     ScopedTextRangeList* scopedRangesAtLine( int line );
     int scopedLineCount();
 
     void giveMultiLineScopedTextRange( MultiLineScopedTextRange* range );
+    void setMultiLineScopedTextRangeMax( MultiLineScopedTextRange& range, int max );
+    void removeMultiLineScopedTextRange( MultiLineScopedTextRange* range );
+    QList<MultiLineScopedTextRange*> takeAllMultiLineScopedTextRanges();
     void removeScopesAfterOffset( int offset );
     MultiLineScopedTextRange& defaultScopedRange();
+    ScopedTextRangePool* scopedRangePool();
+
+    ScopedTextRangeList* findInternedLineScopedRangeList( const QString& key );
+    void internLineScopedRangeList( const QString& key, ScopedTextRangeList* list );
+    void clearInternedLineScopedRangeLists();
+    int internedLineScopedRangeListCount() const;
 
     QVector<MultiLineScopedTextRange*> multiLineScopedRangesBetweenOffsets( int offsetBegin, int offsetEnd );
     TextScopeList scopesAtOffset( int offset );
@@ -354,6 +509,12 @@ public:
 
     void dumpScopedLineAddresses( const QString& text = QString() );
 
+  // memory statistics
+    int lineScopedRangeCount();
+    qint64 lineScopedRangeMemoryUsage();
+    qint64 estimatedObjectMemoryUsage();
+    QString memoryStatsString();
+
   // getters
     TextDocument* textDocument();
 
@@ -372,7 +533,10 @@ private:
     MultiLineScopedTextRange defaultScopedRange_;          ///< The default scoped text range
 //    QHash<QString,TextScope*> scopeMap_;                 ///< A list of all defined/used scopes (pointers to these scopes are smaller then full strings)
     MultiLineScopedTextRangeSet scopedRanges_;             ///< A list with all (multi-line) ranges
+    ScopedTextRangePool scopedRangePool_;                  ///< The pool for the range arrays of the line scopes
     GapVector<ScopedTextRangeList*>  lineRangeList_;       ///< A list of all line scopes
+    QHash<QString,ScopedTextRangeList*> internedLineRangeListMap_;  ///< The shared independent line scopes by lexer-state and line text (holds a reference)
+    int internedLineRangeListCost_;                        ///< The total length of the interned keys
 
     /// This special variable is used to 'remember' to which offset the document has been scoped.
     /// This should speed up the syntax highlighting drasticly because the parsing only needs to happen
@@ -6,7 +6,11 @@
 #include "textgrammar.h"
 
 #include <QDir>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
 
+#include "edbee/io/tmbinarycache.h"
 #include "edbee/io/tmlanguageparser.h"
 #include "edbee/util/regexp.h"
 
@@ -187,6 +191,7 @@ TextGrammar::TextGrammar(const QString& name, const QString& displayName)
     : name_(name)
     , displayName_(displayName)
     , mainRule_(0)
+    , loaded_(1)
 {
 
 }
@@ -209,6 +214,13 @@ void TextGrammar::giveMainRule(TextGrammarRule* mainRule)
 }
 
 
+/// Sets the name of the textgrammar
+void TextGrammar::setName( const QString& name )
+{
+    name_ = name;
+}
+
+
 /// return the name of the textgrammar
 QString TextGrammar::name() const
 {
@@ -216,6 +228,13 @@ QString TextGrammar::name() const
 }
 
 
+/// Sets the displayname of this grammar
+void TextGrammar::setDisplayName( const QString& displayName )
+{
+    displayName_ = displayName;
+}
+
+
 /// Returns the displayname of this grammar
 QString TextGrammar::displayName() const
 {
@@ -224,8 +243,10 @@ QString TextGrammar::displayName() const
 
 
 /// Returns the main grammar rule for this textgrammar
+/// For a lazy grammar this method parses the rules of the grammar on first use
 TextGrammarRule* TextGrammar::mainRule() const
 {
+    ensureLoaded();
     return mainRule_;
 }
 
@@ -251,10 +272,19 @@ void TextGrammar::giveToRepos(const QString& name, TextGrammarRule* rule)
 /// @return the found grammar rule (or the defValue if not found)
 TextGrammarRule *TextGrammar::findFromRepos(const QString& name, TextGrammarRule* defValue )
 {
+    ensureLoaded();
     return repository_.value(name, defValue );
 }
 
 
+/// Returns all named rules of the grammar
+const QMap<QString, TextGrammarRule*>& TextGrammar::repository() const
+{
+    ensureLoaded();
+    return repository_;
+}
+
+
 /// Adds a file extension
 /// @param ext the extension to add.
 void TextGrammar::addFileExtension(const QString& ext)
@@ -263,12 +293,241 @@ void TextGrammar::addFileExtension(const QString& ext)
 }
 
 
+/// Makes this grammar a lazy grammar. The rules are parsed from the given file on first use
+/// @param fileName the grammar file with the rules of this grammar
+void TextGrammar::setLazyFileName(const QString& fileName)
+{
+    Q_ASSERT(!mainRule_);
+    fileName_ = fileName;
+    loaded_.fetchAndStoreOrdered(0);
+}
+
+
+/// Returns the filename of a lazy grammar
+QString TextGrammar::fileName() const
+{
+    return fileName_;
+}
+
+
+/// Sets the binary cache path. A lazy grammar reads its rules from the cache if there's a valid cache entry
+/// and updates the cache after parsing the grammar file.
+/// @param cachePath the cache directory (empty to disable caching)
+void TextGrammar::setCachePath(const QString& cachePath)
+{
+    cachePath_ = cachePath;
+}
+
+
+/// Returns the binary cache path
+QString TextGrammar::cachePath() const
+{
+    return cachePath_;
+}
+
+
+/// Sets the sha1 hash of the grammar file. The hash is computed once when the header is read from the cache,
+/// reading the rules from the cache reuses it
+/// @param hash the sha1 hash of the grammar file (empty if unknown)
+void TextGrammar::setSourceHash(const QByteArray& hash)
+{
+    sourceHash_ = hash;
+}
+
+
+/// Returns the sha1 hash of the grammar file (empty if unknown)
+QByteArray TextGrammar::sourceHash() const
+{
+    return sourceHash_;
+}
+
+
+/// Returns true if the rules of this grammar are available
+bool TextGrammar::isLoaded() const
+{
+    return loaded_.fetchAndAddOrdered(0) != 0;
+}
+
+
+/// Parses the rules of a lazy grammar if this hasn't happend yet.
+/// This method can be called from multiple threads, the grammar is only parsed once
+void TextGrammar::ensureLoaded() const
+{
+    if( isLoaded() ) { return; }
+
+    QMutexLocker lock(&loadMutex_);
+    if( isLoaded() ) { return; }
+    TextGrammar* self = const_cast<TextGrammar*>(this);
+    bool parsed = self->load();
+    loaded_.fetchAndStoreOrdered(1);
+
+    // store the parsed rules, so the next start can skip the xml parsing
+    if( parsed && !cachePath_.isEmpty() ) {
+        TmBinaryCache cache( cachePath_ );
+        if( !cache.writeGrammar( fileName_, self ) ) {
+            qlog_warn() << cache.lastErrorMessage();
+        }
+    }
+}
+
+
+/// Reads the rules from the binary cache or parses the rules from the grammar file
+/// @return true if the rules have been parsed from the grammar file
+bool TextGrammar::load()
+{
+    if( !cachePath_.isEmpty() ) {
+        TmBinaryCache cache( cachePath_ );
+        cache.setSourceHash( fileName_, sourceHash_ );
+        if( cache.readGrammarRules( fileName_, this ) ) { return false; }
+    }
+
+    TmLanguageParser parser;
+    bool parsed = parser.parseRules( fileName_, this );
+    if( !parsed ) {
+        qlog_warn() << QObject::tr("Error reading file %1:%2").arg(fileName_).arg(parser.lastErrorMessage());
+    }
+
+    // a grammar that cannot be parsed still needs a main rule
+    if( !mainRule_ ) {
+        giveMainRule( TextGrammarRule::createMainRule( this, name_ ) );
+    }
+    return parsed;
+}
+
+
+//==========================
+
+
+/// Loads all lazy grammars in a background thread, so the first use of a grammar doesn't need to wait for the parsing.
+/// Loading a grammar compiles its regexps while the GUI thread can compile the regexps of another grammar. This is safe
+/// because RegExp serializes all oniguruma compiles. The binary cache files are written atomically (via a temp file)
+class GrammarPrewarmer : public QRunnable
+{
+public:
+    /// Constructs the prewarmer
+    /// @param grammars the grammars to load
+    GrammarPrewarmer( const QList<TextGrammar*>& grammars )
+        : grammarRefList_( grammars )
+        , cancelled_(0)
+    {
+        setAutoDelete( false );
+    }
+
+    /// loads all grammars (in the worker thread)
+    virtual void run()
+    {
+        foreach( TextGrammar* grammar, grammarRefList_ ) {
+            if( cancelled_.fetchAndAddOrdered(0) ) { return; }
+            grammar->ensureLoaded();
+        }
+    }
+
+    /// stops loading after the current grammar
+    void cancel() { cancelled_.fetchAndStoreOrdered(1); }
+
+private:
+    QList<TextGrammar*> grammarRefList_;        ///< The grammars to load
+    QAtomicInt cancelled_;                      ///< Set to 1 to stop loading
+};
+
+
+//==========================
+
+
+/// Reads a grammar file. A valid entry in the binary cache is used instead of parsing the file.
+/// This function doesn't touch the grammar manager, so it can be called from a worker thread
+/// @param file the grammar file to read
+/// @param headerOnly only read the header, the rules of the lazy grammar are read on first use
+/// @param cachePath the binary cache path (empty for no cache)
+/// @param errorMessage (out) the error message when the grammar couldn't be read
+/// @return the grammar or 0 on error
+static TextGrammar* loadGrammarFile( const QString& file, bool headerOnly, const QString& cachePath, QString& errorMessage )
+{
+    TextGrammar* grammar = 0;
+    TmBinaryCache cache( cachePath );
+
+    // a valid cache entry skips the xml parsing
+    if( !cachePath.isEmpty() ) {
+        grammar = headerOnly ? cache.readGrammarHeader( file ) : cache.readGrammar( file );
+    }
+
+    // read the file
+    if( !grammar ) {
+        TmLanguageParser parser;
+        grammar = headerOnly ? parser.parseHeader( file ) : parser.parse( file );
+        if( !grammar ) {
+            QFileInfo fileInfo(file);
+            errorMessage = QObject::tr("Error reading file %1:%2").arg(fileInfo.absoluteFilePath()).arg(parser.lastErrorMessage());
+            return 0;
+        }
+        if( !headerOnly && !cachePath.isEmpty() && !cache.writeGrammar( file, grammar ) ) {
+            qlog_warn() << cache.lastErrorMessage();
+        }
+    }
+
+    if( headerOnly ) { grammar->setCachePath( cachePath ); }
+    return grammar;
+}
+
+
+/// Reads a single grammar file in a worker thread
+class GrammarFileLoader : public QRunnable
+{
+public:
+    /// Constructs the loader
+    /// @param fileName the grammar file to read
+    /// @param headerOnly only read the header of the file
+    /// @param cachePath the binary cache path
+    GrammarFileLoader( const QString& fileName, bool headerOnly, const QString& cachePath )
+        : fileName_( fileName )
+        , headerOnly_( headerOnly )
+        , cachePath_( cachePath )
+        , grammar_(0)
+    {
+        setAutoDelete( false );
+    }
+
+    /// Deletes the grammar if it isn't taken
+    virtual ~GrammarFileLoader()
+    {
+        delete grammar_;
+    }
+
+    /// reads the grammar file (in the worker thread)
+    virtual void run()
+    {
+        grammar_ = loadGrammarFile( fileName_, headerOnly_, cachePath_, errorMessage_ );
+    }
+
+    /// Takes the grammar (ownership is transfered to the caller)
+    TextGrammar* takeGrammar()
+    {
+        TextGrammar* result = grammar_;
+        grammar_ = 0;
+        return result;
+    }
+
+    QString fileName() const { return fileName_; }
+    QString errorMessage() const { return errorMessage_; }
+
+private:
+    QString fileName_;          ///< The grammar file to read
+    bool headerOnly_;           ///< Only read the header (lazy loading)
+    QString cachePath_;         ///< The binary cache path
+    TextGrammar* grammar_;      ///< The read grammar (0 on error)
+    QString errorMessage_;      ///< The error message when reading failed
+};
+
+
 //==========================
 
 
 /// The text grammar manager constructor
 TextGrammarManager::TextGrammarManager()
     : defaultGrammarRef_(0)
+    , lazyLoadingEnabled_(true)
+    , prewarmPool_(0)
+    , prewarmer_(0)
 {
 
     // always make sure there's a default grammar
@@ -281,6 +540,8 @@ TextGrammarManager::TextGrammarManager()
 /// The detstructor (deletes all grammars)
 TextGrammarManager::~TextGrammarManager()
 {
+    stopPrewarming();
+    delete prewarmPool_;
     qDeleteAll( grammarMap_ );
     grammarMap_.clear();
 }
@@ -294,15 +555,28 @@ TextGrammarManager::~TextGrammarManager()
 TextGrammar* TextGrammarManager::readGrammarFile(const QString& file)
 {
     lastErrorMessage_.clear();
+    TextGrammar* grammar = loadGrammarFile( file, false, cachePath_, lastErrorMessage_ );
+    if( grammar ) {
+        giveGrammar( grammar );
+    } else {
+        qlog_warn() << lastErrorMessage_;
+    }
+    return grammar;
+}
 
-    // read the file
-    TmLanguageParser parser;
-    TextGrammar* grammar = parser.parse( file );
+
+/// This method reads the header of the given grammar file and adds a lazy grammar to the grammar manager.
+/// The rules of the grammar are parsed on first use.
+///
+/// @param filename the direct filename to read
+/// @return the lazy TextGrammar. When an error happend, the errorMessage is set
+TextGrammar* TextGrammarManager::readGrammarFileHeader(const QString& file)
+{
+    lastErrorMessage_.clear();
+    TextGrammar* grammar = loadGrammarFile( file, true, cachePath_, lastErrorMessage_ );
     if( grammar ) {
         giveGrammar( grammar );
     } else {
-        QFileInfo fileInfo(file);
-        lastErrorMessage_ = QObject::tr("Error reading file %1:%2").arg(fileInfo.absoluteFilePath()).arg(parser.lastErrorMessage());
         qlog_warn() << lastErrorMessage_;
     }
     return grammar;
@@ -310,23 +584,106 @@ TextGrammar* TextGrammarManager::readGrammarFile(const QString& file)
 
 
 /// reads all grammar files in the given path
+/// The files are read concurrently on a thread pool. The grammars are added to the manager after all
+/// files have been read, in the order of the filenames.
+/// With lazy loading enabled only the headers of the grammar files are read
 /// @param path the path to read all grammar files from
 void TextGrammarManager::readAllGrammarFilesInPath(const QString& path )
 {
 //    qlog_info() << "readAllGrammarFilesInPath(" << path << ")";
     QDir dir(path);
     QStringList filters("*.tmLanguage");
+    QList<GrammarFileLoader*> loaders;
     foreach( QFileInfo fileInfo, dir.entryInfoList( filters, QDir::Files, QDir::Name ) ) {
-//        qlog_info() << "- parse" << fileInfo.baseName() << ".";
-        readGrammarFile( fileInfo.absoluteFilePath());
+        loaders.append( new GrammarFileLoader( fileInfo.absoluteFilePath(), lazyLoadingEnabled_, cachePath_ ) );
     }
+    if( loaders.isEmpty() ) { return; }
+
+    // a single file doesn't need a thread
+    if( loaders.size() == 1 ) {
+        loaders.first()->run();
+    } else {
+        QThreadPool pool;
+        foreach( GrammarFileLoader* loader, loaders ) {
+            pool.start( loader );
+        }
+        pool.waitForDone();
+    }
+
+    // add all grammars at once (in the gui thread)
+    lastErrorMessage_.clear();
+    foreach( GrammarFileLoader* loader, loaders ) {
+//        qlog_info() << "- parse" << loader->fileName() << ".";
+        TextGrammar* grammar = loader->takeGrammar();
+        if( grammar ) {
+            giveGrammar( grammar );
+        } else {
+            lastErrorMessage_ = loader->errorMessage();
+            qlog_warn() << lastErrorMessage_;
+        }
+    }
+    qDeleteAll( loaders );
+}
+
+
+/// Enables or disables lazy loading of the grammars read by readAllGrammarFilesInPath
+void TextGrammarManager::setLazyLoadingEnabled(bool enabled)
+{
+    lazyLoadingEnabled_ = enabled;
+}
+
+
+/// Returns true if lazy loading of grammars is enabled (default true)
+bool TextGrammarManager::isLazyLoadingEnabled() const
+{
+    return lazyLoadingEnabled_;
+}
+
+
+/// Sets the directory of the binary grammar cache. With a cache, warm starts don't need to parse the grammar files.
+/// (Stale or corrupt cache entries are ignored and overwritten)
+/// @param cachePath the cache directory, an empty string disables the cache
+void TextGrammarManager::setCachePath(const QString& cachePath)
+{
+    cachePath_ = cachePath;
+}
+
+
+/// Returns the directory of the binary grammar cache
+QString TextGrammarManager::cachePath() const
+{
+    return cachePath_;
+}
+
+
+/// Starts loading all lazy grammars in a background thread.
+/// A grammar that's requested while it's being loaded waits for the background thread
+void TextGrammarManager::prewarmGrammars()
+{
+    stopPrewarming();
+
+    QList<TextGrammar*> lazyGrammars;
+    foreach( TextGrammar* grammar, grammarMap_.values() ) {
+        if( !grammar->isLoaded() ) { lazyGrammars.append( grammar ); }
+    }
+    if( lazyGrammars.isEmpty() ) { return; }
+
+    if( !prewarmPool_ ) {
+        prewarmPool_ = new QThreadPool();
+        prewarmPool_->setMaxThreadCount(1);
+    }
+    prewarmer_ = new GrammarPrewarmer( lazyGrammars );
+    prewarmPool_->start( prewarmer_ );
 }
 
 
 /// This method returns the given language grammar
+/// A lazy grammar is parsed on the first call
 TextGrammar* TextGrammarManager::get(const QString &name)
 {
-    return grammarMap_.value(name,0);
+    TextGrammar* grammar = grammarMap_.value(name,0);
+    if( grammar ) { grammar->ensureLoaded(); }
+    return grammar;
 }
 
 
@@ -338,6 +695,7 @@ void TextGrammarManager::giveGrammar(TextGrammar* grammar)
 
     // when the grammar already exists delete it
     if( grammarMap_.contains(name)) {
+        stopPrewarming();   // the background thread could be loading the old grammar
         TextGrammar* oldGrammar = grammarMap_.take(name);
 
         // when the old grammar was the default, replace the default (feels pretty dirty)
@@ -393,13 +751,27 @@ TextGrammar* TextGrammarManager::detectGrammarWithFilename(const QString& fileNa
 {
     foreach( TextGrammar* grammar, grammarMap_.values() ) {
         foreach( QString ext, grammar->fileExtensions() ) {
-            if( fileName.endsWith( QString(".%1").arg(ext) ) ) return grammar;
+            if( fileName.endsWith( QString(".%1").arg(ext) ) ) {
+                grammar->ensureLoaded();
+                return grammar;
+            }
         }
     }
     return this->defaultGrammar();
 }
 
 
+/// Stops the background loading of the grammars and waits for the thread to finish
+void TextGrammarManager::stopPrewarming()
+{
+    if( !prewarmer_ ) { return; }
+    prewarmer_->cancel();
+    prewarmPool_->waitForDone();
+    delete prewarmer_;
+    prewarmer_ = 0;
+}
+
+
 /// returns the grammar manager
 /// @return the last error message
 QString TextGrammarManager::lastErrorMessage() const
@@ -5,19 +5,25 @@
 
 #pragma once
 
+#include <QAtomicInt>
+#include <QByteArray>
 #include <QHash>
 #include <QList>
 #include <QMap>
+#include <QMutex>
 #include <QString>
 #include <QStringList>
 
 class QFile;
+class QThreadPool;
 
 namespace edbee {
 
 class RegExp;
 class TextGrammar;
 class Edbee;
+class GrammarPrewarmer;
+class TmLanguageParser;
 
 
 /// defines a single grammar rule
@@ -122,6 +128,9 @@ private:
 
 
 /// This class defines a single language grammar
+///
+/// A grammar can be lazy. A lazy grammar only contains the header (name, displayName and file extensions).
+/// The rules are parsed from the grammar file the first time the mainRule or the repository is accessed.
 class TextGrammar
 {
 public:
@@ -131,21 +140,42 @@ public:
 
     void giveMainRule( TextGrammarRule* mainRule );
 
+    void setName( const QString& name );
     QString name() const;
+    void setDisplayName( const QString& displayName );
     QString displayName() const;
     TextGrammarRule* mainRule() const;
     QStringList fileExtensions() const;
 
     void giveToRepos( const QString& name, TextGrammarRule* rule);
     TextGrammarRule* findFromRepos( const QString& name, TextGrammarRule* defValue = 0  );
+    const QMap<QString, TextGrammarRule*>& repository() const;
     void addFileExtension( const QString& ext );
 
+    void setLazyFileName( const QString& fileName );
+    QString fileName() const;
+    void setCachePath( const QString& cachePath );
+    QString cachePath() const;
+    void setSourceHash( const QByteArray& hash );
+    QByteArray sourceHash() const;
+    bool isLoaded() const;
+    void ensureLoaded() const;
+
+private:
+    bool load();
+
 private:
     QString name_;                               ///< the display name of this
     QString displayName_;                        ///< the name to display
     TextGrammarRule *mainRule_;                      ///< the 'main' rule of this grammar
     QMap<QString, TextGrammarRule*> repository_;     ///< A map with all named grammar rules
     QStringList fileExtensions_;                  ///< A list with all file-extensions
+
+    QString fileName_;                           ///< The file to load the rules from (only for lazy grammars)
+    QString cachePath_;                          ///< The binary cache for the rules of a lazy grammar (empty for no cache)
+    QByteArray sourceHash_;                      ///< The sha1 of the grammar file, computed when the header was read (empty if unknown)
+    mutable QAtomicInt loaded_;                  ///< Are the rules loaded? (0 for a lazy grammar that isn't used yet)
+    mutable QMutex loadMutex_;                   ///< Grammars can be loaded by lexers in other threads
 };
 
 
@@ -162,8 +192,15 @@ protected:
 
 public:
     TextGrammar* readGrammarFile(const QString& file );
+    TextGrammar* readGrammarFileHeader(const QString& file );
     void readAllGrammarFilesInPath(const QString& path );
 
+    void setLazyLoadingEnabled( bool enabled );
+    bool isLazyLoadingEnabled() const;
+    void setCachePath( const QString& cachePath );
+    QString cachePath() const;
+    void prewarmGrammars();
+
     TextGrammar* get( const QString& name );
     void giveGrammar( TextGrammar* grammar );
 
@@ -176,11 +213,18 @@ public:
 
     QString lastErrorMessage() const;
 
+private:
+    void stopPrewarming();
+
 private:
 
     TextGrammar* defaultGrammarRef_;                   ///< A reference to the default grammar
     QMap<QString,TextGrammar*> grammarMap_;            ///< A map with all grammar definitions
     QString lastErrorMessage_;                             ///< Returns the error message
+    bool lazyLoadingEnabled_;                          ///< Only read the grammar headers on startup, parse the rules on first use
+    QString cachePath_;                                ///< The directory of the binary grammar cache (empty for no cache)
+    QThreadPool* prewarmPool_;                         ///< The thread that loads the lazy grammars in the background (0 if not started)
+    GrammarPrewarmer* prewarmer_;                      ///< The background loader of the lazy grammars
 
     friend class Edbee;
 };
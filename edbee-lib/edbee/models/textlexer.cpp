@@ -22,10 +22,22 @@ void TextLexer::setGrammar(TextGrammar* grammar)
 {
     Q_ASSERT(grammar);
     grammarRef_ = grammar;
+    if( !textScopes() ) { return; }     // a lexer without document (the chunk lexers of the parallel lexer)
     textScopes()->setDefaultScope( grammarRef_->mainRule()->scopeName(), grammarRef_->mainRule() );
     textScopes()->removeScopesAfterOffset(0); // invalidate the complete scopes
 }
 
+/// Lexes the next line that couldn't be lexed completely (because of a lexing limit) again.
+/// The default implementation doesn't have incomplete lines
+/// @param lineTimeBudget the time budget (in ms) for lexing the line (0 is unlimited)
+/// @return the line that has been lexed or -1 if there are no incomplete lines
+int TextLexer::lexNextIncompleteLine( int lineTimeBudget )
+{
+    Q_UNUSED(lineTimeBudget);
+    return -1;
+}
+
+
 /// This method returns the text document
 TextDocument* TextLexer::textDocument()
 {
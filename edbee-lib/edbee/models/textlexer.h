@@ -37,6 +37,8 @@ public:
     /// @param endOffset the last offset to
     virtual void lexRange( int beginOffset, int endOffset ) = 0;
 
+    virtual int lexNextIncompleteLine( int lineTimeBudget );
+
 
     TextDocumentScopes* textScopes() { return textDocumentScopesRef_; }
     TextDocument* textDocument();
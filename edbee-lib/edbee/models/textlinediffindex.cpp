@@ -0,0 +1,88 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textlinediffindex.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Constructs an empty index
+TextLineDiffIndex::TextLineDiffIndex()
+{
+}
+
+
+/// The destructor
+TextLineDiffIndex::~TextLineDiffIndex()
+{
+}
+
+
+/// Removes all lines
+void TextLineDiffIndex::clear()
+{
+    lineList_.clear();
+}
+
+
+/// Changes the number of lines. Added lines are unchanged
+void TextLineDiffIndex::setLineCount( int lineCount )
+{
+    lineList_.resize( lineCount );
+}
+
+
+/// Replaces the given lines with new (unchanged) lines. The lines after it are moved.
+/// The range is clipped to the lines in the index, so an index that doesn't cover the whole document stays valid.
+/// @param line the first line to replace
+/// @param lineCount the number of lines to remove
+/// @param newLineCount the number of lines to insert
+void TextLineDiffIndex::replaceLines( int line, int lineCount, int newLineCount )
+{
+    if( line < 0 || line > lineList_.size() ) { return; }
+    lineList_.remove( line, qMin( lineCount, lineList_.size() - line ) );
+    lineList_.insert( line, newLineCount, LineDiff() );
+}
+
+
+/// Sets the differences of the given line
+/// @param line the line index
+/// @param status the LineStatus of the line
+/// @param spans the changed parts of the line
+void TextLineDiffIndex::setLineDiff( int line, int status, const QVector<TextLineDiffSpan>& spans )
+{
+    LineDiff& lineDiff = lineList_[line];
+    lineDiff.status = status;
+    lineDiff.spans = spans;
+}
+
+
+/// Returns the number of lines
+int TextLineDiffIndex::lineCount() const
+{
+    return lineList_.size();
+}
+
+
+/// Returns the LineStatus of the given line (LineUnchanged for lines outside the index)
+int TextLineDiffIndex::lineStatus( int line ) const
+{
+    if( line < 0 || line >= lineList_.size() ) { return LineUnchanged; }
+    return lineList_.at(line).status;
+}
+
+
+/// Returns the changed parts of the given line (an empty list for lines outside the index)
+const QVector<TextLineDiffSpan>& TextLineDiffIndex::lineSpans( int line ) const
+{
+    static const QVector<TextLineDiffSpan> emptySpans;
+    if( line < 0 || line >= lineList_.size() ) { return emptySpans; }
+    return lineList_.at(line).spans;
+}
+
+
+} // edbee
@@ -0,0 +1,65 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QVector>
+
+namespace edbee {
+
+
+/// A changed part of a line
+class TextLineDiffSpan
+{
+public:
+    TextLineDiffSpan( int start=0, int length=0, int kind=0 ) : start(start), length(length), kind(kind) {}
+
+    int start;      ///< The column of the first character
+    int length;     ///< The number of characters
+    int kind;       ///< The kind of change (the diff operation)
+};
+
+
+/// Keeps the precomputed differences of all lines of a document.
+///
+/// Every line has a status and the list of its changed parts. The parts are converted from the diff once,
+/// so rendering a line doesn't need to walk (or copy) the diff itself.
+class TextLineDiffIndex
+{
+public:
+    enum LineStatus {
+        LineUnchanged = 0,
+        LineDeleted = 1,
+        LineInserted = 2,
+        LineChanged = 3
+    };
+
+    TextLineDiffIndex();
+    virtual ~TextLineDiffIndex();
+
+    void clear();
+    void setLineCount( int lineCount );
+    void replaceLines( int line, int lineCount, int newLineCount );
+    void setLineDiff( int line, int status, const QVector<TextLineDiffSpan>& spans );
+
+    bool isEmpty() const { return lineList_.isEmpty(); }
+    int lineCount() const;
+    int lineStatus( int line ) const;
+    const QVector<TextLineDiffSpan>& lineSpans( int line ) const;
+
+private:
+
+    /// The differences of a single line
+    struct LineDiff {
+        LineDiff() : status(LineUnchanged) {}
+        int status;                             ///< The LineStatus of the line
+        QVector<TextLineDiffSpan> spans;        ///< The changed parts
+    };
+
+    QVector<LineDiff> lineList_;                ///< The differences of every line
+};
+
+
+} // edbee
@@ -8,6 +8,7 @@
 #include <QApplication>
 #include <QAction>
 #include <QThread>
+#include <QTimer>
 
 #include "edbee/commands/selectioncommand.h"
 #include "edbee/models/changes/mergablechangegroup.h"
@@ -19,6 +20,7 @@
 #include "edbee/models/change.h"
 #include "edbee/models/textdocument.h"
 #include "edbee/models/textdocumentscopes.h"
+#include "edbee/models/textlexer.h"
 #include "edbee/models/texteditorcommandmap.h"
 #include "edbee/models/texteditorconfig.h"
 #include "edbee/models/texteditorkeymap.h"
@@ -39,6 +41,12 @@
 
 namespace edbee {
 
+/// The time (in ms) without lexing activity before the incomplete lines are lexed again
+static const int IncompleteLineLexDelay = 500;
+
+/// The time budget (in ms) for lexing an incomplete line in the background
+static const int IncompleteLineTimeBudget = 1000;
+
 
 /// The constructor
 /// @param widget the widget this controller is associated with
@@ -56,8 +64,14 @@ TextEditorController::TextEditorController( TextEditorWidget* widget, QObject *p
     , textRenderer_(0)
     , textCaretCache_(0)
     , textSearcher_(0)
+    , incompleteLineTimer_(0)
     , autoScrollToCaret_(AutoScrollAlways)
 {
+    // the incomplete lines are lexed when there's no other lexing activity
+    incompleteLineTimer_ = new QTimer( this );
+    incompleteLineTimer_->setSingleShot( true );
+    incompleteLineTimer_->setInterval( IncompleteLineLexDelay );
+    connect( incompleteLineTimer_, SIGNAL(timeout()), this, SLOT(lexIncompleteLine()) );
 
     // create the keymap
     keyMapRef_ = Edbee::instance()->defaultKeyMap();
@@ -88,7 +102,8 @@ TextEditorController::~TextEditorController()
 }
 
 
-/// This method is called to reset the caret timer and update the ui
+/// This method is called to reset the caret timer and to scroll to the caret.
+/// (The changed lines are repainted by the text and selection change handlers)
 void TextEditorController::notifyStateChange()
 {
     if( widgetRef_ ) {
@@ -98,8 +113,6 @@ void TextEditorController::notifyStateChange()
         if( autoScrollToCaret_ == AutoScrollAlways || (autoScrollToCaret_ == AutoScrollWhenFocus && hasFocus())   ) {
             scrollOffsetVisible( textSelection()->range(0).caret() );
         }
-
-        widgetRef_->updateComponents();
     }
 }
 
@@ -128,6 +141,8 @@ void TextEditorController::setTextDocument(TextDocument* doc)
             oldDocumentRef->textUndoStack()->unregisterController(this);
             disconnect( oldDocumentRef, SIGNAL(textChanged(edbee::TextBufferChange)), this, SLOT(onTextChanged(edbee::TextBufferChange)) );
             disconnect( textDocumentRef_->lineDataManager(), SIGNAL(lineDataChanged(int,int,int)), this, SLOT(onLineDataChanged(int,int,int)));
+            disconnect( oldDocumentRef, SIGNAL(lineDiffsChanged(int,int)), this, SLOT(onLineDiffsChanged(int,int)) );
+            disconnect( oldDocumentRef, SIGNAL(lastScopedOffsetChanged(int,int)), incompleteLineTimer_, SLOT(start()) );
         }
 
         // delete some old and dependent objects
@@ -144,6 +159,8 @@ void TextEditorController::setTextDocument(TextDocument* doc)
 
         connect( textDocumentRef_, SIGNAL(textChanged(edbee::TextBufferChange)), this, SLOT(onTextChanged(edbee::TextBufferChange)));
         connect( textDocumentRef_->lineDataManager(), SIGNAL(lineDataChanged(int,int,int)), this, SLOT(onLineDataChanged(int,int,int)) );
+        connect( textDocumentRef_, SIGNAL(lineDiffsChanged(int,int)), this, SLOT(onLineDiffsChanged(int,int)) );
+        connect( textDocumentRef_, SIGNAL(lastScopedOffsetChanged(int,int)), incompleteLineTimer_, SLOT(start()) );
 
         // force an repaint when the grammar is changed
         connect( textDocumentRef_, &TextDocument::languageGrammarChanged, this, &TextEditorController::update );
@@ -356,9 +373,17 @@ void TextEditorController::onTextChanged( edbee::TextBufferChange change )
     /// update the selection
 //    textSelection()->changeSpatial( change.offset(), change.length(), change.newTextLength() );
 
-    /// TODO: improve this:
     if( widgetRef_) {
         widget()->updateGeometryComponents();
+
+        // repaint the changed lines. When the number of lines is changed, the lines after the change are moved too
+        int lineCount = change.newLineCount() + 1;
+        int lineDelta = change.newLineCount() - change.lineCount();
+        if( lineDelta ) {
+            int docLineCount = textDocument()->lineCount();
+            lineCount = qMax( docLineCount, docLineCount - lineDelta ) + 1 - change.line();    // (+1 for the separator of the last line)
+        }
+        widgetRef_->scheduleLineUpdate( change.line(), lineCount );
         notifyStateChange();
     }
 }
@@ -368,10 +393,39 @@ void TextEditorController::onTextChanged( edbee::TextBufferChange change )
 /// @param oldRangeSet the old range set of the change
 void TextEditorController::onSelectionChanged(TextRangeSet* oldRangeSet)
 {
-    Q_UNUSED(oldRangeSet);
-
-    /// TODO: improve this:
     if( widgetRef_) {
+        TextSelection* sel = textSelection();
+        if( oldRangeSet->rangeCount() == sel->rangeCount() ) {
+            for( int i=0, cnt=sel->rangeCount(); i<cnt; ++i ) {
+                TextRange& oldRange = oldRangeSet->range(i);
+                TextRange& newRange = sel->range(i);
+                if( oldRange.anchor() == newRange.anchor() && oldRange.caret() == newRange.caret() ) { continue; }
+
+                if( newRange.min() > oldRange.max() || oldRange.min() > newRange.max() ) {
+                    updateOffsetRange( oldRange.min(), oldRange.max(), oldRange.length() > 0 );
+                    updateOffsetRange( newRange.min(), newRange.max(), newRange.length() > 0 );
+
+                // with overlapping ranges only the lines between the old and the new start and between the old and the new end are changed
+                } else {
+                    bool selection = oldRange.length() || newRange.length();
+                    if( oldRange.min() != newRange.min() ) { updateOffsetRange( oldRange.min(), newRange.min(), selection ); }
+                    if( oldRange.max() != newRange.max() ) { updateOffsetRange( oldRange.max(), newRange.max(), selection ); }
+
+                    // the carets are drawn over the lines
+                    updateOffsetRange( oldRange.caret(), oldRange.caret(), false );
+                    updateOffsetRange( newRange.caret(), newRange.caret(), false );
+                }
+            }
+        } else {
+            for( int i=0, cnt=oldRangeSet->rangeCount(); i<cnt; ++i ) {
+                TextRange& range = oldRangeSet->range(i);
+                updateOffsetRange( range.min(), range.max(), range.length() > 0 );
+            }
+            for( int i=0, cnt=sel->rangeCount(); i<cnt; ++i ) {
+                TextRange& range = sel->range(i);
+                updateOffsetRange( range.min(), range.max(), range.length() > 0 );
+            }
+        }
         notifyStateChange();
     }
 }
@@ -384,8 +438,57 @@ void TextEditorController::onSelectionChanged(TextRangeSet* oldRangeSet)
 void TextEditorController::onLineDataChanged(int line, int length, int newLength)
 {
     if( this->widgetRef_ ) {
-        widgetRef_->updateLine( line, qMax(length,newLength));
+        widgetRef_->textEditorComponent()->invalidateLines( line, qMax(length,newLength) );
+        widgetRef_->scheduleLineUpdate( line, qMax(length,newLength) );
+    }
+}
+
+
+/// The differences of the given lines are recomputed, the lines need to be repainted
+/// @param line the first line with new differences
+/// @param length the number of lines
+void TextEditorController::onLineDiffsChanged( int line, int length )
+{
+    if( widgetRef_ ) {
+        widgetRef_->textEditorComponent()->invalidateLines( line, length );
+        widgetRef_->scheduleLineUpdate( line, length );
+    }
+}
+
+
+/// Lexes the next incomplete line of the document again (with a larger time budget) and repaints it.
+/// When the scopes after the line have been removed, all following lines are repainted.
+/// The timer is restarted until there are no incomplete lines left
+void TextEditorController::lexIncompleteLine()
+{
+    TextDocumentScopes* scopes = textDocumentRef_->scopes();
+    int lastScopedOffset = scopes->lastScopedOffset();
+    int line = textDocumentRef_->textLexer()->lexNextIncompleteLine( IncompleteLineTimeBudget );
+    if( line < 0 ) { return; }
+
+    int length = scopes->lastScopedOffset() < lastScopedOffset ? textDocumentRef_->lineCount() - line : 1;
+    if( widgetRef_ ) {
+        widgetRef_->textEditorComponent()->invalidateLines( line, length );
+        widgetRef_->scheduleLineUpdate( line, length );
+    }
+    incompleteLineTimer_->start();
+}
+
+
+/// Repaints the lines between the given offsets
+/// @param offset1 the offset of the first (or the last) line
+/// @param offset2 the offset of the last (or the first) line
+/// @param invalidate remove the cached rendering of the lines? (required when their selection is changed)
+void TextEditorController::updateOffsetRange( int offset1, int offset2, bool invalidate )
+{
+    TextDocument* doc = textDocument();
+    int length = doc->length();
+    int firstLine = doc->lineFromOffset( qBound( 0, qMin( offset1, offset2 ), length ) );
+    int lastLine = doc->lineFromOffset( qBound( 0, qMax( offset1, offset2 ), length ) );
+    if( invalidate ) {
+        widgetRef_->textEditorComponent()->invalidateLines( firstLine, lastLine - firstLine + 1 );
     }
+    widgetRef_->scheduleLineUpdate( firstLine, lastLine - firstLine + 1 );
 }
 
 
@@ -11,6 +11,7 @@
 #include "edbee/models/textbuffer.h"
 
 class QAction;
+class QTimer;
 
 namespace edbee {
 
@@ -97,6 +98,7 @@ public slots:
     void onTextChanged( edbee::TextBufferChange change );
     void onSelectionChanged( edbee::TextRangeSet *oldRangeSet );
     void onLineDataChanged( int line, int length, int newLength );
+    void onLineDiffsChanged( int line, int length );
 
     void updateAfterConfigChange();
     
@@ -140,6 +142,14 @@ public slots:
     virtual void executeCommand( TextEditorCommand* textCommand );
     virtual bool executeCommand( const QString& name=QString() );
 
+private slots:
+
+    void lexIncompleteLine();
+
+private:
+
+    void updateOffsetRange( int offset1, int offset2, bool invalidate );
+
 private:
 
     TextEditorWidget* widgetRef_;             ///< A reference to the text editor widget
@@ -155,6 +165,7 @@ private:
     TextCaretCache* textCaretCache_;          ///< The text-caret cache. (For remembering the x-position of the current carrets)
 
     TextSearcher* textSearcher_;              ///< The text-searcher
+    QTimer* incompleteLineTimer_;             ///< The idle timer for lexing the incomplete lines (lines that reached a lexing limit)
     
     AutoScrollToCaret autoScrollToCaret_;     ///< This flags tells the editor to automaticly scrol to the caret
 };
@@ -331,6 +331,52 @@ void TextEditorWidget::updateComponents()
 }
 
 
+/// Schedules a repaint of the given lines. The scheduled lines are repainted in the next event loop iteration,
+/// overlapping and adjacent lines are combined to a single update.
+/// @param line the first line to repaint
+/// @param length the number of lines to repaint
+void TextEditorWidget::scheduleLineUpdate(int line, int length)
+{
+    if( length <= 0 ) { return; }
+    if( scheduledLineMap_.isEmpty() ) {
+        QTimer::singleShot( 0, this, SLOT(updateScheduledLines()) );
+    }
+
+    // merge with the lines that start before this line
+    int firstLine = line;
+    int lastLine = line + length - 1;
+    QMap<int,int>::iterator itr = scheduledLineMap_.upperBound( firstLine );
+    if( itr != scheduledLineMap_.begin() ) {
+        --itr;
+        if( itr.value() + 1 >= firstLine ) {
+            firstLine = itr.key();
+            lastLine = qMax( lastLine, itr.value() );
+            itr = scheduledLineMap_.erase( itr );
+        } else {
+            ++itr;
+        }
+    }
+
+    // merge with the lines that start in (or directly after) these lines
+    while( itr != scheduledLineMap_.end() && itr.key() <= lastLine + 1 ) {
+        lastLine = qMax( lastLine, itr.value() );
+        itr = scheduledLineMap_.erase( itr );
+    }
+    scheduledLineMap_.insert( firstLine, lastLine );
+}
+
+
+/// Repaints the scheduled lines (see scheduleLineUpdate)
+void TextEditorWidget::updateScheduledLines()
+{
+    QMap<int,int> lineMap = scheduledLineMap_;
+    scheduledLineMap_.clear();
+    for( QMap<int,int>::const_iterator itr = lineMap.constBegin(); itr != lineMap.constEnd(); ++itr ) {
+        updateLine( itr.key(), itr.value() - itr.key() + 1 );
+    }
+}
+
+
 /// Updates the geometry for all components
 void TextEditorWidget::updateGeometryComponents()
 {
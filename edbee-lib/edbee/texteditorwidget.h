@@ -6,6 +6,7 @@
 #pragma once
 
 //#include <QAbstractScrollArea>
+#include <QMap>
 #include <QStringList>
 #include <QWidget>
 
@@ -83,6 +84,9 @@ public slots:
     virtual void updateAreaAroundOffset(int offset, int width=8);
     virtual void updateLine( int line, int length=1 );
     virtual void updateComponents();
+    void scheduleLineUpdate( int line, int length=1 );
+    void updateScheduledLines();
+    QMap<int,int> scheduledLines() const { return scheduledLineMap_; }
 
     virtual void updateGeometryComponents();
 
@@ -96,6 +100,8 @@ private:
     TextEditorComponent* editCompRef_;      ///< The editor ref
     TextMarginComponent* marginCompRef_;    ///< The margin components
 
+    QMap<int,int> scheduledLineMap_;        ///< The lines that are repainted in the next event loop iteration (first line => last line)
+
 };
 
 } // edbee
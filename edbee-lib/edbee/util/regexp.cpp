@@ -3,6 +3,8 @@
  * Author Rick Blommers
  */
 
+#include <QMutex>
+#include <QMutexLocker>
 #include <QRegExp>
 
 // This is required for windows, to prevent linkage errors (somehow the sources of oniguruma assumes we're linking with a dll)
@@ -13,6 +15,178 @@
 
 namespace edbee {
 
+
+/// Oniguruma isn't build with USE_MULTI_THREAD_SYSTEM. Compiling and freeing a regexp changes global state without
+/// a lock (the recycled parse tree nodes and the shared character class table). Regexps are compiled by the grammar
+/// loaders, the prewarmer and the lexer workers, so every onig_new/onig_free is serialized with this mutex.
+/// (Searching doesn't touch global state)
+static QMutex onigCompileMutex;
+
+
+/// The match stack limit of new regular expressions (0 is unlimited)
+static unsigned int defaultMatchStackLimitValue = 0;
+
+/// The retry limit of new regular expressions (0 is unlimited)
+static unsigned long defaultRetryLimitValue = 0;
+
+
+/// Skips the character class at the given position
+/// @param pattern the regexp pattern
+/// @param idx the index of the opening '['
+/// @return the index of the closing ']' or -1 if the class isn't terminated
+static int skipCharacterClass( const QString& pattern, int idx )
+{
+    int depth = 0;
+    for( int i=idx, len=pattern.length(); i<len; ++i ) {
+        QChar c = pattern.at(i);
+        if( c == '\\' ) {
+            ++i;
+        } else if( c == '[' ) {
+            ++depth;
+            // a ']' directly after the (negated) opening bracket is a literal
+            if( i+1 < len && pattern.at(i+1) == '^' ) { ++i; }
+            if( i+1 < len && pattern.at(i+1) == ']' ) { ++i; }
+        } else if( c == ']' ) {
+            if( --depth == 0 ) { return i; }
+        }
+    }
+    return -1;
+}
+
+
+/// Skips the group at the given position
+/// @param pattern the regexp pattern
+/// @param idx the index of the opening '('
+/// @return the index of the closing ')' or -1 if the group isn't terminated
+static int skipGroup( const QString& pattern, int idx )
+{
+    int depth = 0;
+    for( int i=idx, len=pattern.length(); i<len; ++i ) {
+        QChar c = pattern.at(i);
+        if( c == '\\' ) {
+            ++i;
+        } else if( c == '[' ) {
+            i = skipCharacterClass( pattern, i );
+            if( i < 0 ) { return -1; }
+        } else if( c == '(' ) {
+            ++depth;
+        } else if( c == ')' ) {
+            if( --depth == 0 ) { return i; }
+        }
+    }
+    return -1;
+}
+
+
+/// Scans the pattern for inline option groups like (?i) (?x-i) or (?i:subexp)
+/// @param pattern the regexp pattern
+/// @param caseInsensitive (out) set to true when a case-insensitive option is found
+/// @param extended (out) set to true when an extended option is found
+static void scanInlineOptions( const QString& pattern, bool& caseInsensitive, bool& extended )
+{
+    for( int i=0, len=pattern.length(); i<len; ++i ) {
+        QChar c = pattern.at(i);
+        if( c == '\\' ) {
+            ++i;
+        } else if( c == '[' ) {
+            i = skipCharacterClass( pattern, i );
+            if( i < 0 ) { return; }
+        } else if( c == '(' && i+1 < len && pattern.at(i+1) == '?' ) {
+            for( int j=i+2; j<len; ++j ) {
+                QChar option = pattern.at(j);
+                if( option == 'i' ) {
+                    caseInsensitive = true;
+                } else if( option == 'x' ) {
+                    extended = true;
+                } else if( option != 'm' && option != '-' ) {
+                    break;
+                }
+            }
+        }
+    }
+}
+
+
+/// Returns the minimal repeat count of the quantifier at the given position
+/// @param pattern the regexp pattern
+/// @param idx the position of the quantifier character
+/// @param end (out) the position of the last character of the quantifier
+/// @return the minimal repeat count or -1 if the character isn't a quantifier
+static int quantifierMinimum( const QString& pattern, int idx, int& end )
+{
+    end = idx;
+    QChar c = pattern.at(idx);
+    if( c == '*' || c == '?' ) { return 0; }
+    if( c == '+' ) { return 1; }
+    if( c != '{' ) { return -1; }
+
+    // an interval {n} {n,} {,m} or {n,m}. Everything else is a literal '{'
+    QString minimum;
+    bool comma = false;
+    for( int i=idx+1, len=pattern.length(); i<len; ++i ) {
+        QChar ch = pattern.at(i);
+        if( ch == '}' ) {
+            end = i;
+            return minimum.toInt();
+        } else if( ch == ',' && !comma ) {
+            comma = true;
+        } else if( ch.isDigit() && ch.unicode() < 128 ) {
+            if( !comma ) { minimum.append(ch); }
+        } else {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+
+/// Returns the position of the last character of the alphanumeric escape sequence starting at the given index
+/// @param pattern the regexp pattern
+/// @param idx the index of the backslash
+/// @return the index of the last character of the escape sequence, -1 if the escape sequence isn't supported
+static int skipAlphaNumericEscape( const QString& pattern, int idx )
+{
+    int len = pattern.length();
+    QChar c = pattern.at(idx+1);
+    int i = idx+1;
+    switch( c.toLatin1() ) {
+        case 'x':
+        case 'u':
+        case 'p':
+        case 'P': {
+            // \x{7HHHHHHH} \p{property} \xHH or \uHHHH
+            if( i+1 < len && pattern.at(i+1) == '{' ) {
+                int closeIdx = pattern.indexOf('}', i+1);
+                return closeIdx < 0 ? -1 : closeIdx;
+            }
+            int maxDigits = c == 'x' ? 2 : ( c == 'u' ? 4 : 0 );
+            for( int digits=0; digits < maxDigits && i+1 < len && QString("0123456789abcdefABCDEF").contains( pattern.at(i+1) ); ++digits ) { ++i; }
+            return i;
+        }
+        case 'k':
+        case 'g':
+            // \k<name> \g'name'
+            if( i+1 < len && ( pattern.at(i+1) == '<' || pattern.at(i+1) == '\'' ) ) {
+                int closeIdx = pattern.indexOf( pattern.at(i+1) == '<' ? '>' : '\'', i+2 );
+                return closeIdx < 0 ? -1 : closeIdx;
+            }
+            return i;
+        case 'c':
+        case 'C':
+        case 'M':
+            // control and meta sequences
+            return -1;
+        default:
+            // octal codes and back-references
+            while( i+1 < len && pattern.at(i+1).isDigit() ) { ++i; }
+            return i;
+    }
+}
+
+
+//====================================================================================================================
+
+
 /// The onig regexp-engine
 class OnigRegExpEngine : public RegExpEngine
 {
@@ -21,10 +195,15 @@ private:
     OnigErrorInfo einfo_;       ///< The error information
     bool valid_;                ///< Is the reg-exp valid?
     QString error_;             ///< The current error as a qstring
-    OnigRegion *region_;        ///< The current found region
+    OnigRegion *region_;        ///< The region of the last match (reused for every search)
+    bool matched_;              ///< Does the region contain a valid match?
     QString pattern_;           ///< The original regexp-pattern
     QString line_;              ///< The current line
     const QChar* lineRef_;      ///< A reference to the given line
+    QString requiredLiteral_;   ///< A literal that must be present in every match (empty if there isn't one)
+    int skippedSearchCount_;    ///< The number of searches that were rejected by the required literal
+    unsigned int matchStackLimit_;  ///< The maximum number of backtrack-entries of a single search (0 is unlimited)
+    unsigned long retryLimit_;      ///< The maximum number of backtracks of a single search (0 is unlimited)
 
 
     /// clears the error message
@@ -61,8 +240,13 @@ public:
     /// @param syntax the syntax to use
     OnigRegExpEngine( const QString& pattern, bool caseSensitive, RegExp::Syntax syntax )
         : reg_(0)
-        , region_(0)
+        , region_(onig_region_new())
+        , matched_(false)
         , pattern_(pattern)
+        , lineRef_(0)
+        , skippedSearchCount_(0)
+        , matchStackLimit_(0)
+        , retryLimit_(0)
     {
         const QChar* patternChars = pattern.constData();
 
@@ -73,9 +257,13 @@ public:
         OnigOptionType onigOptions = ONIG_OPTION_NONE|ONIG_OPTION_CAPTURE_GROUP;
         if( !caseSensitive ) { onigOptions = onigOptions | ONIG_OPTION_IGNORECASE;}
 
+        onigCompileMutex.lock();
         int result = onig_new(&reg_, (OnigUChar*)patternChars, (OnigUChar*)(patternChars + pattern.length()), onigOptions, ONIG_ENCODING_UTF16_LE, ONIG_SYNTAX_DEFAULT, &einfo_);
+        onigCompileMutex.unlock();
         valid_ = result == ONIG_NORMAL;
         fillError( result );
+
+        if( valid_ ) { requiredLiteral_ = RegExp::findRequiredLiteral( pattern, caseSensitive ); }
     }
 
 
@@ -83,6 +271,7 @@ public:
     virtual ~OnigRegExpEngine()
     {
         deleteRegion();
+        QMutexLocker lock( &onigCompileMutex );
         onig_free(reg_);
     }
 
@@ -96,6 +285,42 @@ public:
     /// returns the error message
     virtual QString error() { return error_; }
 
+    /// returns the number of capture groups in the pattern
+    virtual int captureCount() const { return valid_ ? onig_number_of_captures(reg_) : 0; }
+
+    /// returns the literal that is required for a match
+    virtual QString requiredLiteral() const { return requiredLiteral_; }
+
+    /// returns the number of searches that were rejected by the required literal
+    virtual int skippedSearchCount() const { return skippedSearchCount_; }
+
+    /// sets the limits that are passed to every search
+    virtual void setSearchLimits( unsigned int matchStackLimit, unsigned long retryLimit )
+    {
+        matchStackLimit_ = matchStackLimit;
+        retryLimit_ = retryLimit;
+    }
+
+
+    /// Checks if the required literal is present in the given range of the text
+    /// @param charPtr the pointer to the string data
+    /// @param offset the start of the range
+    /// @param length the end of the range
+    /// @return true if the literal is found (or when there's no required literal)
+    bool containsRequiredLiteral( const QChar* charPtr, int offset, int length ) const
+    {
+        int literalLength = requiredLiteral_.length();
+        if( literalLength == 0 ) { return true; }
+
+        const QChar* literal = requiredLiteral_.constData();
+        const QChar first = literal[0];
+        for( int i=qMax(0,offset), last=length-literalLength; i<=last; ++i ) {
+            if( charPtr[i] != first ) { continue; }
+            if( memcmp( charPtr+i+1, literal+1, (literalLength-1)*sizeof(QChar) ) == 0 ) { return true; }
+        }
+        return false;
+    }
+
 
     /// returns the index of the given QChar array in the given text
     /// @param charPtr the pointer to the string data
@@ -107,11 +332,16 @@ public:
         // invalid reg-exp don't use it!
         if( !valid_ ) { return -2; }
 
-        // delete old regenion an make a new one
-        deleteRegion();
-        region_ = onig_region_new();
-
+        // the region is reused, onig_search only (re)allocates it when it requires more capture slots
+        matched_ = false;
         lineRef_ = charPtr;
+        clearError();
+
+        // a match is impossible without the required literal. (A match always lies between offset and length, also for reverse searches)
+        if( !containsRequiredLiteral( charPtr, offset, length ) ) {
+            ++skippedSearchCount_;
+            return -1;
+        }
         OnigUChar* stringStart  = (OnigUChar*)charPtr;
         OnigUChar* stringEnd    = (OnigUChar*)(charPtr+length);
         OnigUChar* stringOffset = (OnigUChar*)(charPtr+offset);
@@ -121,11 +351,10 @@ public:
             stringRange  = (OnigUChar*)(charPtr+offset);
         }
 
-        clearError();
-
-        int result = onig_search(reg_, stringStart, stringEnd, stringOffset, stringRange, region_, ONIG_OPTION_NONE);
+        int result = onig_search_with_limits(reg_, stringStart, stringEnd, stringOffset, stringRange, region_, ONIG_OPTION_NONE, matchStackLimit_, retryLimit_);
         if ( result >= 0) {
             Q_ASSERT(result%2==0);
+            matched_ = true;
             return result>>1;
 
         } else if (result == ONIG_MISMATCH) {
@@ -145,11 +374,9 @@ public:
     /// @return the position of the given match (-1 if not found, -2 on error)
     virtual int indexIn( const QString& str, int offset )
     {
-        line_ = str;
-        int length = line_.length(); // very scary, calling line_.length() invalidates the line_.data() pointer :S
-        lineRef_ = line_.data();
-
-        return indexIn( lineRef_, offset, length, false );
+        line_ = str;    // (implicitly shared, the line is kept alive for cap())
+        lineRef_ = line_.constData();
+        return indexIn( lineRef_, offset, line_.length(), false );
     }
 
 
@@ -171,9 +398,8 @@ public:
     virtual int lastIndexIn( const QString& str, int offset )
     {
         line_ = str;
-        int length = line_.length(); // very scary, calling line_.length() invalidates the line_.data() pointer :S
-        lineRef_ = line_.data();
-        return lastIndexIn( lineRef_, offset, length);
+        lineRef_ = line_.constData();
+        return lastIndexIn( lineRef_, offset, line_.length() );
     }
 
 
@@ -196,7 +422,7 @@ public:
     /// @param nth the given match
     virtual int pos( int nth ) const
     {
-        if( !region_ ) { return -1; } // no region
+        if( !matched_ ) { return -1; } // no match
         if( nth < region_->num_regs ) {
             int result = region_->beg[nth];
             if( result < 0 ) { return -1; }
@@ -222,7 +448,7 @@ public:
     /// @param nth the match number
     virtual int len( int nth ) const
     {
-        if( !region_ ) { return -1; } // no region
+        if( !matched_ ) { return -1; } // no match
         if( nth < region_->num_regs ) {
             int result = region_->end[nth] - region_->beg[nth]; // end is the first character AFTER the match
             Q_ASSERT(result%2==0);
@@ -287,6 +513,18 @@ public:
     /// returns the error message
     virtual QString error() { return reg_->errorString(); }
 
+    /// returns the number of capture groups in the pattern
+    virtual int captureCount() const { return reg_->captureCount(); }
+
+    /// The QRegExp engine doesn't use a literal prefilter
+    virtual QString requiredLiteral() const { return QString(); }
+
+    /// Without prefilter no search is skipped
+    virtual int skippedSearchCount() const { return 0; }
+
+    /// QRegExp has no search limits
+    virtual void setSearchLimits( unsigned int, unsigned long ) {}
+
 
     /// returns the index of the regexp in the given string
     /// @param str the string to search in
@@ -362,6 +600,11 @@ public:
 /// @param engine the engine to use (EngineOniguruma(default) or EngineQRegExp)
 RegExp::RegExp( const QString& pattern, bool caseSensitive, Syntax syntax, Engine engine)
     : d_(0)
+    , caseSensitive_(caseSensitive)
+    , syntax_(syntax)
+    , engine_(engine)
+    , matchStackLimit_(defaultMatchStackLimitValue)
+    , retryLimit_(defaultRetryLimitValue)
 {
     switch( engine ) {
         case EngineQRegExp:
@@ -370,9 +613,11 @@ RegExp::RegExp( const QString& pattern, bool caseSensitive, Syntax syntax, Engin
         default:
             Q_ASSERT(false);
             qlog_warn() << "Invalid engine supplied to RegExp. Falling back to EngineOniguruma";
+            engine_ = EngineOniguruma;
         case EngineOniguruma:
             d_ = new OnigRegExpEngine(pattern, caseSensitive, syntax);
     }
+    d_->setSearchLimits( matchStackLimit_, retryLimit_ );
 }
 
 
@@ -383,6 +628,18 @@ RegExp::~RegExp()
 }
 
 
+/// Creates a new regular expression with the same pattern, options, engine and search limits.
+/// The copy has its own match state, so it can be used in another thread then this regexp
+/// @return the new regular expression (the caller is the owner)
+RegExp* RegExp::clone() const
+{
+    RegExp* result = new RegExp( pattern(), caseSensitive_, syntax_, engine_ );
+    result->setMatchStackLimit( matchStackLimit_ );
+    result->setRetryLimit( retryLimit_ );
+    return result;
+}
+
+
 /// escapes a string with every regexp special character escaped
 /// we currently always use QRegExp::escape.. For the future we added an engine parameter
 /// which is currently ignored
@@ -393,6 +650,123 @@ QString RegExp::escape(const QString& str, RegExp::Engine engine)
 }
 
 
+/// Initializes the oniguruma engine. The lazy initialization of oniguruma isn't thread-safe,
+/// this method should be called before regular expressions are compiled in other threads
+void RegExp::initEngine()
+{
+    QMutexLocker lock( &onigCompileMutex );
+    onig_init();
+}
+
+
+/// Sets the match stack limit of regular expressions that are constructed after this call.
+/// Existing regular expressions keep their limit. This should be called before regexps are created in other threads
+/// @param size the maximum stack size (0 is unlimited)
+void RegExp::setDefaultMatchStackLimit( unsigned int size )
+{
+    defaultMatchStackLimitValue = size;
+}
+
+
+/// Returns the match stack limit of new regular expressions (0 is unlimited)
+unsigned int RegExp::defaultMatchStackLimit()
+{
+    return defaultMatchStackLimitValue;
+}
+
+
+/// Sets the retry limit of regular expressions that are constructed after this call.
+/// Existing regular expressions keep their limit. This should be called before regexps are created in other threads
+/// @param count the maximum number of backtracks (0 is unlimited)
+void RegExp::setDefaultRetryLimit( unsigned long count )
+{
+    defaultRetryLimitValue = count;
+}
+
+
+/// Returns the retry limit of new regular expressions (0 is unlimited)
+unsigned long RegExp::defaultRetryLimit()
+{
+    return defaultRetryLimitValue;
+}
+
+
+/// Finds the longest literal string that must be present in every match of the given pattern.
+/// This literal is used to skip the regexp search for texts that don't contain this literal.
+///
+/// The analysis is conservative, only the top-level of the pattern is used and when in doubt no literal is returned.
+/// For case-insensitive patterns only the ascii non-letter characters are used (case folding can match other characters)
+///
+/// @param pattern the regular expression pattern
+/// @param caseSensitive is the regular expression case sensitive
+/// @return the required literal or an empty string if no literal could be found
+QString RegExp::findRequiredLiteral( const QString& pattern, bool caseSensitive )
+{
+    bool caseInsensitive = !caseSensitive;
+    bool extended = false;
+    scanInlineOptions( pattern, caseInsensitive, extended );
+    if( extended ) { return QString(); }    // whitespace and comments are ignored in extended mode
+
+    QString best;
+    QString current;
+    for( int i=0, len=pattern.length(); i<len; ++i ) {
+        QChar c = pattern.at(i);
+
+        // quantifiers: the last character is optional when the minimum is 0
+        int quantifierEnd = i;
+        int minimum = quantifierMinimum( pattern, i, quantifierEnd );
+        if( minimum >= 0 ) {
+            if( minimum == 0 && !current.isEmpty() ) {
+                current.chop( current.length() > 1 && current.at( current.length()-1 ).isLowSurrogate() ? 2 : 1 );
+            }
+            if( current.length() > best.length() ) { best = current; }
+            current.clear();
+            i = quantifierEnd;
+            continue;
+        }
+
+        // alternatives on the top-level don't have a common literal
+        if( c == '|' ) { return QString(); }
+
+        // a plain character
+        QChar literal;
+        if( c == '\\' ) {
+            if( i+1 >= len ) { return QString(); }
+            QChar next = pattern.at(i+1);
+            if( next.unicode() >= 128 || !next.isLetterOrNumber() ) {
+                literal = next;
+                ++i;
+            } else {
+                i = skipAlphaNumericEscape( pattern, i );
+                if( i < 0 ) { return QString(); }
+            }
+        } else if( c == '(' ) {
+            i = skipGroup( pattern, i );
+            if( i < 0 ) { return QString(); }
+        } else if( c == '[' ) {
+            i = skipCharacterClass( pattern, i );
+            if( i < 0 ) { return QString(); }
+        } else if( c != '.' && c != '^' && c != '$' && c != ')' && c != ']' && c != '{' && c != '}' ) {
+            literal = c;
+        }
+
+        // case-insensitive patterns only accept characters without case folding
+        if( caseInsensitive && !literal.isNull() && ( literal.unicode() >= 128 || literal.isLetter() ) ) {
+            literal = QChar();
+        }
+
+        if( literal.isNull() ) {
+            if( current.length() > best.length() ) { best = current; }
+            current.clear();
+        } else {
+            current.append( literal );
+        }
+    }
+    if( current.length() > best.length() ) { best = current; }
+    return best;
+}
+
+
 /// returns true if the supplied regular expression was valid
 bool RegExp::isValid() const
 {
@@ -414,6 +788,86 @@ QString RegExp::pattern() const
 }
 
 
+/// returns true if the pattern is case sensitive
+bool RegExp::isCaseSensitive() const
+{
+    return caseSensitive_;
+}
+
+
+/// returns the syntax of the pattern
+RegExp::Syntax RegExp::syntax() const
+{
+    return syntax_;
+}
+
+
+/// returns the engine that matches the pattern
+RegExp::Engine RegExp::engine() const
+{
+    return engine_;
+}
+
+
+/// returns the number of capture groups in the pattern (without the complete match group 0)
+int RegExp::captureCount() const
+{
+    return d_->captureCount();
+}
+
+
+/// returns the literal that must be present in the searched text for a match. (empty if there's no such literal)
+QString RegExp::requiredLiteral() const
+{
+    return d_->requiredLiteral();
+}
+
+
+/// returns the number of searches that were rejected without running the regexp engine, because the
+/// searched text didn't contain the required literal
+int RegExp::skippedSearchCount() const
+{
+    return d_->skippedSearchCount();
+}
+
+
+/// Sets the maximum number of backtrack-entries a single search of this regexp may use. A search that exceeds
+/// this limit fails with an error (indexIn returns -2). This protects against catastrophic backtracking.
+/// The QRegExp engine ignores this limit.
+/// @param size the maximum stack size (0 is unlimited)
+void RegExp::setMatchStackLimit( unsigned int size )
+{
+    matchStackLimit_ = size;
+    d_->setSearchLimits( matchStackLimit_, retryLimit_ );
+}
+
+
+/// Returns the match stack limit of a single search (0 is unlimited)
+unsigned int RegExp::matchStackLimit() const
+{
+    return matchStackLimit_;
+}
+
+
+/// Sets the maximum number of backtracks of a single search of this regexp. A search that exceeds this limit
+/// fails with an error (indexIn returns -2). Unlike the match stack limit this also stops a catastrophic
+/// search that backtracks within a small stack (like nested quantifiers on a long line).
+/// The QRegExp engine ignores this limit.
+/// @param count the maximum number of backtracks (0 is unlimited)
+void RegExp::setRetryLimit( unsigned long count )
+{
+    retryLimit_ = count;
+    d_->setSearchLimits( matchStackLimit_, retryLimit_ );
+}
+
+
+/// Returns the retry limit of a single search (0 is unlimited)
+unsigned long RegExp::retryLimit() const
+{
+    return retryLimit_;
+}
+
+
 /// Attempts to find a match in str from position offset (0 by default). If offset is -1, the search starts at the last character; if -2, at the next to last character; etc.
 /// Returns the position of the first match, or -1 if there was no match.
 /// The caretMode parameter can be used to instruct whether ^ should match at index 0 or at offset.
@@ -424,6 +878,27 @@ int RegExp::indexIn(const QString& str, int offset)  // const
 }
 
 
+/// Searches for the regular expression and returns the match result
+/// The returned match object doesn't depend on this regexp, it stays valid after the next search.
+/// @param str the string to search in
+/// @param offset the offset to start searching
+/// @return the match (use RegExpMatch::hasMatch() to check if the regular expression was found)
+RegExpMatch RegExp::match( const QString& str, int offset )
+{
+    RegExpMatch result;
+    if( indexIn( str, offset ) < 0 ) { return result; }
+
+    result.text_ = str;
+    int groupCount = captureCount() + 1;
+    result.ranges_.resize( groupCount * 2 );
+    for( int i=0; i<groupCount; ++i ) {
+        result.ranges_[i*2]   = pos(i);
+        result.ranges_[i*2+1] = len(i);
+    }
+    return result;
+}
+
+
 /// Searchers for the regular expression in the given string
 /// @param str the string to search in
 /// @param offset the offset to start searching
@@ -477,4 +952,66 @@ QString RegExp::cap(int nth) const
     return d_->cap(nth);
 }
 
+
+//====================================================================================================================
+
+
+/// Constructs an empty (not matched) match result
+RegExpMatch::RegExpMatch()
+{
+}
+
+
+/// Returns true if the regular expression was found
+bool RegExpMatch::hasMatch() const
+{
+    return !ranges_.isEmpty();
+}
+
+
+/// Returns the number of capture groups (without the complete match group 0)
+int RegExpMatch::captureCount() const
+{
+    return hasMatch() ? ranges_.size() / 2 - 1 : 0;
+}
+
+
+/// Returns the position of the nth capture (-1 if the capture didn't match)
+/// @param nth the capture group (0 is the complete match)
+int RegExpMatch::pos( int nth ) const
+{
+    if( nth < 0 || nth*2 >= ranges_.size() ) { return -1; }
+    return ranges_.at(nth*2);
+}
+
+
+/// Returns the length of the nth capture (-1 if the capture doesn't exist)
+/// @param nth the capture group (0 is the complete match)
+int RegExpMatch::len( int nth ) const
+{
+    if( nth < 0 || nth*2 >= ranges_.size() ) { return -1; }
+    return ranges_.at(nth*2+1);
+}
+
+
+/// Returns the position directly after the nth capture (-1 if the capture didn't match)
+/// @param nth the capture group (0 is the complete match)
+int RegExpMatch::end( int nth ) const
+{
+    int p = pos(nth);
+    return p < 0 ? -1 : p + len(nth);
+}
+
+
+/// Returns the text of the nth capture. This is the only method that creates a string
+/// @param nth the capture group (0 is the complete match)
+QString RegExpMatch::cap( int nth ) const
+{
+    int p = pos(nth);
+    int l = len(nth);
+    if( p < 0 || l < 0 ) { return QString(); }
+    return text_.mid( p, l );
+}
+
+
 } // edbee
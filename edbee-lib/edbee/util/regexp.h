@@ -6,6 +6,7 @@
 #pragma once
 
 #include <QString>
+#include <QVarLengthArray>
 
 namespace edbee {
 
@@ -18,6 +19,10 @@ public:
     virtual QString pattern() = 0;
     virtual bool isValid() = 0;
     virtual QString error() = 0;
+    virtual int captureCount() const = 0;
+    virtual QString requiredLiteral() const = 0;
+    virtual int skippedSearchCount() const = 0;
+    virtual void setSearchLimits( unsigned int matchStackLimit, unsigned long retryLimit ) = 0;
     virtual int indexIn( const QString& str, int offset ) = 0;
     virtual int indexIn( const QChar* str, int offset, int length ) = 0;
     virtual int lastIndexIn( const QString& str, int offset ) = 0;
@@ -30,6 +35,31 @@ public:
 
 
 
+/// The result of a single regular expression match.
+/// Only the positions of the captures are stored, the captured strings are created when cap() is called.
+/// The positions are stored inline for patterns with up to 16 capture groups. (no heap allocations)
+class RegExpMatch
+{
+public:
+    RegExpMatch();
+
+    bool hasMatch() const;
+    int captureCount() const;
+
+    int pos( int nth = 0 ) const;
+    int len( int nth = 0 ) const;
+    int end( int nth = 0 ) const;
+    QString cap( int nth = 0 ) const;
+
+private:
+    QString text_;                          ///< The matched text (implicitly shared)
+    QVarLengthArray<int,34> ranges_;        ///< pos/length pairs of the complete match and all captures
+
+    friend class RegExp;
+};
+
+
+
 /// A class for matching QStrings with the Oniguruma API
 /// We need this Regular Expression library to be able to support tmLanguages fully
 /// I tried to make this class as close as possible to the QRegExp library
@@ -56,15 +86,33 @@ public:
 
     RegExp( const QString& pattern, bool caseSensitive=true, Syntax syntax=SyntaxDefault, Engine engine=EngineOniguruma );
     virtual ~RegExp();
+    RegExp* clone() const;
 
     static QString escape( const QString& str, Engine engine=EngineOniguruma );
+    static QString findRequiredLiteral( const QString& pattern, bool caseSensitive=true );
+    static void initEngine();
+    static void setDefaultMatchStackLimit( unsigned int size );
+    static unsigned int defaultMatchStackLimit();
+    static void setDefaultRetryLimit( unsigned long count );
+    static unsigned long defaultRetryLimit();
 
     bool isValid() const;
     QString errorString() const ;
     QString pattern() const ;
+    bool isCaseSensitive() const;
+    Syntax syntax() const;
+    Engine engine() const;
+    int captureCount() const;
+    QString requiredLiteral() const;
+    int skippedSearchCount() const;
+    void setMatchStackLimit( unsigned int size );
+    unsigned int matchStackLimit() const;
+    void setRetryLimit( unsigned long count );
+    unsigned long retryLimit() const;
 
 
     int	indexIn( const QString& str, int offset = 0 ); // const;
+    RegExpMatch match( const QString& str, int offset = 0 );
     int indexIn( const QChar* str, int offset, int length );
     int lastIndexIn( const QString& str, int offset=-1 );
     int lastIndexIn( const QChar* str, int offset, int length );
@@ -80,6 +128,11 @@ public:
 
 private:
     RegExpEngine* d_;       ///< The private data member
+    bool caseSensitive_;    ///< Is the pattern case sensitive?
+    Syntax syntax_;         ///< The syntax of the pattern
+    Engine engine_;         ///< The engine that matches the pattern
+    unsigned int matchStackLimit_;  ///< The maximum number of backtrack-entries of a single search (0 is unlimited)
+    unsigned long retryLimit_;      ///< The maximum number of backtracks of a single search (0 is unlimited)
 };
 
 } // edbee
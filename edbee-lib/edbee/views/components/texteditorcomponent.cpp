@@ -8,6 +8,7 @@
 #include <QMenu>
 #include <QPainter>
 #include <QPaintEvent>
+#include <QPixmap>
 #include <QTimer>
 
 #include "edbee/commands/selectioncommand.h"
@@ -20,9 +21,11 @@
 #include "edbee/texteditorcontroller.h"
 #include "edbee/texteditorwidget.h"
 #include "edbee/views/components/texteditorrenderer.h"
+#include "edbee/views/components/texteditortilecache.h"
 #include "edbee/views/texteditorscrollarea.h"
 #include "edbee/views/textrenderer.h"
 #include "edbee/views/textselection.h"
+#include "edbee/views/texttheme.h"
 
 #include "debug.h"
 
@@ -36,8 +39,10 @@ TextEditorComponent::TextEditorComponent(TextEditorController* controller, QWidg
     , caretTimer_(0)
     , controllerRef_(controller)
     , textEditorRenderer_(0)
+    , tileCache_(0)
 {
     textEditorRenderer_ = new TextEditorRenderer( controller->textRenderer());
+    tileCache_ = new TextEditorTileCache();
 
 //    setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
     setSizePolicy( QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding );
@@ -67,6 +72,10 @@ TextEditorComponent::TextEditorComponent(TextEditorController* controller, QWidg
     if( config()->caretBlinkingRate() > 0 ) {
         caretTimer_->start( config()->caretBlinkingRate() >> 1 );
     }
+
+    // the text changes are used to keep the tile cache up-to-date
+    connect( controller, SIGNAL(textDocumentChanged(edbee::TextDocument*,edbee::TextDocument*)), this, SLOT(textDocumentChanged(edbee::TextDocument*,edbee::TextDocument*)));
+    connectTextDocument( textDocument() );
 }
 
 
@@ -74,6 +83,7 @@ TextEditorComponent::TextEditorComponent(TextEditorController* controller, QWidg
 TextEditorComponent::~TextEditorComponent()
 {
     delete caretTimer_;
+    delete tileCache_;
     delete textEditorRenderer_;
 }
 
@@ -123,6 +133,7 @@ void TextEditorComponent::giveTextEditorRenderer(TextEditorRenderer *renderer)
 {
     delete textEditorRenderer_;
     textEditorRenderer_ = renderer;
+    tileCache_->clear();
 }
 
 
@@ -163,6 +174,7 @@ void TextEditorComponent::fullUpdate()
 {
 //    qlog_info() << "**** fullUpdate!!! **** ";
     controller()->textRenderer()->invalidateCaches();
+    tileCache_->clear();
     updateGeometry();
     update();
 }
@@ -184,10 +196,11 @@ void TextEditorComponent::paintEvent(QPaintEvent* paintEvent)
 
 //qlog_info() << "CLIPRECT..... " << translatedRect;
 
-    // render the editor
+    // render the editor. The lines are drawn with the cached tiles, the (blinking) carets are drawn over them
 //    textRenderer()->render( p, translatedRect );
+    renderTiles( &p, translatedRect );
     textRenderer()->renderBegin(translatedRect);
-    textEditorRenderer_->render(&p);
+    textEditorRenderer_->renderCarets(&p);
     textRenderer()->renderEnd(translatedRect);
 
 #if DEBUG_DRAW_RENDER_CLIPPING_RECTANGLE
@@ -546,7 +559,16 @@ void TextEditorComponent::updateLine(int line, int length)
     TextRenderer* ren = textRenderer();
     int startY = ren->yPosForLine( line ) - textEditorRenderer_->extraPixelsToUpdateAroundLines();
     int endY   = ren->yPosForLine( line + length ) + textEditorRenderer_->extraPixelsToUpdateAroundLines();
-    update( 0, startY, width(), endY );
+    update( 0, startY, width(), endY - startY );
+}
+
+
+/// Removes the cached rendering of the given lines. (This doesn't repaint the lines, see updateLine)
+/// @param line the first line
+/// @param length the number of lines
+void TextEditorComponent::invalidateLines(int line, int length)
+{
+    tileCache_->invalidateLines( line, length );
 }
 
 
@@ -557,4 +579,136 @@ TextRenderer *TextEditorComponent::textRenderer() const
 }
 
 
+/// Connects the text changes of the given document
+void TextEditorComponent::connectTextDocument( TextDocument* doc )
+{
+    if( !doc ) { return; }
+    connect( doc, SIGNAL(textChanged(edbee::TextBufferChange)), this, SLOT(textChanged(edbee::TextBufferChange)) );
+    connect( doc, SIGNAL(diffLookupChanged()), this, SLOT(diffLookupChanged()) );
+}
+
+
+/// Draws the lines in the given rectangle with the cached tiles. Missing and outdated tiles are rendered first
+/// @param painter the painter to draw the tiles with
+/// @param rect the rectangle to draw
+void TextEditorComponent::renderTiles( QPainter* painter, const QRect& rect )
+{
+    TextRenderer* ren = textRenderer();
+    int lineHeight = ren->lineHeight();
+#if QT_VERSION >= QT_VERSION_CHECK(5,6,0)
+    qreal devicePixelRatio = devicePixelRatioF();
+#else
+    qreal devicePixelRatio = this->devicePixelRatio();
+#endif
+    tileCache_->validate( ren->theme(), font(), lineHeight, devicePixelRatio );
+
+    // lex the visible lines and make sure the layouts are up-to-date (the layout ids validate the tiles)
+    QRect lexRect = rect.united( ren->viewport() );
+    ren->renderBegin( lexRect );
+    int firstVisibleLine = ren->startLine();
+    int lastVisibleLine = ren->endLine();
+    ren->renderEnd( lexRect );
+
+    // the tiles of the lines. (The line after the last line is the separator of the last line)
+    int lineCount = textDocument()->lineCount();
+    int firstLine = ren->rawLineIndexForYpos( rect.top() );
+    int lastLine = qMin( ren->rawLineIndexForYpos( rect.bottom() ), lineCount );
+
+    int firstColumn = rect.left() / TextEditorTileCache::TileWidth;
+    int lastColumn = rect.right() / TextEditorTileCache::TileWidth;
+
+    // lexing a changed line can change the formats of the visible lines after it. The painter is clipped to the rect,
+    // so the tiles of these lines are rendered in this pass and drawn by a repaint that's queued after this paint event
+    int firstOutdatedLine = -1;
+    int lastOutdatedLine = -1;
+    for( int line=firstVisibleLine; line <= lastVisibleLine; ++line ) {
+        if( firstLine <= line && line <= lastLine ) { continue; }
+        int layoutId = ren->textLayoutIdForLine( line );
+        if( !tileCache_->hasOutdatedTile( line, layoutId ) ) { continue; }
+        tileCache_->invalidateLines( line, 1 );     // (the outdated tiles outside the viewport are rendered when needed)
+        for( int column=qMax( 0, ren->viewport().left() / TextEditorTileCache::TileWidth ), endColumn=ren->viewport().right() / TextEditorTileCache::TileWidth; column <= endColumn; ++column ) {
+            renderTile( line, column, layoutId, devicePixelRatio );
+        }
+        if( firstOutdatedLine < 0 ) { firstOutdatedLine = line; }
+        lastOutdatedLine = line;
+    }
+    if( firstOutdatedLine >= 0 ) {
+        QMetaObject::invokeMethod( this, "updateLine", Qt::QueuedConnection, Q_ARG( int, firstOutdatedLine ), Q_ARG( int, lastOutdatedLine - firstOutdatedLine + 1 ) );
+    }
+
+    for( int line=firstLine; line <= lastLine; ++line ) {
+        int layoutId = ren->textLayoutIdForLine( line );
+        for( int column=firstColumn; column <= lastColumn; ++column ) {
+            const QPixmap* pixmap = tileCache_->tile( line, column, layoutId );
+            if( !pixmap ) { pixmap = renderTile( line, column, layoutId, devicePixelRatio ); }
+            painter->drawPixmap( column * TextEditorTileCache::TileWidth, line * lineHeight, *pixmap );
+        }
+    }
+
+    // the area after the lines only has a background
+    int emptyTop = ( lastLine + 1 ) * lineHeight;
+    if( emptyTop <= rect.bottom() ) {
+        painter->fillRect( rect.left(), emptyTop, rect.width(), rect.bottom() - emptyTop + 1, ren->theme()->backgroundColor() );
+    }
+}
+
+
+/// Renders the given tile and gives it to the tile cache
+/// @param line the line of the tile
+/// @param column the tile column
+/// @param layoutId the id of the text layout of the line
+/// @param devicePixelRatio the device pixel ratio of the tile
+/// @return the rendered tile (owned by the cache)
+const QPixmap* TextEditorComponent::renderTile( int line, int column, int layoutId, qreal devicePixelRatio )
+{
+    TextRenderer* ren = textRenderer();
+    int lineHeight = ren->lineHeight();
+    QRect tileRect( column * TextEditorTileCache::TileWidth, line * lineHeight, TextEditorTileCache::TileWidth, lineHeight );
+
+    QPixmap* pixmap = new QPixmap( tileRect.size() * devicePixelRatio );
+    pixmap->setDevicePixelRatio( devicePixelRatio );
+
+    // the separator of the previous line is drawn on the first pixel row of the tile
+    QRect renderRect( tileRect );
+    if( line > 0 && config()->useLineSeparator() ) { renderRect.setTop( renderRect.top() - 1 ); }
+
+    QPainter painter( pixmap );
+    painter.setFont( font() );
+    painter.translate( -tileRect.topLeft() );
+    ren->renderBegin( renderRect );
+    textEditorRenderer_->renderLines( &painter );
+    ren->renderEnd( renderRect );
+    painter.end();
+
+    tileCache_->giveTile( line, column, layoutId, pixmap );
+    return pixmap;
+}
+
+
+/// The text-document has been changed
+void TextEditorComponent::textDocumentChanged( TextDocument* oldDocument, TextDocument* newDocument )
+{
+    if( oldDocument ) {
+        disconnect( oldDocument, 0, this, 0 );
+    }
+    tileCache_->clear();
+    connectTextDocument( newDocument );
+}
+
+
+/// The text is replaced. The tiles of the changed lines are removed, the tiles after it are moved
+void TextEditorComponent::textChanged( TextBufferChange change )
+{
+    tileCache_->replaceLines( change.line(), change.lineCount() + 1, change.newLineCount() + 1 );
+}
+
+
+/// The line differences are changed, the tiles are rendered with the old differences
+void TextEditorComponent::diffLookupChanged()
+{
+    tileCache_->clear();
+    update();
+}
+
+
 } // edbee
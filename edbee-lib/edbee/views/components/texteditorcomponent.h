@@ -8,6 +8,11 @@
 #include <QSize>
 #include <QWidget>
 
+#include "edbee/models/textbuffer.h"
+
+class QPainter;
+class QPixmap;
+
 namespace edbee {
 
 class TextDocument;
@@ -16,6 +21,7 @@ class TextEditorConfig;
 class TextEditorController;
 class TextEditorRenderer;
 class TextEditorKeyMap;
+class TextEditorTileCache;
 class TextRenderer;
 class TextSelection;
 
@@ -38,6 +44,7 @@ public:
 
     TextEditorRenderer* textEditorRenderer() { return textEditorRenderer_; }
     void giveTextEditorRenderer( TextEditorRenderer* renderer );
+    TextEditorTileCache* tileCache() { return tileCache_; }
 
     void resetCaretTime();
     void fullUpdate();
@@ -64,10 +71,19 @@ public slots:
     virtual void updateLineAtOffset(int offset);
     virtual void updateAreaAroundOffset(int offset, int width=8);
     virtual void updateLine( int line, int length );
+    void invalidateLines( int line, int length );
+
+protected slots:
+    void textDocumentChanged( edbee::TextDocument* oldDocument, edbee::TextDocument* newDocument );
+    void textChanged( edbee::TextBufferChange change );
+    void diffLookupChanged();
 
 private:
 
     TextRenderer* textRenderer() const;
+    void connectTextDocument( TextDocument* doc );
+    void renderTiles( QPainter* painter, const QRect& rect );
+    const QPixmap* renderTile( int line, int column, int layoutId, qreal devicePixelRatio );
 
     QTimer* caretTimer_;                ///< A timer for updating the carets
 
@@ -76,6 +92,7 @@ private:
 
     TextEditorController* controllerRef_;       ///< A reference to the controller
     TextEditorRenderer* textEditorRenderer_;    /// A text-editor renderer
+    TextEditorTileCache* tileCache_;            ///< The cache with the rendered line strips
 };
 
 } // edbee
@@ -22,10 +22,15 @@ namespace edbee {
 
 static const int ShadowWidth=5;
 
+/// The width of the marker of a removed part of a changed line (the removed part has no width in the line)
+static const int DiffDeleteMarkerWidth=2;
+
 
 TextEditorRenderer::TextEditorRenderer( TextRenderer *renderer )
     : rendererRef_(renderer)
+    , themeRef_(0)
     , shadowGradient_(0)
+    , diffColorsValid_(false)
 {
     shadowGradient_ = new QLinearGradient( 0, 0, ShadowWidth, 0 );
     shadowGradient_ ->setColorAt(0, QColor( 0x00, 0x00, 0x00, 0x99 ));
@@ -43,7 +48,18 @@ int TextEditorRenderer::preferedWidth()
     return renderer()->totalWidth();
 }
 
+/// Renders the editor: the lines and the carets
 void TextEditorRenderer::render(QPainter *painter)
+{
+    renderLines( painter );
+    renderCarets( painter );
+//    renderShade( painter, *renderer()->clipRect() );        /// TODO, deze renderShade moet misschien in de viewport render-code gebreuren
+}
+
+
+/// Renders the background, the selection, the separators and the text of the lines in the clipping rectangle.
+/// The result doesn't depend on the carets, so it can be cached (see TextEditorComponent)
+void TextEditorRenderer::renderLines(QPainter *painter)
 {
     int startLine = renderer()->startLine();
     int endLine   = renderer()->endLine();
@@ -61,67 +77,53 @@ void TextEditorRenderer::render(QPainter *painter)
         renderLineSeparator( painter, line );
         renderLineText( painter, line );
     }
-
-    renderCarets(painter);
-//    renderShade( painter, *renderer()->clipRect() );        /// TODO, deze renderShade moet misschien in de viewport render-code gebreuren
-
 }
 
 
+/// Renders the difference background of the given line. (Nothing is done for lines without differences)
 void TextEditorRenderer::renderLineBackground(QPainter *painter,int line)
 {
+    const QVector<TextLineDiffSpan>& spans = renderer()->textDocument()->lineDiffSpans(line);
+    if( spans.isEmpty() ) { return; }
+
     int lineHeight = renderer()->lineHeight();
-    int viewportWidth = renderer()->viewportWidth();
-	qDebug() << "line background width" << viewportWidth;
-	QColor baseColor = themeRef_->backgroundColor();
-	QColor insertedColor = QColor(baseColor);
-	insertedColor.setGreen(baseColor.green() + 30); // QColor(0, 66, 0);
-	QColor changedColor = baseColor.darker(120);
-	//changedColor.darker(50);
-    //QColor changedColor = QColor(255, 255, 204);
-	QColor deletedColor = QColor(baseColor);
-	deletedColor.setRed(baseColor.red() + 30);
-	QColor editColor = QColor(200, 200, 152);
-	
+    int viewportWidth = renderer()->clipRect()->right() + 1;     // (filled up to the clipping rectangle, the viewport can be cached in tiles)
+    updateDiffColors();
 
-    TextDocument* doc = renderer()->textDocument();
-    //int changeType = doc->getLineStatus(line);
-	auto diffs = doc->getLineDiffs(line);
-    if (diffs.count() > 1) {
-        QColor lineColor;
-        //if (changeType == 1) lineColor = deletedColor;
-        //if (changeType == 2) lineColor = insertedColor;
-        //if (changeType == 3) lineColor = changedColor;
-
-		lineColor = changedColor;
-        QTextLayout* textLayout = renderer()->textLayoutForLine(line);
-        QRectF rect = textLayout->boundingRect();
-        
-        painter->fillRect(0, line*lineHeight + rect.top(), viewportWidth, lineHeight, lineColor );
-
-		int offset = 0;
-		for (int i = 0; i < diffs.count(); ++i)
-		{
-			// add sub-line diffs.
-			auto diff = diffs[i];
-			if (diff.operation != stringdiff::EQUAL)
-			{
-				auto textLine = textLayout->lineAt(0);
-				auto lineCount = textLayout->lineCount();
-				if (textLine.isValid()) {
-					auto startX = textLine.cursorToX(offset);
-					auto endX = textLine.cursorToX(offset + diff.text.length());
-					painter->fillRect(startX, line*lineHeight + rect.top(), endX - startX, lineHeight, editColor);
-				}
-			}
-
-			offset += diff.text.length();
-		}
-
-		
+    QTextLayout* textLayout = renderer()->textLayoutForLine(line);
+    QRectF rect = textLayout->boundingRect();
+    painter->fillRect(0, line*lineHeight + rect.top(), viewportWidth, lineHeight, diffChangedColor_ );
+
+    // the changed parts of the line
+    QTextLine textLine = textLayout->lineAt(0);
+    if( textLine.isValid() ) {
+        for( int i=0, cnt=spans.size(); i<cnt; ++i ) {
+            const TextLineDiffSpan& span = spans.at(i);
+            qreal startX = textLine.cursorToX( span.start );
+            if( span.length == 0 ) {
+                painter->fillRect( QRectF( startX - DiffDeleteMarkerWidth / 2.0, line*lineHeight + rect.top(), DiffDeleteMarkerWidth, lineHeight ), diffDeleteColor_ );
+                continue;
+            }
+            qreal endX = textLine.cursorToX( span.start + span.length );
+            painter->fillRect( QRectF( startX, line*lineHeight + rect.top(), endX - startX, lineHeight ), diffEditColor_ );
+        }
     }
 }
 
+
+/// Updates the difference colors when the background color of the theme is changed
+void TextEditorRenderer::updateDiffColors()
+{
+    QColor baseColor = themeRef_->backgroundColor();
+    if( diffColorsValid_ && baseColor == diffBaseColor_ ) { return; }
+    diffBaseColor_ = baseColor;
+    diffChangedColor_ = baseColor.darker(120);
+    diffEditColor_ = QColor(200, 200, 152);
+    diffDeleteColor_ = QColor(200, 112, 112);
+    diffColorsValid_ = true;
+}
+
+
 void TextEditorRenderer::renderLineSelection(QPainter *painter,int line)
 {
 //PROF_BEGIN_NAMED("render-selection")
@@ -167,14 +169,14 @@ void TextEditorRenderer::renderLineSeparator(QPainter *painter,int line)
     int lineHeight = renderer()->lineHeight();
 //    int viewportX = renderer()->viewportX();
 //    int viewportWidth = renderer()->vie\wportWidth();
-    QRect visibleRect( renderer()->viewport() );
+    const QRect* clipRect = renderer()->clipRect();
 
     if( config->useLineSeparator() ) {
         const QPen& pen = config->lineSeparatorPen();
         painter->setPen( pen );
         int y = (line+1)*lineHeight; // - pen.width();
 //        p.drawLine( viewportX(), y, viewportWidth(), y );
-        painter->drawLine( visibleRect.left(), y, visibleRect.right(), y ); // draw from 0 to allow correct rendering of dotted lines
+        painter->drawLine( 0, y, clipRect->right(), y ); // draw from 0 to allow correct rendering of dotted lines
     }
 //PROF_END
 }
@@ -213,6 +215,7 @@ void TextEditorRenderer::renderCarets(QPainter *painter)
 //PROF_BEGIN_NAMED("render-carets")
 
     if( renderer()->shouldRenderCaret() ) {
+        themeRef_ = renderer()->theme();
         TextDocument* doc= renderer()->textDocument();
         TextRangeSet* sel = renderer()->textSelection();
         painter->setPen( themeRef_->caretColor() );
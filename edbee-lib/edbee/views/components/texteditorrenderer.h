@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <QColor>
+
 class QLinearGradient;
 class QPainter;
 class QRect;
@@ -22,6 +24,7 @@ public:
 
     virtual int preferedWidth();
     virtual void render(QPainter* painter);
+    virtual void renderLines(QPainter* painter);
     virtual void renderLineBackground(QPainter *painter, int line);
     virtual void renderLineSelection(QPainter *painter, int line);
     virtual void renderLineSeparator(QPainter *painter, int line);
@@ -33,11 +36,20 @@ public:
 
     TextRenderer* renderer() { return rendererRef_; }
 
+private:
+    void updateDiffColors();
+
 private:
     TextRenderer* rendererRef_;       ///< the renderere reference
     TextTheme* themeRef_;             ///< A theem reference used while rendering
     QLinearGradient* shadowGradient_; ///< The shadow gradient to draw
 
+    bool diffColorsValid_;            ///< Are the difference colors computed?
+    QColor diffBaseColor_;            ///< The background color the difference colors are computed from
+    QColor diffChangedColor_;         ///< The background of a changed line
+    QColor diffEditColor_;            ///< The background of the changed parts of a line
+    QColor diffDeleteColor_;          ///< The marker of the removed parts of a line
+
 };
 
 } // edbee
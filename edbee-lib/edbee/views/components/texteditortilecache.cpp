@@ -0,0 +1,194 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "texteditortilecache.h"
+
+#include <QList>
+#include <QPair>
+#include <QPixmap>
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Deletes the pixmap of the tile
+TextEditorTileCache::Tile::~Tile()
+{
+    delete pixmap;
+}
+
+
+//=================================================
+
+
+/// Constructs an empty tile cache
+TextEditorTileCache::TextEditorTileCache()
+    : tileCache_( DefaultMaxCost )
+    , columnCount_(0)
+    , themeRef_(0)
+    , lineHeight_(0)
+    , devicePixelRatio_(0)
+{
+}
+
+
+/// The destructor
+TextEditorTileCache::~TextEditorTileCache()
+{
+}
+
+
+/// Clears the cache when the tiles have been rendered with other settings
+/// @param theme the current theme
+/// @param font the current font
+/// @param lineHeight the current line height
+/// @param devicePixelRatio the device pixel ratio of the widget
+void TextEditorTileCache::validate( TextTheme* theme, const QFont& font, int lineHeight, qreal devicePixelRatio )
+{
+    if( theme == themeRef_ && lineHeight == lineHeight_ && devicePixelRatio == devicePixelRatio_ && font == font_ ) { return; }
+    clear();
+    themeRef_ = theme;
+    font_ = font;
+    lineHeight_ = lineHeight;
+    devicePixelRatio_ = devicePixelRatio;
+}
+
+
+/// Returns the given tile
+/// @param line the line of the tile
+/// @param column the column of the tile (the x-position divided by the TileWidth)
+/// @param layoutId the id of the current text layout of the line
+/// @return the pixmap of the tile or 0 if it isn't in the cache or if it's rendered with another layout
+const QPixmap* TextEditorTileCache::tile( int line, int column, int layoutId )
+{
+    Tile* tile = tileCache_.object( tileKey( line, column ) );
+    if( !tile || tile->layoutId != layoutId ) { return 0; }
+    return tile->pixmap;
+}
+
+
+/// Returns true if the cache contains a tile of the given line that is rendered with another layout.
+/// The pixels of this tile on the screen are outdated
+/// @param line the line to check
+/// @param layoutId the id of the current text layout of the line
+bool TextEditorTileCache::hasOutdatedTile( int line, int layoutId )
+{
+    for( int column=0; column<columnCount_; ++column ) {
+        Tile* tile = tileCache_.object( tileKey( line, column ) );
+        if( tile && tile->layoutId != layoutId ) { return true; }
+    }
+    return false;
+}
+
+
+/// Adds the given tile to the cache. An existing tile at this location is replaced
+/// @param line the line of the tile
+/// @param column the column of the tile
+/// @param layoutId the id of the text layout the tile is rendered with
+/// @param pixmap the rendered tile. The ownership is transfered to the cache
+void TextEditorTileCache::giveTile( int line, int column, int layoutId, QPixmap* pixmap )
+{
+    Tile* tile = new Tile();
+    tile->pixmap = pixmap;
+    tile->layoutId = layoutId;
+    tileCache_.insert( tileKey( line, column ), tile, tileCost( tile ) );
+    columnCount_ = qMax( columnCount_, column + 1 );
+}
+
+
+/// Removes all tiles
+void TextEditorTileCache::clear()
+{
+    tileCache_.clear();
+    columnCount_ = 0;
+}
+
+
+/// Removes the tiles of the given lines
+/// @param line the first line
+/// @param lineCount the number of lines
+void TextEditorTileCache::invalidateLines( int line, int lineCount )
+{
+    if( lineCount <= 0 ) { return; }
+
+    // a few lines are removed directly, with a lot of lines it's faster to walk the tiles in the cache
+    if( qint64(lineCount) * columnCount_ <= tileCache_.size() ) {
+        for( int i=0; i<lineCount; ++i ) {
+            for( int column=0; column<columnCount_; ++column ) {
+                tileCache_.remove( tileKey( line + i, column ) );
+            }
+        }
+    } else {
+        foreach( qint64 key, tileCache_.keys() ) {
+            int tileLine = key >> 32;
+            if( line <= tileLine && tileLine < line + lineCount ) { tileCache_.remove( key ); }
+        }
+    }
+}
+
+
+/// Replaces the given lines. The tiles of the replaced lines are removed, the tiles after these lines are moved
+/// to their new line index.
+/// @param line the first line to replace
+/// @param lineCount the number of lines that are replaced
+/// @param newLineCount the number of lines they're replaced with
+void TextEditorTileCache::replaceLines( int line, int lineCount, int newLineCount )
+{
+    int lineDelta = newLineCount - lineCount;
+    if( !lineDelta ) {
+        invalidateLines( line, lineCount );
+        return;
+    }
+
+    // take the tiles after the change (they're inserted again with their new line index)
+    QList< QPair<qint64,Tile*> > movedTileList;
+    foreach( qint64 key, tileCache_.keys() ) {
+        int tileLine = key >> 32;
+        if( tileLine < line ) { continue; }
+        if( tileLine < line + lineCount ) {
+            tileCache_.remove( key );
+        } else {
+            int column = key & 0xffffffff;
+            movedTileList.append( qMakePair( tileKey( tileLine + lineDelta, column ), tileCache_.take( key ) ) );
+        }
+    }
+    for( int i=0, cnt=movedTileList.size(); i<cnt; ++i ) {
+        Tile* tile = movedTileList.at(i).second;
+        tileCache_.insert( movedTileList.at(i).first, tile, tileCost( tile ) );
+    }
+}
+
+
+/// Returns the number of tiles in the cache
+int TextEditorTileCache::tileCount() const
+{
+    return tileCache_.size();
+}
+
+
+/// Sets the maximum size of the cache
+/// @param maxCost the maximum size in KB
+void TextEditorTileCache::setMaxCost( int maxCost )
+{
+    tileCache_.setMaxCost( maxCost );
+}
+
+
+/// Returns the cache key of the given tile
+qint64 TextEditorTileCache::tileKey( int line, int column )
+{
+    return ( qint64(line) << 32 ) | quint32(column);
+}
+
+
+/// Returns the cost of the given tile in the cache (the size in KB)
+int TextEditorTileCache::tileCost( const Tile* tile )
+{
+    return qMax( 1, tile->pixmap->width() * tile->pixmap->height() * tile->pixmap->depth() / 8 / 1024 );
+}
+
+
+} // edbee
@@ -0,0 +1,73 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QCache>
+#include <QFont>
+
+class QPixmap;
+
+namespace edbee {
+
+class TextTheme;
+
+
+/// A cache of rendered line strips for the text editor component.
+///
+/// Every line is split in tiles of TileWidth pixels. A tile is stored with the id of the text layout of its line,
+/// so a tile of a line with a new layout (changed text or formats) isn't used anymore.
+/// Text changes move the tiles after the change to their new line index, so a scroll or a line insert only
+/// requires rendering of the lines that aren't in the cache.
+class TextEditorTileCache
+{
+public:
+    enum {
+        TileWidth = 512,                ///< The width of a tile in pixels
+        DefaultMaxCost = 32*1024        ///< The default maximum size of the cache in KB
+    };
+
+    TextEditorTileCache();
+    virtual ~TextEditorTileCache();
+
+    void validate( TextTheme* theme, const QFont& font, int lineHeight, qreal devicePixelRatio );
+
+    const QPixmap* tile( int line, int column, int layoutId );
+    bool hasOutdatedTile( int line, int layoutId );
+    void giveTile( int line, int column, int layoutId, QPixmap* pixmap );
+
+    void clear();
+    void invalidateLines( int line, int lineCount );
+    void replaceLines( int line, int lineCount, int newLineCount );
+
+    int tileCount() const;
+    void setMaxCost( int maxCost );
+
+private:
+
+    /// A rendered tile
+    struct Tile {
+        Tile() : pixmap(0), layoutId(0) {}
+        ~Tile();
+
+        QPixmap* pixmap;                ///< The rendered pixels of the tile
+        int layoutId;                   ///< The id of the text layout the tile is rendered with
+    };
+
+    static qint64 tileKey( int line, int column );
+    static int tileCost( const Tile* tile );
+
+private:
+    QCache<qint64,Tile> tileCache_;     ///< The tiles by line and column (see tileKey)
+    int columnCount_;                   ///< The maximum number of tile columns of a line in the cache
+
+    TextTheme* themeRef_;               ///< The theme the tiles are rendered with
+    QFont font_;                        ///< The font the tiles are rendered with
+    int lineHeight_;                    ///< The line height of the tiles
+    qreal devicePixelRatio_;            ///< The device pixel ratio of the tiles
+};
+
+
+} // edbee
@@ -226,13 +226,10 @@ void TextMarginComponent::giveDelegate(TextMarginComponentDelegate* delegate)
 void TextMarginComponent::renderLineBackgrounds(QPainter* painter, int startLine, int endLine, int width)
 {
 	TextDocument* doc = renderer()->textDocument();
+	if (doc->lineDiffIndex()->isEmpty()) return;
 	int lineHeight = renderer()->lineHeight();
 	QColor baseColor = renderer()->theme()->backgroundColor();
 
-	QColor insertedColor = QColor(0, 66, 0);
-	QColor changedColor = baseColor.darker(120);
-	QColor deletedColor = QColor(66, 0, 0);
-
 	for (int line = startLine; line <= endLine; ++line) {
 
 		int changeType = doc->getLineStatus(line);
@@ -0,0 +1,100 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textlinewidthindex.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Constructs an empty index
+TextLineWidthIndex::TextLineWidthIndex()
+{
+}
+
+
+/// The destructor
+TextLineWidthIndex::~TextLineWidthIndex()
+{
+}
+
+
+/// Removes all lines
+void TextLineWidthIndex::clear()
+{
+    lineWidthList_.clear();
+    widthCountMap_.clear();
+}
+
+
+/// Replaces the given lines with new lines. The new lines have a width of 0
+/// @param line the first line to replace
+/// @param lineCount the number of lines to remove
+/// @param newLineCount the number of lines to insert
+void TextLineWidthIndex::replaceLines( int line, int lineCount, int newLineCount )
+{
+    Q_ASSERT( 0 <= line && line + lineCount <= lineWidthList_.length() );
+    for( int i=0; i<lineCount; ++i ) {
+        removeWidth( lineWidthList_.at( line + i ) );
+    }
+    lineWidthList_.fill( line, lineCount, 0, newLineCount );
+}
+
+
+/// Sets the width of the given line
+/// @param line the line index
+/// @param width the width of the line in pixels
+void TextLineWidthIndex::setLineWidth( int line, int width )
+{
+    int oldWidth = lineWidthList_.at(line);
+    if( oldWidth == width ) { return; }
+    removeWidth( oldWidth );
+    addWidth( width );
+    lineWidthList_.set( line, width );
+}
+
+
+/// Returns the width of the given line
+int TextLineWidthIndex::lineWidth( int line ) const
+{
+    return lineWidthList_.at(line);
+}
+
+
+/// Returns the number of lines
+int TextLineWidthIndex::lineCount() const
+{
+    return lineWidthList_.length();
+}
+
+
+/// Returns the width of the widest line (0 if there are no lines)
+int TextLineWidthIndex::maxWidth() const
+{
+    if( widthCountMap_.isEmpty() ) { return 0; }
+    return widthCountMap_.lastKey();
+}
+
+
+/// Counts a line with the given width
+void TextLineWidthIndex::addWidth( int width )
+{
+    if( width <= 0 ) { return; }
+    ++widthCountMap_[width];
+}
+
+
+/// Removes a line with the given width from the counts
+void TextLineWidthIndex::removeWidth( int width )
+{
+    if( width <= 0 ) { return; }
+    QMap<int,int>::iterator itr = widthCountMap_.find( width );
+    Q_ASSERT( itr != widthCountMap_.end() );
+    if( --itr.value() == 0 ) { widthCountMap_.erase( itr ); }
+}
+
+
+} // edbee
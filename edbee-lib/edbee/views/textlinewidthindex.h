@@ -0,0 +1,43 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include <QMap>
+
+#include "edbee/util/gapvector.h"
+
+namespace edbee {
+
+
+/// Keeps the widths of all lines of a document and tracks the maximum width.
+///
+/// The widths are stored in a gap vector, so inserting and removing lines near the previous change is cheap.
+/// The number of lines per width is kept in a sorted map, so the maximum width is available in O(log n).
+class TextLineWidthIndex
+{
+public:
+    TextLineWidthIndex();
+    virtual ~TextLineWidthIndex();
+
+    void clear();
+    void replaceLines( int line, int lineCount, int newLineCount );
+    void setLineWidth( int line, int width );
+
+    int lineWidth( int line ) const;
+    int lineCount() const;
+    int maxWidth() const;
+
+private:
+    void addWidth( int width );
+    void removeWidth( int width );
+
+private:
+    GapVector<int> lineWidthList_;          ///< The width of every line
+    QMap<int,int> widthCountMap_;           ///< The number of lines per width (lines without a width aren't counted)
+};
+
+
+} // edbee
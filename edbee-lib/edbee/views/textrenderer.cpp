@@ -6,13 +6,18 @@
 #include "textrenderer.h"
 
 #include <QDateTime>
+#include <QFontInfo>
+#include <QFontMetricsF>
 #include <QRect>
 #include <QPainter>
+#include <QPair>
 #include <QTextLayout>
+#include <qmath.h>
 
 #include "util/simpleprofiler.h"
 
 #include "edbee/models/textdocument.h"
+#include "edbee/models/textdocumentscopes.h"
 #include "edbee/models/texteditorconfig.h"
 #include "edbee/models/textlexer.h"
 #include "edbee/views/textselection.h"
@@ -35,7 +40,10 @@ TextRenderer::TextRenderer(TextEditorController* controller)
     , controllerRef_(controller)
     , caretTime_(0)
     , caretBlinkRate_(0)
-    , totalWidthCache_(0)
+    , lastTextLayoutId_(0)
+    , lineWidthCharWidth_(0)
+    , lineWidthTabStop_(0)
+    , fixedPitchCharWidth_(-1)
     , textThemeStyler_(0)
     , clipRectRef_(0)
 {
@@ -64,7 +72,8 @@ void TextRenderer::init()
 /// This method resets all caching information
 void TextRenderer::reset()
 {
-    totalWidthCache_ = 0;
+    lineWidthIndex_.clear();
+    fixedPitchCharWidth_ = -1;
     cachedTextLayoutList_.clear();
 }
 
@@ -98,34 +107,13 @@ int TextRenderer::lineIndexForYpos(int y)
 }
 
 
-/// Returns the total width of the editor. This method is NOT the real with
-/// This method takes the maximum line length and multiplies it with the widest character.
+/// Returns the total width of the editor. This is the width of the widest line.
+/// The widths of the lines are estimated with the number of characters. The estimate is replaced with the measured
+/// width when the layout of the line is created, so the result is the real width of the lines that have been layed out
 int TextRenderer::totalWidth()
 {
-    if( !totalWidthCache_ ) {
-        for( int line=0,cnt=textDocument()->lineCount(); line<cnt; ++line ) {
-            QTextLayout* layout = textLayoutForLine( line );
-            totalWidthCache_ = qMax( qRound(layout->boundingRect().right()+0.5), totalWidthCache_ );
-        }
-
-    }
-    return totalWidthCache_;
-
-    /* maxWidth returns 0 on Mac
-    if( !totalWidthCache_ ) {
-        TextDocument* doc =textDocument();
-        int maxChars = 0;
-        for( int line=0,cnt=doc->lineCount(); line<cnt; ++line ) {
-            maxChars = qMax( doc->lineLength(line), maxChars );
-        }
-
-        QFontMetrics fm = QtextWidget()->fontMetrics();
-        qlog_info() << "FontMetrics: " << fm.averageCharWidth();
-        qlog_info() << "Maximum width:" << maxChars << " * " << fm.maxWidth() << " :: " << (fm.maxWidth() * maxChars);
-        ttoalWidthCache_ = fm.maxWidth() * maxChars;
-    }
-    return totalWidthCache_;
-    */
+    ensureLineWidthIndex();
+    return lineWidthIndex_.maxWidth();
 }
 
 
@@ -166,9 +154,76 @@ int TextRenderer::firstVisibleLine()
 }
 
 
+/// Calculates the character width of the fixed pitch fast path for the given font
+/// All printable ascii characters should have the same width (also in bold and italic, the theme can use these)
+/// and the font shouldn't kern.
+/// @return the character width or 0 if the font can't be used for the fast path
+static qreal calculateFixedPitchCharWidth( const QFont& font )
+{
+    if( !QFontInfo(font).fixedPitch() ) { return 0; }
+    qreal charWidth = QFontMetricsF(font).width( QLatin1Char('M') );
+    if( charWidth <= 0 ) { return 0; }
+
+    for( int variant=0; variant<4; ++variant ) {
+        QFont variantFont( font );
+        variantFont.setBold( variant & 1 );
+        variantFont.setItalic( variant & 2 );
+        QFontMetricsF fm( variantFont );
+        for( int c=0x20; c<0x7f; ++c ) {
+            if( fm.width( QLatin1Char(c) ) != charWidth ) { return 0; }
+        }
+        QString kerningPairs("AVAWTaToLTWAYaFrPy");
+        if( fm.width( kerningPairs ) != kerningPairs.length() * charWidth ) { return 0; }
+    }
+    return charWidth;
+}
+
+
+/// Returns the character width when the geometry of the lines can be calculated without a text layout.
+///
+/// This fixed pitch fast path is possible when the printable ascii characters of the font all have the same width.
+/// Only lines with printable ascii characters and tabs use the fast path, the results are identical to the results
+/// of the text layout. (The fast path isn't used when the whitespace is shown)
+///
+/// @return the character width or 0 if text layouts are required
+qreal TextRenderer::fixedPitchCharWidth()
+{
+    if( config()->showWhitespaceMode() == TextEditorConfig::ShowWhitespaces ) { return 0; }
+    QFont font = textWidget()->font();
+    if( fixedPitchCharWidth_ < 0 || font != fixedPitchFont_ ) {
+        fixedPitchFont_ = font;
+        fixedPitchCharWidth_ = calculateFixedPitchCharWidth( font );
+    }
+    return fixedPitchCharWidth_;
+}
+
+
 /// This method returns the (closet) valid column for the given x-position
 int TextRenderer::columnIndexForXpos(int line, int x )
 {
+    // the fixed pitch fast path (the nearest character edge, on a tie the first edge)
+    // Trailing whitespace isn't part of the text width of a layout, these lines use the layout.
+    qreal charWidth = fixedPitchCharWidth();
+    if( charWidth > 0 && line >= 0 && line < textDocument()->lineCount() ) {
+        QString text = textDocument()->lineWithoutNewline(line);
+        if( text.isEmpty() || !text.at( text.length()-1 ).isSpace() ) {
+            int result = 0;
+            qreal pos = 0;
+            qreal distance = qAbs( x - pos );
+            int i = 0;
+            for( int cnt=text.length(); i<cnt; ++i ) {
+                qreal advance = fixedPitchAdvance( text.at(i), pos, charWidth );
+                if( advance < 0 ) { break; }
+                pos += advance;
+                if( qAbs( x - pos ) < distance ) {
+                    distance = qAbs( x - pos );
+                    result = i+1;
+                }
+            }
+            if( i == text.length() ) { return result; }
+        }
+    }
+
     QTextLayout* layout = textLayoutForLine( line );
     if(!layout) return 0;
 
@@ -182,6 +237,24 @@ int TextRenderer::columnIndexForXpos(int line, int x )
 /// This method returns the x position for the given column
 int TextRenderer::xPosForColumn(int line, int column)
 {
+    // the fixed pitch fast path (all characters of the line should be supported, other characters can change the layout)
+    qreal charWidth = fixedPitchCharWidth();
+    if( charWidth > 0 && line >= 0 && line < textDocument()->lineCount() ) {
+        QString text = textDocument()->lineWithoutNewline(line);
+        int end = qBound( 0, column, text.length() );
+        qreal pos = 0;
+        bool supported = true;
+        for( int i=0, cnt=text.length(); supported && i<cnt; ++i ) {
+            qreal advance = fixedPitchAdvance( text.at(i), pos, charWidth );
+            if( advance < 0 ) {
+                supported = false;
+            } else if( i < end ) {
+                pos += advance;
+            }
+        }
+        if( supported ) { return pos; }
+    }
+
     QTextLayout* layout = textLayoutForLine( line );
     int x = 0;// sideBarLeftWidth();
     if(layout) {
@@ -224,21 +297,38 @@ int TextRenderer::yPosForOffset(int offset)
 
 
 /// This method returns the textlayout for the given line
+///
+/// The layouts are cached by line index. The text changes keep this cache up-to-date (see textChanged), the formats
+/// are validated with the scoped range list of the line. A line with a new scoped range list only gets a new layout
+/// when its format ranges are really changed.
 QTextLayout *TextRenderer::textLayoutForLine(int line)
 {
     Q_ASSERT( line >= 0 );
-/// FIXME:  Invalide TextLayout cache when required!!!
 
     TextDocument* doc = textDocument();
     if( line >= doc->lineCount() ) return 0;
-    QTextLayout* textLayout = cachedTextLayoutList_.object(line);
+
+    ScopedTextRangeList* scopedRanges = doc->scopes()->scopedRangesAtLine(line);
+    qint64 scopedRangeListId = scopedRanges ? scopedRanges->id() : 0;
+
+    // a cached layout is valid when the scopes of the line haven't changed (or result in the same formats)
+    CachedTextLayout* cachedLayout = cachedTextLayoutList_.object(line);
+    if( cachedLayout && cachedLayout->scopedRangeListId != scopedRangeListId ) {
+        if( equalFormatRanges( cachedLayout->layout->additionalFormats(), themeStyler()->getLineFormatRanges( line ) ) ) {
+            cachedLayout->scopedRangeListId = scopedRangeListId;
+        } else {
+            cachedTextLayoutList_.remove(line);
+            cachedLayout = 0;
+        }
+    }
+
+    QTextLayout* textLayout = cachedLayout ? cachedLayout->layout : 0;
     if( !textLayout ) {
         textLayout = new QTextLayout();
         textLayout->setCacheEnabled(true);
-        int tabWidth = controllerRef_->widget()->fontMetrics().charWidth("M",0);
 
         QTextOption option;
-        option.setTabStop( config()->indentSize() * tabWidth );
+        option.setTabStop( tabStopWidth() );
 
         if( config()->showWhitespaceMode() == TextEditorConfig::ShowWhitespaces ) {
             option.setFlags( QTextOption::ShowTabsAndSpaces );        /// TODO: Make an option to show spaces and tabs
@@ -278,20 +368,37 @@ QTextLayout *TextRenderer::textLayoutForLine(int line)
         Q_UNUSED(textline);
         textLayout->endLayout();
 
-        // update the width cache
-        totalWidthCache_ = qMax( totalWidthCache_, qRound(textLayout->boundingRect().width()+0.5));
-
         // add to the cache
-        cachedTextLayoutList_.insert( line, textLayout );
+        cachedLayout = new CachedTextLayout();
+        cachedLayout->layout = textLayout;
+        cachedLayout->id = ++lastTextLayoutId_;
+        cachedLayout->scopedRangeListId = scopedRangeListId;
+        cachedTextLayoutList_.insert( line, cachedLayout );
 
 //qlog_info() << "Cache Line: " << line;
 
+        // replace the estimated width of the line with the real width (when the index is rebuilt later, the width is measured again)
+        int width = measuredLineWidth( textLayout );
+        if( width >= 0 && lineWidthIndex_.lineCount() == doc->lineCount() ) {
+            lineWidthIndex_.setLineWidth( line, width );
+        }
     }
-
     return textLayout;
 }
 
 
+/// Returns the id of the text layout of the given line.
+/// The layout of a line gets a new id when it is rebuilt (because the text or the formats of the line are changed),
+/// so the id can be used to validate things that are derived from the layout
+/// @param line the line to retrieve the layout id for
+/// @return the id of the layout or 0 if the line doesn't exist
+int TextRenderer::textLayoutIdForLine( int line )
+{
+    if( !textLayoutForLine( line ) ) { return 0; }
+    return cachedTextLayoutList_.object(line)->id;
+}
+
+
 /// This method starts rendering
 void TextRenderer::renderBegin( const QRect& rect )
 {    
@@ -380,7 +487,6 @@ TextEditorWidget *TextRenderer::textWidget()
 /// Sets the current viewport of the renderer
 void TextRenderer::setViewport(const QRect& viewport)
 {
-	qDebug() << "Viewport set to" << viewport_.width();
     viewport_ = viewport;
 }
 
@@ -433,9 +539,12 @@ TextTheme* TextRenderer::theme()
 
 
 /// Selects the active theme name
+/// The cached layouts contain the formats of the old theme, these are invalidated when the theme changes
 void TextRenderer::setThemeByName(const QString& name)
 {
+    TextTheme* oldTheme = theme();
     textThemeStyler_->setThemeByName(name);
+    if( theme() != oldTheme ) { invalidateTextLayoutCaches(0); }
 }
 
 
@@ -443,7 +552,9 @@ void TextRenderer::setThemeByName(const QString& name)
 /// @param theme the them to set
 void TextRenderer::setTheme(TextTheme* theme)
 {
+    TextTheme* oldTheme = this->theme();
     textThemeStyler_->setTheme( theme );
+    if( this->theme() != oldTheme ) { invalidateTextLayoutCaches(0); }
 }
 
 
@@ -458,41 +569,49 @@ void TextRenderer::textDocumentChanged(edbee::TextDocument *oldDocument, edbee::
 
     // connect with the new dpcument
     connect( newDocument, SIGNAL(textChanged(edbee::TextBufferChange)), this, SLOT(textChanged(edbee::TextBufferChange)));
-    connect( newDocument, SIGNAL(lastScopedOffsetChanged(int,int)), this, SLOT(lastScopedOffsetChanged(int,int)) );
 }
 
 
 /// The text is replaced
+/// The layouts of the changed lines are removed. The layouts after the change are moved to their new line index,
+/// so inserting or removing lines doesn't invalidate the layouts of the lines below it.
 void TextRenderer::textChanged(edbee::TextBufferChange change)
 {
-    int lineCount = qMax( change.lineCount(), change.newLineCount()) + 1;
+    int firstLine = change.line();
+    int lastChangedLine = change.line() + change.lineCount();
+    int lineDelta = change.newLineCount() - change.lineCount();
 
-    // Unfortunately when the line-count is changed we need to invalidate all
-    // because we cannot move the cached layouts easy in the layout list
-    if( change.lineCount() - change.newLineCount() ) {
-        cachedTextLayoutList_.clear();
+    // update the widths of the changed lines (when the index isn't built, it's built when it's required)
+    if( lineWidthIndex_.lineCount() && lineWidthIndex_.lineCount() + lineDelta == textDocument()->lineCount() ) {
+        lineWidthIndex_.replaceLines( firstLine, change.lineCount() + 1, change.newLineCount() + 1 );
+        for( int line=firstLine, lastLine=firstLine+change.newLineCount(); line <= lastLine; ++line ) {
+            lineWidthIndex_.setLineWidth( line, estimateLineWidth( line ) );
+        }
     } else {
+        lineWidthIndex_.clear();
+    }
 
-        // invalidate all if there are to many lines
-        if( lineCount > cachedTextLayoutList_.size()/2 ) {
-            cachedTextLayoutList_.clear();
-        } else {
-            for( int i=0,cnt=lineCount; i<cnt; ++i ) {
-                cachedTextLayoutList_.remove( change.line() + i );
-            }
+    // without a change in the number of lines, only the changed lines are removed
+    if( !lineDelta ) {
+        for( int line=firstLine; line <= lastChangedLine; ++line ) {
+            cachedTextLayoutList_.remove( line );
         }
+        return;
     }
-}
 
-
-/// The scoped to offset has been changed
-void TextRenderer::lastScopedOffsetChanged(int previousOffset, int newOffset)
-{
-//qlog_info() << "** lastScopedOffsetChanged("<<previousOffset<<","<<newOffset<<") **";
-    Q_UNUSED(newOffset);
-    int lastValidLine = textDocument()->lineFromOffset(previousOffset);
-    invalidateTextLayoutCaches( lastValidLine );
-        //    textWidget()->fullUpdate();
+    // take the layouts after the change (they're inserted again with their new line index)
+    QList< QPair<int,CachedTextLayout*> > movedLayoutList;
+    foreach( int line, cachedTextLayoutList_.keys() ) {
+        if( line < firstLine ) { continue; }
+        if( line <= lastChangedLine ) {
+            cachedTextLayoutList_.remove( line );
+        } else {
+            movedLayoutList.append( qMakePair( line + lineDelta, cachedTextLayoutList_.take( line ) ) );
+        }
+    }
+    for( int i=0, cnt=movedLayoutList.size(); i<cnt; ++i ) {
+        cachedTextLayoutList_.insert( movedLayoutList.at(i).first, movedLayoutList.at(i).second );
+    }
 }
 
 
@@ -513,11 +632,106 @@ void TextRenderer::invalidateTextLayoutCaches(int fromLine)
 }
 
 
+/// Makes sure the line width index contains all lines of the document.
+/// All widths are estimated again when the font or the tab stops are changed. (The lines with a cached layout get their measured width)
+void TextRenderer::ensureLineWidthIndex()
+{
+    TextDocument* doc = textDocument();
+    QFont font = textWidget()->font();
+    int tabStop = tabStopWidth();
+    if( lineWidthIndex_.lineCount() == doc->lineCount() && font == lineWidthFont_ && tabStop == lineWidthTabStop_ ) { return; }
+
+    lineWidthFont_ = font;
+    lineWidthTabStop_ = tabStop;
+    lineWidthCharWidth_ = fixedPitchCharWidth();
+    if( lineWidthCharWidth_ <= 0 ) { lineWidthCharWidth_ = emWidth(); }
+    lineWidthIndex_.clear();
+    lineWidthIndex_.replaceLines( 0, 0, doc->lineCount() );
+    for( int line=0, cnt=doc->lineCount(); line<cnt; ++line ) {
+        lineWidthIndex_.setLineWidth( line, estimateLineWidth( line ) );
+    }
+    foreach( int line, cachedTextLayoutList_.keys() ) {
+        int width = line < doc->lineCount() ? measuredLineWidth( cachedTextLayoutList_.object(line)->layout ) : -1;
+        if( width >= 0 ) { lineWidthIndex_.setLineWidth( line, width ); }
+    }
+}
+
+
+/// Estimates the width of the given line with the number of characters.
+/// For a fixed pitch font this is the real width, for other fonts the em-width is used for every character.
+/// @param line the line to estimate
+/// @return the estimated width in pixels
+int TextRenderer::estimateLineWidth( int line )
+{
+    qreal tabStop = lineWidthTabStop_;
+    TextDocument* doc = textDocument();
+    qreal x = 0;
+    for( int offset=doc->offsetFromLine(line), end=offset+doc->lineLengthWithoutNewline(line); offset < end; ++offset ) {
+        if( doc->charAt(offset) == '\t' && tabStop > 0 ) {
+            x = ( qFloor( x / tabStop ) + 1 ) * tabStop;
+        } else {
+            x += lineWidthCharWidth_;
+        }
+    }
+    return qCeil(x);
+}
+
+
+/// Returns the measured width of the given layout for the line width index
+/// @param layout the layout of the line
+/// @return the width in pixels or -1 if the layout wasn't created with the font and tab stops of the index
+int TextRenderer::measuredLineWidth( QTextLayout* layout )
+{
+    if( layout->font() != lineWidthFont_ || layout->textOption().tabStop() != lineWidthTabStop_ ) { return -1; }
+    return qRound( layout->boundingRect().width() + 0.5 );
+}
+
+
+/// Returns the distance between the tab stops in pixels
+int TextRenderer::tabStopWidth()
+{
+    int tabWidth = controllerRef_->widget()->fontMetrics().charWidth("M",0);
+    return config()->indentSize() * tabWidth;
+}
+
+
+/// Returns the advance of the given character for the fixed pitch fast path
+/// A tab advances to the next tab stop (like QTextEngine does this)
+/// @param c the character
+/// @param x the x position of the character
+/// @param charWidth the fixed pitch character width
+/// @return the advance or -1 if the character requires a text layout
+qreal TextRenderer::fixedPitchAdvance( QChar c, qreal x, qreal charWidth )
+{
+    ushort code = c.unicode();
+    if( 0x20 <= code && code < 0x7f ) { return charWidth; }
+    if( code == '\t' ) {
+        qreal tabStop = tabStopWidth();
+        if( tabStop <= 0 ) { return -1; }
+        return ( qFloor( x / tabStop ) + 1 ) * tabStop - x;
+    }
+    return -1;
+}
+
+
+/// Returns true if both lists contain the same format ranges
+bool TextRenderer::equalFormatRanges( const QList<QTextLayout::FormatRange>& ranges1, const QList<QTextLayout::FormatRange>& ranges2 )
+{
+    if( ranges1.size() != ranges2.size() ) { return false; }
+    for( int i=0, cnt=ranges1.size(); i<cnt; ++i ) {
+        const QTextLayout::FormatRange& range1 = ranges1.at(i);
+        const QTextLayout::FormatRange& range2 = ranges2.at(i);
+        if( range1.start != range2.start || range1.length != range2.length || range1.format != range2.format ) { return false; }
+    }
+    return true;
+}
+
+
 /// call this method to invalidate all caches!
 void TextRenderer::invalidateCaches()
 {
 //qlog_info() << "** invalidateCaches() **";
-    totalWidthCache_ = 0;
+    fixedPitchCharWidth_ = -1;
     cachedTextLayoutList_.clear();
 }
 
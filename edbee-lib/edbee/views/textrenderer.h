@@ -6,16 +6,17 @@
 #pragma once
 
 #include <QCache>
+#include <QFont>
 #include <QObject>
 #include <QHash>
 #include <QRect>
-
+#include <QTextLayout>
 
 #include "edbee/models/textbuffer.h"
+#include "edbee/views/textlinewidthindex.h"
 
 class QPainter;
 class QRect;
-class QTextLayout;
 
 
 namespace edbee {
@@ -54,12 +55,14 @@ public:
 
     int columnIndexForXpos( int line, int x );
     int xPosForColumn( int line, int column );
+    qreal fixedPitchCharWidth();
     int xPosForOffset( int offset );
     int yPosForLine( int line );
     int yPosForOffset( int offset );
 
 // caching
     QTextLayout* textLayoutForLine( int line );
+    int textLayoutIdForLine( int line );
 
 // rendering
     void renderBegin(const QRect& rect );
@@ -102,15 +105,30 @@ public:
     int endLine() { return endLine_; }                              ///< This method is valid only while rendering!
 
 private:
-    void updateWidthCacheForRange( int offset, int length );
+    void ensureLineWidthIndex();
+    int estimateLineWidth( int line );
+    int measuredLineWidth( QTextLayout* layout );
+
+    /// A cached layout of a line
+    struct CachedTextLayout {
+        CachedTextLayout() : layout(0), id(0), scopedRangeListId(0) {}
+        ~CachedTextLayout() { delete layout; }
+
+        QTextLayout* layout;            ///< The layout of the line
+        int id;                         ///< The unique id of this layout
+        qint64 scopedRangeListId;       ///< The id of the scoped range list the formats are based on (0 for none)
+    };
+
+    static bool equalFormatRanges( const QList<QTextLayout::FormatRange>& ranges1, const QList<QTextLayout::FormatRange>& ranges2 );
+
+    int tabStopWidth();
+    qreal fixedPitchAdvance( QChar c, qreal x, qreal charWidth );
 
 protected slots:
 
     void textDocumentChanged( edbee::TextDocument* oldDocument, edbee::TextDocument* newDocument );
     void textChanged( edbee::TextBufferChange change );
 
-    void lastScopedOffsetChanged( int previousOffset, int newOffset );
-
 public slots:
 
     void invalidateTextLayoutCaches(int fromLine=0);
@@ -122,10 +140,16 @@ private:
     qint64 caretTime_;                      ///< The current time of the caret. -1 means that the caret is disabled
     qint64 caretBlinkRate_;                 ///< The caret blink rate
 
-    QCache<int,QTextLayout> cachedTextLayoutList_;  ///< A list of cached text layouts
+    QCache<int,CachedTextLayout> cachedTextLayoutList_;  ///< The cached text layouts by line index
+    int lastTextLayoutId_;                                ///< The id of the last created text layout
 
     QRect viewport_;                                ///< The current (total) viewport. (This is updated from the window)
-    int totalWidthCache_;                           ///< The total width cache
+    TextLineWidthIndex lineWidthIndex_;             ///< The (estimated) widths of all lines, for the total width
+    QFont lineWidthFont_;                           ///< The font the line widths are calculated for
+    qreal lineWidthCharWidth_;                      ///< The character width used for estimating the line widths
+    int lineWidthTabStop_;                          ///< The tab stop width the line widths are calculated for
+    qreal fixedPitchCharWidth_;                     ///< The character width of the fixed pitch fast path (0 if the font doesn't allow it, -1 if unknown)
+    QFont fixedPitchFont_;                          ///< The font the fixed pitch character width is calculated for
 
     TextThemeStyler* textThemeStyler_;              ///< The current theme styler
 
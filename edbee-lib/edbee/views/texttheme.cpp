@@ -9,9 +9,13 @@
 #include <QDateTime>
 #include <QDir>
 #include <QPalette>
+#include <QRunnable>
 #include <QStack>
+#include <QThread>
+#include <QThreadPool>
 #include <QVector>
 
+#include "edbee/io/tmbinarycache.h"
 #include "edbee/io/tmthemeparser.h"
 #include "edbee/models/textbuffer.h"
 #include "edbee/models/textdocument.h"
@@ -67,6 +71,8 @@ TextTheme::TextTheme()
     , foregroundColor_( 0xff222222 )
     , lineHighlightColor_(0xff999999 )
     , selectionColor_( 0xff9999ff)
+    , selectorMatcher_(0)
+    , lineFormatCache_( LineFormatCacheCost )
 
     // thTheme settings
 //    , backgroundColor_(0xff272822)
@@ -96,6 +102,7 @@ TextTheme::TextTheme()
 
 TextTheme::~TextTheme()
 {
+    delete selectorMatcher_;
     qDeleteAll(themeRules_);
 }
 
@@ -103,19 +110,77 @@ TextTheme::~TextTheme()
 void TextTheme::giveThemeRule(TextThemeRule* rule)
 {
     themeRules_.append(rule);
+    delete selectorMatcher_;
+    selectorMatcher_ = 0;
+    clearFormatCache();
 }
 
+
+/// Fills the format with all rules that match the given scope list. (The rules are applied in order, so later rules override earlier rules)
+/// The selectors of the rules are compiled into a single matcher, so the scope list isn't matched with every rule separately
 void TextTheme::fillFormatForTextScopeList( const TextScopeList* scopeList, QTextCharFormat* format)
 {
 //    format->setForeground( foregroundColor() );
 //    format->setBackground( backgroundColor() );
 
-    foreach( TextThemeRule* rule, themeRules_ ) {
-        if( rule->matchesScopeList( scopeList ) ) {
-            rule->fillFormat(format);
+    if( !selectorMatcher_ ) {
+        selectorMatcher_ = new TextScopeSelectorMatcher();
+        foreach( TextThemeRule* rule, themeRules_ ) {
+            selectorMatcher_->addSelector( rule->scopeSelector() );
         }
     }
 
+    QVector<int> ruleIndices;
+    selectorMatcher_->findMatches( scopeList, ruleIndices );
+    foreach( int ruleIndex, ruleIndices ) {
+        themeRules_.at(ruleIndex)->fillFormat(format);
+    }
+}
+
+
+/// Returns the format for the given scope stack. The format only depends on the scopes of the stack, so it's
+/// resolved once per stack id and cached. (Evaluating all rule selectors for every format range is expensive)
+/// @param stackId the id of the scope stack (see TextScopeManager::findOrRegisterScopeStack)
+/// @param activeRanges the ranges that form the stack, these are only used when the format isn't cached yet
+/// @return the character format
+QTextCharFormat TextTheme::formatForScopeStack( int stackId, QVector<ScopedTextRange*>& activeRanges )
+{
+    QHash<int,QTextCharFormat>::const_iterator itr = formatCache_.constFind( stackId );
+    if( itr != formatCache_.constEnd() ) { return itr.value(); }
+
+    QTextCharFormat format;
+    TextScopeList scopeList(activeRanges);
+    fillFormatForTextScopeList( &scopeList, &format );
+    formatCache_.insert( stackId, format );
+    return format;
+}
+
+
+/// Clears the cached formats. This is required when the rules change
+void TextTheme::clearFormatCache()
+{
+    formatCache_.clear();
+    lineFormatCache_.clear();
+}
+
+
+/// Returns the cached format ranges of a line
+/// The format ranges are shared by all controllers and documents that use this theme. A line is identified by its
+/// scoped range list. Relexing a line gives it a new list, so the cached ranges of the old list are never used again.
+/// @param scopedRangeListId the id of the scoped range list of the line (see ScopedTextRangeList::id)
+/// @return the format ranges or 0 if they aren't cached. The pointer is only valid until the next insert
+const QList<QTextLayout::FormatRange>* TextTheme::findLineFormatRanges( qint64 scopedRangeListId )
+{
+    return lineFormatCache_.object( scopedRangeListId );
+}
+
+
+/// Caches the format ranges of a line
+/// @param scopedRangeListId the id of the scoped range list of the line
+/// @param formatRangeList the format ranges of the line
+void TextTheme::insertLineFormatRanges( qint64 scopedRangeListId, const QList<QTextLayout::FormatRange>& formatRangeList )
+{
+    lineFormatCache_.insert( scopedRangeListId, new QList<QTextLayout::FormatRange>( formatRangeList ), formatRangeList.size() + 1 );
 }
 
 
@@ -140,23 +205,25 @@ TextThemeStyler::~TextThemeStyler()
 }
 
 
-/// This method returns a reference to the given line format.
-/// WARNING this reference is ONLY valid very shortly.. Another call to this
-/// method can invalidates the previous result!!!
+/// This method returns the format ranges of the given line.
+/// The format ranges are cached by the theme, per scoped range list. A relexed line gets a new list, so the cache
+/// never needs to be invalidated and it's shared by all controllers that use the same theme.
 ///
 /// @param lineIdx the line index
 /// @return the array of ranges
 QList<QTextLayout::FormatRange> TextThemeStyler::getLineFormatRanges( int lineIdx )
 {
     TextDocumentScopes* scopes = controller()->textDocument()->scopes();
-
-    // check if the range is in the case. When it is, use it
     QList<QTextLayout::FormatRange> formatRangeList;
 
     // get all textranges on the given line
     ScopedTextRangeList* scopedRanges = scopes->scopedRangesAtLine(lineIdx);
     if( scopedRanges == 0 || scopedRanges->size() == 0 ) { return formatRangeList; }
 
+    // check if the range is in the cache. When it is, use it
+    const QList<QTextLayout::FormatRange>* cachedFormatRangeList = theme()->findLineFormatRanges( scopedRanges->id() );
+    if( cachedFormatRangeList ) { return *cachedFormatRangeList; }
+
 
     // build format ranges from these (nested) scope ranges
     //
@@ -166,8 +233,12 @@ QList<QTextLayout::FormatRange> TextThemeStyler::getLineFormatRanges( int lineId
     // =
     //  [ ][xx][#########][xxxx][ ][kkkkkkk][  ]
     //
+    // the ids of the scope stacks are tracked with the active ranges, they are the keys of the cached theme formats
+    TextScopeManager* scopeManager = Edbee::instance()->scopeManager();
     QStack<ScopedTextRange*> activeRanges;
+    QStack<int> stackIds;
     activeRanges.append( scopedRanges->at(0) );
+    stackIds.append( scopeManager->findOrRegisterScopeStack( 0, scopedRanges->at(0)->scope() ) );
 
     int lastOffset = 0; //lineStartOffset;
     for( int i=1, cnt=scopedRanges->size(); i<cnt; ++i ) {
@@ -181,8 +252,9 @@ QList<QTextLayout::FormatRange> TextThemeStyler::getLineFormatRanges( int lineId
 
             // when the 'min' is behind the end of the textrange on the stack we need to pop the stack
             if( activeRangeMax <= min ) {
-                appendFormatRange( formatRangeList, lastOffset, activeRangeMax-1, activeRanges );
+                appendFormatRange( formatRangeList, lastOffset, activeRangeMax-1, activeRanges, stackIds.top() );
                 activeRanges.pop();
+                stackIds.pop();
                 lastOffset = activeRangeMax;
                 Q_ASSERT( !activeRanges.empty() );
             } else {
@@ -192,12 +264,13 @@ QList<QTextLayout::FormatRange> TextThemeStyler::getLineFormatRanges( int lineId
 
         // add a new 'range' if a new one is started and there's a 'gap'
         if( lastOffset < min ) {
-            appendFormatRange( formatRangeList, lastOffset, min-1, activeRanges );
+            appendFormatRange( formatRangeList, lastOffset, min-1, activeRanges, stackIds.top() );
             lastOffset = min;
         }
 
         // push the new range to the stack
         activeRanges.push_back( range );
+        stackIds.push_back( scopeManager->findOrRegisterScopeStack( stackIds.top(), range->scope() ) );
 
     }
 
@@ -206,12 +279,14 @@ QList<QTextLayout::FormatRange> TextThemeStyler::getLineFormatRanges( int lineId
         ScopedTextRange* activeRange = activeRanges.last();
         int activeRangeMax = activeRange->max();
         if( lastOffset < activeRange->max() ) {
-            appendFormatRange(formatRangeList, lastOffset, activeRangeMax-1, activeRanges );
+            appendFormatRange(formatRangeList, lastOffset, activeRangeMax-1, activeRanges, stackIds.top() );
             lastOffset = activeRange->max();
         }
         activeRanges.pop();
+        stackIds.pop();
     }
 
+    theme()->insertLineFormatRanges( scopedRanges->id(), formatRangeList );
     return formatRangeList;
 }
 
@@ -263,27 +338,16 @@ TextTheme* TextThemeStyler::theme() const
 
 
 
-/// This method returns the character format for the given text scope
-QTextCharFormat TextThemeStyler::getTextScopeFormat( QVector<ScopedTextRange*>& activeRanges )
-{
-//    ScopedTextRange* range = activeRanges.last();
-    QTextCharFormat format;
-
-    TextScopeList scopeList(activeRanges);
-    theme()->fillFormatForTextScopeList( &scopeList, &format );
-    return format;
-}
-
-
 /// helper function to create a format range
-void TextThemeStyler::appendFormatRange(QList<QTextLayout::FormatRange> &rangeList, int start, int end,  QVector<ScopedTextRange*>& activeRanges )
+/// @param stackId the scope stack id of the active ranges
+void TextThemeStyler::appendFormatRange(QList<QTextLayout::FormatRange> &rangeList, int start, int end,  QVector<ScopedTextRange*>& activeRanges, int stackId )
 {
     // only append a format if the lexer style is different then default
     if( activeRanges.size() > 1  ) {
         QTextLayout::FormatRange formatRange;
         formatRange.start  = start;
         formatRange.length = end - start + 1;
-        formatRange.format = getTextScopeFormat( activeRanges );
+        formatRange.format = theme()->formatForScopeStack( stackId, activeRanges );
         rangeList.append( formatRange );
     }
 }
@@ -294,13 +358,100 @@ void TextThemeStyler::textDocumentChanged(edbee::TextDocument *oldDocument, edbe
     Q_UNUSED(oldDocument);
 }
 
-/// invalidates all layouts
-void TextThemeStyler::invalidateLayouts()
+
+//=================================================
+
+
+/// Reads a theme file. A valid entry in the binary cache is used instead of parsing the file.
+/// This function doesn't touch the theme manager, so it can be called from a worker thread
+/// @param fileName the theme file to read
+/// @param cachePath the binary cache path (empty for no cache)
+/// @param errorMessage (out) the error message when the theme couldn't be read
+/// @return the theme or 0 on error
+static TextTheme* loadThemeFile( const QString& fileName, const QString& cachePath, QString& errorMessage )
 {
-//    formateRangeListCache_.clear();
+    // a valid cache entry skips the xml parsing
+    TmBinaryCache cache( cachePath );
+    if( !cachePath.isEmpty() ) {
+        TextTheme* theme = cache.readTheme( fileName );
+        if( theme ) { return theme; }
+    }
+
+    // check if the file exists
+    QFile file(fileName);
+    if( file.exists() && file.open(QIODevice::ReadOnly) ) {
+
+        // parse the theme
+        TmThemeParser parser;
+        TextTheme* theme = parser.readContent(&file);
+        if( !theme ) {
+            errorMessage = QObject::tr("Error parsing theme %1:%2").arg(file.fileName()).arg( parser.lastErrorMessage());
+        }
+        file.close();
+
+        // store the parsed theme, so the next start can skip the xml parsing
+        if( theme && !cachePath.isEmpty() && !cache.writeTheme( fileName, theme ) ) {
+            qlog_warn() << cache.lastErrorMessage();
+        }
+        return theme;
+    } else {
+        errorMessage = QObject::tr("Error theme not found %1.").arg(file.fileName());
+        return 0;
+    }
 }
 
 
+/// Reads a single theme file in a worker thread
+class ThemeFileLoader : public QRunnable
+{
+public:
+    /// Constructs the loader (in the thread that should own the theme)
+    /// @param fileName the theme file to read
+    /// @param cachePath the binary cache path
+    ThemeFileLoader( const QString& fileName, const QString& cachePath )
+        : fileName_( fileName )
+        , cachePath_( cachePath )
+        , targetThreadRef_( QThread::currentThread() )
+        , theme_(0)
+    {
+        setAutoDelete( false );
+    }
+
+    /// Deletes the theme if it isn't taken
+    virtual ~ThemeFileLoader()
+    {
+        delete theme_;
+    }
+
+    /// reads the theme file (in the worker thread)
+    virtual void run()
+    {
+        theme_ = loadThemeFile( fileName_, cachePath_, errorMessage_ );
+
+        // the theme is a QObject, it should belong to the thread that uses it
+        if( theme_ ) { theme_->moveToThread( targetThreadRef_ ); }
+    }
+
+    /// Takes the theme (ownership is transfered to the caller)
+    TextTheme* takeTheme()
+    {
+        TextTheme* result = theme_;
+        theme_ = 0;
+        return result;
+    }
+
+    QString fileName() const { return fileName_; }
+    QString errorMessage() const { return errorMessage_; }
+
+private:
+    QString fileName_;          ///< The theme file to read
+    QString cachePath_;         ///< The binary cache path
+    QThread* targetThreadRef_;  ///< The thread the theme is moved to
+    TextTheme* theme_;          ///< The read theme (0 on error)
+    QString errorMessage_;      ///< The error message when reading failed
+};
+
+
 //=================================================
 
 
@@ -356,6 +507,37 @@ QString TextThemeManager::themeName(int idx)
 }
 
 
+/// Loads all themes that are listed (and not loaded yet). The theme files are read concurrently on a thread pool.
+/// The themes are added to the manager after all files have been read
+void TextThemeManager::loadAllThemes()
+{
+    QList<ThemeFileLoader*> loaders;
+    foreach( QString name, themeNames_ ) {
+        if( themeMap_.contains(name) ) { continue; }
+        loaders.append( new ThemeFileLoader( QString("%1/%2.tmTheme").arg(themePath_).arg(name), cachePath_ ) );
+    }
+
+    QThreadPool pool;
+    foreach( ThemeFileLoader* loader, loaders ) {
+        pool.start( loader );
+    }
+    pool.waitForDone();
+
+    // add all themes at once (in the gui thread)
+    lastErrorMessage_.clear();
+    foreach( ThemeFileLoader* loader, loaders ) {
+        TextTheme* theme = loader->takeTheme();
+        if( theme ) {
+            themeMap_.insert( QFileInfo( loader->fileName() ).completeBaseName(), theme );
+        } else {
+            lastErrorMessage_ = loader->errorMessage();
+            qlog_warn() << lastErrorMessage_;
+        }
+    }
+    qDeleteAll( loaders );
+}
+
+
 /// This method loads the given theme file.
 /// The theme manager stays owner of the given theme
 /// @param filename the filename of the theme to load
@@ -365,36 +547,20 @@ TextTheme* TextThemeManager::readThemeFile( const QString& fileName, const QStri
 {
     lastErrorMessage_.clear();
 
-    // check if the file exists
-    QFile file(fileName);
-    if( file.exists() && file.open(QIODevice::ReadOnly) ) {
-
-        // parse the theme
-        TmThemeParser parser;
-        TextTheme* theme = parser.readContent(&file);
-        if( theme ) {
-
-            // when the name if blank extract it from the filename
-            QString name = nameIn;
-            if( name.isEmpty() ) {
-                name = QFileInfo(fileName).completeBaseName();
-            }
-
-            // delete a possibly old theme with the given name
-            // add the theme to the map
-            delete themeMap_.value(name);
-            themeMap_.insert(name, theme);
-
-        } else {
-            lastErrorMessage_ = QObject::tr("Error parsing theme %1:%2").arg(file.fileName()).arg( parser.lastErrorMessage());
-        }
-        file.close();
-        return theme;
-    } else {
-        lastErrorMessage_ = QObject::tr("Error theme not found %1.").arg(file.fileName());
-        return 0;
+    // when the name if blank extract it from the filename
+    QString name = nameIn;
+    if( name.isEmpty() ) {
+        name = QFileInfo(fileName).completeBaseName();
     }
 
+    TextTheme* theme = loadThemeFile( fileName, cachePath_, lastErrorMessage_ );
+    if( theme ) {
+        // delete a possibly old theme with the given name
+        // add the theme to the map
+        delete themeMap_.value(name);
+        themeMap_.insert(name, theme);
+    }
+    return theme;
 }
 
 
@@ -422,6 +588,21 @@ TextTheme* TextThemeManager::theme(const QString& name)
 }
 
 
+/// Sets the directory of the binary theme cache. With a cache, warm starts don't need to parse the theme files.
+/// @param cachePath the cache directory, an empty string disables the cache
+void TextThemeManager::setCachePath(const QString& cachePath)
+{
+    cachePath_ = cachePath;
+}
+
+
+/// Returns the directory of the binary theme cache
+QString TextThemeManager::cachePath() const
+{
+    return cachePath_;
+}
+
+
 /// this method returns the last error message
 QString TextThemeManager::lastErrorMessage() const
 {
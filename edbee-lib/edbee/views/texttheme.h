@@ -6,6 +6,7 @@
 #pragma once
 
 #include <QCache>
+#include <QHash>
 #include <QTextLayout>
 #include <QTextCharFormat>
 
@@ -21,6 +22,7 @@ class TextEditorController;
 class Edbee;
 class TextScopeList;
 class TextScopeSelector;
+class TextScopeSelectorMatcher;
 
 /// The styles available in tmTheme files
 //class TextStyle
@@ -75,6 +77,13 @@ public:
     void giveThemeRule( TextThemeRule* rule );
 
     void fillFormatForTextScopeList(const TextScopeList *scopeList, QTextCharFormat* format );
+    QTextCharFormat formatForScopeStack( int stackId, QVector<ScopedTextRange*>& activeRanges );
+    void clearFormatCache();
+    int formatCacheSize() const { return formatCache_.size(); }
+
+    const QList<QTextLayout::FormatRange>* findLineFormatRanges( qint64 scopedRangeListId );
+    void insertLineFormatRanges( qint64 scopedRangeListId, const QList<QTextLayout::FormatRange>& formatRangeList );
+    int lineFormatCacheSize() const { return lineFormatCache_.size(); }
 
     QString name() { return name_; }
     void setName( const QString& name ) { name_ = name; }
@@ -117,6 +126,9 @@ public:
 
 
 private:
+    enum {
+        LineFormatCacheCost = 50000         ///< The maximum number of cached line format ranges (the cost of a line is its number of ranges + 1)
+    };
 
     QString name_;                        ///< The name of the theme
     QString uuid_;                        ///< The uuid
@@ -145,6 +157,10 @@ private:
 
     // The selectos
     QList<TextThemeRule*> themeRules_;     ///< the scope selector
+    TextScopeSelectorMatcher* selectorMatcher_;  ///< The compiled selectors of the rules (created when required)
+
+    QHash<int,QTextCharFormat> formatCache_;  ///< The resolved formats by scope stack id
+    QCache<qint64,QList<QTextLayout::FormatRange> > lineFormatCache_;  ///< The format ranges of the lines by scoped range list id
 
 };
 
@@ -174,13 +190,11 @@ public:
     TextTheme* theme() const;
 
 private:
-    QTextCharFormat getTextScopeFormat(QVector<ScopedTextRange *> &activeRanges);
-    void appendFormatRange(QList<QTextLayout::FormatRange>& rangeList, int start, int end,  QVector<edbee::ScopedTextRange *> &activeRanges );
+    void appendFormatRange(QList<QTextLayout::FormatRange>& rangeList, int start, int end,  QVector<edbee::ScopedTextRange *> &activeRanges, int stackId );
 
 private slots:
 
     void textDocumentChanged(edbee::TextDocument* oldDocument, edbee::TextDocument* newDocument);
-    void invalidateLayouts();
 
 
 private:
@@ -210,15 +224,19 @@ public:
 
     TextTheme* readThemeFile( const QString& fileName, const QString& name=QString() );
     void listAllThemes( const QString& themePath=QString() );
+    void loadAllThemes();
     int themeCount() { return themeNames_.size(); }
     QString themeName( int idx );
     TextTheme* theme( const QString& name );
     TextTheme* fallbackTheme() const { return fallbackTheme_; }
+    void setCachePath( const QString& cachePath );
+    QString cachePath() const;
     QString lastErrorMessage() const;
 
 private:
 
     QString  themePath_;                           ///< The theme path
+    QString cachePath_;                            ///< The directory of the binary theme cache (empty for no cache)
     QStringList themeNames_;                       ///< All themes
     QHash<QString,TextTheme*> themeMap_;           ///< A map with all (loaded) themes
     TextTheme* fallbackTheme_;                     ///< The fallback theme (this can be used if no themes are found)
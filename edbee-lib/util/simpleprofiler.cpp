@@ -41,6 +41,7 @@ SimpleProfiler::~SimpleProfiler()
     qDeleteAll(statsMap_);
     statsMap_.clear();
     stack_.clear();
+    counterMap_.clear();
 }
 
 
@@ -76,6 +77,23 @@ void SimpleProfiler::end()
 }
 
 
+/// increases the named counter
+/// @param name the name of the counter
+/// @param amount the amount to add
+void SimpleProfiler::count( const char* name, int amount )
+{
+    counterMap_[ QString::fromLatin1(name) ] += amount;
+}
+
+
+/// returns the current value of the given counter
+/// @param name the name of the counter
+int SimpleProfiler::counterValue( const char* name ) const
+{
+    return counterMap_.value( QString::fromLatin1(name), 0 );
+}
+
+
 static bool sortByDuration( const SimpleProfiler::ProfilerItem* a, const SimpleProfiler::ProfilerItem* b )
 {
    return b->durationWithoutChilds() < a->durationWithoutChilds();
@@ -127,6 +145,17 @@ void SimpleProfiler::dumpResults()
             }
         }
     }
+
+    if( !counterMap_.isEmpty() ) {
+        qlog_info() << "";
+        qlog_info() << "Counters";
+        qlog_info() << "========";
+        QMapIterator<QString,int> itr( counterMap_ );
+        while( itr.hasNext() ) {
+            itr.next();
+            qlog_info() << QString("%1 %2").arg( itr.value(), 8 ).arg( itr.key() );
+        }
+    }
 }
 
 
@@ -25,10 +25,14 @@ namespace edbee {
 #define PROF_BEGIN_NAMED(name) \
     SimpleProfiler::instance()->begin( __FILE__, __LINE__, __func__, name );
 
+#define PROF_COUNT(name) \
+    SimpleProfiler::instance()->count( name );
+
 #else
 #define PROF_BEGIN
 #define PROF_END
 #define PROF_BEGIN_NAMED(name)
+#define PROF_COUNT(name)
 #endif
 
 
@@ -87,6 +91,8 @@ public:
 
     void begin( const char* file, int line, const char* function, const char* name );
     void end();
+    void count( const char* name, int amount=1 );
+    int counterValue( const char* name ) const;
 
     void dumpResults();
 
@@ -95,6 +101,7 @@ protected:
 
     QMap<QString,ProfilerItem*> statsMap_;   ///< The statistics
     QStack<ProfileStackItem> stack_;         ///< The current items being processed
+    QMap<QString,int> counterMap_;           ///< Named counters (for example the number of compilations)
 };
 
 
@@ -20,14 +20,18 @@ SOURCES += \
     edbee/models/textdocumenttest.cpp \
     edbee/models/textbuffertest.cpp \
 	edbee/models/textlinedatatest.cpp \
+	edbee/models/textdiffmodeltest.cpp \
+	edbee/models/textlinediffindextest.cpp \
 	edbee/util/gapvectortest.cpp \
 	edbee/util/lineoffsetvectortest.cpp \
 	main.cpp \
     edbee/util/lineendingtest.cpp \
     edbee/textdocumentserializertest.cpp \
     edbee/io/tmlanguageparsertest.cpp \
+    edbee/io/tmbinarycachetest.cpp \
     edbee/util/regexptest.cpp \
     edbee/models/textdocumentscopestest.cpp \
+    edbee/models/textgrammartest.cpp \
     edbee/models/textundostacktest.cpp \
     edbee/util/cascadingqvariantmaptest.cpp \
     edbee/models/textsearchertest.cpp \
@@ -41,7 +45,12 @@ SOURCES += \
     edbee/models/changes/mergablechangegrouptest.cpp \
     edbee/util/rangesetlineiteratortest.cpp \
     edbee/models/dynamicvariablestest.cpp \
-    edbee/util/rangelineiteratortest.cpp
+    edbee/util/rangelineiteratortest.cpp \
+    edbee/views/textrenderertest.cpp \
+    edbee/views/textlinewidthindextest.cpp \
+    edbee/views/components/texteditortilecachetest.cpp \
+    edbee/texteditorwidgettest.cpp \
+    edbee/texteditorwidgettestcase.cpp
 
 HEADERS += \
 	edbee/commands/replaceselectioncommandtest.h \
@@ -49,13 +58,17 @@ HEADERS += \
     edbee/models/textdocumenttest.h \
     edbee/models/textbuffertest.h \
 	edbee/models/textlinedatatest.h \
+	edbee/models/textdiffmodeltest.h \
+	edbee/models/textlinediffindextest.h \
 	edbee/util/gapvectortest.h \
 	edbee/util/lineoffsetvectortest.h \
     edbee/util/lineendingtest.h \
     edbee/textdocumentserializertest.h \
     edbee/io/tmlanguageparsertest.h \
+    edbee/io/tmbinarycachetest.h \
     edbee/util/regexptest.h \
     edbee/models/textdocumentscopestest.h \
+    edbee/models/textgrammartest.h \
     edbee/models/textundostacktest.h \
     edbee/util/cascadingqvariantmaptest.h \
     edbee/models/textsearchertest.h \
@@ -69,7 +82,12 @@ HEADERS += \
     edbee/models/changes/mergablechangegrouptest.h \
     edbee/util/rangesetlineiteratortest.h \
     edbee/models/dynamicvariablestest.h \
-    edbee/util/rangelineiteratortest.h
+    edbee/util/rangelineiteratortest.h \
+    edbee/views/textrenderertest.h \
+    edbee/views/textlinewidthindextest.h \
+    edbee/views/components/texteditortilecachetest.h \
+    edbee/texteditorwidgettest.h \
+    edbee/texteditorwidgettestcase.h
 
 ##OTHER_FILES += ../edbee-data/config/*
 ##OTHER_FILES += ../edbee-data/keymaps/*
@@ -0,0 +1,236 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "tmbinarycachetest.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+
+#include "edbee/io/tmbinarycache.h"
+#include "edbee/io/tmlanguageparser.h"
+#include "edbee/io/tmthemeparser.h"
+#include "edbee/models/textdocumentscopes.h"
+#include "edbee/models/textgrammar.h"
+#include "edbee/views/texttheme.h"
+#include "edbee/edbee.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+static const char* FixtureGrammar =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<plist version=\"1.0\">\n"
+    "<dict>\n"
+    "  <key>fileTypes</key><array><string>ch</string></array>\n"
+    "  <key>name</key><string>Cached</string>\n"
+    "  <key>patterns</key>\n"
+    "  <array>\n"
+    "    <dict><key>match</key><string>(\\d+)(px)?</string><key>name</key><string>constant.numeric.cached</string>\n"
+    "      <key>captures</key><dict><key>2</key><dict><key>name</key><string>keyword.unit.cached</string></dict></dict></dict>\n"
+    "    <dict><key>include</key><string>#strings</string></dict>\n"
+    "  </array>\n"
+    "  <key>repository</key>\n"
+    "  <dict>\n"
+    "    <key>strings</key>\n"
+    "    <dict><key>begin</key><string>\"</string><key>end</key><string>\"</string><key>name</key><string>string.cached</string>\n"
+    "      <key>patterns</key><array><dict><key>match</key><string>\\\\.</string><key>name</key><string>constant.escape.cached</string></dict></array>\n"
+    "      <key>endCaptures</key><dict><key>0</key><dict><key>name</key><string>punctuation.end.cached</string></dict></dict></dict>\n"
+    "  </dict>\n"
+    "  <key>scopeName</key><string>source.cached</string>\n"
+    "</dict>\n"
+    "</plist>\n";
+
+
+static const char* FixtureTheme =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<plist version=\"1.0\">\n"
+    "<dict>\n"
+    "  <key>name</key><string>Cached</string>\n"
+    "  <key>settings</key>\n"
+    "  <array>\n"
+    "    <dict><key>settings</key><dict><key>background</key><string>#272822</string><key>foreground</key><string>#F8F8F2</string>\n"
+    "      <key>bracketsOptions</key><string>underline</string></dict></dict>\n"
+    "    <dict><key>name</key><string>Comment</string><key>scope</key><string>comment</string>\n"
+    "      <key>settings</key><dict><key>foreground</key><string>#75715E</string><key>fontStyle</key><string>italic</string></dict></dict>\n"
+    "    <dict><key>name</key><string>Keyword</string><key>scope</key><string>keyword, storage.type</string>\n"
+    "      <key>settings</key><dict><key>foreground</key><string>#F92672</string><key>fontStyle</key><string>bold underline</string></dict></dict>\n"
+    "  </array>\n"
+    "</dict>\n"
+    "</plist>\n";
+
+
+/// Dumps the rule tree (for comparing grammars)
+static QString dumpRule( TextGrammarRule* rule, const QString& indent="" )
+{
+    QString result = indent + rule->toString(true);
+    QMapIterator<int,QString> itr( rule->matchCaptures() );
+    while( itr.hasNext() ) { itr.next(); result.append( QString(" c%1=%2").arg(itr.key()).arg(itr.value()) ); }
+    QMapIterator<int,QString> endItr( rule->endCaptures() );
+    while( endItr.hasNext() ) { endItr.next(); result.append( QString(" e%1=%2").arg(endItr.key()).arg(endItr.value()) ); }
+    result.append( QString(" content=%1\n").arg(rule->contentScopeName()) );
+    for( int i=0; i<rule->ruleCount(); ++i ) {
+        result.append( dumpRule( rule->rule(i), indent + "  " ) );
+    }
+    return result;
+}
+
+
+/// Dumps the complete grammar
+static QString dumpGrammar( TextGrammar* grammar )
+{
+    QString result = QString("%1/%2/%3\n").arg(grammar->name()).arg(grammar->displayName()).arg(grammar->fileExtensions().join(","));
+    result.append( dumpRule( grammar->mainRule() ) );
+    QMapIterator<QString,TextGrammarRule*> itr( grammar->repository() );
+    while( itr.hasNext() ) {
+        itr.next();
+        result.append( itr.key() ).append(":\n").append( dumpRule( itr.value(), "  " ) );
+    }
+    return result;
+}
+
+
+/// Creates the (empty) cache directory
+void TmBinaryCacheTest::init()
+{
+    cachePath_ = QDir::temp().filePath( QString("edbee-cache-test-%1").arg( QDateTime::currentMSecsSinceEpoch() ) );
+    QDir().mkpath( cachePath_ );
+}
+
+
+/// Removes the cache directory
+void TmBinaryCacheTest::clean()
+{
+    QDir dir( cachePath_ );
+    foreach( QString file, dir.entryList( QDir::Files ) ) {
+        dir.remove( file );
+    }
+    QDir().rmdir( cachePath_ );
+}
+
+
+/// Tests the grammar cache: the cached grammar should equal the parsed grammar.
+/// Stale and corrupt entries should be ignored
+void TmBinaryCacheTest::testGrammarCache()
+{
+    QString sourceFile = QString("%1/cached.tmLanguage").arg(cachePath_);
+    writeFile( sourceFile, FixtureGrammar );
+
+    TmLanguageParser parser;
+    TextGrammar* grammar = parser.parse( sourceFile );
+    testTrue( grammar != 0 );
+
+    TmBinaryCache cache( cachePath_ );
+    testTrue( cache.readGrammar( sourceFile ) == 0 );     // nothing cached yet
+    testTrue( cache.writeGrammar( sourceFile, grammar ) );
+
+    // the complete grammar
+    TextGrammar* cachedGrammar = cache.readGrammar( sourceFile );
+    testTrue( cachedGrammar != 0 );
+    testEqual( dumpGrammar( cachedGrammar ), dumpGrammar( grammar ) );
+    delete cachedGrammar;
+
+    // a lazy grammar reads its rules on first use
+    TextGrammar* lazyGrammar = cache.readGrammarHeader( sourceFile );
+    testTrue( lazyGrammar != 0 );
+    testFalse( lazyGrammar->isLoaded() );
+    testEqual( lazyGrammar->fileExtensions().join(","), "ch" );
+    testFalse( lazyGrammar->sourceHash().isEmpty() );
+    testTrue( lazyGrammar->sourceHash() == cache.sourceHash( sourceFile ) );
+    lazyGrammar->setCachePath( cache.cachePath() );
+    testEqual( dumpGrammar( lazyGrammar ), dumpGrammar( grammar ) );
+    delete lazyGrammar;
+
+    // a corrupt cache file is ignored
+    QFile cacheFile( cache.cacheFileName( sourceFile ) );
+    testTrue( cacheFile.open( QIODevice::ReadOnly ) );
+    QByteArray data = cacheFile.readAll();
+    cacheFile.close();
+    writeFile( cache.cacheFileName( sourceFile ), data.left( data.size() / 2 ) );
+    testTrue( cache.readGrammar( sourceFile ) == 0 );
+    testTrue( cache.writeGrammar( sourceFile, grammar ) );
+    cachedGrammar = cache.readGrammar( sourceFile );
+    testTrue( cachedGrammar != 0 );
+    delete cachedGrammar;
+
+    // a cached rule tree that is too deep is rejected
+    TextGrammar deepGrammar( "source.deep", "Deep" );
+    TextGrammarRule* deepRule = TextGrammarRule::createMainRule( &deepGrammar, "source.deep" );
+    deepGrammar.giveMainRule( deepRule );
+    for( int i=0; i<1000; ++i ) {
+        TextGrammarRule* child = TextGrammarRule::createRuleList( &deepGrammar );
+        deepRule->giveRule( child );
+        deepRule = child;
+    }
+    testTrue( cache.writeGrammar( sourceFile, &deepGrammar ) );
+    testTrue( cache.readGrammar( sourceFile ) == 0 );
+
+    // a changed source file makes the entry stale
+    writeFile( sourceFile, QByteArray(FixtureGrammar).replace("Cached","Changed") );
+    testTrue( cache.readGrammar( sourceFile ) == 0 );
+    testTrue( cache.readGrammarHeader( sourceFile ) == 0 );
+
+    delete grammar;
+}
+
+
+/// Tests the theme cache
+void TmBinaryCacheTest::testThemeCache()
+{
+    QString sourceFile = QString("%1/cached.tmTheme").arg(cachePath_);
+    writeFile( sourceFile, FixtureTheme );
+
+    QFile file( sourceFile );
+    testTrue( file.open( QIODevice::ReadOnly ) );
+    TmThemeParser parser;
+    TextTheme* theme = parser.readContent( &file );
+    file.close();
+    testTrue( theme != 0 );
+
+    TmBinaryCache cache( cachePath_ );
+    testTrue( cache.readTheme( sourceFile ) == 0 );
+    testTrue( cache.writeTheme( sourceFile, theme ) );
+
+    TextTheme* cachedTheme = cache.readTheme( sourceFile );
+    testTrue( cachedTheme != 0 );
+    testEqual( cachedTheme->backgroundColor().name(), theme->backgroundColor().name() );
+    testEqual( cachedTheme->foregroundColor().name(), theme->foregroundColor().name() );
+    testFalse( cachedTheme->caretColor().isValid() );
+    testEqual( cachedTheme->bracketOptions(), "underline" );
+    testEqual( cachedTheme->rules().size(), 2 );
+    for( int i=0; i<theme->rules().size(); ++i ) {
+        TextThemeRule* rule = theme->rules().at(i);
+        TextThemeRule* cachedRule = cachedTheme->rules().at(i);
+        testEqual( cachedRule->name(), rule->name() );
+        testEqual( cachedRule->scopeSelector()->toString(), rule->scopeSelector()->toString() );
+        testEqual( cachedRule->foregroundColor().name(), rule->foregroundColor().name() );
+        testTrue( cachedRule->backgroundColor().isValid() == rule->backgroundColor().isValid() );
+        testTrue( cachedRule->bold() == rule->bold() );
+        testTrue( cachedRule->italic() == rule->italic() );
+        testTrue( cachedRule->underline() == rule->underline() );
+    }
+    delete cachedTheme;
+
+    // a grammar cache entry isn't a theme
+    testTrue( cache.writeGrammar( sourceFile, Edbee::instance()->grammarManager()->defaultGrammar() ) );
+    testTrue( cache.readTheme( sourceFile ) == 0 );
+
+    delete theme;
+}
+
+
+/// Writes the given data to a file
+void TmBinaryCacheTest::writeFile(const QString& fileName, const QByteArray& data)
+{
+    QFile file( fileName );
+    testTrue( file.open( QIODevice::WriteOnly | QIODevice::Truncate ) );
+    file.write( data );
+    file.close();
+}
+
+
+} // edbee
@@ -0,0 +1,31 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "util/test.h"
+
+namespace edbee {
+
+class TmBinaryCacheTest : public edbee::test::TestCase
+{
+Q_OBJECT
+private slots:
+
+    void init();
+    void clean();
+
+    void testGrammarCache();
+    void testThemeCache();
+
+private:
+    void writeFile( const QString& fileName, const QByteArray& data );
+
+    QString cachePath_;
+
+};
+
+}
+DECLARE_TEST(edbee::TmBinaryCacheTest);
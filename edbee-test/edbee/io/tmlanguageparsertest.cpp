@@ -5,16 +5,185 @@
 
 #include "tmlanguageparsertest.h"
 
+#include <QBuffer>
+#include <QFile>
+#include <QTemporaryFile>
+
 #include "edbee/io/tmlanguageparser.h"
+#include "edbee/models/textgrammar.h"
+#include "edbee/edbee.h"
 
 #include "debug.h"
 
 namespace edbee {
 
 
+/// Reads a plist into a variant tree. (The way the grammar parser worked before it was streaming)
+class PListVariantReader : public BasePListParser
+{
+public:
+    QVariant read( QIODevice* device )
+    {
+        QVariant result;
+        if( beginParsing(device) ) { result = readNextPlistType(); }
+        endParsing();
+        return result;
+    }
+};
+
+
 void TmLanguageParserTest::testParser()
 {
 }
 
 
+/// Tests the reading of the grammar header and the parsing of the rules on first use
+void TmLanguageParserTest::testLazyGrammar()
+{
+    QTemporaryFile file;
+    testTrue( file.open() );
+    file.write(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<plist version=\"1.0\">\n"
+        "<dict>\n"
+        "  <key>fileTypes</key>\n"
+        "  <array><string>lz</string><string>lazy</string></array>\n"
+        "  <key>name</key><string>Lazy</string>\n"
+        "  <key>patterns</key>\n"
+        "  <array>\n"
+        "    <dict><key>match</key><string>\\d+</string><key>name</key><string>constant.numeric.lazy</string></dict>\n"
+        "    <dict><key>include</key><string>#strings</string></dict>\n"
+        "  </array>\n"
+        "  <key>repository</key>\n"
+        "  <dict>\n"
+        "    <key>strings</key>\n"
+        "    <dict><key>begin</key><string>\"</string><key>end</key><string>\"</string><key>name</key><string>string.lazy</string></dict>\n"
+        "  </dict>\n"
+        "  <key>scopeName</key><string>source.lazy</string>\n"
+        "</dict>\n"
+        "</plist>\n" );
+    file.close();
+
+    // only the header is read
+    TmLanguageParser parser;
+    TextGrammar* grammar = parser.parseHeader( file.fileName() );
+    testTrue( grammar != 0 );
+    testEqual( grammar->name(), "source.lazy" );
+    testEqual( grammar->displayName(), "Lazy" );
+    testEqual( grammar->fileExtensions().join(","), "lz,lazy" );
+    testFalse( grammar->isLoaded() );
+
+    // the rules are parsed on first use
+    TextGrammarRule* mainRule = grammar->mainRule();
+    testTrue( grammar->isLoaded() );
+    testEqual( mainRule->scopeName(), "source.lazy" );
+    testEqual( mainRule->ruleCount(), 2 );
+    testEqual( mainRule->rule(0)->scopeName(), "constant.numeric.lazy" );
+    testTrue( grammar->findFromRepos("strings") != 0 );
+    testEqual( grammar->fileExtensions().size(), 2 );
+    delete grammar;
+
+    // a file without a name or scope isn't a grammar
+    QTemporaryFile invalidFile;
+    testTrue( invalidFile.open() );
+    invalidFile.write( "<plist version=\"1.0\"><dict><key>name</key><string>Invalid</string></dict></plist>" );
+    invalidFile.close();
+    testTrue( parser.parseHeader( invalidFile.fileName() ) == 0 );
+    testFalse( parser.lastErrorMessage().isEmpty() );
+}
+
+
+/// Tests the construction of the grammar rules directly from the xml stream
+void TmLanguageParserTest::testStreamingParser()
+{
+    QByteArray data(
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<plist version=\"1.0\">\n"
+        "<dict>\n"
+        "  <key>comment</key><dict><key>nested</key><array><dict><key>match</key><string>x</string></dict></array></dict>\n"
+        "  <key>patterns</key>\n"
+        "  <array>\n"
+        "    <dict>\n"
+        "      <key>captures</key><dict><key>1</key><dict><key>name</key><string>cap.one</string></dict></dict>\n"
+        "      <key>match</key><string>(a)b</string>\n"
+        "      <key>name</key><string>match.ab</string>\n"
+        "      <key>patterns</key><array><dict><key>match</key><string>ignored</string></dict></array>\n"
+        "    </dict>\n"
+        "    <dict>\n"
+        "      <key>begin</key><string>(&lt;)</string>\n"
+        "      <key>beginCaptures</key><dict><key>1</key><dict><key>name</key><string>begin.one</string></dict></dict>\n"
+        "      <key>captures</key><dict><key>1</key><dict><key>name</key><string>both.one</string></dict><key>2</key><dict><key>name</key><string>both.two</string></dict></dict>\n"
+        "      <key>disabled</key><integer>0</integer>\n"
+        "      <key>end</key><string>(&gt;)</string>\n"
+        "      <key>name</key><string>meta.angle</string>\n"
+        "      <key>patterns</key><array><dict><key>include</key><string>$self</string></dict><string>junk</string></array>\n"
+        "    </dict>\n"
+        "    <dict><key>patterns</key><array><dict><key>include</key><string>#list</string></dict></array></dict>\n"
+        "  </array>\n"
+        "  <key>repository</key><dict><key>list</key><dict><key>match</key><string>z</string></dict></dict>\n"
+        "  <key>scopeName</key><string>source.stream</string>\n"
+        "  <key>name</key><string>Stream</string>\n"
+        "  <key>fileTypes</key><array><string>st</string></array>\n"
+        "</dict>\n"
+        "</plist>\n" );
+    QBuffer buffer( &data );
+    testTrue( buffer.open( QIODevice::ReadOnly ) );
+
+    TmLanguageParser parser;
+    TextGrammar* grammar = parser.parse( &buffer );
+    testTrue( grammar != 0 );
+    testEqual( grammar->name(), "source.stream" );
+    testEqual( grammar->displayName(), "Stream" );
+    testEqual( grammar->fileExtensions().join(","), "st" );
+
+    TextGrammarRule* mainRule = grammar->mainRule();
+    testEqual( mainRule->scopeName(), "source.stream" );
+    testEqual( mainRule->ruleCount(), 3 );
+
+    // a match rule ignores its patterns
+    TextGrammarRule* matchRule = mainRule->rule(0);
+    testTrue( matchRule->isSingleLineRegExp() );
+    testEqual( matchRule->scopeName(), "match.ab" );
+    testEqual( matchRule->ruleCount(), 0 );
+    testEqual( matchRule->matchCaptures().value(1), "cap.one" );
+
+    // the begin captures overrule the shared captures
+    TextGrammarRule* multiRule = mainRule->rule(1);
+    testTrue( multiRule->isMultiLineRegExp() );
+    testEqual( multiRule->endRegExpString(), "(>)" );
+    testEqual( multiRule->matchCaptures().value(1), "begin.one" );
+    testEqual( multiRule->matchCaptures().value(2), "both.two" );
+    testEqual( multiRule->endCaptures().value(1), "both.one" );
+    testEqual( multiRule->ruleCount(), 1 );
+    testTrue( multiRule->rule(0)->isIncludeCall() );
+    testEqual( multiRule->rule(0)->includeName(), "$self" );
+
+    testTrue( mainRule->rule(2)->isRuleList() );
+    testEqual( mainRule->rule(2)->ruleCount(), 1 );
+    testTrue( grammar->findFromRepos("list") != 0 );
+    testEqual( grammar->findFromRepos("list")->scopeName(), "" );
+    delete grammar;
+}
+
+
+/// Tests if all available grammar files can be parsed by the streaming parser and can be read as a variant tree.
+/// Only the lazily loaded grammars have a file. (The timings of both are reported by edbee-bench --parse-grammars)
+void TmLanguageParserTest::testParseAllGrammars()
+{
+    foreach( TextGrammar* grammar, Edbee::instance()->grammarManager()->grammars() ) {
+        if( grammar->fileName().isEmpty() ) { continue; }
+
+        TmLanguageParser parser;
+        TextGrammar* parsedGrammar = parser.parse( grammar->fileName() );
+        testTrue( parsedGrammar != 0 );
+        delete parsedGrammar;
+
+        QFile file( grammar->fileName() );
+        testTrue( file.open( QIODevice::ReadOnly ) );
+        PListVariantReader reader;
+        testTrue( reader.read( &file ).isValid() );
+    }
+}
+
+
 } // edbee
@@ -15,6 +15,9 @@ Q_OBJECT
 private slots:
 
     void testParser();
+    void testLazyGrammar();
+    void testStreamingParser();
+    void testParseAllGrammars();
 
 };
 
@@ -5,7 +5,15 @@
 
 #include "grammartextlexertest.h"
 
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
 #include "edbee/io/tmlanguageparser.h"
+#include "edbee/lexers/grammarlexerstatistics.h"
+#include "edbee/lexers/grammarrulescanner.h"
 #include "edbee/lexers/grammartextlexer.h"
 #include "edbee/models/chardocument/chartextdocument.h"
 #include "edbee/models/textdocument.h"
@@ -22,6 +30,7 @@ namespace edbee {
 /// This method test the basic matching algorithm
 GrammarTextLexerTest::GrammarTextLexerTest()
     : doc_(0)
+    , grammar_(0)
 {
 }
 
@@ -37,6 +46,8 @@ void GrammarTextLexerTest::clean()
 {
     delete doc_;
     doc_ = 0;
+    delete grammar_;
+    grammar_ = 0;
 }
 
 
@@ -84,6 +95,378 @@ void GrammarTextLexerTest::testHamlLexer()
 }
 
 
+/// Tests which patterns can be added to a combined (multi-pattern) regexp
+void GrammarTextLexerTest::testCombinablePatterns()
+{
+    bool extended = false;
+    testTrue( GrammarRuleScanner::isCombinablePattern( "\\b(if|else)\\b", extended ) );
+    testFalse( extended );
+    testTrue( GrammarRuleScanner::isCombinablePattern( "(?<=\\.)\\w+(?<!x)", extended ) );
+    testTrue( GrammarRuleScanner::isCombinablePattern( "(?i:select)\\\\1", extended ) );  // escaped backslash followed by a 1
+
+    testTrue( GrammarRuleScanner::isCombinablePattern( "(?x) a b   # comment", extended ) );
+    testTrue( extended );
+
+    testFalse( GrammarRuleScanner::isCombinablePattern( "(['\"])\\1", extended ) );     // back-reference
+    testFalse( GrammarRuleScanner::isCombinablePattern( "\\G\\s+", extended ) );       // search-start anchor
+    testFalse( GrammarRuleScanner::isCombinablePattern( "(?<name>\\w+)", extended ) );  // named group
+    testFalse( GrammarRuleScanner::isCombinablePattern( "a(?x) b", extended ) );        // non-leading extended mode
+    testFalse( GrammarRuleScanner::isCombinablePattern( "(?x) a (?-x) b", extended ) );
+}
+
+
+/// The multi-pattern scan must give exactly the same results as searching every rule individually
+void GrammarTextLexerTest::testMultiPatternScan()
+{
+    createFixtureGrammarDocument(
+        "if( a == 12 ) { // comment\n"
+        "  b = \"str\\\"ing\" + 'x' /* multi\n"
+        "  line */ while 3 <<EOT EOT\n"
+        "else 'open\n"
+        "string' 42"
+    );
+
+    QStringList expected = lexAndDumpScopes( false );
+    QStringList result = lexAndDumpScopes( true );
+    testEqual( result.join("\n"), expected.join("\n") );
+}
+
+
+/// Compares the multi-pattern scan with the individual searches for all loaded grammars
+/// (The durations of both scan methods are reported by edbee-bench --scan-modes)
+void GrammarTextLexerTest::testMultiPatternScanWithLoadedGrammars()
+{
+    QString text;
+    for( int i=0; i<50; ++i ) {
+        text.append( "#include <stdio.h>\n<!-- html --><div class=\"x\">text</div>\n" );
+        text.append( "function test( a, b ) { return a + 12.5 * b; } // comment\n" );
+        text.append( "/* block\n comment */ if( x == 'str' ) { print(\"hello\\n\"); }\n" );
+        text.append( "def method(arg): # python/ruby\n  key: value\n  - item\n" );
+    }
+
+    foreach( TextGrammar* grammar, Edbee::instance()->grammarManager()->grammars() ) {
+        createFixtureDocument( text );
+        doc_->setLanguageGrammar( grammar );
+
+        QStringList expected = lexAndDumpScopes( false );
+        QStringList result = lexAndDumpScopes( true );
+        testEqual( result.join("\n"), expected.join("\n") );
+
+        delete doc_;
+        doc_ = 0;
+    }
+}
+
+
+/// Tests the sharing of compiled end-regexps between multi-line scopes
+void GrammarTextLexerTest::testEndRegExpCache()
+{
+    createFixtureGrammarDocument(
+        "\"a\" 'b' \"c\" /* x */\n"
+        "\"d\" 'e\n"
+        "f' /* y\n"
+        "*/ \"g\""
+    );
+
+    // without a cache every opened scope compiles its end regexp
+    lexer()->setEndRegExpCacheSize(0);
+    int compileCount = lexer()->endRegExpCompileCount();
+    QStringList expected = lexAndDumpScopes( true );
+    testEqual( lexer()->endRegExpCompileCount() - compileCount, 8 );
+
+    // with a cache only the distinct end patterns are compiled: " ' and */
+    lexer()->setEndRegExpCacheSize(16);
+    compileCount = lexer()->endRegExpCompileCount();
+    QStringList result = lexAndDumpScopes( true );
+    testEqual( lexer()->endRegExpCompileCount() - compileCount, 3 );
+    testEqual( result.join("\n"), expected.join("\n") );
+}
+
+
+/// Tests the maximum line length and the relexing of incomplete lines
+void GrammarTextLexerTest::testLineLimits()
+{
+    createFixtureGrammarDocument(
+        "if 12\n"
+        "if( a == 12 ) 'str\n"
+        "ing' else"
+    );
+
+    lexer()->setMaxLineLength(0);
+    QStringList expected = lexAndDumpScopes( true );
+
+    // the long line only gets the enclosing (grammar) scope
+    lexer()->setMaxLineLength(10);
+    lexAndDumpScopes( true );
+    testFalse( scopes()->scopedRangesAtLine(0)->isIncomplete() );
+    testTrue( scopes()->scopedRangesAtLine(1)->isIncomplete() );
+    testFalse( scopes()->scopedRangesAtLine(1)->isIndependent() );
+    testEqual( scopes()->scopedRangesAtLine(1)->size(), 1 );
+
+    // the incomplete lines are lexed later
+    testEqual( lexer()->lexNextIncompleteLine(0), 1 );
+    testFalse( scopes()->scopedRangesAtLine(1)->isIncomplete() );
+    testEqual( lexer()->lexNextIncompleteLine(0), -1 );
+
+    lexer()->lexRange( 0, doc_->length() );
+    testEqual( scopes()->scopesAsStringList().join("\n"), expected.join("\n") );
+}
+
+
+/// Tests if relexing an incomplete line keeps the scopes of the following lines when the lexer state doesn't change
+void GrammarTextLexerTest::testRelexIncompleteLine()
+{
+    createFixtureGrammarDocument(
+        "if 12\n"
+        "if( a == 12 ) 12\n"
+        "'str\n"
+        "ing' else"
+    );
+
+    lexer()->setMaxLineLength(0);
+    QStringList expected = lexAndDumpScopes( true );
+
+    lexer()->setMaxLineLength(10);
+    lexAndDumpScopes( true );
+    testTrue( scopes()->scopedRangesAtLine(1)->isIncomplete() );
+    ScopedTextRangeList* lastLineList = scopes()->scopedRangesAtLine(3);
+    int lastScopedOffset = scopes()->lastScopedOffset();
+
+    testEqual( lexer()->lexNextIncompleteLine(0), 1 );
+    testEqual( scopes()->scopedLineCount(), 4 );
+    testTrue( scopes()->scopedRangesAtLine(3) == lastLineList );
+    testEqual( scopes()->lastScopedOffset(), lastScopedOffset );
+    testEqual( scopes()->scopesAsStringList().join("\n"), expected.join("\n") );
+    testEqual( lexer()->lexNextIncompleteLine(0), -1 );
+
+    // a change before the line continues the search at the changed line
+    doc_->replace( 0, 0, "if( b == 12 ) 12\n" );
+    lexer()->lexRange( 0, doc_->length() );
+    testEqual( lexer()->lexNextIncompleteLine(0), 0 );
+}
+
+
+/// Tests if lexing chunks in parallel gives the same result as lexing the document line by line
+void GrammarTextLexerTest::testParallelLexing()
+{
+    createFixtureGrammarDocument(
+        "if 12 /* a comment\n"
+        "over 'multiple'\n"
+        "lines */ else 'a\n"
+        "string\n"
+        "while' 12\n"
+        "// if 'no string\n"
+        "a == 'b' /*\n"
+        "'\n"
+        "*/ while\n"
+        "if 'str\n"
+        "ing' == 12"
+    );
+    QStringList expected = lexAndDumpScopes( true );
+
+    // chunks of 2 lines start in a string or comment most of the time
+    for( int chunkLineCount=1; chunkLineCount < 5; ++chunkLineCount ) {
+        scopes()->removeScopesAfterOffset(0);
+        lexer()->lexLinesParallel( 0, doc_->lineCount(), chunkLineCount );
+        testEqual( scopes()->scopesAsStringList().join("\n"), expected.join("\n") );
+        testEqual( scopes()->lastScopedOffset(), doc_->length() );
+    }
+
+    // the parallel lexed scopes can be updated incrementally
+    doc_->replace( 0, 0, "/*" );
+    lexer()->lexRange( 0, doc_->length() );
+    QStringList changed = scopes()->scopesAsStringList();
+    testEqual( lexAndDumpScopes( true ).join("\n"), changed.join("\n") );
+}
+
+
+/// Tests the speculative lexing of the remainder of a large document in the background
+void GrammarTextLexerTest::testBackgroundLexing()
+{
+    QString text;
+    for( int i=0; i<300; ++i ) {
+        text.append(
+            "if 12 /* a comment\n"
+            "over 'multiple'\n"
+            "lines */ else 'a\n"
+            "string\n"
+            "while' 12\n"
+            "// if 'no string\n"
+            "a == 'b' /*\n"
+            "'\n"
+            "*/ while\n"
+            "if 'str\n"
+            "ing' == 12\n"
+        );
+    }
+    createFixtureGrammarDocument( text );
+    QStringList expected = lexAndDumpScopes( true );
+
+    // only the requested lines are lexed, the results of the remainder are applied when the job is finished
+    lexer()->setParallelLexingEnabled( true );
+    scopes()->removeScopesAfterOffset(0);
+    lexer()->lexRange( 0, doc_->offsetFromLine(10) );
+    testTrue( scopes()->lastScopedOffset() < doc_->length() );
+
+    QElapsedTimer timer;
+    timer.start();
+    while( scopes()->lastScopedOffset() < doc_->length() && timer.elapsed() < 10000 ) {
+        QCoreApplication::processEvents( QEventLoop::AllEvents, 10 );
+    }
+    testEqual( scopes()->lastScopedOffset(), doc_->length() );
+    testEqual( scopes()->scopesAsStringList().join("\n"), expected.join("\n") );
+
+    // requesting the lines of a running job waits for the job
+    scopes()->removeScopesAfterOffset(0);
+    lexer()->lexRange( 0, doc_->offsetFromLine(10) );
+    lexer()->lexRange( 0, doc_->length() );
+    testEqual( scopes()->lastScopedOffset(), doc_->length() );
+    testEqual( scopes()->scopesAsStringList().join("\n"), expected.join("\n") );
+
+    // a change cancels the running job
+    scopes()->removeScopesAfterOffset(0);
+    lexer()->lexRange( 0, doc_->offsetFromLine(10) );
+    doc_->replace( 0, 0, "/*" );
+    lexer()->lexRange( 0, doc_->length() );
+    QStringList changed = scopes()->scopesAsStringList();
+    lexer()->setParallelLexingEnabled( false );
+    testEqual( lexAndDumpScopes( true ).join("\n"), changed.join("\n") );
+}
+
+
+/// Tests the sharing of the scopes of identical lines
+void GrammarTextLexerTest::testLineInterning()
+{
+    createFixtureGrammarDocument(
+        "if 12 == 'a'\n"
+        "if 12 == 'a'\n"
+        "/* if 12 == 'a'\n"
+        "if 12 == 'a'\n"
+        "if 12 == 'a' */\n"
+        "/*\n"
+        "if 12 == 'a'\n"
+        "*/\n"
+        "if 12 == 'a'\n"
+    );
+
+    lexer()->setLineInterningEnabled( false );
+    QStringList expected = lexAndDumpScopes( true );
+
+    lexer()->setLineInterningEnabled( true );
+    int hitCount = lexer()->internedLineHitCount();
+    testEqual( lexAndDumpScopes( true ).join("\n"), expected.join("\n") );
+    testEqual( lexer()->internedLineHitCount() - hitCount, 3 );
+
+    // identical lines with the same state share the scopes
+    testTrue( scopes()->scopedRangesAtLine(0) == scopes()->scopedRangesAtLine(1) );
+    testTrue( scopes()->scopedRangesAtLine(0) == scopes()->scopedRangesAtLine(8) );
+
+    // the same line in another comment block gets its own copy
+    testTrue( scopes()->scopedRangesAtLine(3) != scopes()->scopedRangesAtLine(6) );
+    testTrue( scopes()->scopedRangesAtLine(6)->at(1)->multiLineScopedTextRange() != scopes()->scopedRangesAtLine(3)->at(1)->multiLineScopedTextRange() );
+
+    // changing a shared line only changes that line
+    doc_->replace( doc_->offsetFromLine(1), 2, "while" );
+    lexer()->lexRange( 0, doc_->length() );
+    QStringList changed = scopes()->scopesAsStringList();
+    lexer()->setLineInterningEnabled( false );
+    testEqual( lexAndDumpScopes( true ).join("\n"), changed.join("\n") );
+
+    // lines that are too long to lex aren't interned
+    lexer()->setLineInterningEnabled( true );
+    lexer()->setMaxLineLength( 5 );
+    lexAndDumpScopes( true );
+    testTrue( scopes()->scopedRangesAtLine(0) != scopes()->scopedRangesAtLine(8) );
+}
+
+
+/// Tests the search statistics per grammar rule
+void GrammarTextLexerTest::testStatistics()
+{
+    createFixtureGrammarDocument(
+        "if 12 == 'a'\n"
+        "/* 12\n"
+        "*/ 13"
+    );
+    lexer()->setLineInterningEnabled( false );
+    testFalse( lexer()->isStatisticsEnabled() );
+    testTrue( lexer()->statistics() == 0 );
+
+    TextGrammarRule* mainRule = grammar_->mainRule();
+    TextGrammarRule* numericRule = mainRule->rule(3);
+    TextGrammarRule* integerRule = mainRule->rule(4);
+    TextGrammarRule* stringRule = mainRule->rule(6);
+    TextGrammarRule* commentRule = grammar_->findFromRepos("comments")->rule(1);
+
+    // both scan methods record the same matches and wins
+    for( int i=0; i<2; ++i ) {
+        bool multiPatternScan = ( i == 0 );
+        lexer()->setStatisticsEnabled( true );
+        QStringList expected = lexAndDumpScopes( multiPatternScan );
+        GrammarLexerStatistics* stats = lexer()->statistics();
+        testTrue( stats != 0 );
+        testEqual( stats->lineCount(), 3 );
+        testTrue( stats->searchCount() > 0 );
+
+        // the rules that are matched by the combined regexp record their wins as combined search
+        GrammarLexerStatistics::SearchKind matchKind = multiPatternScan ? GrammarLexerStatistics::CombinedSearch : GrammarLexerStatistics::MatchSearch;
+
+        // the integer rule matches the same numbers as the numeric rule, but never wins
+        const GrammarRuleStatistics* numericStats = stats->ruleStatistics( numericRule, matchKind );
+        testTrue( numericStats != 0 );
+        testEqual( numericStats->winCount, 2 );
+        testEqual( numericStats->wastedCount(), multiPatternScan ? 0 : numericStats->matchCount - 2 );
+        const GrammarRuleStatistics* integerStats = stats->ruleStatistics( integerRule, GrammarLexerStatistics::MatchSearch );
+        testTrue( multiPatternScan || integerStats != 0 );
+        if( integerStats ) { testEqual( integerStats->winCount, 0 ); }
+
+        // the multi-line rules win with their begin- and end-patterns
+        testEqual( stats->ruleStatistics( stringRule, matchKind )->winCount, 1 );
+        testEqual( stats->ruleStatistics( stringRule, GrammarLexerStatistics::EndSearch )->winCount, 1 );
+        testEqual( stats->ruleStatistics( commentRule, matchKind )->winCount, 1 );
+        testEqual( stats->ruleStatistics( commentRule, GrammarLexerStatistics::EndSearch )->winCount, 1 );
+
+        // the combined searches without a match are recorded on the context rule
+        const GrammarRuleStatistics* combinedStats = stats->ruleStatistics( mainRule, GrammarLexerStatistics::CombinedSearch );
+        testTrue( multiPatternScan == ( combinedStats != 0 ) );
+
+        // the instrumentation doesn't change the result
+        lexer()->setStatisticsEnabled( false );
+        testEqual( lexAndDumpScopes( multiPatternScan ).join("\n"), expected.join("\n") );
+        testTrue( lexer()->statistics() == 0 );
+    }
+
+    // the statistics of parallel lexed chunks are merged
+    lexer()->setStatisticsEnabled( true );
+    scopes()->removeScopesAfterOffset(0);
+    lexer()->lexLinesParallel( 0, doc_->lineCount(), 1 );
+    testTrue( lexer()->statistics()->lineCount() >= 3 );
+    testTrue( lexer()->statistics()->ruleStatistics( numericRule, GrammarLexerStatistics::CombinedSearch )->winCount >= 2 );
+
+    QJsonParseError jsonError;
+    QJsonObject json = QJsonDocument::fromJson( lexer()->statistics()->toJson().toUtf8(), &jsonError ).object();
+    testTrue( jsonError.error == QJsonParseError::NoError );
+    testEqual( json.value("lines").toInt(), lexer()->statistics()->lineCount() );
+    bool numericRuleFound = false;
+    foreach( const QJsonValue& value, json.value("combined").toArray() ) {
+        QJsonObject rule = value.toObject();
+        if( rule.value("scope").toString() == "constant.numeric.scantest" && rule.value("pattern").toString() == "\\d+" ) { numericRuleFound = true; }
+    }
+    testTrue( numericRuleFound );
+    testTrue( lexer()->statistics()->toString().contains( "constant.numeric.integer.scantest" ) );
+
+    // a combined match that loses from an individually searched rule (the heredoc) is wasted
+    doc_->replace( 0, doc_->length(), "<<a a 12" );
+    lexer()->setStatisticsEnabled( false );
+    lexer()->setStatisticsEnabled( true );
+    lexAndDumpScopes( true );
+    const GrammarRuleStatistics* numericStats = lexer()->statistics()->ruleStatistics( numericRule, GrammarLexerStatistics::CombinedSearch );
+    testEqual( numericStats->matchCount, 2 );
+    testEqual( numericStats->winCount, 1 );
+    testEqual( numericStats->wastedCount(), 1 );
+}
+
+
 /// creates the main fixture document
 void GrammarTextLexerTest::createFixtureDocument( const QString& data )
 {
@@ -93,6 +476,57 @@ void GrammarTextLexerTest::createFixtureDocument( const QString& data )
 }
 
 
+/// creates the fixture document with the fixture grammar. Both are deleted by clean()
+void GrammarTextLexerTest::createFixtureGrammarDocument( const QString& data )
+{
+    grammar_ = createFixtureGrammar();
+    createFixtureDocument( data );
+    doc_->setLanguageGrammar( grammar_ );
+}
+
+
+/// Creates a small grammar with combinable and non-combinable rules, includes and multi-line rules
+/// @return the grammar (the caller is the owner)
+TextGrammar* GrammarTextLexerTest::createFixtureGrammar()
+{
+    TextGrammar* grammar = new TextGrammar( "source.scantest", "Scan Test" );
+    TextGrammarRule* mainRule = TextGrammarRule::createMainRule( grammar, "source.scantest" );
+    grammar->giveMainRule( mainRule );
+
+    mainRule->giveRule( TextGrammarRule::createIncludeRule( grammar, "#comments" ) );
+    mainRule->giveRule( TextGrammarRule::createSingleLineRegExp( grammar, "keyword.control.scantest", "\\b(if|else|while)\\b" ) );
+    mainRule->giveRule( TextGrammarRule::createSingleLineRegExp( grammar, "string.unquoted.heredoc.scantest", "<<(\\w+)\\s+\\1" ) );
+    mainRule->giveRule( TextGrammarRule::createSingleLineRegExp( grammar, "constant.numeric.scantest", "\\d+" ) );
+    mainRule->giveRule( TextGrammarRule::createSingleLineRegExp( grammar, "constant.numeric.integer.scantest", "\\d+" ) );  // never wins
+    mainRule->giveRule( TextGrammarRule::createSingleLineRegExp( grammar, "keyword.operator.scantest", "(?x) == | \\+ | = # operators" ) );
+
+    TextGrammarRule* stringRule = TextGrammarRule::createMultiLineRegExp( grammar, "string.quoted.scantest", "string.quoted.scantest", "(['\"])", "\\1" );
+    stringRule->setCapture( 1, "punctuation.definition.string.begin.scantest" );
+    stringRule->setEndCapture( 0, "punctuation.definition.string.end.scantest" );
+    stringRule->giveRule( TextGrammarRule::createSingleLineRegExp( grammar, "constant.character.escape.scantest", "\\\\." ) );
+    mainRule->giveRule( stringRule );
+
+    TextGrammarRule* comments = TextGrammarRule::createRuleList( grammar );
+    comments->giveRule( TextGrammarRule::createSingleLineRegExp( grammar, "comment.line.double-slash.scantest", "//.*$" ) );
+    comments->giveRule( TextGrammarRule::createMultiLineRegExp( grammar, "comment.block.scantest", "comment.block.scantest", "/\\*", "\\*/" ) );
+    grammar->giveToRepos( "comments", comments );
+
+    return grammar;
+}
+
+
+/// Lexes the complete fixture document and returns the dumped scopes
+/// @param multiPatternScan should the multi-pattern scan be used
+/// @return the list with all scopes
+QStringList GrammarTextLexerTest::lexAndDumpScopes( bool multiPatternScan )
+{
+    lexer()->setMultiPatternScanEnabled( multiPatternScan );
+    scopes()->removeScopesAfterOffset(0);
+    lexer()->lexRange( 0, doc_->length() );
+    return scopes()->scopesAsStringList();
+}
+
+
 /// Returns a references to the document scopes
 TextDocumentScopes* GrammarTextLexerTest::scopes()
 {
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <QStringList>
+
 #include "util/test.h"
 
 namespace edbee {
@@ -27,16 +29,30 @@ private slots:
     void clean();
 
     void testHamlLexer();
+    void testCombinablePatterns();
+    void testMultiPatternScan();
+    void testMultiPatternScanWithLoadedGrammars();
+    void testEndRegExpCache();
+    void testLineLimits();
+    void testRelexIncompleteLine();
+    void testParallelLexing();
+    void testBackgroundLexing();
+    void testLineInterning();
+    void testStatistics();
 
 private:
 
 private: 
     void createFixtureDocument( const QString& data );
+    void createFixtureGrammarDocument( const QString& data );
+    TextGrammar* createFixtureGrammar();
+    QStringList lexAndDumpScopes( bool multiPatternScan );
 
     TextDocumentScopes* scopes();
     GrammarTextLexer* lexer();
 
     TextDocument* doc_;         ///< The document used for testign
+    TextGrammar* grammar_;      ///< The fixture grammar of the document (0 when the document uses another grammar)
 
 };
 
@@ -0,0 +1,168 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textdiffmodeltest.h"
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QTimer>
+
+#include "edbee/models/chardocument/chartextdocument.h"
+#include "edbee/models/textdiffmodel.h"
+#include "edbee/models/textlinediffindex.h"
+#include "edbee/models/textundostack.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Tests the differences with a base text
+void TextDiffModelTest::testDiffBase()
+{
+    CharTextDocument doc;
+    doc.setText("a\nB\nc\nx\nd");
+    doc.diffModel()->setThreadingEnabled(false);
+    doc.setDiffBase("a\nb\nc\nd");
+    testEqual( lineStatuses(&doc), "-C-I-" );
+    testEqual( doc.diffModel()->baseLineForLine(4), 3 );
+    testEqual( doc.diffModel()->baseLineForLine(3), -1 );
+
+    // the changed line shows the inserted character and the position of the removed character
+    const QVector<TextLineDiffSpan>& spans = doc.lineDiffSpans(1);
+    testEqual( spans.size(), 2 );
+    testEqual( spans.at(0).start, 0 );
+    testEqual( spans.at(0).length, 1 );
+    testEqual( spans.at(1).start, 1 );
+    testEqual( spans.at(1).length, 0 );
+
+    // unchanged and inserted lines have no changed parts
+    testTrue( doc.lineDiffSpans(0).isEmpty() );
+    testTrue( doc.lineDiffSpans(3).isEmpty() );
+}
+
+
+/// Tests if the differences follow the changes of the document
+void TextDiffModelTest::testEdits()
+{
+    CharTextDocument doc;
+    doc.setText("a\nB\nc\nx\nd");
+    doc.diffModel()->setThreadingEnabled(false);
+    doc.setDiffBase("a\nb\nc\nd");
+    testEqual( lineStatuses(&doc), "-C-I-" );
+
+    // restore the changed line
+    doc.replace( 2, 1, "b" );
+    testEqual( lineStatuses(&doc), "---I-" );
+
+    // inserting a line moves the other lines
+    doc.replace( 0, 0, "new\n" );
+    testEqual( lineStatuses(&doc), "I---I-" );
+    testEqual( doc.diffModel()->baseLineForLine(5), 3 );
+
+    // remove the line 'c'
+    doc.replace( doc.offsetFromLine(3), 2, "" );
+    testEqual( doc.text(), "new\na\nb\nx\nd" );
+    testEqual( lineStatuses(&doc), "I--C-" );
+
+    // remove the line 'x', the removed base line is shown at the next line
+    doc.replace( doc.offsetFromLine(3), 2, "" );
+    testEqual( lineStatuses(&doc), "I--D" );
+
+    // undo restores the differences
+    doc.textUndoStack()->undo();
+    testEqual( lineStatuses(&doc), "I--C-" );
+}
+
+
+/// Tests if a static diff lookup is moved when lines are inserted
+void TextDiffModelTest::testDiffLookupMovesLines()
+{
+    CharTextDocument doc;
+    doc.setText("x\nab\ny");
+
+    QVector<stringdiff::Diff> changedLine;
+    changedLine.append( stringdiff::Diff( stringdiff::EQUAL, "a" ) );
+    changedLine.append( stringdiff::Diff( stringdiff::INSERT, "b" ) );
+    QVector<QVector<stringdiff::Diff>> lookup;
+    lookup.append( QVector<stringdiff::Diff>() );
+    lookup.append( changedLine );
+    lookup.append( QVector<stringdiff::Diff>() );
+    doc.setDiffLookup( lookup );
+    testEqual( lineStatuses(&doc), "-I-" );
+    testEqual( doc.lineDiffSpans(1).size(), 1 );
+
+    doc.replace( 0, 0, "new\n" );
+    testEqual( lineStatuses(&doc), "--I-" );
+    testEqual( doc.lineDiffSpans(2).size(), 1 );
+    testEqual( doc.lineDiffSpans(2).at(0).start, 1 );
+
+    // the changed parts of an edited line don't match its text anymore
+    doc.replace( doc.offsetFromLine(2) + 1, 1, "c" );
+    testEqual( lineStatuses(&doc), "--I-" );
+    testTrue( doc.lineDiffSpans(2).isEmpty() );
+}
+
+
+/// Tests diffing on the worker thread. The notification of a job that's thrown away when threading is toggled
+/// may not finish the job that runs after it
+void TextDiffModelTest::testThreadedDiff()
+{
+    CharTextDocument doc;
+    doc.setText("a\nB\nc\nx\nd");
+    doc.setDiffBase("a\nb\nc\nd");
+    testTrue( doc.diffModel()->isThreadingEnabled() );
+    testTrue( waitForLineDiffs( doc.diffModel() ) );
+    testEqual( lineStatuses(&doc), "-C-I-" );
+
+    // start a job and throw it away by disabling threading. Its notification is still queued
+    doc.replace( 2, 1, "b" );
+    QMetaObject::invokeMethod( doc.diffModel(), "startUpdate" );
+    doc.diffModel()->setThreadingEnabled(false);
+    testEqual( lineStatuses(&doc), "---I-" );
+
+    // the next job is running when the notification of the old job arrives
+    doc.diffModel()->setThreadingEnabled(true);
+    doc.replace( 0, 1, "A" );
+    QMetaObject::invokeMethod( doc.diffModel(), "startUpdate" );
+    testTrue( doc.diffModel()->isUpdating() );
+    testTrue( waitForLineDiffs( doc.diffModel() ) );
+    testFalse( doc.diffModel()->isUpdating() );
+    testEqual( lineStatuses(&doc), "C--I-" );
+}
+
+
+/// Runs the event loop until the model reports changed line differences
+/// @return false when the model doesn't report the differences within 10 seconds
+bool TextDiffModelTest::waitForLineDiffs( TextDiffModel* model )
+{
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot( true );
+    connect( model, SIGNAL(lineDiffsChanged(int,int)), &loop, SLOT(quit()) );
+    connect( &timer, SIGNAL(timeout()), &loop, SLOT(quit()) );
+    timer.start( 10000 );
+    loop.exec();
+    return timer.isActive();
+}
+
+
+/// Returns the status of all lines: '-' unchanged, 'C' changed, 'I' inserted and 'D' removed lines before it
+QString TextDiffModelTest::lineStatuses( TextDocument* doc )
+{
+    QString result;
+    for( int line=0, cnt=doc->lineCount(); line<cnt; ++line ) {
+        switch( doc->getLineStatus(line) ) {
+            case TextLineDiffIndex::LineChanged: result.append("C"); break;
+            case TextLineDiffIndex::LineInserted: result.append("I"); break;
+            case TextLineDiffIndex::LineDeleted: result.append("D"); break;
+            default: result.append("-");
+        }
+    }
+    return result;
+}
+
+
+} // edbee
@@ -0,0 +1,36 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "util/test.h"
+
+namespace edbee {
+
+class TextDiffModel;
+class TextDocument;
+
+
+/// Tests the incremental line differences
+class TextDiffModelTest : public edbee::test::TestCase
+{
+    Q_OBJECT
+
+private slots:
+
+    void testDiffBase();
+    void testEdits();
+    void testDiffLookupMovesLines();
+    void testThreadedDiff();
+
+private:
+    bool waitForLineDiffs( TextDiffModel* model );
+    QString lineStatuses( TextDocument* doc );
+};
+
+
+} // edbee
+
+DECLARE_TEST(edbee::TextDiffModelTest);
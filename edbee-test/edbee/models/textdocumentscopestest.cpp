@@ -5,7 +5,10 @@
 
 #include "textdocumentscopestest.h"
 
+#include "edbee/models/chardocument/chartextdocument.h"
+#include "edbee/models/textdocument.h"
 #include "edbee/models/textdocumentscopes.h"
+#include "edbee/views/texttheme.h"
 #include "edbee/edbee.h"
 
 #include "debug.h"
@@ -157,5 +160,231 @@ void TextDocumentScopesTest::testScopeSelectorRanking()
 
 
 
+/// Tests if the compiled selectors give the same scores as the selectors
+void TextDocumentScopesTest::testScopeSelectorMatcher()
+{
+    TextScopeManager* sm = Edbee::instance()->scopeManager();
+
+    QStringList selectorNames;
+    selectorNames << "text.* markup.bold" << "text markup.bold" << "markup.bold" << "text.html meta.*.markdown markup"
+                  << "text.html meta.* markup" << "text.html * markup" << "text.html markup" << "text markup" << "markup"
+                  << "text.html" << "text" << "source.ruby" << "markup.italic, text.html" << "meta markup.bold" << ""
+                  << "text.html.basic source.php.embedded.html" << "markup.bold.markdown.extra" << "*";
+
+    QStringList scopeNames;
+    scopeNames << "text.html.markdown meta.paragraph.markdown markup.bold.markdown" << "source.ruby" << "source.*"
+               << "text.html.* source.php.*.*" << "text.html.basic source.php.embedded.html string.quoted"
+               << "markup.bold" << "";
+
+    QList<TextScopeSelector*> selectors;
+    TextScopeSelectorMatcher matcher;
+    foreach( QString name, selectorNames ) {
+        selectors.append( new TextScopeSelector( name ) );
+        testEqual( matcher.addSelector( selectors.last() ), selectors.size()-1 );
+    }
+    testEqual( matcher.selectorCount(), selectors.size() );
+
+    foreach( QString name, scopeNames ) {
+        TextScopeList* scopeList = sm->createTextScopeList( name );
+        QVector<TextScopeMatchScore> scores;
+        matcher.calculateMatchScores( scopeList, scores );
+        testEqual( scores.size(), selectors.size() );
+
+        int bestIndex = -1;
+        double bestScore = -1.0;
+        QVector<int> expectedMatches;
+        for( int i=0; i<selectors.size(); ++i ) {
+            double score = selectors.at(i)->calculateMatchScore( scopeList );
+            testTrue( qAbs( TextScopeSelectorMatcher::scoreToDouble( scores.at(i) ) - score ) < 1e-12 );
+            if( score >= 0 ) { expectedMatches.append(i); }
+            if( score > bestScore ) {
+                bestScore = score;
+                bestIndex = i;
+            }
+        }
+
+        QVector<int> matches;
+        matcher.findMatches( scopeList, matches );
+        testTrue( matches == expectedMatches );
+        testEqual( matcher.findBestMatch( scopeList ), bestIndex );
+        delete scopeList;
+    }
+
+    // the ranking order of the textmate selector test
+    TextScopeList* multiScope = sm->createTextScopeList("text.html.markdown meta.paragraph.markdown markup.bold.markdown");
+    QVector<TextScopeMatchScore> scores;
+    matcher.calculateMatchScores( multiScope, scores );
+    for( int i=1; i<11; ++i ) {
+        testTrue( scores.at(i) < scores.at(i-1) );
+    }
+    testEqual( matcher.findBestMatch( multiScope ), 0 );
+    delete multiScope;
+
+    matcher.clear();
+    testEqual( matcher.selectorCount(), 0 );
+    qDeleteAll(selectors);
+}
+
+
+/// Tests the compact line range list and the range pool
+void TextDocumentScopesTest::testScopedRangeList()
+{
+    TextScopeManager* sm = Edbee::instance()->scopeManager();
+    TextScope* source = sm->refTextScope("source.test");
+    TextScope* keyword = sm->refTextScope("keyword.test");
+    MultiLineScopedTextRange multiRange( 0, 100, source );
+
+    ScopedTextRangePool pool;
+    ScopedTextRangeList* list = new ScopedTextRangeList( &pool );
+    list->addRange( 0, 20, multiRange );
+    for( int i=0; i<10; ++i ) {
+        list->addRange( i, i+1, keyword );
+    }
+    testEqual( list->size(), 11 );
+    testTrue( list->at(0)->multiLineScopedTextRange() == &multiRange );
+    testTrue( list->at(0)->scope() == source );
+    testTrue( list->at(1)->multiLineScopedTextRange() == 0 );
+    testEqual( list->at(10)->toString(), QString("9>10:keyword.test") );
+
+    // squeezing only keeps the used ranges
+    list->squeeze();
+    testEqual( pool.usedBytes(), (qint64)( 11 * sizeof(ScopedTextRange) ) );
+
+    // moving to another pool
+    ScopedTextRangePool otherPool;
+    list->moveToPool( &otherPool );
+    testEqual( pool.usedBytes(), (qint64)0 );
+    testEqual( otherPool.usedBytes(), (qint64)( 11 * sizeof(ScopedTextRange) ) );
+    testEqual( list->at(10)->toString(), QString("9>10:keyword.test") );
+    delete list;
+    testEqual( otherPool.usedBytes(), (qint64)0 );
+
+    // released arrays are reused
+    ScopedTextRange* ranges = pool.allocate(4);
+    pool.release( ranges, 4 );
+    testTrue( pool.allocate(4) == ranges );
+    pool.release( ranges, 4 );
+}
+
+
+/// Returns the ranges between the given offsets by scanning all ranges (the algorithm without the range index)
+static QString rangesBetweenOffsetsByScanning( QList<MultiLineScopedTextRange*>& ranges, int offsetBegin, int offsetEnd )
+{
+    QStringList result;
+    foreach( MultiLineScopedTextRange* range, ranges ) {
+        if( (offsetBegin <= range->min() && range->min() < offsetEnd) || (range->min() <= offsetBegin && offsetBegin < range->max()) ) {
+            result.append( range->toString() );
+        }
+    }
+    return result.join("|");
+}
+
+
+/// Returns the ranges between the given offsets with the range index
+static QString rangesBetweenOffsets( TextDocumentScopes* scopes, int offsetBegin, int offsetEnd )
+{
+    QStringList result;
+    QVector<MultiLineScopedTextRange*> ranges = scopes->multiLineScopedRangesBetweenOffsets( offsetBegin, offsetEnd );
+    for( int i=1; i<ranges.size(); ++i ) {  // (skip the default range)
+        result.append( ranges.at(i)->toString() );
+    }
+    return result.join("|");
+}
+
+
+/// Tests the max-end index of the multi-line ranges
+void TextDocumentScopesTest::testMultiLineRangeIndex()
+{
+    CharTextDocument doc;
+    doc.setText( QString("a").repeated(200) );
+    TextDocumentScopes* scopes = doc.scopes();
+    TextScope* scope = Edbee::instance()->scopeManager()->refTextScope("comment.test");
+
+    // nested and sequential ranges (sorted by start offset)
+    QList<MultiLineScopedTextRange*> ranges;
+    for( int i=0; i<40; ++i ) {
+        int min = i * 5;
+        int max = ( i % 4 == 0 ) ? min + 60 : min + 3;
+        ranges.append( new MultiLineScopedTextRange( min, qMin( max, 200 ), scope ) );
+        scopes->giveMultiLineScopedTextRange( ranges.last() );
+    }
+    for( int offset=0; offset <= 200; ++offset ) {
+        testEqual( rangesBetweenOffsets( scopes, offset, offset ), rangesBetweenOffsetsByScanning( ranges, offset, offset ) );
+        testEqual( rangesBetweenOffsets( scopes, offset, offset+7 ), rangesBetweenOffsetsByScanning( ranges, offset, offset+7 ) );
+    }
+
+    // changing the end of a range
+    scopes->setMultiLineScopedTextRangeMax( *ranges.at(8), 190 );
+    scopes->setMultiLineScopedTextRangeMax( *ranges.at(0), 2 );
+    for( int offset=0; offset <= 200; ++offset ) {
+        testEqual( rangesBetweenOffsets( scopes, offset, offset ), rangesBetweenOffsetsByScanning( ranges, offset, offset ) );
+    }
+
+    // removing ranges in the middle (the index is rebuilt on the next query)
+    scopes->removeMultiLineScopedTextRange( ranges.takeAt(30) );
+    scopes->removeMultiLineScopedTextRange( ranges.takeAt(22) );
+    scopes->removeMultiLineScopedTextRange( ranges.takeAt(10) );
+    scopes->setMultiLineScopedTextRangeMax( *ranges.at(12), 170 );  // (65>68)
+    for( int offset=0; offset <= 200; ++offset ) {
+        testEqual( rangesBetweenOffsets( scopes, offset, offset ), rangesBetweenOffsetsByScanning( ranges, offset, offset ) );
+    }
+
+    // removing the ranges after an offset, moves the end of the covering ranges to the end of the document
+    scopes->removeScopesAfterOffset( 101 );
+    while( ranges.last()->min() >= 101 ) { ranges.removeLast(); }   // (deleted by the scopes)
+    for( int offset=0; offset <= 200; ++offset ) {
+        testEqual( rangesBetweenOffsets( scopes, offset, offset ), rangesBetweenOffsetsByScanning( ranges, offset, offset ) );
+    }
+    testEqual( rangesBetweenOffsets( scopes, 150, 150 ), QString("40>200:comment.test|60>200:comment.test|65>200:comment.test|80>200:comment.test|100>200:comment.test") );
+}
+
+
+/// Tests the interned scope stacks and the theme formats that are cached per stack
+void TextDocumentScopesTest::testScopeStackIds()
+{
+    TextScopeManager* sm = Edbee::instance()->scopeManager();
+    TextScope* source = sm->refTextScope("source.stacktest");
+    TextScope* comment = sm->refTextScope("comment.stacktest");
+
+    TextScopeStackId sourceId = sm->findOrRegisterScopeStack( 0, source );
+    TextScopeStackId commentId = sm->findOrRegisterScopeStack( sourceId, comment );
+    testTrue( sourceId != 0 );
+    testTrue( commentId != sourceId );
+    testEqual( sm->findOrRegisterScopeStack( 0, source ), sourceId );
+    testEqual( sm->findOrRegisterScopeStack( sourceId, comment ), commentId );
+
+    // the same scope in another stack is another stack
+    TextScopeStackId otherId = sm->findOrRegisterScopeStack( 0, comment );
+    testTrue( otherId != commentId );
+    testTrue( otherId != sourceId );
+
+    // the theme caches the format once per stack
+    TextTheme theme;
+    theme.giveThemeRule( new TextThemeRule( "comment", "comment", QColor(Qt::green) ) );
+    ScopedTextRange sourceRange( 0, 10, source );
+    ScopedTextRange commentRange( 2, 5, comment );
+    QVector<ScopedTextRange*> activeRanges;
+    activeRanges.append( &sourceRange );
+    activeRanges.append( &commentRange );
+
+    QTextCharFormat expected;
+    TextScopeList scopeList( activeRanges );
+    theme.fillFormatForTextScopeList( &scopeList, &expected );
+    testTrue( theme.formatForScopeStack( commentId, activeRanges ) == expected );
+    testEqual( theme.formatCacheSize(), 1 );
+    testTrue( theme.formatForScopeStack( commentId, activeRanges ) == expected );
+    testEqual( theme.formatCacheSize(), 1 );
+    testTrue( theme.formatForScopeStack( commentId, activeRanges ).foreground().color() == QColor(Qt::green) );
+
+    activeRanges.removeLast();
+    testTrue( theme.formatForScopeStack( sourceId, activeRanges ).foreground().color() != QColor(Qt::green) );
+    testEqual( theme.formatCacheSize(), 2 );
+
+    // changing the rules clears the cache
+    theme.giveThemeRule( new TextThemeRule( "source", "source", QColor(Qt::red) ) );
+    testEqual( theme.formatCacheSize(), 0 );
+    testTrue( theme.formatForScopeStack( sourceId, activeRanges ).foreground().color() == QColor(Qt::red) );
+}
+
 
 } // edbee
@@ -20,6 +20,12 @@ private slots:
     void testRindexOf();
 
     void testScopeSelectorRanking();
+    void testScopeSelectorMatcher();
+
+    void testScopedRangeList();
+    void testMultiLineRangeIndex();
+
+    void testScopeStackIds();
 
 };
 
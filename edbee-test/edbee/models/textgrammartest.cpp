@@ -0,0 +1,78 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textgrammartest.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+
+#include "edbee/models/textgrammar.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// A grammar manager that isn't the global instance
+class TestGrammarManager : public TextGrammarManager
+{
+public:
+    TestGrammarManager() {}
+    virtual ~TestGrammarManager() {}
+};
+
+
+/// Tests the concurrent reading of all grammar files. The result should be the same as reading the files one by one
+void TextGrammarTest::testReadAllGrammarFilesInPath()
+{
+    QString path = QDir::temp().filePath( QString("edbee-grammar-test-%1").arg( QDateTime::currentMSecsSinceEpoch() ) );
+    QDir().mkpath( path );
+
+    // a few grammars and an invalid file
+    const int grammarCount = 12;
+    for( int i=0; i<grammarCount; ++i ) {
+        QFile file( QString("%1/grammar%2.tmLanguage").arg(path).arg(i,2,10,QChar('0')) );
+        testTrue( file.open( QIODevice::WriteOnly ) );
+        file.write( QString(
+            "<plist version=\"1.0\"><dict>"
+            "<key>fileTypes</key><array><string>g%1</string></array>"
+            "<key>name</key><string>Grammar %1</string>"
+            "<key>patterns</key><array><dict><key>match</key><string>\\d{%1}</string><key>name</key><string>constant.g%1</string></dict></array>"
+            "<key>scopeName</key><string>source.g%1</string>"
+            "</dict></plist>" ).arg(i).toUtf8() );
+        file.close();
+    }
+    QFile invalidFile( QString("%1/invalid.tmLanguage").arg(path) );
+    testTrue( invalidFile.open( QIODevice::WriteOnly ) );
+    invalidFile.write( "<plist><dict><key>name</key>" );
+    invalidFile.close();
+
+    for( int lazy=0; lazy<2; ++lazy ) {
+        TestGrammarManager manager;
+        manager.setLazyLoadingEnabled( lazy != 0 );
+        manager.readAllGrammarFilesInPath( path );
+
+        testEqual( manager.grammars().size(), grammarCount + 1 );    // including the default grammar
+        testFalse( manager.lastErrorMessage().isEmpty() );
+        for( int i=0; i<grammarCount; ++i ) {
+            TextGrammar* grammar = manager.get( QString("source.g%1").arg(i) );
+            testTrue( grammar != 0 );
+            testEqual( grammar->displayName(), QString("Grammar %1").arg(i) );
+            testEqual( grammar->mainRule()->ruleCount(), 1 );
+            testEqual( grammar->mainRule()->rule(0)->scopeName(), QString("constant.g%1").arg(i) );
+            testTrue( manager.detectGrammarWithFilename( QString("file.g%1").arg(i) ) == grammar );
+        }
+    }
+
+    QDir dir( path );
+    foreach( QString file, dir.entryList( QDir::Files ) ) {
+        dir.remove( file );
+    }
+    QDir().rmdir( path );
+}
+
+
+} // edbee
@@ -0,0 +1,22 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "util/test.h"
+
+namespace edbee {
+
+class TextGrammarTest : public edbee::test::TestCase
+{
+Q_OBJECT
+private slots:
+
+    void testReadAllGrammarFilesInPath();
+
+};
+
+}
+DECLARE_TEST(edbee::TextGrammarTest);
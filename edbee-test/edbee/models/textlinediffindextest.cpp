@@ -0,0 +1,47 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textlinediffindextest.h"
+
+#include "edbee/models/textlinediffindex.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Tests the status and the changed parts of the lines
+void TextLineDiffIndexTest::testLineDiff()
+{
+    TextLineDiffIndex index;
+    testTrue( index.isEmpty() );
+    testEqual( index.lineStatus(0), int(TextLineDiffIndex::LineUnchanged) );
+    testTrue( index.lineSpans(0).isEmpty() );
+
+    index.setLineCount( 3 );
+    testEqual( index.lineCount(), 3 );
+    testEqual( index.lineStatus(1), int(TextLineDiffIndex::LineUnchanged) );
+
+    QVector<TextLineDiffSpan> spans;
+    spans.append( TextLineDiffSpan( 2, 3, 1 ) );
+    spans.append( TextLineDiffSpan( 8, 1, 2 ) );
+    index.setLineDiff( 1, TextLineDiffIndex::LineChanged, spans );
+    testEqual( index.lineStatus(1), int(TextLineDiffIndex::LineChanged) );
+    testEqual( index.lineSpans(1).size(), 2 );
+    testEqual( index.lineSpans(1).at(1).start, 8 );
+    testEqual( index.lineSpans(1).at(1).length, 1 );
+    testEqual( index.lineSpans(1).at(1).kind, 2 );
+    testTrue( index.lineSpans(2).isEmpty() );
+
+    // lines outside the index are unchanged
+    testEqual( index.lineStatus(-1), int(TextLineDiffIndex::LineUnchanged) );
+    testTrue( index.lineSpans(3).isEmpty() );
+
+    index.clear();
+    testTrue( index.isEmpty() );
+}
+
+
+} // edbee
@@ -0,0 +1,26 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "util/test.h"
+
+namespace edbee {
+
+
+/// Tests the line difference index
+class TextLineDiffIndexTest : public edbee::test::TestCase
+{
+    Q_OBJECT
+
+private slots:
+
+    void testLineDiff();
+};
+
+
+} // edbee
+
+DECLARE_TEST(edbee::TextLineDiffIndexTest);
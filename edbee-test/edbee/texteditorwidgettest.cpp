@@ -0,0 +1,89 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "texteditorwidgettest.h"
+
+#include <QStringList>
+
+#include "edbee/models/textdocument.h"
+#include "edbee/texteditorcontroller.h"
+#include "edbee/texteditorwidget.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Overlapping and adjacent lines are combined
+void TextEditorWidgetTest::testScheduleLineUpdate()
+{
+    widget_->scheduleLineUpdate( 5, 1 );
+    widget_->scheduleLineUpdate( 7, 2 );
+    testEqual( scheduledLines(), "5-5,7-8" );
+
+    widget_->scheduleLineUpdate( 6, 1 );
+    testEqual( scheduledLines(), "5-8" );
+
+    widget_->scheduleLineUpdate( 20, 3 );
+    widget_->scheduleLineUpdate( 4, 0 );
+    testEqual( scheduledLines(), "5-8,20-22" );
+
+    widget_->scheduleLineUpdate( 0, 30 );
+    testEqual( scheduledLines(), "0-29" );
+
+    widget_->updateScheduledLines();
+    testEqual( scheduledLines(), "" );
+}
+
+
+/// A change in a line only repaints that line, a new line repaints the lines after it
+void TextEditorWidgetTest::testTextChangeUpdate()
+{
+    doc()->replace( doc()->offsetFromLine(5) + 2, 0, "x" );
+    testEqual( scheduledLines(), "5-5" );
+    widget_->updateScheduledLines();
+
+    doc()->replace( doc()->offsetFromLine(5) + 2, 0, "\n" );
+    testEqual( scheduledLines(), "5-21" );
+    widget_->updateScheduledLines();
+
+    doc()->replace( doc()->offsetFromLine(5), doc()->lineLength(5), "" );
+    testEqual( scheduledLines(), "5-21" );
+}
+
+
+/// A caret movement repaints the old and the new caret line, a growing selection only the new lines
+void TextEditorWidgetTest::testSelectionChangeUpdate()
+{
+    TextEditorController* controller = widget_->controller();
+    controller->moveCaretTo( 3, 0, false );
+    widget_->updateScheduledLines();
+
+    controller->moveCaretTo( 7, 2, false );
+    testEqual( scheduledLines(), "3-3,7-7" );
+    widget_->updateScheduledLines();
+
+    controller->moveCaretTo( 9, 2, true );
+    testEqual( scheduledLines(), "7-9" );
+    widget_->updateScheduledLines();
+
+    controller->moveCaretTo( 10, 1, true );
+    testEqual( scheduledLines(), "9-10" );
+}
+
+
+/// returns the scheduled lines as a string (first-last,first-last)
+QString TextEditorWidgetTest::scheduledLines()
+{
+    QStringList result;
+    QMap<int,int> lineMap = widget_->scheduledLines();
+    for( QMap<int,int>::const_iterator itr = lineMap.constBegin(); itr != lineMap.constEnd(); ++itr ) {
+        result.append( QString("%1-%2").arg(itr.key()).arg(itr.value()) );
+    }
+    return result.join(",");
+}
+
+
+} // edbee
@@ -0,0 +1,31 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "edbee/texteditorwidgettestcase.h"
+
+namespace edbee {
+
+
+/// Tests the repainting of the text editor widget
+class TextEditorWidgetTest : public TextEditorWidgetTestCase
+{
+    Q_OBJECT
+
+private slots:
+
+    void testScheduleLineUpdate();
+    void testTextChangeUpdate();
+    void testSelectionChangeUpdate();
+
+private:
+    QString scheduledLines();
+};
+
+
+} // edbee
+
+DECLARE_TEST(edbee::TextEditorWidgetTest);
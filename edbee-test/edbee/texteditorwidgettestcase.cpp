@@ -0,0 +1,52 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "texteditorwidgettestcase.h"
+
+#include <QStringList>
+
+#include "edbee/models/textdocument.h"
+#include "edbee/texteditorcontroller.h"
+#include "edbee/texteditorwidget.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Creates a widget with a document of 20 lines ("line 0" to "line 19"), without scheduled line updates
+void TextEditorWidgetTestCase::init()
+{
+    widget_ = new TextEditorWidget();
+    QStringList lines;
+    for( int i=0; i<20; ++i ) { lines.append( QString("line %1").arg(i) ); }
+    doc()->setText( lines.join("\n") );
+    widget_->updateScheduledLines();
+}
+
+
+/// destroys the widget
+void TextEditorWidgetTestCase::clean()
+{
+    delete widget_;
+    widget_ = 0;
+}
+
+
+/// returns the document
+TextDocument* TextEditorWidgetTestCase::doc()
+{
+    return widget_->textDocument();
+}
+
+
+/// returns the renderer
+TextRenderer* TextEditorWidgetTestCase::renderer()
+{
+    return widget_->controller()->textRenderer();
+}
+
+
+} // edbee
@@ -0,0 +1,36 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "util/test.h"
+
+namespace edbee {
+
+class TextDocument;
+class TextEditorWidget;
+class TextRenderer;
+
+
+/// The base class of the tests that need a text editor widget.
+/// Every test gets a new widget with a document of 20 lines
+class TextEditorWidgetTestCase : public edbee::test::TestCase
+{
+    Q_OBJECT
+
+protected slots:
+
+    virtual void init();
+    virtual void clean();
+
+protected:
+    TextDocument* doc();
+    TextRenderer* renderer();
+
+    TextEditorWidget* widget_;
+};
+
+
+} // edbee
@@ -35,4 +35,177 @@ void RegExpTest::testRegExp()
 }
 
 
+/// tests the number of capture groups
+void RegExpTest::testCaptureCount()
+{
+    RegExp noGroups( "abc" );
+    testEqual( noGroups.captureCount(), 0 );
+
+    RegExp groups( "(a)(b(c))(?:d)" );
+    testEqual( groups.captureCount(), 3 );
+}
+
+
+/// tests the required literal analysis of regexp patterns
+void RegExpTest::testFindRequiredLiteral()
+{
+    testEqual( RegExp::findRequiredLiteral("\\bfunction\\b"), QString("function") );
+    testEqual( RegExp::findRequiredLiteral("<!--"), QString("<!--") );
+    testEqual( RegExp::findRequiredLiteral("^\\s*#include"), QString("#include") );
+    testEqual( RegExp::findRequiredLiteral("ab?c"), QString("a") );
+    testEqual( RegExp::findRequiredLiteral("ab*?cd"), QString("cd") );
+    testEqual( RegExp::findRequiredLiteral("a{0,2}bcd"), QString("bcd") );
+    testEqual( RegExp::findRequiredLiteral("(foo)bar+"), QString("bar") );
+    testEqual( RegExp::findRequiredLiteral("[abc]def"), QString("def") );
+    testEqual( RegExp::findRequiredLiteral("[]a]bc"), QString("bc") );
+    testEqual( RegExp::findRequiredLiteral("\\x41BC"), QString("BC") );
+    testEqual( RegExp::findRequiredLiteral("\\((\\d+)\\)"), QString("(") );
+
+    // no literal
+    testEqual( RegExp::findRequiredLiteral("foo|bar"), QString() );
+    testEqual( RegExp::findRequiredLiteral("(?x) foo"), QString() );
+    testEqual( RegExp::findRequiredLiteral("[a-z]+"), QString() );
+
+    // case insensitive, only non-letters are used
+    testEqual( RegExp::findRequiredLiteral("Select \\*", false), QString(" *") );
+    testEqual( RegExp::findRequiredLiteral("(?i)abc1-2"), QString("1-2") );
+}
+
+
+/// tests the searching with a required literal prefilter
+void RegExpTest::testRequiredLiteralSearch()
+{
+    RegExp regExp("\\bfunction\\s+(\\w+)");
+    testEqual( regExp.requiredLiteral(), QString("function") );
+
+    // without the literal the search is skipped
+    testEqual( regExp.indexIn("var x = 12;"), -1 );
+    testEqual( regExp.pos(0), -1 );
+    testEqual( regExp.pos(1), -1 );
+
+    // a literal after the offset
+    testEqual( regExp.indexIn("function a(); function b()", 3), 14 );
+    testEqual( regExp.cap(1), QString("b") );
+
+    // the literal is present but the regexp doesn't match
+    testEqual( regExp.indexIn("functional"), -1 );
+    testEqual( regExp.pos(0), -1 );
+
+    // reverse searches
+    testEqual( regExp.lastIndexIn("function a(); function b()", 0), 14 );
+    testEqual( regExp.lastIndexIn("no match here", 0), -1 );
+}
+
+
+/// tests if the results of a previous search never leak into the next search
+void RegExpTest::testRepeatedSearches()
+{
+    RegExp regExp("(a)|(b)(c)?");
+    testEqual( regExp.indexIn("xxbc"), 2 );
+    testEqual( regExp.pos(1), -1 );
+    testEqual( regExp.pos(2), 2 );
+    testEqual( regExp.cap(3), QString("c") );
+
+    testEqual( regExp.indexIn("a"), 0 );
+    testEqual( regExp.pos(1), 0 );
+    testEqual( regExp.pos(2), -1 );
+    testEqual( regExp.pos(3), -1 );
+
+    testEqual( regExp.indexIn("xyz"), -1 );
+    testEqual( regExp.pos(0), -1 );
+    testEqual( regExp.len(0), -1 );
+    testEqual( regExp.cap(0), QString() );
+
+    // the searched string may go out of scope, the captures remain valid
+    {
+        QString str("..b");
+        regExp.indexIn(str);
+    }
+    testEqual( regExp.cap(0), QString("b") );
+}
+
+
+/// tests the match object
+void RegExpTest::testMatch()
+{
+    RegExp regExp("a+(b*)(x)?c*");
+    RegExpMatch match = regExp.match("xxxaaabccccddddd");
+    testTrue( match.hasMatch() );
+    testEqual( match.captureCount(), 2 );
+    testEqual( match.pos(0), 3 );
+    testEqual( match.len(0), 8 );
+    testEqual( match.end(0), 11 );
+    testEqual( match.pos(1), 6 );
+    testEqual( match.cap(1), QString("b") );
+    testEqual( match.pos(2), -1 );
+    testEqual( match.cap(2), QString() );
+    testEqual( match.pos(3), -1 );
+
+    // a match stays valid after the next search
+    RegExpMatch noMatch = regExp.match("nothing");
+    testFalse( noMatch.hasMatch() );
+    testEqual( noMatch.pos(0), -1 );
+    testEqual( match.cap(0), QString("aaabcccc") );
+}
+
+
+/// tests if a search that exceeds the match stack limit fails with an error
+void RegExpTest::testMatchStackLimit()
+{
+    QString text = QString("ba").repeated(1000);
+    RegExp regExp("(?:a|b)*b");
+
+    regExp.setMatchStackLimit(400);
+    testEqual( regExp.indexIn(text), -2 );
+    testFalse( regExp.errorString().isEmpty() );
+    testEqual( regExp.pos(0), -1 );
+
+    // the limit belongs to the regexp, a clone keeps it
+    RegExp* copy = regExp.clone();
+    testEqual( copy->matchStackLimit(), 400u );
+    testEqual( copy->indexIn(text), -2 );
+    delete copy;
+
+    regExp.setMatchStackLimit(0);
+    testEqual( regExp.indexIn(text), 0 );
+    testEqual( regExp.len(0), 1999 );
+}
+
+
+/// tests if a catastrophic search is stopped by the retry limit
+void RegExpTest::testRetryLimit()
+{
+    QString text = QString("x").repeated(26).append("y1");
+    RegExp regExp("(x+x+)+y\\d\\d");
+
+    regExp.setRetryLimit(100000);
+    testEqual( regExp.indexIn(text), -2 );
+    testFalse( regExp.errorString().isEmpty() );
+
+    // a normal search isn't affected
+    testEqual( regExp.indexIn("xxy12"), 0 );
+
+    // new regexps get the default limit
+    unsigned long oldLimit = RegExp::defaultRetryLimit();
+    RegExp::setDefaultRetryLimit(1234);
+    RegExp other("x");
+    testEqual( other.retryLimit(), 1234ul );
+    RegExp::setDefaultRetryLimit(oldLimit);
+}
+
+
+/// Tests if a clone keeps the options and engine of the regexp
+void RegExpTest::testClone()
+{
+    RegExp regExp("a+b", false, RegExp::SyntaxFixedString, RegExp::EngineQRegExp );
+    RegExp* clone = regExp.clone();
+    testEqual( clone->pattern(), QString("a+b") );
+    testFalse( clone->isCaseSensitive() );
+    testTrue( clone->syntax() == RegExp::SyntaxFixedString );
+    testTrue( clone->engine() == RegExp::EngineQRegExp );
+    testEqual( clone->indexIn("xA+B"), 1 );
+    delete clone;
+}
+
+
 } // edbee
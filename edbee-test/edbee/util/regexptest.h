@@ -15,6 +15,14 @@ class RegExpTest  : public edbee::test::TestCase
 private slots:
 
     void testRegExp();
+    void testCaptureCount();
+    void testFindRequiredLiteral();
+    void testRequiredLiteralSearch();
+    void testRepeatedSearches();
+    void testMatch();
+    void testMatchStackLimit();
+    void testRetryLimit();
+    void testClone();
 
 };
 
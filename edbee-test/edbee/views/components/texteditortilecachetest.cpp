@@ -0,0 +1,108 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "texteditortilecachetest.h"
+
+#include <QFont>
+#include <QPixmap>
+
+#include "edbee/views/components/texteditortilecache.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// A tile is only returned for the layout it is rendered with
+void TextEditorTileCacheTest::testTileLayoutId()
+{
+    TextEditorTileCache cache;
+    QPixmap* pixmap = new QPixmap( 16, 16 );
+    cache.giveTile( 3, 1, 10, pixmap );
+    testEqual( cache.tileCount(), 1 );
+    testTrue( cache.tile( 3, 1, 10 ) == pixmap );
+    testTrue( cache.tile( 3, 1, 11 ) == 0 );
+    testTrue( cache.tile( 3, 0, 10 ) == 0 );
+    testTrue( cache.tile( 2, 1, 10 ) == 0 );
+
+    // a new tile replaces the old one
+    QPixmap* newPixmap = new QPixmap( 16, 16 );
+    cache.giveTile( 3, 1, 11, newPixmap );
+    testEqual( cache.tileCount(), 1 );
+    testTrue( cache.tile( 3, 1, 11 ) == newPixmap );
+}
+
+
+/// Tests the removal of the tiles of lines
+void TextEditorTileCacheTest::testInvalidateLines()
+{
+    TextEditorTileCache cache;
+    for( int line=0; line<10; ++line ) {
+        cache.giveTile( line, 0, line, new QPixmap( 16, 16 ) );
+        cache.giveTile( line, 1, line, new QPixmap( 16, 16 ) );
+    }
+    testEqual( cache.tileCount(), 20 );
+
+    cache.invalidateLines( 2, 3 );
+    testEqual( cache.tileCount(), 14 );
+    testTrue( cache.tile( 1, 1, 1 ) != 0 );
+    testTrue( cache.tile( 2, 0, 2 ) == 0 );
+    testTrue( cache.tile( 4, 1, 4 ) == 0 );
+    testTrue( cache.tile( 5, 0, 5 ) != 0 );
+
+    // a lot of lines (this walks the tiles)
+    cache.invalidateLines( 0, 1000 );
+    testEqual( cache.tileCount(), 0 );
+}
+
+
+/// Inserting and removing lines moves the tiles after the change
+void TextEditorTileCacheTest::testReplaceLines()
+{
+    TextEditorTileCache cache;
+    QList<QPixmap*> pixmaps;
+    for( int line=0; line<10; ++line ) {
+        pixmaps.append( new QPixmap( 16, 16 ) );
+        cache.giveTile( line, 0, line, pixmaps.last() );
+    }
+
+    // replace line 4 with 3 lines
+    cache.replaceLines( 4, 1, 3 );
+    testEqual( cache.tileCount(), 9 );
+    testTrue( cache.tile( 3, 0, 3 ) == pixmaps.at(3) );
+    testTrue( cache.tile( 4, 0, 4 ) == 0 );
+    testTrue( cache.tile( 7, 0, 5 ) == pixmaps.at(5) );
+    testTrue( cache.tile( 11, 0, 9 ) == pixmaps.at(9) );
+
+    // remove the lines 6 to 8
+    cache.replaceLines( 6, 3, 1 );
+    testEqual( cache.tileCount(), 7 );
+    testTrue( cache.tile( 6, 0, 5 ) == 0 );
+    testTrue( cache.tile( 7, 0, 7 ) == pixmaps.at(7) );
+    testTrue( cache.tile( 9, 0, 9 ) == pixmaps.at(9) );
+}
+
+
+/// Other render settings clear the cache
+void TextEditorTileCacheTest::testValidate()
+{
+    TextEditorTileCache cache;
+    QFont font("Courier", 12);
+    cache.validate( 0, font, 16, 1.0 );
+    cache.giveTile( 0, 0, 1, new QPixmap( 16, 16 ) );
+
+    cache.validate( 0, font, 16, 1.0 );
+    testEqual( cache.tileCount(), 1 );
+
+    cache.validate( 0, font, 16, 2.0 );
+    testEqual( cache.tileCount(), 0 );
+
+    cache.giveTile( 0, 0, 1, new QPixmap( 16, 16 ) );
+    cache.validate( 0, font, 17, 2.0 );
+    testEqual( cache.tileCount(), 0 );
+}
+
+
+} // edbee
@@ -0,0 +1,29 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "util/test.h"
+
+namespace edbee {
+
+
+/// Tests the tile cache of the text editor component
+class TextEditorTileCacheTest : public edbee::test::TestCase
+{
+    Q_OBJECT
+
+private slots:
+
+    void testTileLayoutId();
+    void testInvalidateLines();
+    void testReplaceLines();
+    void testValidate();
+};
+
+
+} // edbee
+
+DECLARE_TEST(edbee::TextEditorTileCacheTest);
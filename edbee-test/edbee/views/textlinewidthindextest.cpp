@@ -0,0 +1,75 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textlinewidthindextest.h"
+
+#include "edbee/views/textlinewidthindex.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Tests the maximum width when line widths are changed
+void TextLineWidthIndexTest::testMaxWidth()
+{
+    TextLineWidthIndex index;
+    testEqual( index.lineCount(), 0 );
+    testEqual( index.maxWidth(), 0 );
+
+    index.replaceLines( 0, 0, 4 );
+    testEqual( index.lineCount(), 4 );
+    testEqual( index.maxWidth(), 0 );
+
+    index.setLineWidth( 0, 10 );
+    index.setLineWidth( 1, 30 );
+    index.setLineWidth( 2, 30 );
+    index.setLineWidth( 3, 20 );
+    testEqual( index.maxWidth(), 30 );
+    testEqual( index.lineWidth(3), 20 );
+
+    // one of the widest lines shrinks
+    index.setLineWidth( 1, 5 );
+    testEqual( index.maxWidth(), 30 );
+
+    // the last widest line shrinks
+    index.setLineWidth( 2, 15 );
+    testEqual( index.maxWidth(), 20 );
+
+    index.clear();
+    testEqual( index.lineCount(), 0 );
+    testEqual( index.maxWidth(), 0 );
+}
+
+
+/// Tests inserting and removing lines
+void TextLineWidthIndexTest::testReplaceLines()
+{
+    TextLineWidthIndex index;
+    index.replaceLines( 0, 0, 5 );
+    for( int i=0; i<5; ++i ) { index.setLineWidth( i, (i+1)*10 ); }
+    testEqual( index.maxWidth(), 50 );
+
+    // insert 2 lines after the first line
+    index.replaceLines( 1, 0, 2 );
+    testEqual( index.lineCount(), 7 );
+    testEqual( index.lineWidth(0), 10 );
+    testEqual( index.lineWidth(1), 0 );
+    testEqual( index.lineWidth(2), 0 );
+    testEqual( index.lineWidth(3), 20 );
+    testEqual( index.lineWidth(6), 50 );
+    index.setLineWidth( 2, 100 );
+    testEqual( index.maxWidth(), 100 );
+
+    // remove the widest lines
+    index.replaceLines( 2, 5, 1 );
+    testEqual( index.lineCount(), 3 );
+    testEqual( index.lineWidth(1), 0 );
+    testEqual( index.lineWidth(2), 0 );
+    testEqual( index.maxWidth(), 10 );
+}
+
+
+} // edbee
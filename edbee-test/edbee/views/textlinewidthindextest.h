@@ -0,0 +1,27 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "util/test.h"
+
+namespace edbee {
+
+
+/// Tests the line width index
+class TextLineWidthIndexTest : public edbee::test::TestCase
+{
+    Q_OBJECT
+
+private slots:
+
+    void testMaxWidth();
+    void testReplaceLines();
+};
+
+
+} // edbee
+
+DECLARE_TEST(edbee::TextLineWidthIndexTest);
@@ -0,0 +1,255 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#include "textrenderertest.h"
+
+#include <QFont>
+#include <QFontDatabase>
+#include <QTextLayout>
+
+#include "edbee/models/textdocument.h"
+#include "edbee/models/textdocumentscopes.h"
+#include "edbee/views/textrenderer.h"
+#include "edbee/views/texttheme.h"
+#include "edbee/texteditorcontroller.h"
+#include "edbee/texteditorwidget.h"
+#include "edbee/edbee.h"
+
+#include "debug.h"
+
+namespace edbee {
+
+
+/// Inserting lines moves the layouts of the lines below the change
+void TextRendererTest::testLayoutCacheLineInsert()
+{
+    QList<QTextLayout*> layouts;
+    for( int line=0; line<20; ++line ) { layouts.append( renderer()->textLayoutForLine(line) ); }
+
+    // insert a new line in front of line 8
+    doc()->replace( doc()->offsetFromLine(8), 0, "new\n" );
+    testEqual( doc()->lineCount(), 21 );
+
+    for( int line=0; line<8; ++line ) {
+        testTrue( renderer()->textLayoutForLine(line) == layouts.at(line) );
+    }
+    for( int line=9; line<20; ++line ) {
+        testTrue( renderer()->textLayoutForLine(line+1) == layouts.at(line) );
+    }
+    for( int line=0; line<21; ++line ) {
+        testEqual( renderer()->textLayoutForLine(line)->text(), doc()->lineWithoutNewline(line) );
+    }
+}
+
+
+/// Removing lines moves the layouts of the lines below the change
+void TextRendererTest::testLayoutCacheLineRemove()
+{
+    QList<QTextLayout*> layouts;
+    for( int line=0; line<20; ++line ) { layouts.append( renderer()->textLayoutForLine(line) ); }
+
+    // remove line 3 and 4
+    doc()->replace( doc()->offsetFromLine(3), doc()->offsetFromLine(5) - doc()->offsetFromLine(3), "" );
+    testEqual( doc()->lineCount(), 18 );
+
+    for( int line=0; line<3; ++line ) {
+        testTrue( renderer()->textLayoutForLine(line) == layouts.at(line) );
+    }
+    for( int line=6; line<20; ++line ) {
+        testTrue( renderer()->textLayoutForLine(line-2) == layouts.at(line) );
+    }
+    for( int line=0; line<18; ++line ) {
+        testEqual( renderer()->textLayoutForLine(line)->text(), doc()->lineWithoutNewline(line) );
+    }
+}
+
+
+/// Changing a line only invalidates the layout of that line
+void TextRendererTest::testLayoutCacheLineChange()
+{
+    QList<QTextLayout*> layouts;
+    for( int line=0; line<20; ++line ) { layouts.append( renderer()->textLayoutForLine(line) ); }
+
+    doc()->replace( doc()->offsetFromLine(10), 4, "LINE" );
+    for( int line=0; line<20; ++line ) {
+        if( line != 10 ) { testTrue( renderer()->textLayoutForLine(line) == layouts.at(line) ); }
+        testEqual( renderer()->textLayoutForLine(line)->text(), doc()->lineWithoutNewline(line) );
+    }
+    testEqual( renderer()->textLayoutForLine(10)->text(), QString("LINE 10") );
+}
+
+
+/// A layout is only rebuilt when the formats of the scopes of the line are changed
+void TextRendererTest::testLayoutCacheScopes()
+{
+    TextScopeManager* sm = Edbee::instance()->scopeManager();
+    TextScope* source = sm->refTextScope("source.renderertest");
+    TextScope* comment = sm->refTextScope("comment.renderertest");
+
+    TextTheme theme;
+    theme.giveThemeRule( new TextThemeRule( "comment", "comment", QColor(Qt::green) ) );
+    renderer()->setTheme( &theme );
+    testEqual( renderer()->textLayoutForLine(2)->additionalFormats().size(), 0 );
+
+    // scoping the line changes the formats
+    ScopedTextRangeList* list = new ScopedTextRangeList( doc()->scopes()->scopedRangePool() );
+    list->addRange( 0, 6, source );
+    list->addRange( 0, 4, comment );
+    doc()->scopes()->giveLineScopedRangeList( 2, list );
+    QTextLayout* layout = renderer()->textLayoutForLine(2);
+    testEqual( layout->additionalFormats().size(), 1 );
+
+    // relexing the line with the same result keeps the layout
+    list = new ScopedTextRangeList( doc()->scopes()->scopedRangePool() );
+    list->addRange( 0, 6, source );
+    list->addRange( 0, 4, comment );
+    doc()->scopes()->giveLineScopedRangeList( 2, list );
+    testTrue( renderer()->textLayoutForLine(2) == layout );
+
+    // other scopes change the layout
+    list = new ScopedTextRangeList( doc()->scopes()->scopedRangePool() );
+    list->addRange( 0, 6, source );
+    list->addRange( 2, 4, comment );
+    doc()->scopes()->giveLineScopedRangeList( 2, list );
+    layout = renderer()->textLayoutForLine(2);
+    testEqual( layout->additionalFormats().size(), 1 );
+    testEqual( layout->additionalFormats().at(0).start, 2 );
+
+    renderer()->setTheme(0);
+}
+
+
+/// Tests the cache of the line format ranges in the theme (keyed on the id of the scoped range list of the line)
+void TextRendererTest::testLineFormatRangeCache()
+{
+    TextScopeManager* sm = Edbee::instance()->scopeManager();
+    TextScope* source = sm->refTextScope("source.cachetest");
+    TextScope* comment = sm->refTextScope("comment.cachetest");
+
+    TextTheme theme;
+    theme.giveThemeRule( new TextThemeRule( "comment", "comment", QColor(Qt::green) ) );
+    doc()->setText("a comment");
+    renderer()->setTheme( &theme );
+
+    ScopedTextRangeList* list = new ScopedTextRangeList( doc()->scopes()->scopedRangePool() );
+    list->addRange( 0, 9, source );
+    list->addRange( 2, 9, comment );
+    qint64 listId = list->id();
+    doc()->scopes()->giveLineScopedRangeList( 0, list );
+
+    QList<QTextLayout::FormatRange> ranges = renderer()->themeStyler()->getLineFormatRanges( 0 );
+    testEqual( ranges.size(), 1 );
+    testEqual( ranges.at(0).start, 2 );
+    testEqual( ranges.at(0).length, 7 );
+    testEqual( theme.lineFormatCacheSize(), 1 );
+    testTrue( theme.findLineFormatRanges( listId ) != 0 );
+
+    // the cached ranges are used the second time
+    ranges = renderer()->themeStyler()->getLineFormatRanges( 0 );
+    testEqual( ranges.size(), 1 );
+    testEqual( theme.lineFormatCacheSize(), 1 );
+
+    // a relexed line gets a new list (with a new id)
+    list = new ScopedTextRangeList( doc()->scopes()->scopedRangePool() );
+    list->addRange( 0, 9, source );
+    list->addRange( 0, 1, comment );
+    testTrue( list->id() > listId );
+    doc()->scopes()->giveLineScopedRangeList( 0, list );
+
+    ranges = renderer()->themeStyler()->getLineFormatRanges( 0 );
+    testEqual( ranges.size(), 1 );
+    testEqual( ranges.at(0).start, 0 );
+    testEqual( ranges.at(0).length, 1 );
+    testEqual( theme.lineFormatCacheSize(), 2 );
+
+    // changing the rules clears the cache
+    theme.giveThemeRule( new TextThemeRule( "source", "source", QColor(Qt::red) ) );
+    testEqual( theme.lineFormatCacheSize(), 0 );
+
+    renderer()->setTheme(0);
+}
+
+
+/// The fixed pitch fast path should give the same positions as the text layouts
+void TextRendererTest::testFixedPitchGeometry()
+{
+    widget_->setFont( QFontDatabase::systemFont( QFontDatabase::FixedFont ) );
+    renderer()->invalidateCaches();
+    testTrue( renderer()->fixedPitchCharWidth() > 0 );     // (else the fast path isn't tested)
+
+    QString text = QString("int main()\n\tif( a ) {\n\t\treturn 1;\t// one\n  trailing  \n\nmixed \t tabs\t\nunicode ")
+        + QChar(0xe9) + QChar(0x4e2d) + QString("\n      \tx");
+    doc()->setText( text );
+
+    for( int line=0, cnt=doc()->lineCount(); line<cnt; ++line ) {
+        QTextLine textLine = renderer()->textLayoutForLine(line)->lineAt(0);
+        int length = doc()->lineLengthWithoutNewline(line);
+        for( int column=0; column <= length+1; ++column ) {
+            int x = 0;
+            x += textLine.cursorToX( column );
+            testEqual( renderer()->xPosForColumn( line, column ), x );
+        }
+        int width = renderer()->xPosForColumn( line, length );
+        for( int x=-5; x<width+20; ++x ) {
+            testEqual( renderer()->columnIndexForXpos( line, x ), textLine.xToCursor( x ) );
+        }
+    }
+}
+
+
+/// The total width is the width of the widest line, also when lines are inserted and removed
+void TextRendererTest::testTotalWidth()
+{
+    renderer()->totalWidth();
+
+    // after laying out all lines, all widths are real widths
+    int maxWidth = 0;
+    for( int line=0, cnt=doc()->lineCount(); line<cnt; ++line ) {
+        maxWidth = qMax( maxWidth, qRound( renderer()->textLayoutForLine(line)->boundingRect().width()+0.5 ) );
+    }
+    testEqual( renderer()->totalWidth(), maxWidth );
+
+    // insert a long line
+    doc()->replace( doc()->offsetFromLine(5), 0, QString("x").repeated(200).append("\n") );
+    int longWidth = qRound( renderer()->textLayoutForLine(5)->boundingRect().width()+0.5 );
+    testTrue( longWidth > maxWidth );
+    testEqual( renderer()->totalWidth(), longWidth );
+
+    // the cache invalidation (done at every full update) keeps the widths
+    renderer()->invalidateCaches();
+    testEqual( renderer()->totalWidth(), longWidth );
+
+    // remove it again (the lines are layed out again, to replace the estimated widths)
+    doc()->replace( doc()->offsetFromLine(5), doc()->lineLength(5), "" );
+    for( int line=0, cnt=doc()->lineCount(); line<cnt; ++line ) { renderer()->textLayoutForLine(line); }
+    testEqual( renderer()->totalWidth(), maxWidth );
+}
+
+
+/// The layed out lines get their measured width, also when the widths are estimated after the layout is created
+void TextRendererTest::testMeasuredLineWidths()
+{
+    widget_->setFont( QFontDatabase::systemFont( QFontDatabase::GeneralFont ) );
+    renderer()->invalidateCaches();
+    doc()->setText( QString("i").repeated(100).append("\nab\n").append( QString("l").repeated(80) ) );
+
+    // the layouts are created before the width index (the em-width estimate of narrow characters is too wide)
+    int maxWidth = 0;
+    for( int line=0, cnt=doc()->lineCount(); line<cnt; ++line ) {
+        maxWidth = qMax( maxWidth, qRound( renderer()->textLayoutForLine(line)->boundingRect().width()+0.5 ) );
+    }
+    testEqual( renderer()->totalWidth(), maxWidth );
+
+    // a changed line is measured when its layout is created again
+    doc()->replace( 0, 50, "" );
+    maxWidth = 0;
+    for( int line=0, cnt=doc()->lineCount(); line<cnt; ++line ) {
+        maxWidth = qMax( maxWidth, qRound( renderer()->textLayoutForLine(line)->boundingRect().width()+0.5 ) );
+    }
+    testEqual( renderer()->totalWidth(), maxWidth );
+}
+
+
+} // edbee
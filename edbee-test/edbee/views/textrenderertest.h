@@ -0,0 +1,33 @@
+/**
+ * Copyright 2011-2013 - Reliable Bits Software by Blommers IT. All Rights Reserved.
+ * Author Rick Blommers
+ */
+
+#pragma once
+
+#include "edbee/texteditorwidgettestcase.h"
+
+namespace edbee {
+
+
+/// Tests the text renderer
+class TextRendererTest : public TextEditorWidgetTestCase
+{
+    Q_OBJECT
+
+private slots:
+
+    void testLayoutCacheLineInsert();
+    void testLayoutCacheLineRemove();
+    void testLayoutCacheLineChange();
+    void testLayoutCacheScopes();
+    void testLineFormatRangeCache();
+    void testFixedPitchGeometry();
+    void testTotalWidth();
+    void testMeasuredLineWidths();
+};
+
+
+} // edbee
+
+DECLARE_TEST(edbee::TextRendererTest);